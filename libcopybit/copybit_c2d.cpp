@@ -112,6 +112,15 @@ C2D_STATUS (*LINK_c2dFillSurface) ( uint32 surface_id, uint32 fill_color,
 #define MAX_SURFACES (MAX_RGB_SURFACES + MAX_YUV_2_PLANE_SURFACES + MAX_YUV_3_PLANE_SURFACES + 1)
 #define NUM_SURFACE_TYPES 3      // RGB_SURFACE + YUV_SURFACE_2_PLANES + YUV_SURFACE_3_PLANES
 #define MAX_BLIT_OBJECT_COUNT 50 // Max. blit objects that can be passed per draw
+#define MAX_PENDING_FRAMES 3     // Max. flushed frames the engine can be working on
+// One set of surfaces for each frame in flight plus the one being built, so
+// that a new frame never updates a surface the engine may still be reading.
+#define NUM_SURFACE_SETS (MAX_PENDING_FRAMES + 1)
+// Destinations wider than this are drawn in horizontal bands of
+// C2D_TILE_HEIGHT lines, one c2dDraw per band, so that the engine can start
+// on a band while the driver is still setting up the next one.
+#define C2D_TILE_MIN_WIDTH  2048
+#define C2D_TILE_HEIGHT     256
 
 enum {
     RGB_SURFACE,
@@ -130,45 +139,78 @@ enum eC2DFlags {
     FLAGS_TEMP_SRC_DST         = 1<<2
 };
 
+// Debug logging of the frame pipeline
+#define DEBUG_C2D_PENDING 0
+
+// The C2D driver library. The tests build copybit against a stub driver.
+#ifndef C2D_LIBRARY
+#define C2D_LIBRARY "libC2D2.so"
+#endif
+
 static gralloc::IAllocController* sAlloc = 0;
 /******************************************************************************/
 
-/** State information for each device instance */
-struct copybit_context_t {
-    struct copybit_device_t device;
+/** A flushed frame that the C2D engine has not retired yet */
+struct c2d_pending_frame {
+    void* time_stamp;
+    unsigned int mapped_gpu_addr[MAX_SURFACES]; // unmapped once retired
+};
+
+/** The C2D surfaces and temp buffers a frame is built with. A set stays
+ * with its frame until the engine retires it. */
+struct c2d_surface_set {
     // Templates for the various source surfaces. These templates are created
     // to avoid the expensive create/destroy C2D Surfaces
     C2D_OBJECT_STR blit_rgb_object[MAX_RGB_SURFACES];
     C2D_OBJECT_STR blit_yuv_2_plane_object[MAX_YUV_2_PLANE_SURFACES];
     C2D_OBJECT_STR blit_yuv_3_plane_object[MAX_YUV_3_PLANE_SURFACES];
+    unsigned int dst[NUM_SURFACE_TYPES]; // dst surfaces
+    alloc_data temp_src_buffer;
+    alloc_data temp_dst_buffer;
+    // Handles describing the temp buffers. These are created once at open
+    // so that the blit path does not allocate on every call.
+    private_handle_t* temp_src_hnd;
+    private_handle_t* temp_dst_hnd;
+};
+
+/** State information for each device instance */
+struct copybit_context_t {
+    struct copybit_device_t device;
+    c2d_surface_set sets[NUM_SURFACE_SETS];
+    c2d_surface_set* set;       // set of the frame being built
+    int set_index;
     C2D_OBJECT_STR blit_list[MAX_BLIT_OBJECT_COUNT]; // Z-ordered list of blit objects
     C2D_DRIVER_INFO c2d_driver_info;
     void *libc2d2;
-    alloc_data temp_src_buffer;
-    alloc_data temp_dst_buffer;
-    unsigned int dst[NUM_SURFACE_TYPES]; // dst surfaces
     unsigned int mapped_gpu_addr[MAX_SURFACES]; // GPU addresses mapped inside copybit
     int blit_rgb_count;         // Total RGB surfaces being blit
     int blit_yuv_2_plane_count; // Total 2 plane YUV surfaces being
     int blit_yuv_3_plane_count; // Total 3 plane YUV  surfaces being blit
     int blit_count;             // Total blit objects.
     unsigned int trg_transform;      /* target transform */
+    int transform;              /* COPYBIT_TRANSFORM_* of the current blit */
     int fb_width;
     int fb_height;
     int src_global_alpha;
     int config_mask;
     int dst_surface_type;
     bool is_premultiplied_alpha;
-    void* time_stamp;
     bool dst_surface_mapped; // Set when dst surface is mapped to GPU addr
     void* dst_surface_base; // Stores the dst surface addr
+    int dst_width;  // Dimensions of the mapped dst surface
+    int dst_height;
 
-    // used for signaling the wait thread
-    bool wait_timestamp;
+    // Serializes the copybit calls that build up the current frame
+    pthread_mutex_t wait_cleanup_lock;
+
+    // Queue of flushed frames, retired in order by the wait thread
+    c2d_pending_frame pending[MAX_PENDING_FRAMES];
+    int pending_head;   // oldest frame in flight
+    int pending_count;
     pthread_t wait_thread_id;
     bool stop_thread;
-    pthread_mutex_t wait_cleanup_lock;
-    pthread_cond_t wait_cleanup_cond;
+    pthread_mutex_t pending_lock;
+    pthread_cond_t pending_cond;
 
 };
 
@@ -213,47 +255,84 @@ tag: HARDWARE_MODULE_TAG,
 };
 
 
-/* thread function which waits on the timeStamp and cleans up the surfaces */
+static void unmap_gpuaddr_list(unsigned int *mapped_gpu_addr)
+{
+    for (int i = 0; i < MAX_SURFACES; i++) {
+        if (mapped_gpu_addr[i]) {
+            LINK_c2dUnMapAddr( (void*)mapped_gpu_addr[i]);
+            mapped_gpu_addr[i] = 0;
+        }
+    }
+}
+
+/* thread function which waits on the pending timeStamps in order and cleans
+ * up the surfaces of each frame once it is retired */
 static void* c2d_wait_loop(void* ptr) {
     copybit_context_t* ctx = (copybit_context_t*)(ptr);
     char thread_name[64] = "copybitWaitThr";
     prctl(PR_SET_NAME, (unsigned long) &thread_name, 0, 0, 0);
     setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY);
 
-    while(ctx->stop_thread == false) {
-        pthread_mutex_lock(&ctx->wait_cleanup_lock);
-        while(ctx->wait_timestamp == false && !ctx->stop_thread) {
-            pthread_cond_wait(&(ctx->wait_cleanup_cond),
-                              &(ctx->wait_cleanup_lock));
+    pthread_mutex_lock(&ctx->pending_lock);
+    while(true) {
+        while(ctx->pending_count == 0 && !ctx->stop_thread) {
+            pthread_cond_wait(&(ctx->pending_cond), &(ctx->pending_lock));
         }
-        if(ctx->wait_timestamp) {
-            if(LINK_c2dWaitTimestamp(ctx->time_stamp)) {
-                ALOGE("%s: LINK_c2dWaitTimeStamp ERROR!!", __FUNCTION__);
-            }
-            ctx->wait_timestamp = false;
-            // Unmap any mapped addresses.
-            for (int i = 0; i < MAX_SURFACES; i++) {
-                if (ctx->mapped_gpu_addr[i]) {
-                    LINK_c2dUnMapAddr( (void*)ctx->mapped_gpu_addr[i]);
-                    ctx->mapped_gpu_addr[i] = 0;
-                }
-            }
-            // Reset the counts after the draw.
-            ctx->blit_rgb_count = 0;
-            ctx->blit_yuv_2_plane_count = 0;
-            ctx->blit_yuv_3_plane_count = 0;
-            ctx->blit_count = 0;
-            ctx->dst_surface_mapped = false;
-            ctx->dst_surface_base = 0;
-        }
-        pthread_mutex_unlock(&ctx->wait_cleanup_lock);
-        if(ctx->stop_thread)
+        // Frames still in flight are retired before exiting
+        if(ctx->pending_count == 0)
             break;
+
+        c2d_pending_frame *frame = &ctx->pending[ctx->pending_head];
+        // The frame is owned by this thread until it is retired, so new
+        // frames can be queued while waiting.
+        pthread_mutex_unlock(&ctx->pending_lock);
+        if(LINK_c2dWaitTimestamp(frame->time_stamp)) {
+            ALOGE("%s: LINK_c2dWaitTimeStamp ERROR!!", __FUNCTION__);
+        }
+        unmap_gpuaddr_list(frame->mapped_gpu_addr);
+        pthread_mutex_lock(&ctx->pending_lock);
+
+        ctx->pending_head = (ctx->pending_head + 1) % MAX_PENDING_FRAMES;
+        ctx->pending_count--;
+        pthread_cond_broadcast(&ctx->pending_cond);
     }
+    pthread_mutex_unlock(&ctx->pending_lock);
     pthread_exit(NULL);
     return NULL;
 }
 
+/* Hands the current frame over to the wait thread, blocking if the engine
+ * already has MAX_PENDING_FRAMES frames in flight. The blit state is reset
+ * and the next frame is built with the next surface set, which no frame in
+ * flight can be using. */
+static void queue_pending_frame(copybit_context_t* ctx, void* time_stamp)
+{
+    pthread_mutex_lock(&ctx->pending_lock);
+    while(ctx->pending_count == MAX_PENDING_FRAMES) {
+        ALOGD_IF(DEBUG_C2D_PENDING, "%s: waiting for a frame to retire",
+                 __FUNCTION__);
+        pthread_cond_wait(&(ctx->pending_cond), &(ctx->pending_lock));
+    }
+    int index = (ctx->pending_head + ctx->pending_count) % MAX_PENDING_FRAMES;
+    c2d_pending_frame *frame = &ctx->pending[index];
+    frame->time_stamp = time_stamp;
+    memcpy(frame->mapped_gpu_addr, ctx->mapped_gpu_addr,
+           sizeof(ctx->mapped_gpu_addr));
+    ctx->pending_count++;
+    pthread_cond_broadcast(&ctx->pending_cond);
+    pthread_mutex_unlock(&ctx->pending_lock);
+
+    memset(ctx->mapped_gpu_addr, 0, sizeof(ctx->mapped_gpu_addr));
+    ctx->blit_rgb_count = 0;
+    ctx->blit_yuv_2_plane_count = 0;
+    ctx->blit_yuv_3_plane_count = 0;
+    ctx->blit_count = 0;
+    ctx->dst_surface_mapped = false;
+    ctx->dst_surface_base = 0;
+    ctx->set_index = (ctx->set_index + 1) % NUM_SURFACE_SETS;
+    ctx->set = &ctx->sets[ctx->set_index];
+}
+
 
 /* convert COPYBIT_FORMAT to C2D format */
 static int get_format(int format) {
@@ -599,6 +678,55 @@ static int set_image(copybit_context_t* ctx, uint32 surfaceId,
     return status;
 }
 
+/* Tiling is only done for unrotated targets, since the scissor of the
+ * blit objects is not in the same space as the target surface otherwise.
+ */
+static bool can_tile_draw(struct copybit_context_t *ctx)
+{
+    if (ctx->dst_width <= C2D_TILE_MIN_WIDTH ||
+        ctx->trg_transform != C2D_TARGET_ROTATE_0)
+        return false;
+
+    for (int i = 0; i < ctx->blit_count; i++) {
+        if (ctx->blit_list[i].config_mask & C2D_OVERRIDE_TARGET_ROTATE_270)
+            return false;
+    }
+    return true;
+}
+
+static bool band_has_objects(struct copybit_context_t *ctx, int top,
+                             int bottom)
+{
+    for (int i = 0; i < ctx->blit_count; i++) {
+        const C2D_RECT& clip = ctx->blit_list[i].scissor_rect;
+        if (clip.y < bottom && (clip.y + clip.height) > top)
+            return true;
+    }
+    return false;
+}
+
+/** draw the blit list one horizontal band of the target at a time */
+static int msm_copybit_tiled(struct copybit_context_t *ctx,
+                             unsigned int target, uint32_t target_transform)
+{
+    for (int top = 0; top < ctx->dst_height; top += C2D_TILE_HEIGHT) {
+        int bottom = top + C2D_TILE_HEIGHT;
+        if (bottom > ctx->dst_height)
+            bottom = ctx->dst_height;
+        if (!band_has_objects(ctx, top, bottom))
+            continue;
+
+        C2D_RECT band = {0, top, ctx->dst_width, bottom - top};
+        if(LINK_c2dDraw(target, target_transform, &band, 0, 0,
+                        ctx->blit_list, ctx->blit_count)) {
+            ALOGE("%s: LINK_c2dDraw ERROR band %d-%d", __FUNCTION__,
+                                                       top, bottom);
+            return COPYBIT_FAILURE;
+        }
+    }
+    return COPYBIT_SUCCESS;
+}
+
 /** copy the bits */
 static int msm_copybit(struct copybit_context_t *ctx, unsigned int target)
 {
@@ -617,6 +745,9 @@ static int msm_copybit(struct copybit_context_t *ctx, unsigned int target)
         // For A3xx - set 0x0 as the transform is set in the config_mask
         target_transform = 0x0;
     }
+    if (can_tile_draw(ctx)) {
+        return msm_copybit_tiled(ctx, target, target_transform);
+    }
     if(LINK_c2dDraw(target, target_transform, 0x0, 0, 0, ctx->blit_list,
                     ctx->blit_count)) {
         ALOGE("%s: LINK_c2dDraw ERROR", __FUNCTION__);
@@ -633,25 +764,24 @@ static int flush_get_fence_copybit (struct copybit_device_t *dev, int* fd)
     int status = COPYBIT_FAILURE;
     if (!ctx)
         return COPYBIT_FAILURE;
+    void* time_stamp = NULL;
     pthread_mutex_lock(&ctx->wait_cleanup_lock);
-    status = msm_copybit(ctx, ctx->dst[ctx->dst_surface_type]);
+    status = msm_copybit(ctx, ctx->set->dst[ctx->dst_surface_type]);
 
-    if(LINK_c2dFlush(ctx->dst[ctx->dst_surface_type], &ctx->time_stamp)) {
+    if(LINK_c2dFlush(ctx->set->dst[ctx->dst_surface_type], &time_stamp)) {
         ALOGE("%s: LINK_c2dFlush ERROR", __FUNCTION__);
         // unlock the mutex and return failure
         pthread_mutex_unlock(&ctx->wait_cleanup_lock);
         return COPYBIT_FAILURE;
     }
-    if(LINK_c2dCreateFenceFD(ctx->dst[ctx->dst_surface_type], ctx->time_stamp,
+    if(LINK_c2dCreateFenceFD(ctx->set->dst[ctx->dst_surface_type], time_stamp,
                                                                         fd)) {
         ALOGE("%s: LINK_c2dCreateFenceFD ERROR", __FUNCTION__);
         status = COPYBIT_FAILURE;
     }
-    if(status == COPYBIT_SUCCESS) {
-        //signal the wait_thread
-        ctx->wait_timestamp = true;
-        pthread_cond_signal(&ctx->wait_cleanup_cond);
-    }
+    // The flushed work is tracked by its timestamp even if the fence could
+    // not be created, so its surfaces are unmapped once it completes.
+    queue_pending_frame(ctx, time_stamp);
     pthread_mutex_unlock(&ctx->wait_cleanup_lock);
     return status;
 }
@@ -662,20 +792,15 @@ static int finish_copybit(struct copybit_device_t *dev)
     if (!ctx)
         return COPYBIT_FAILURE;
 
-   int status = msm_copybit(ctx, ctx->dst[ctx->dst_surface_type]);
+   int status = msm_copybit(ctx, ctx->set->dst[ctx->dst_surface_type]);
 
-   if(LINK_c2dFinish(ctx->dst[ctx->dst_surface_type])) {
+   if(LINK_c2dFinish(ctx->set->dst[ctx->dst_surface_type])) {
         ALOGE("%s: LINK_c2dFinish ERROR", __FUNCTION__);
         return COPYBIT_FAILURE;
     }
 
     // Unmap any mapped addresses.
-    for (int i = 0; i < MAX_SURFACES; i++) {
-        if (ctx->mapped_gpu_addr[i]) {
-            LINK_c2dUnMapAddr( (void*)ctx->mapped_gpu_addr[i]);
-            ctx->mapped_gpu_addr[i] = 0;
-        }
-    }
+    unmap_gpuaddr_list(ctx->mapped_gpu_addr);
 
     // Reset the counts after the draw.
     ctx->blit_rgb_count = 0;
@@ -699,7 +824,7 @@ static int clear_copybit(struct copybit_device_t *dev,
     C2D_RECT c2drect = {rect->l, rect->t, rect->r - rect->l, rect->b - rect->t};
     pthread_mutex_lock(&ctx->wait_cleanup_lock);
     if(!ctx->dst_surface_mapped) {
-        ret = set_image(ctx, ctx->dst[RGB_SURFACE], buf,
+        ret = set_image(ctx, ctx->set->dst[RGB_SURFACE], buf,
                         (eC2DFlags)flags, mapped_dst_idx);
         if(ret) {
             ALOGE("%s: set_image error", __FUNCTION__);
@@ -711,7 +836,9 @@ static int clear_copybit(struct copybit_device_t *dev,
         //with the dest surface, hence set dst_surface_mapped.
         ctx->dst_surface_mapped = true;
         ctx->dst_surface_base = buf->base;
-        ret = LINK_c2dFillSurface(ctx->dst[RGB_SURFACE], 0x0, &c2drect);
+        ctx->dst_width = buf->w;
+        ctx->dst_height = buf->h;
+        ret = LINK_c2dFillSurface(ctx->set->dst[RGB_SURFACE], 0x0, &c2drect);
     }
     pthread_mutex_unlock(&ctx->wait_cleanup_lock);
     return ret;
@@ -845,6 +972,7 @@ static int set_parameter_copybit(
                 finish_copybit(dev);
             }
             ctx->trg_transform = transform;
+            ctx->transform = value;
         }
         break;
         case COPYBIT_FRAMEBUFFER_WIDTH:
@@ -1059,12 +1187,49 @@ static int copy_image(private_handle_t *src_handle,
     return ret;
 }
 
-static void delete_handle(private_handle_t *handle)
+/* Point a preallocated handle at a temporary buffer */
+static void set_temp_handle(private_handle_t *handle, const alloc_data &data,
+                            const bufferInfo &info)
 {
-    if (handle) {
-        delete handle;
-        handle = 0;
+    handle->fd = data.fd;
+    handle->size = data.size;
+    handle->flags = data.allocType;
+    handle->base = (int)(data.base);
+    handle->offset = data.offset;
+    handle->gpuaddr = 0;
+    handle->format = info.format;
+    handle->width = info.width;
+    handle->height = info.height;
+}
+
+/* Returns the number of free source templates for the given surface type */
+static int get_free_src_templates(struct copybit_context_t *ctx,
+                                  int surface_type)
+{
+    switch(surface_type) {
+        case RGB_SURFACE:
+            return MAX_RGB_SURFACES - ctx->blit_rgb_count;
+        case YUV_SURFACE_2_PLANES:
+            return MAX_YUV_2_PLANE_SURFACES - ctx->blit_yuv_2_plane_count;
+        case YUV_SURFACE_3_PLANES:
+            return MAX_YUV_3_PLANE_SURFACES - ctx->blit_yuv_3_plane_count;
+        default:
+            return 0;
+    }
+}
+
+static int get_src_surface_type(int format)
+{
+    if (is_supported_rgb_format(format) == COPYBIT_SUCCESS)
+        return RGB_SURFACE;
+    if (is_supported_yuv_format(format) == COPYBIT_SUCCESS) {
+        int num_planes = get_num_planes(format);
+        if (num_planes == 2)
+            return YUV_SURFACE_2_PLANES;
+        if (num_planes == 3)
+            return YUV_SURFACE_3_PLANES;
     }
+    return -EINVAL;
 }
 
 static bool need_to_execute_draw(struct copybit_context_t* ctx,
@@ -1079,6 +1244,60 @@ static bool need_to_execute_draw(struct copybit_context_t* ctx,
     return false;
 }
 
+/* Blit a source that C2D cannot fetch by converting it on the CPU straight
+ * into the destination.
+ */
+static int stretch_copybit_sw(
+    struct copybit_device_t *dev,
+    struct copybit_image_t const *dst,
+    struct copybit_image_t const *src,
+    struct copybit_rect_t const *dst_rect,
+    struct copybit_rect_t const *src_rect,
+    struct copybit_region_t const *region,
+    bool enableBlend)
+{
+    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
+    int status = COPYBIT_SUCCESS;
+
+    if (enableBlend && (ctx->config_mask & C2D_GLOBAL_ALPHA_BIT)) {
+        ALOGE("%s: plane alpha is not supported for format 0x%x",
+              __FUNCTION__, src->format);
+        return COPYBIT_FAILURE;
+    }
+
+    // Anything queued for the destination has to land before the CPU
+    // writes to it.
+    finish_copybit(dev);
+
+    struct copybit_rect_t clip;
+    while ((status == COPYBIT_SUCCESS) && region->next(region, &clip)) {
+        status = convert_yuv_to_rgb(dst, src, dst_rect, src_rect, &clip,
+                                    ctx->transform);
+    }
+
+    if (status == COPYBIT_SUCCESS) {
+        private_handle_t *dst_hnd = (private_handle_t *)dst->handle;
+        if (sAlloc == 0) {
+            sAlloc = gralloc::IAllocController::getInstance();
+        }
+        IMemAlloc* memalloc = sAlloc->getAllocator(dst_hnd->flags);
+        if (memalloc->clean_buffer((void *)(dst_hnd->base), dst_hnd->size,
+                                   dst_hnd->offset, dst_hnd->fd,
+                                   gralloc::CACHE_CLEAN)) {
+            ALOGE("%s: clean_buffer failed", __FUNCTION__);
+            status = COPYBIT_FAILURE;
+        }
+    } else {
+        ALOGE("%s: convert_yuv_to_rgb failed", __FUNCTION__);
+    }
+
+    ctx->is_premultiplied_alpha = false;
+    ctx->fb_width = 0;
+    ctx->fb_height = 0;
+    ctx->config_mask = 0;
+    return status;
+}
+
 /** do a stretch blit type operation */
 static int stretch_copybit_internal(
     struct copybit_device_t *dev,
@@ -1118,6 +1337,12 @@ static int stretch_copybit_internal(
         return COPYBIT_FAILURE;
     }
 
+    if (is_supported_yuv_format(src->format) != COPYBIT_SUCCESS &&
+        is_yuv_to_rgb_supported(dst->format, src->format)) {
+        return stretch_copybit_sw(dev, dst, src, dst_rect, src_rect, region,
+                                  enableBlend);
+    }
+
     int dst_surface_type;
     if (is_supported_rgb_format(dst->format) == COPYBIT_SUCCESS) {
         dst_surface_type = RGB_SURFACE;
@@ -1140,13 +1365,19 @@ static int stretch_copybit_internal(
         return COPYBIT_FAILURE;
     }
 
-    if (ctx->blit_rgb_count == MAX_RGB_SURFACES ||
-        ctx->blit_yuv_2_plane_count == MAX_YUV_2_PLANE_SURFACES ||
-        ctx->blit_yuv_3_plane_count == MAX_YUV_2_PLANE_SURFACES ||
+    src_surface_type = get_src_surface_type(src->format);
+    if (src_surface_type < 0) {
+        ALOGE("%s: Invalid source surface format 0x%x", __FUNCTION__,
+                                                        src->format);
+        return -EINVAL;
+    }
+
+    if (get_free_src_templates(ctx, src_surface_type) == 0 ||
         ctx->blit_count == MAX_BLIT_OBJECT_COUNT ||
         ctx->dst_surface_type != dst_surface_type) {
-        // we have reached the max. limits of our internal structures or
-        // changed the target.
+        // we have run out of templates for this source type or changed the
+        // target. Templates of the other types are still free, so only
+        // those conditions force a draw.
         // Draw the remaining surfaces. We need to do the finish here since
         // we need to free up the surface templates.
         finish_copybit(dev);
@@ -1166,42 +1397,32 @@ static int stretch_copybit_internal(
     bool need_temp_dst = need_temp_buffer(dst);
     bufferInfo dst_info;
     populate_buffer_info(dst, dst_info);
-    private_handle_t* dst_hnd = new private_handle_t(-1, 0, 0, 0, dst_info.format,
-                                                     dst_info.width, dst_info.height);
-    if (dst_hnd == NULL) {
-        ALOGE("%s: dst_hnd is null", __FUNCTION__);
-        return COPYBIT_FAILURE;
-    }
+    private_handle_t* dst_hnd = ctx->set->temp_dst_hnd;
     if (need_temp_dst) {
-        if (get_size(dst_info) != ctx->temp_dst_buffer.size) {
-            free_temp_buffer(ctx->temp_dst_buffer);
+        if (get_size(dst_info) != ctx->set->temp_dst_buffer.size) {
+            free_temp_buffer(ctx->set->temp_dst_buffer);
             // Create a temp buffer and set that as the destination.
-            if (COPYBIT_FAILURE == get_temp_buffer(dst_info, ctx->temp_dst_buffer)) {
+            if (COPYBIT_FAILURE == get_temp_buffer(dst_info, ctx->set->temp_dst_buffer)) {
                 ALOGE("%s: get_temp_buffer(dst) failed", __FUNCTION__);
-                delete_handle(dst_hnd);
                 return COPYBIT_FAILURE;
             }
         }
-        dst_hnd->fd = ctx->temp_dst_buffer.fd;
-        dst_hnd->size = ctx->temp_dst_buffer.size;
-        dst_hnd->flags = ctx->temp_dst_buffer.allocType;
-        dst_hnd->base = (int)(ctx->temp_dst_buffer.base);
-        dst_hnd->offset = ctx->temp_dst_buffer.offset;
-        dst_hnd->gpuaddr = 0;
+        set_temp_handle(dst_hnd, ctx->set->temp_dst_buffer, dst_info);
         dst_image.handle = dst_hnd;
     }
     if(!ctx->dst_surface_mapped) {
         //map the destination surface to GPU address
-        status = set_image(ctx, ctx->dst[ctx->dst_surface_type], &dst_image,
+        status = set_image(ctx, ctx->set->dst[ctx->dst_surface_type], &dst_image,
                            (eC2DFlags)flags, mapped_dst_idx);
         if(status) {
             ALOGE("%s: dst: set_image error", __FUNCTION__);
-            delete_handle(dst_hnd);
             unmap_gpuaddr(ctx, mapped_dst_idx);
             return COPYBIT_FAILURE;
         }
         ctx->dst_surface_mapped = true;
         ctx->dst_surface_base = dst->base;
+        ctx->dst_width = dst->w;
+        ctx->dst_height = dst->h;
     } else if(ctx->dst_surface_mapped && ctx->dst_surface_base != dst->base) {
         // Destination surface for the operation should be same for multiple
         // requests, this check is catch if there is any case when the
@@ -1211,30 +1432,12 @@ static int stretch_copybit_internal(
 
     // Update the source
     flags = 0;
-    if(is_supported_rgb_format(src->format) == COPYBIT_SUCCESS) {
-        src_surface_type = RGB_SURFACE;
-        src_surface = ctx->blit_rgb_object[ctx->blit_rgb_count];
-    } else if (is_supported_yuv_format(src->format) == COPYBIT_SUCCESS) {
-        int num_planes = get_num_planes(src->format);
-        if (num_planes == 2) {
-            src_surface_type = YUV_SURFACE_2_PLANES;
-            src_surface = ctx->blit_yuv_2_plane_object[ctx->blit_yuv_2_plane_count];
-        } else if (num_planes == 3) {
-            src_surface_type = YUV_SURFACE_3_PLANES;
-            src_surface = ctx->blit_yuv_3_plane_object[ctx->blit_yuv_2_plane_count];
-        } else {
-            ALOGE("%s: src number of YUV planes is invalid src format = 0x%x",
-                  __FUNCTION__, src->format);
-            delete_handle(dst_hnd);
-            unmap_gpuaddr(ctx, mapped_dst_idx);
-            return -EINVAL;
-        }
+    if (src_surface_type == RGB_SURFACE) {
+        src_surface = ctx->set->blit_rgb_object[ctx->blit_rgb_count];
+    } else if (src_surface_type == YUV_SURFACE_2_PLANES) {
+        src_surface = ctx->set->blit_yuv_2_plane_object[ctx->blit_yuv_2_plane_count];
     } else {
-        ALOGE("%s: Invalid source surface format 0x%x", __FUNCTION__,
-                                                        src->format);
-        delete_handle(dst_hnd);
-        unmap_gpuaddr(ctx, mapped_dst_idx);
-        return -EINVAL;
+        src_surface = ctx->set->blit_yuv_3_plane_object[ctx->blit_yuv_3_plane_count];
     }
 
     copybit_image_t src_image;
@@ -1246,33 +1449,19 @@ static int stretch_copybit_internal(
     bool need_temp_src = need_temp_buffer(src);
     bufferInfo src_info;
     populate_buffer_info(src, src_info);
-    private_handle_t* src_hnd = new private_handle_t(-1, 0, 0, 0, src_info.format,
-                                                 src_info.width, src_info.height);
-    if (NULL == src_hnd) {
-        ALOGE("%s: src_hnd is null", __FUNCTION__);
-        delete_handle(dst_hnd);
-        unmap_gpuaddr(ctx, mapped_dst_idx);
-        return COPYBIT_FAILURE;
-    }
+    private_handle_t* src_hnd = ctx->set->temp_src_hnd;
     if (need_temp_src) {
-        if (get_size(src_info) != ctx->temp_src_buffer.size) {
-            free_temp_buffer(ctx->temp_src_buffer);
+        if (get_size(src_info) != ctx->set->temp_src_buffer.size) {
+            free_temp_buffer(ctx->set->temp_src_buffer);
             // Create a temp buffer and set that as the destination.
             if (COPYBIT_SUCCESS != get_temp_buffer(src_info,
-                                               ctx->temp_src_buffer)) {
+                                               ctx->set->temp_src_buffer)) {
                 ALOGE("%s: get_temp_buffer(src) failed", __FUNCTION__);
-                delete_handle(dst_hnd);
-                delete_handle(src_hnd);
                 unmap_gpuaddr(ctx, mapped_dst_idx);
                 return COPYBIT_FAILURE;
             }
         }
-        src_hnd->fd = ctx->temp_src_buffer.fd;
-        src_hnd->size = ctx->temp_src_buffer.size;
-        src_hnd->flags = ctx->temp_src_buffer.allocType;
-        src_hnd->base = (int)(ctx->temp_src_buffer.base);
-        src_hnd->offset = ctx->temp_src_buffer.offset;
-        src_hnd->gpuaddr = 0;
+        set_temp_handle(src_hnd, ctx->set->temp_src_buffer, src_info);
         src_image.handle = src_hnd;
 
         // Copy the source.
@@ -1280,8 +1469,6 @@ static int stretch_copybit_internal(
                                 CONVERT_TO_C2D_FORMAT);
         if (status == COPYBIT_FAILURE) {
             ALOGE("%s:copy_image failed in temp source",__FUNCTION__);
-            delete_handle(dst_hnd);
-            delete_handle(src_hnd);
             unmap_gpuaddr(ctx, mapped_dst_idx);
             return status;
         }
@@ -1292,8 +1479,6 @@ static int stretch_copybit_internal(
                                    src_hnd->offset, src_hnd->fd,
                                    gralloc::CACHE_CLEAN)) {
             ALOGE("%s: clean_buffer failed", __FUNCTION__);
-            delete_handle(dst_hnd);
-            delete_handle(src_hnd);
             unmap_gpuaddr(ctx, mapped_dst_idx);
             return COPYBIT_FAILURE;
         }
@@ -1305,8 +1490,6 @@ static int stretch_copybit_internal(
                        (eC2DFlags)flags, mapped_src_idx);
     if(status) {
         ALOGE("%s: set_image (src) error", __FUNCTION__);
-        delete_handle(dst_hnd);
-        delete_handle(src_hnd);
         unmap_gpuaddr(ctx, mapped_dst_idx);
         unmap_gpuaddr(ctx, mapped_src_idx);
         return COPYBIT_FAILURE;
@@ -1319,8 +1502,6 @@ static int stretch_copybit_internal(
             src_surface.config_mask &= ~C2D_ALPHA_BLEND_NONE;
             if(!(src_surface.global_alpha)) {
                 // src alpha is zero
-                delete_handle(dst_hnd);
-                delete_handle(src_hnd);
                 unmap_gpuaddr(ctx, mapped_dst_idx);
                 unmap_gpuaddr(ctx, mapped_src_idx);
                 return COPYBIT_FAILURE;
@@ -1331,13 +1512,13 @@ static int stretch_copybit_internal(
     }
 
     if (src_surface_type == RGB_SURFACE) {
-        ctx->blit_rgb_object[ctx->blit_rgb_count] = src_surface;
+        ctx->set->blit_rgb_object[ctx->blit_rgb_count] = src_surface;
         ctx->blit_rgb_count++;
     } else if (src_surface_type == YUV_SURFACE_2_PLANES) {
-        ctx->blit_yuv_2_plane_object[ctx->blit_yuv_2_plane_count] = src_surface;
+        ctx->set->blit_yuv_2_plane_object[ctx->blit_yuv_2_plane_count] = src_surface;
         ctx->blit_yuv_2_plane_count++;
     } else {
-        ctx->blit_yuv_3_plane_object[ctx->blit_yuv_3_plane_count] = src_surface;
+        ctx->set->blit_yuv_3_plane_object[ctx->blit_yuv_3_plane_count] = src_surface;
         ctx->blit_yuv_3_plane_count++;
     }
 
@@ -1365,8 +1546,6 @@ static int stretch_copybit_internal(
         status = copy_image(dst_hnd, dst, CONVERT_TO_ANDROID_FORMAT);
         if (status == COPYBIT_FAILURE) {
             ALOGE("%s:copy_image failed in temp Dest",__FUNCTION__);
-            delete_handle(dst_hnd);
-            delete_handle(src_hnd);
             unmap_gpuaddr(ctx, mapped_dst_idx);
             unmap_gpuaddr(ctx, mapped_src_idx);
             return status;
@@ -1377,9 +1556,6 @@ static int stretch_copybit_internal(
                                dst_hnd->offset, dst_hnd->fd,
                                gralloc::CACHE_CLEAN);
     }
-    delete_handle(dst_hnd);
-    delete_handle(src_hnd);
-
     ctx->is_premultiplied_alpha = false;
     ctx->fb_width = 0;
     ctx->fb_height = 0;
@@ -1425,41 +1601,181 @@ static int blit_copybit(
 
 /*****************************************************************************/
 
+static void destroy_surface_set(c2d_surface_set* set)
+{
+    for (int i = 0; i < NUM_SURFACE_TYPES; i++) {
+        if (set->dst[i])
+            LINK_c2dDestroySurface(set->dst[i]);
+    }
+
+    for (int i = 0; i < MAX_RGB_SURFACES; i++) {
+        if (set->blit_rgb_object[i].surface_id)
+            LINK_c2dDestroySurface(set->blit_rgb_object[i].surface_id);
+    }
+
+    for (int i = 0; i < MAX_YUV_2_PLANE_SURFACES; i++) {
+        if (set->blit_yuv_2_plane_object[i].surface_id)
+            LINK_c2dDestroySurface(set->blit_yuv_2_plane_object[i].surface_id);
+    }
+
+    for (int i = 0; i < MAX_YUV_3_PLANE_SURFACES; i++) {
+        if (set->blit_yuv_3_plane_object[i].surface_id)
+            LINK_c2dDestroySurface(set->blit_yuv_3_plane_object[i].surface_id);
+    }
+
+    delete set->temp_src_hnd;
+    delete set->temp_dst_hnd;
+}
+
+/** create the destination and source template surfaces of a set */
+static int create_surface_set(c2d_surface_set* set)
+{
+    C2D_RGB_SURFACE_DEF surfDefinition = {0};
+    C2D_YUV_SURFACE_DEF yuvSurfaceDef = {0} ;
+    unsigned int surface_id = 0;
+
+    /* Create RGB Surface */
+    surfDefinition.buffer = (void*)0xdddddddd;
+    surfDefinition.phys = (void*)0xdddddddd;
+    surfDefinition.stride = 1 * 4;
+    surfDefinition.width = 1;
+    surfDefinition.height = 1;
+    surfDefinition.format = C2D_COLOR_FORMAT_8888_ARGB;
+    if (LINK_c2dCreateSurface(&(set->dst[RGB_SURFACE]), C2D_TARGET | C2D_SOURCE,
+                              (C2D_SURFACE_TYPE)(C2D_SURFACE_RGB_HOST |
+                                                 C2D_SURFACE_WITH_PHYS |
+                                                 C2D_SURFACE_WITH_PHYS_DUMMY ),
+                                                 &surfDefinition)) {
+        ALOGE("%s: create dst[RGB_SURFACE] failed", __FUNCTION__);
+        set->dst[RGB_SURFACE] = 0;
+        return COPYBIT_FAILURE;
+    }
+
+    for (int i = 0; i < MAX_RGB_SURFACES; i++)
+    {
+        if (LINK_c2dCreateSurface(&surface_id, C2D_TARGET | C2D_SOURCE,
+                              (C2D_SURFACE_TYPE)(C2D_SURFACE_RGB_HOST |
+                                                 C2D_SURFACE_WITH_PHYS |
+                                                 C2D_SURFACE_WITH_PHYS_DUMMY ),
+                                                 &surfDefinition)) {
+            ALOGE("%s: create RGB source surface %d failed", __FUNCTION__, i);
+            set->blit_rgb_object[i].surface_id = 0;
+            return COPYBIT_FAILURE;
+        }
+        set->blit_rgb_object[i].surface_id = surface_id;
+        ALOGW("%s i = %d surface_id=%d",  __FUNCTION__, i,
+                                      set->blit_rgb_object[i].surface_id);
+    }
+
+    // Create 2 plane YUV surfaces
+    yuvSurfaceDef.format = C2D_COLOR_FORMAT_420_NV12;
+    yuvSurfaceDef.width = 4;
+    yuvSurfaceDef.height = 4;
+    yuvSurfaceDef.plane0 = (void*)0xaaaaaaaa;
+    yuvSurfaceDef.phys0 = (void*) 0xaaaaaaaa;
+    yuvSurfaceDef.stride0 = 4;
+
+    yuvSurfaceDef.plane1 = (void*)0xaaaaaaaa;
+    yuvSurfaceDef.phys1 = (void*) 0xaaaaaaaa;
+    yuvSurfaceDef.stride1 = 4;
+    if (LINK_c2dCreateSurface(&(set->dst[YUV_SURFACE_2_PLANES]),
+                              C2D_TARGET | C2D_SOURCE,
+                              (C2D_SURFACE_TYPE)(C2D_SURFACE_YUV_HOST |
+                               C2D_SURFACE_WITH_PHYS |
+                               C2D_SURFACE_WITH_PHYS_DUMMY),
+                              &yuvSurfaceDef)) {
+        ALOGE("%s: create dst[YUV_SURFACE_2_PLANES] failed", __FUNCTION__);
+        set->dst[YUV_SURFACE_2_PLANES] = 0;
+        return COPYBIT_FAILURE;
+    }
+
+    for (int i=0; i < MAX_YUV_2_PLANE_SURFACES; i++)
+    {
+        if (LINK_c2dCreateSurface(&surface_id, C2D_TARGET | C2D_SOURCE,
+                              (C2D_SURFACE_TYPE)(C2D_SURFACE_YUV_HOST |
+                                                 C2D_SURFACE_WITH_PHYS |
+                                                 C2D_SURFACE_WITH_PHYS_DUMMY ),
+                              &yuvSurfaceDef)) {
+            ALOGE("%s: create YUV source %d failed", __FUNCTION__, i);
+            set->blit_yuv_2_plane_object[i].surface_id = 0;
+            return COPYBIT_FAILURE;
+        }
+        set->blit_yuv_2_plane_object[i].surface_id = surface_id;
+        ALOGW("%s: 2 Plane YUV i=%d surface_id=%d",  __FUNCTION__, i,
+                               set->blit_yuv_2_plane_object[i].surface_id);
+    }
+
+    // Create YUV 3 plane surfaces
+    yuvSurfaceDef.format = C2D_COLOR_FORMAT_420_YV12;
+    yuvSurfaceDef.plane2 = (void*)0xaaaaaaaa;
+    yuvSurfaceDef.phys2 = (void*) 0xaaaaaaaa;
+    yuvSurfaceDef.stride2 = 4;
+
+    if (LINK_c2dCreateSurface(&(set->dst[YUV_SURFACE_3_PLANES]),
+                              C2D_TARGET | C2D_SOURCE,
+                              (C2D_SURFACE_TYPE)(C2D_SURFACE_YUV_HOST |
+                                                 C2D_SURFACE_WITH_PHYS |
+                                                 C2D_SURFACE_WITH_PHYS_DUMMY),
+                              &yuvSurfaceDef)) {
+        ALOGE("%s: create dst[YUV_SURFACE_3_PLANES] failed", __FUNCTION__);
+        set->dst[YUV_SURFACE_3_PLANES] = 0;
+        return COPYBIT_FAILURE;
+    }
+
+    for (int i=0; i < MAX_YUV_3_PLANE_SURFACES; i++)
+    {
+        if (LINK_c2dCreateSurface(&(surface_id),
+                              C2D_TARGET | C2D_SOURCE,
+                              (C2D_SURFACE_TYPE)(C2D_SURFACE_YUV_HOST |
+                                                 C2D_SURFACE_WITH_PHYS |
+                                                 C2D_SURFACE_WITH_PHYS_DUMMY),
+                              &yuvSurfaceDef)) {
+            ALOGE("%s: create 3 plane YUV surface %d failed", __FUNCTION__, i);
+            set->blit_yuv_3_plane_object[i].surface_id = 0;
+            return COPYBIT_FAILURE;
+        }
+        set->blit_yuv_3_plane_object[i].surface_id = surface_id;
+        ALOGW("%s: 3 Plane YUV i=%d surface_id=%d",  __FUNCTION__, i,
+                               set->blit_yuv_3_plane_object[i].surface_id);
+    }
+
+    set->temp_src_buffer.fd = -1;
+    set->temp_src_buffer.base = 0;
+    set->temp_src_buffer.size = 0;
+
+    set->temp_dst_buffer.fd = -1;
+    set->temp_dst_buffer.base = 0;
+    set->temp_dst_buffer.size = 0;
+
+    set->temp_src_hnd = new private_handle_t(-1, 0, 0, 0, 0, 0, 0);
+    set->temp_dst_hnd = new private_handle_t(-1, 0, 0, 0, 0, 0, 0);
+    if (!set->temp_src_hnd || !set->temp_dst_hnd) {
+        ALOGE("%s: temp handle allocation failed", __FUNCTION__);
+        return COPYBIT_FAILURE;
+    }
+    return COPYBIT_SUCCESS;
+}
+
 static void clean_up(copybit_context_t* ctx)
 {
     void* ret;
     if (!ctx)
         return;
 
-    // stop the wait_cleanup_thread
-    pthread_mutex_lock(&ctx->wait_cleanup_lock);
+    // stop the wait_cleanup_thread, it retires the frames still in flight
+    pthread_mutex_lock(&ctx->pending_lock);
     ctx->stop_thread = true;
     // Signal waiting thread
-    pthread_cond_signal(&ctx->wait_cleanup_cond);
-    pthread_mutex_unlock(&ctx->wait_cleanup_lock);
+    pthread_cond_signal(&ctx->pending_cond);
+    pthread_mutex_unlock(&ctx->pending_lock);
     // waits for the cleanup thread to exit
     pthread_join(ctx->wait_thread_id, &ret);
+    pthread_mutex_destroy(&ctx->pending_lock);
+    pthread_cond_destroy (&ctx->pending_cond);
     pthread_mutex_destroy(&ctx->wait_cleanup_lock);
-    pthread_cond_destroy (&ctx->wait_cleanup_cond);
-
-    for (int i = 0; i < NUM_SURFACE_TYPES; i++) {
-        if (ctx->dst[i])
-            LINK_c2dDestroySurface(ctx->dst[i]);
-    }
-
-    for (int i = 0; i < MAX_RGB_SURFACES; i++) {
-        if (ctx->blit_rgb_object[i].surface_id)
-            LINK_c2dDestroySurface(ctx->blit_rgb_object[i].surface_id);
-    }
-
-    for (int i = 0; i < MAX_YUV_2_PLANE_SURFACES; i++) {
-        if (ctx->blit_yuv_2_plane_object[i].surface_id)
-            LINK_c2dDestroySurface(ctx->blit_yuv_2_plane_object[i].surface_id);
-    }
 
-    for (int i = 0; i < MAX_YUV_3_PLANE_SURFACES; i++) {
-        if (ctx->blit_yuv_3_plane_object[i].surface_id)
-            LINK_c2dDestroySurface(ctx->blit_yuv_3_plane_object[i].surface_id);
+    for (int i = 0; i < NUM_SURFACE_SETS; i++) {
+        destroy_surface_set(&ctx->sets[i]);
     }
 
     if (ctx->libc2d2) {
@@ -1475,8 +1791,10 @@ static int close_copybit(struct hw_device_t *dev)
 {
     struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
     if (ctx) {
-        free_temp_buffer(ctx->temp_src_buffer);
-        free_temp_buffer(ctx->temp_dst_buffer);
+        for (int i = 0; i < NUM_SURFACE_SETS; i++) {
+            free_temp_buffer(ctx->sets[i].temp_src_buffer);
+            free_temp_buffer(ctx->sets[i].temp_dst_buffer);
+        }
     }
     clean_up(ctx);
     return 0;
@@ -1487,8 +1805,6 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
                         struct hw_device_t** device)
 {
     int status = COPYBIT_SUCCESS;
-    C2D_RGB_SURFACE_DEF surfDefinition = {0};
-    C2D_YUV_SURFACE_DEF yuvSurfaceDef = {0} ;
     struct copybit_context_t *ctx;
     char fbName[64];
 
@@ -1500,7 +1816,7 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
 
     /* initialize drawstate */
     memset(ctx, 0, sizeof(*ctx));
-    ctx->libc2d2 = ::dlopen("libC2D2.so", RTLD_NOW);
+    ctx->libc2d2 = ::dlopen(C2D_LIBRARY, RTLD_NOW);
     if (!ctx->libc2d2) {
         ALOGE("FATAL ERROR: could not dlopen libc2d2.so: %s", dlerror());
         clean_up(ctx);
@@ -1556,147 +1872,15 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
     ctx->device.flush_get_fence = flush_get_fence_copybit;
     ctx->device.clear = clear_copybit;
 
-    /* Create RGB Surface */
-    surfDefinition.buffer = (void*)0xdddddddd;
-    surfDefinition.phys = (void*)0xdddddddd;
-    surfDefinition.stride = 1 * 4;
-    surfDefinition.width = 1;
-    surfDefinition.height = 1;
-    surfDefinition.format = C2D_COLOR_FORMAT_8888_ARGB;
-    if (LINK_c2dCreateSurface(&(ctx->dst[RGB_SURFACE]), C2D_TARGET | C2D_SOURCE,
-                              (C2D_SURFACE_TYPE)(C2D_SURFACE_RGB_HOST |
-                                                 C2D_SURFACE_WITH_PHYS |
-                                                 C2D_SURFACE_WITH_PHYS_DUMMY ),
-                                                 &surfDefinition)) {
-        ALOGE("%s: create ctx->dst_surface[RGB_SURFACE] failed", __FUNCTION__);
-        ctx->dst[RGB_SURFACE] = 0;
-        clean_up(ctx);
-        status = COPYBIT_FAILURE;
-        *device = NULL;
-        return status;
-    }
-
-    unsigned int surface_id = 0;
-    for (int i = 0; i < MAX_RGB_SURFACES; i++)
-    {
-        if (LINK_c2dCreateSurface(&surface_id, C2D_TARGET | C2D_SOURCE,
-                              (C2D_SURFACE_TYPE)(C2D_SURFACE_RGB_HOST |
-                                                 C2D_SURFACE_WITH_PHYS |
-                                                 C2D_SURFACE_WITH_PHYS_DUMMY ),
-                                                 &surfDefinition)) {
-            ALOGE("%s: create RGB source surface %d failed", __FUNCTION__, i);
-            ctx->blit_rgb_object[i].surface_id = 0;
-            status = COPYBIT_FAILURE;
-            break;
-        } else {
-            ctx->blit_rgb_object[i].surface_id = surface_id;
-            ALOGW("%s i = %d surface_id=%d",  __FUNCTION__, i,
-                                          ctx->blit_rgb_object[i].surface_id);
-        }
-    }
-
-    if (status == COPYBIT_FAILURE) {
-        clean_up(ctx);
-        status = COPYBIT_FAILURE;
-        *device = NULL;
-        return status;
-    }
-
-    // Create 2 plane YUV surfaces
-    yuvSurfaceDef.format = C2D_COLOR_FORMAT_420_NV12;
-    yuvSurfaceDef.width = 4;
-    yuvSurfaceDef.height = 4;
-    yuvSurfaceDef.plane0 = (void*)0xaaaaaaaa;
-    yuvSurfaceDef.phys0 = (void*) 0xaaaaaaaa;
-    yuvSurfaceDef.stride0 = 4;
-
-    yuvSurfaceDef.plane1 = (void*)0xaaaaaaaa;
-    yuvSurfaceDef.phys1 = (void*) 0xaaaaaaaa;
-    yuvSurfaceDef.stride1 = 4;
-    if (LINK_c2dCreateSurface(&(ctx->dst[YUV_SURFACE_2_PLANES]),
-                              C2D_TARGET | C2D_SOURCE,
-                              (C2D_SURFACE_TYPE)(C2D_SURFACE_YUV_HOST |
-                               C2D_SURFACE_WITH_PHYS |
-                               C2D_SURFACE_WITH_PHYS_DUMMY),
-                              &yuvSurfaceDef)) {
-        ALOGE("%s: create ctx->dst[YUV_SURFACE_2_PLANES] failed", __FUNCTION__);
-        ctx->dst[YUV_SURFACE_2_PLANES] = 0;
-        clean_up(ctx);
-        status = COPYBIT_FAILURE;
-        *device = NULL;
-        return status;
-    }
-
-    for (int i=0; i < MAX_YUV_2_PLANE_SURFACES; i++)
-    {
-        if (LINK_c2dCreateSurface(&surface_id, C2D_TARGET | C2D_SOURCE,
-                              (C2D_SURFACE_TYPE)(C2D_SURFACE_YUV_HOST |
-                                                 C2D_SURFACE_WITH_PHYS |
-                                                 C2D_SURFACE_WITH_PHYS_DUMMY ),
-                              &yuvSurfaceDef)) {
-            ALOGE("%s: create YUV source %d failed", __FUNCTION__, i);
-            ctx->blit_yuv_2_plane_object[i].surface_id = 0;
-            status = COPYBIT_FAILURE;
-            break;
-        } else {
-            ctx->blit_yuv_2_plane_object[i].surface_id = surface_id;
-            ALOGW("%s: 2 Plane YUV i=%d surface_id=%d",  __FUNCTION__, i,
-                                   ctx->blit_yuv_2_plane_object[i].surface_id);
-        }
-    }
-
-    if (status == COPYBIT_FAILURE) {
-        clean_up(ctx);
-        status = COPYBIT_FAILURE;
-        *device = NULL;
-        return status;
-    }
-
-    // Create YUV 3 plane surfaces
-    yuvSurfaceDef.format = C2D_COLOR_FORMAT_420_YV12;
-    yuvSurfaceDef.plane2 = (void*)0xaaaaaaaa;
-    yuvSurfaceDef.phys2 = (void*) 0xaaaaaaaa;
-    yuvSurfaceDef.stride2 = 4;
-
-    if (LINK_c2dCreateSurface(&(ctx->dst[YUV_SURFACE_3_PLANES]),
-                              C2D_TARGET | C2D_SOURCE,
-                              (C2D_SURFACE_TYPE)(C2D_SURFACE_YUV_HOST |
-                                                 C2D_SURFACE_WITH_PHYS |
-                                                 C2D_SURFACE_WITH_PHYS_DUMMY),
-                              &yuvSurfaceDef)) {
-        ALOGE("%s: create ctx->dst[YUV_SURFACE_3_PLANES] failed", __FUNCTION__);
-        ctx->dst[YUV_SURFACE_3_PLANES] = 0;
-        clean_up(ctx);
-        status = COPYBIT_FAILURE;
-        *device = NULL;
-        return status;
-    }
-
-    for (int i=0; i < MAX_YUV_3_PLANE_SURFACES; i++)
-    {
-        if (LINK_c2dCreateSurface(&(surface_id),
-                              C2D_TARGET | C2D_SOURCE,
-                              (C2D_SURFACE_TYPE)(C2D_SURFACE_YUV_HOST |
-                                                 C2D_SURFACE_WITH_PHYS |
-                                                 C2D_SURFACE_WITH_PHYS_DUMMY),
-                              &yuvSurfaceDef)) {
-            ALOGE("%s: create 3 plane YUV surface %d failed", __FUNCTION__, i);
-            ctx->blit_yuv_3_plane_object[i].surface_id = 0;
-            status = COPYBIT_FAILURE;
-            break;
-        } else {
-            ctx->blit_yuv_3_plane_object[i].surface_id = surface_id;
-            ALOGW("%s: 3 Plane YUV i=%d surface_id=%d",  __FUNCTION__, i,
-                                   ctx->blit_yuv_3_plane_object[i].surface_id);
+    for (int i = 0; i < NUM_SURFACE_SETS; i++) {
+        if (create_surface_set(&ctx->sets[i]) != COPYBIT_SUCCESS) {
+            clean_up(ctx);
+            *device = NULL;
+            return COPYBIT_FAILURE;
         }
     }
-
-    if (status == COPYBIT_FAILURE) {
-        clean_up(ctx);
-        status = COPYBIT_FAILURE;
-        *device = NULL;
-        return status;
-    }
+    ctx->set_index = 0;
+    ctx->set = &ctx->sets[0];
 
     if (LINK_c2dGetDriverCapabilities(&(ctx->c2d_driver_info))) {
          ALOGE("%s: LINK_c2dGetDriverCapabilities failed", __FUNCTION__);
@@ -1708,14 +1892,6 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
     // Initialize context variables.
     ctx->trg_transform = C2D_TARGET_ROTATE_0;
 
-    ctx->temp_src_buffer.fd = -1;
-    ctx->temp_src_buffer.base = 0;
-    ctx->temp_src_buffer.size = 0;
-
-    ctx->temp_dst_buffer.fd = -1;
-    ctx->temp_dst_buffer.base = 0;
-    ctx->temp_dst_buffer.size = 0;
-
     ctx->fb_width = 0;
     ctx->fb_height = 0;
 
@@ -1724,10 +1900,12 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
     ctx->blit_yuv_3_plane_count = 0;
     ctx->blit_count = 0;
 
-    ctx->wait_timestamp = false;
+    ctx->pending_head = 0;
+    ctx->pending_count = 0;
     ctx->stop_thread = false;
     pthread_mutex_init(&(ctx->wait_cleanup_lock), NULL);
-    pthread_cond_init(&(ctx->wait_cleanup_cond), NULL);
+    pthread_mutex_init(&(ctx->pending_lock), NULL);
+    pthread_cond_init(&(ctx->pending_cond), NULL);
     /* Start the wait thread */
     pthread_attr_t attr;
     pthread_attr_init(&attr);
@@ -29,7 +29,13 @@
 
 #include <cutils/log.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __ARM_HAVE_NEON
+#include <arm_neon.h>
+#endif
 #include "software_converter.h"
 
 /** Convert YV12 to YCrCb_420_SP */
@@ -260,3 +266,508 @@ int convert_yuv_android_to_yuv_c2d(private_handle_t *hnd,
     ret = copy_source_to_destination(hnd->base, dst_hnd->base, info);
     return ret;
 }
+
+/* YUV to RGB conversion coefficients in Q13 fixed point */
+struct yuvCoeffs {
+    int yOffset;
+    int y;   // luma gain
+    int rv;  // V contribution to R
+    int gu;  // U contribution to G
+    int gv;  // V contribution to G
+    int bu;  // U contribution to B
+};
+
+static const yuvCoeffs sBT601Limited = { 16, 9535, 13074, 3203, 6660, 16531 };
+static const yuvCoeffs sBT601Full    = {  0, 8192, 11485, 2818, 5849, 14516 };
+static const yuvCoeffs sBT709Limited = { 16, 9535, 14688, 1745, 4366, 17301 };
+
+#define COEFF_SHIFT        13
+#define COEFF_ROUND        (1 << (COEFF_SHIFT - 1))
+#define MAX_CONVERT_THREADS 4
+#define MIN_ROWS_PER_THREAD 64
+#define MIN_PIXELS_PER_THREAD (64 * 1024)
+
+enum {
+    YUV_ORDER_CBCR,  // NV12
+    YUV_ORDER_CRCB,  // NV21
+    YUV_ORDER_PLANAR // YV12
+};
+
+struct yuvToRgbJob {
+    const yuvCoeffs* coeffs;
+    const unsigned char* yPlane;
+    const unsigned char* cbPlane;
+    const unsigned char* crPlane;
+    int yStride;
+    int cStride;
+    int cStep;       // distance between two chroma samples in a row
+    unsigned char* dst;
+    int dstStride;   // in bytes
+    int dstFormat;
+    bool rotate;     // source is sampled transposed
+    const int* colTab;
+    const int* rowTab;
+    int left;        // clipped area, relative to dst_rect
+    int right;
+    int top;
+    int bottom;
+    int dstLeft;     // dst_rect origin
+    int dstTop;
+    bool fastRow;    // 1:1 horizontal mapping without transform
+};
+
+static inline int max_int(int a, int b) { return a > b ? a : b; }
+static inline int min_int(int a, int b) { return a < b ? a : b; }
+
+static inline unsigned char clamp8(int v)
+{
+    return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static inline void store_pixel(unsigned char* out, int format,
+                               int r, int g, int b)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGB_565: {
+            unsigned short px = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+            *(unsigned short*)out = px;
+        } break;
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            out[0] = b; out[1] = g; out[2] = r; out[3] = 0xFF;
+            break;
+        default:
+            out[0] = r; out[1] = g; out[2] = b; out[3] = 0xFF;
+            break;
+    }
+}
+
+static inline int get_bytes_per_pixel(int format)
+{
+    return (format == HAL_PIXEL_FORMAT_RGB_565) ? 2 : 4;
+}
+
+#ifdef __ARM_HAVE_NEON
+/* Converts 8 pixels of a row with 1:1 horizontal mapping. yRow and cRow
+ * point to the first luma and the first interleaved chroma sample. */
+static inline void convert_row8_neon(const yuvToRgbJob& job,
+                                     const unsigned char* yRow,
+                                     const unsigned char* cRow,
+                                     unsigned char* out)
+{
+    const yuvCoeffs& c = *job.coeffs;
+    uint8x8_t y8 = vld1_u8(yRow);
+    uint8x8x2_t uv = vuzp_u8(vld1_u8(cRow), vld1_u8(cRow));
+    uint8x8_t cb8 = vzip_u8(uv.val[0], uv.val[0]).val[0];
+    uint8x8_t cr8 = vzip_u8(uv.val[1], uv.val[1]).val[0];
+    if (job.cbPlane > job.crPlane) {
+        uint8x8_t t = cb8; cb8 = cr8; cr8 = t;
+    }
+
+    int16x8_t y = vreinterpretq_s16_u16(vsubl_u8(y8,
+                                         vdup_n_u8(c.yOffset)));
+    int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(cb8, vdup_n_u8(128)));
+    int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(cr8, vdup_n_u8(128)));
+
+    int32x4_t yl = vmull_n_s16(vget_low_s16(y), c.y);
+    int32x4_t yh = vmull_n_s16(vget_high_s16(y), c.y);
+
+    int32x4_t rl = vmlal_n_s16(yl, vget_low_s16(v), c.rv);
+    int32x4_t rh = vmlal_n_s16(yh, vget_high_s16(v), c.rv);
+    int32x4_t gl = vmlsl_n_s16(vmlsl_n_s16(yl, vget_low_s16(u), c.gu),
+                               vget_low_s16(v), c.gv);
+    int32x4_t gh = vmlsl_n_s16(vmlsl_n_s16(yh, vget_high_s16(u), c.gu),
+                               vget_high_s16(v), c.gv);
+    int32x4_t bl = vmlal_n_s16(yl, vget_low_s16(u), c.bu);
+    int32x4_t bh = vmlal_n_s16(yh, vget_high_s16(u), c.bu);
+
+    uint8x8x4_t px;
+    uint8x8_t r8 = vqmovun_s16(vcombine_s16(vqrshrn_n_s32(rl, COEFF_SHIFT),
+                                            vqrshrn_n_s32(rh, COEFF_SHIFT)));
+    uint8x8_t g8 = vqmovun_s16(vcombine_s16(vqrshrn_n_s32(gl, COEFF_SHIFT),
+                                            vqrshrn_n_s32(gh, COEFF_SHIFT)));
+    uint8x8_t b8 = vqmovun_s16(vcombine_s16(vqrshrn_n_s32(bl, COEFF_SHIFT),
+                                            vqrshrn_n_s32(bh, COEFF_SHIFT)));
+    if (job.dstFormat == HAL_PIXEL_FORMAT_BGRA_8888) {
+        px.val[0] = b8; px.val[2] = r8;
+    } else {
+        px.val[0] = r8; px.val[2] = b8;
+    }
+    px.val[1] = g8;
+    px.val[3] = vdup_n_u8(0xFF);
+    vst4_u8(out, px);
+}
+#endif
+
+/* Converts the rows [top, bottom) of the clipped area of a job */
+static void convert_rows(const yuvToRgbJob& job, int top, int bottom)
+{
+    const yuvCoeffs& c = *job.coeffs;
+    int bpp = get_bytes_per_pixel(job.dstFormat);
+
+    for (int v = top; v < bottom; v++) {
+        unsigned char* out = job.dst + (job.dstTop + v) * job.dstStride +
+                             (job.dstLeft + job.left) * bpp;
+        int u = job.left;
+
+#ifdef __ARM_HAVE_NEON
+        if (job.fastRow && job.cStep == 2 && bpp == 4) {
+            int sy = job.rowTab[v];
+            int sx = job.colTab[u];
+            // Chroma pairs need an even starting column
+            if (!(sx & 1)) {
+                const unsigned char* yRow = job.yPlane + sy * job.yStride;
+                const unsigned char* cRow = (job.cbPlane < job.crPlane ?
+                                             job.cbPlane : job.crPlane) +
+                                            (sy >> 1) * job.cStride;
+                for (; u + 8 <= job.right; u += 8) {
+                    sx = job.colTab[u];
+                    convert_row8_neon(job, yRow + sx, cRow + sx, out);
+                    out += 8 * bpp;
+                }
+            }
+        }
+#endif
+        for (; u < job.right; u++) {
+            int sx, sy;
+            if (job.rotate) {
+                sx = job.rowTab[v];
+                sy = job.colTab[u];
+            } else {
+                sx = job.colTab[u];
+                sy = job.rowTab[v];
+            }
+            int coff = (sy >> 1) * job.cStride + (sx >> 1) * job.cStep;
+            int y = (job.yPlane[sy * job.yStride + sx] - c.yOffset) * c.y;
+            int cb = job.cbPlane[coff] - 128;
+            int cr = job.crPlane[coff] - 128;
+
+            int r = (y + c.rv * cr + COEFF_ROUND) >> COEFF_SHIFT;
+            int g = (y - c.gu * cb - c.gv * cr + COEFF_ROUND) >> COEFF_SHIFT;
+            int b = (y + c.bu * cb + COEFF_ROUND) >> COEFF_SHIFT;
+            store_pixel(out, job.dstFormat, clamp8(r), clamp8(g), clamp8(b));
+            out += bpp;
+        }
+    }
+}
+
+struct convertBand {
+    int top;
+    int bottom;
+};
+
+/* Worker threads kept across blits. The calling thread converts the first
+ * band of a job, worker i the band i. */
+struct convertPool {
+    pthread_mutex_t lock;
+    pthread_cond_t workCond;
+    pthread_cond_t doneCond;
+    int numWorkers;
+    unsigned int generation;
+    const yuvToRgbJob* job;
+    convertBand bands[MAX_CONVERT_THREADS];
+    int numBands;
+    int pending;
+    // Generation a worker was started in, so that one which comes up
+    // after the job it was started for is posted does not miss it
+    unsigned int startGeneration[MAX_CONVERT_THREADS];
+};
+
+static convertPool sPool = { PTHREAD_MUTEX_INITIALIZER,
+                             PTHREAD_COND_INITIALIZER,
+                             PTHREAD_COND_INITIALIZER,
+                             0, 0, NULL, {{0, 0}}, 0, 0, {0} };
+
+/* Serializes blits, they share the pool and the axis tables */
+static pthread_mutex_t sJobLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void* convert_thread(void* ptr)
+{
+    int index = (int)(intptr_t)ptr;
+
+    pthread_mutex_lock(&sPool.lock);
+    unsigned int seen = sPool.startGeneration[index];
+    while (true) {
+        while (sPool.generation == seen)
+            pthread_cond_wait(&sPool.workCond, &sPool.lock);
+        seen = sPool.generation;
+        if (index >= sPool.numBands)
+            continue;
+        const yuvToRgbJob* job = sPool.job;
+        convertBand band = sPool.bands[index];
+        pthread_mutex_unlock(&sPool.lock);
+
+        convert_rows(*job, band.top, band.bottom);
+
+        pthread_mutex_lock(&sPool.lock);
+        if (--sPool.pending == 0)
+            pthread_cond_signal(&sPool.doneCond);
+    }
+    return NULL;
+}
+
+/* Starts workers until the pool has "count", returns how many it has */
+static int grow_pool(int count)
+{
+    while (sPool.numWorkers < count) {
+        pthread_t thread;
+        // Worker indices start at 1, the caller takes band 0
+        int index = sPool.numWorkers + 1;
+        pthread_mutex_lock(&sPool.lock);
+        sPool.startGeneration[index] = sPool.generation;
+        pthread_mutex_unlock(&sPool.lock);
+        if (pthread_create(&thread, NULL, convert_thread,
+                           (void*)(intptr_t)index) != 0) {
+            ALOGE("%s: failed to start a worker", __FUNCTION__);
+            break;
+        }
+        pthread_detach(thread);
+        pthread_mutex_lock(&sPool.lock);
+        sPool.numWorkers++;
+        pthread_mutex_unlock(&sPool.lock);
+    }
+    return sPool.numWorkers;
+}
+
+/* Splits the rows of a job into bands and converts them in parallel.
+ * Small jobs are converted on the calling thread. */
+static void run_job(const yuvToRgbJob& job)
+{
+    int rows = job.bottom - job.top;
+    int pixels = rows * (job.right - job.left);
+    int numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads > MAX_CONVERT_THREADS)
+        numThreads = MAX_CONVERT_THREADS;
+    if (numThreads > rows / MIN_ROWS_PER_THREAD)
+        numThreads = rows / MIN_ROWS_PER_THREAD;
+    if (numThreads > pixels / MIN_PIXELS_PER_THREAD)
+        numThreads = pixels / MIN_PIXELS_PER_THREAD;
+    if (numThreads > 1)
+        numThreads = grow_pool(numThreads - 1) + 1;
+    if (numThreads <= 1) {
+        convert_rows(job, job.top, job.bottom);
+        return;
+    }
+
+    int band = rows / numThreads;
+    pthread_mutex_lock(&sPool.lock);
+    for (int i = 0; i < numThreads; i++) {
+        sPool.bands[i].top = job.top + i * band;
+        sPool.bands[i].bottom = (i == numThreads - 1) ? job.bottom :
+                                sPool.bands[i].top + band;
+    }
+    sPool.job = &job;
+    sPool.numBands = numThreads;
+    sPool.pending = numThreads - 1;
+    sPool.generation++;
+    pthread_cond_broadcast(&sPool.workCond);
+    pthread_mutex_unlock(&sPool.lock);
+
+    convert_rows(job, sPool.bands[0].top, sPool.bands[0].bottom);
+
+    pthread_mutex_lock(&sPool.lock);
+    while (sPool.pending > 0)
+        pthread_cond_wait(&sPool.doneCond, &sPool.lock);
+    sPool.job = NULL;
+    pthread_mutex_unlock(&sPool.lock);
+}
+
+/* Builds the table of source coordinates for one destination axis.
+ * srcLen source samples starting at srcStart are mapped onto dstLen
+ * destination samples using center sampling. */
+static void build_axis_table(int* table, int dstLen, int srcStart,
+                             int srcLen, bool flip)
+{
+    for (int i = 0; i < dstLen; i++) {
+        int pos = flip ? (dstLen - 1 - i) : i;
+        table[i] = srcStart + (int)(((2LL * pos + 1) * srcLen) /
+                                    (2LL * dstLen));
+    }
+}
+
+/* Source coordinates of the destination columns and rows. A video is
+ * blitted with the same geometry frame after frame, so the tables of the
+ * last blit are kept and only rebuilt when it changes. */
+struct axisTables {
+    int* buf;
+    int capacity;
+    bool valid;
+    int dstW;
+    int dstH;
+    copybit_rect_t src;
+    int transform;
+};
+
+static axisTables sTables = { NULL, 0, false, 0, 0, {0, 0, 0, 0}, 0 };
+
+/* Returns the column table followed by the row table, NULL on failure */
+static const int* get_axis_tables(int dstW, int dstH,
+                                  const copybit_rect_t& src, int transform)
+{
+    if (sTables.valid && sTables.dstW == dstW && sTables.dstH == dstH &&
+        !memcmp(&sTables.src, &src, sizeof(src)) &&
+        sTables.transform == transform)
+        return sTables.buf;
+
+    sTables.valid = false;
+    if (sTables.capacity < dstW + dstH) {
+        int* buf = (int*)realloc(sTables.buf, sizeof(int) * (dstW + dstH));
+        if (!buf)
+            return NULL;
+        sTables.buf = buf;
+        sTables.capacity = dstW + dstH;
+    }
+
+    // The transform is applied to the source as flips followed by a
+    // clockwise rotation by 90. Work backwards from each destination
+    // pixel to find the source sample.
+    bool flipH = (transform & COPYBIT_TRANSFORM_FLIP_H) != 0;
+    bool flipV = (transform & COPYBIT_TRANSFORM_FLIP_V) != 0;
+    int srcW = src.r - src.l;
+    int srcH = src.b - src.t;
+    int* colTab = sTables.buf;
+    int* rowTab = colTab + dstW;
+    if (transform & COPYBIT_TRANSFORM_ROT_90) {
+        // dst columns walk the source rows bottom up, dst rows walk the
+        // source columns
+        build_axis_table(colTab, dstW, src.t, srcH, !flipV);
+        build_axis_table(rowTab, dstH, src.l, srcW, flipH);
+    } else {
+        build_axis_table(colTab, dstW, src.l, srcW, flipH);
+        build_axis_table(rowTab, dstH, src.t, srcH, flipV);
+    }
+
+    sTables.dstW = dstW;
+    sTables.dstH = dstH;
+    sTables.src = src;
+    sTables.transform = transform;
+    sTables.valid = true;
+    return sTables.buf;
+}
+
+bool is_yuv_to_rgb_supported(int dst_format, int src_format)
+{
+    switch (dst_format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+        case HAL_PIXEL_FORMAT_RGB_565:
+            break;
+        default:
+            return false;
+    }
+    switch (src_format) {
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+        case HAL_PIXEL_FORMAT_NV12_ENCODEABLE:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        case HAL_PIXEL_FORMAT_YV12:
+            return true;
+        default:
+            return false;
+    }
+}
+
+int convert_yuv_to_rgb(struct copybit_image_t const *dst,
+                       struct copybit_image_t const *src,
+                       struct copybit_rect_t const *dst_rect,
+                       struct copybit_rect_t const *src_rect,
+                       struct copybit_rect_t const *clip,
+                       int transform)
+{
+    if (!dst || !src || !dst_rect || !src_rect || !clip) {
+        ALOGE("%s: invalid inputs", __FUNCTION__);
+        return COPYBIT_FAILURE;
+    }
+    private_handle_t *src_hnd = (private_handle_t *)src->handle;
+    private_handle_t *dst_hnd = (private_handle_t *)dst->handle;
+    if (!src_hnd || !dst_hnd || !src_hnd->base || !dst_hnd->base) {
+        ALOGE("%s: invalid handles", __FUNCTION__);
+        return COPYBIT_FAILURE;
+    }
+    if (!is_yuv_to_rgb_supported(dst->format, src->format)) {
+        ALOGE("%s: unsupported conversion 0x%x -> 0x%x", __FUNCTION__,
+              src->format, dst->format);
+        return COPYBIT_FAILURE;
+    }
+
+    int dstW = dst_rect->r - dst_rect->l;
+    int dstH = dst_rect->b - dst_rect->t;
+    int srcW = src_rect->r - src_rect->l;
+    int srcH = src_rect->b - src_rect->t;
+    if (dstW <= 0 || dstH <= 0 || srcW <= 0 || srcH <= 0 ||
+        src_rect->l < 0 || src_rect->t < 0 ||
+        src_rect->r > (int)src->w || src_rect->b > (int)src->h) {
+        ALOGE("%s: invalid rectangles", __FUNCTION__);
+        return COPYBIT_FAILURE;
+    }
+
+    yuvToRgbJob job;
+    // Area to write, relative to dst_rect
+    job.left   = max_int(max_int(clip->l, dst_rect->l), 0) - dst_rect->l;
+    job.top    = max_int(max_int(clip->t, dst_rect->t), 0) - dst_rect->t;
+    job.right  = min_int(min_int(clip->r, dst_rect->r), (int)dst->w) -
+                 dst_rect->l;
+    job.bottom = min_int(min_int(clip->b, dst_rect->b), (int)dst->h) -
+                 dst_rect->t;
+    if (job.left >= job.right || job.top >= job.bottom)
+        return COPYBIT_SUCCESS;
+
+    if (src_hnd->flags & private_handle_t::PRIV_FLAGS_ITU_R_709)
+        job.coeffs = &sBT709Limited;
+    else if (src_hnd->flags & private_handle_t::PRIV_FLAGS_ITU_R_601_FR)
+        job.coeffs = &sBT601Full;
+    else
+        job.coeffs = &sBT601Limited;
+
+    // In a copybit_image_t, w is the luma stride
+    job.yStride = src->w;
+    job.yPlane = (const unsigned char*)src_hnd->base;
+    switch (src->format) {
+        case HAL_PIXEL_FORMAT_YV12: {
+            // V plane followed by the U plane, see hardware.h
+            job.cStride = ALIGN(src->w / 2, 16);
+            job.cStep = 1;
+            job.crPlane = job.yPlane + job.yStride * src->h;
+            job.cbPlane = job.crPlane + job.cStride * (src->h / 2);
+        } break;
+        case HAL_PIXEL_FORMAT_NV12_ENCODEABLE:
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP: {
+            int offset = job.yStride * src->h;
+            if (src->format == HAL_PIXEL_FORMAT_NV12_ENCODEABLE)
+                offset = ALIGN(offset, 2048);
+            job.cStride = job.yStride;
+            job.cStep = 2;
+            job.cbPlane = job.yPlane + offset;
+            job.crPlane = job.cbPlane + 1;
+        } break;
+        default: {
+            job.cStride = job.yStride;
+            job.cStep = 2;
+            job.crPlane = job.yPlane + job.yStride * src->h;
+            job.cbPlane = job.crPlane + 1;
+        } break;
+    }
+
+    job.dst = (unsigned char*)dst_hnd->base;
+    job.dstFormat = dst->format;
+    job.dstStride = dst->w * get_bytes_per_pixel(dst->format);
+    job.dstLeft = dst_rect->l;
+    job.dstTop = dst_rect->t;
+
+    bool flipH = (transform & COPYBIT_TRANSFORM_FLIP_H) != 0;
+    job.rotate = (transform & COPYBIT_TRANSFORM_ROT_90) != 0;
+    job.fastRow = !job.rotate && !flipH && (srcW == dstW);
+
+    pthread_mutex_lock(&sJobLock);
+    const int* tables = get_axis_tables(dstW, dstH, *src_rect, transform);
+    if (!tables) {
+        pthread_mutex_unlock(&sJobLock);
+        ALOGE("%s: table allocation failed", __FUNCTION__);
+        return COPYBIT_FAILURE;
+    }
+    job.colTab = tables;
+    job.rowTab = tables + dstW;
+
+    run_job(job);
+    pthread_mutex_unlock(&sJobLock);
+    return COPYBIT_SUCCESS;
+}
@@ -60,3 +60,36 @@ int convert_yuv_c2d_to_yuv_android(private_handle_t *hnd,
  */
 int convert_yuv_android_to_yuv_c2d(private_handle_t *hnd,
                                    struct copybit_image_t const *rhs);
+
+/*
+ * Function to convert a YUV source (NV12, NV21 or YV12) to an RGB
+ * destination (RGBA/RGBX/BGRA 8888 or RGB 565) in software. The layer
+ * transform and the scaling from src_rect to dst_rect are applied in the
+ * same pass. Only the part of dst_rect inside clip is written. The color
+ * space is picked from the PRIV_FLAGS_ITU_R_* flags of the source handle.
+ *
+ * @param: destination image
+ * @param: source image
+ * @param: destination rectangle
+ * @param: source rectangle
+ * @param: clip rectangle
+ * @param: COPYBIT_TRANSFORM_* value
+ *
+ * @return: return status
+ */
+int convert_yuv_to_rgb(struct copybit_image_t const *dst,
+                       struct copybit_image_t const *src,
+                       struct copybit_rect_t const *dst_rect,
+                       struct copybit_rect_t const *src_rect,
+                       struct copybit_rect_t const *clip,
+                       int transform);
+
+/*
+ * Function to check if convert_yuv_to_rgb supports the formats
+ *
+ * @param: destination format
+ * @param: source format
+ *
+ * @return: true if the conversion is supported
+ */
+bool is_yuv_to_rgb_supported(int dst_format, int src_format);
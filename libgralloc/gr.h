@@ -82,6 +82,7 @@ class Locker {
     }
     inline void lock()     { pthread_mutex_lock(&mutex); }
     inline void unlock()   { pthread_mutex_unlock(&mutex); }
+    inline bool tryLock()  { return pthread_mutex_trylock(&mutex) == 0; }
     inline void wait()     { pthread_cond_wait(&cond, &mutex); }
     inline void signal()     { pthread_cond_signal(&cond); }
 };
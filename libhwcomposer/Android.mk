@@ -11,7 +11,8 @@ LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes) \
 LOCAL_SHARED_LIBRARIES        := $(common_libs) libEGL liboverlay \
                                  libexternal libqdutils libhardware_legacy \
                                  libdl libmemalloc libqservice libsync \
-                                 libbinder libmedia libvirtual libskia
+                                 libbinder libmedia libvirtual libskia \
+                                 libz
 LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdhwcomposer\"
 LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
 LOCAL_SRC_FILES               := hwc.cpp          \
@@ -22,6 +23,20 @@ LOCAL_SRC_FILES               := hwc.cpp          \
                                  hwc_mdpcomp.cpp  \
                                  hwc_copybit.cpp  \
                                  hwc_qclient.cpp  \
-                                 hwc_dump_layers.cpp
+                                 hwc_dump_layers.cpp \
+                                 hwc_dump_writer.cpp \
+                                 hwc_metrics.cpp  \
+                                 hwc_frame_timeline.cpp \
+                                 hwc_pipe_solver.cpp \
+                                 hwc_snapshot.cpp \
+                                 hwc_ext_transform.cpp
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Extracts the frame captures of debug.sf.capture on the host
+include $(CLEAR_VARS)
+LOCAL_MODULE                  := qcap_extract
+LOCAL_MODULE_TAGS             := optional
+LOCAL_SRC_FILES               := qcap_extract.cpp \
+                                 qcap_reader.cpp
+include $(BUILD_HOST_EXECUTABLE)
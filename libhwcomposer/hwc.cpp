@@ -29,10 +29,14 @@
 #include <overlay.h>
 #include <overlayRotator.h>
 #include <mdp_version.h>
+#include <prop_cache.h>
+#include <event_loop.h>
 #include "hwc_utils.h"
 #include "hwc_fbupdate.h"
 #include "hwc_mdpcomp.h"
 #include "hwc_dump_layers.h"
+#include "hwc_metrics.h"
+#include "hwc_frame_timeline.h"
 #include "external.h"
 #include "hwc_copybit.h"
 #include "profiler.h"
@@ -44,6 +48,7 @@ using namespace overlay;
 #define BLANK_DEBUG 1
 
 #define NON_PRO_8960_SOC_ID 87
+#define HWC_EVENT_THREAD_NAME "hwcEventThread"
 
 static int hwc_device_open(const struct hw_module_t* module,
                            const char* name,
@@ -95,9 +100,11 @@ static void hwc_registerProcs(struct hwc_composer_device_1* dev,
     ctx->proc = procs;
 
     // Now that we have the functions needed, kick off
-    // the uevent & vsync threads
-    init_uevent_thread(ctx);
-    init_vsync_thread(ctx);
+    // the event loop with the uevent & vsync sources
+    init_uevent(ctx);
+    init_vsync(ctx);
+    ctx->mEventLoop->start(HWC_EVENT_THREAD_NAME,
+            HAL_PRIORITY_URGENT_DISPLAY + android::PRIORITY_MORE_FAVORABLE);
 }
 
 //Helper
@@ -185,6 +192,7 @@ static int hwc_prepare_external(hwc_composer_device_1 *dev,
         reset_layer_prop(ctx, dpy, list->numHwLayers - 1);
         if(!ctx->dpyAttr[dpy].isPause) {
            ctx->dpyAttr[dpy].isConfiguring = false;
+           updateExtTransform(ctx, dpy);
            setListStats(ctx, list, dpy);
            if((ret = ctx->mMDPComp[dpy]->prepare(ctx, list)) < 0) {
               const int fbZ = 0;
@@ -221,6 +229,7 @@ static int hwc_prepare_virtual(hwc_composer_device_1 *dev,
         reset_layer_prop(ctx, dpy, list->numHwLayers - 1);
         if(!ctx->dpyAttr[dpy].isPause) {
             ctx->dpyAttr[dpy].isConfiguring = false;
+            updateExtTransform(ctx, dpy);
             setListStats(ctx, list, dpy);
             if(ctx->mMDPComp[dpy]->prepare(ctx, list) < 0) {
                 const int fbZ = 0;
@@ -254,6 +263,11 @@ static int hwc_prepare(hwc_composer_device_1 *dev, size_t numDisplays,
 
     //Will be unlocked at the end of set
     ctx->mDrawLock.lock();
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    ctx->mFrameTimeline->beginCycle(start);
+    //Picks up property changes for the whole frame
+    qdutils::PropCache::getInstance().refresh();
+    hotplug_prepare(ctx);
     reset(ctx, numDisplays, displays);
 
     ctx->mOverlay->configBegin();
@@ -281,6 +295,14 @@ static int hwc_prepare(hwc_composer_device_1 *dev, size_t numDisplays,
     ctx->mOverlay->configDone();
     ctx->mRotMgr->configDone();
 
+    for (int32_t i = numDisplays; i >= 0; i--) {
+        int dpy = getDpyforExternalDisplay(ctx, i);
+        ctx->mMetrics->addFrame(ctx, dpy, displays[i]);
+        ctx->mFrameTimeline->addFrame(ctx, dpy, displays[i]);
+    }
+    ctx->mPrepareTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    ctx->mSnapshot->publish(ctx);
+
     return ret;
 }
 
@@ -655,6 +677,7 @@ static int hwc_set(hwc_composer_device_1 *dev,
 {
     int ret = 0;
     hwc_context_t* ctx = (hwc_context_t*)(dev);
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     for (uint32_t i = 0; i <= numDisplays; i++) {
         hwc_display_contents_1_t* list = displays[i];
         int dpy = getDpyforExternalDisplay(ctx, i);
@@ -675,10 +698,12 @@ static int hwc_set(hwc_composer_device_1 *dev,
     // This is only indicative of how many times SurfaceFlinger posts
     // frames to the display.
     CALC_FPS();
-    MDPComp::resetIdleFallBack();
+    nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+    ctx->mMetrics->addCycle(ctx->mPrepareTime, end - start);
+    ctx->mFrameTimeline->endCycle(ctx->mPrepareTime, end);
+    //Composition cycle is complete, hotplug goes on off this thread
+    hotplug_set(ctx);
     //Was locked at the beginning of prepare
-    //Composition cycle is complete signal all waiting threads
-    ctx->mDrawLock.signal();
     ctx->mDrawLock.unlock();
     return ret;
 }
@@ -781,6 +806,8 @@ void hwc_dump(struct hwc_composer_device_1* dev, char *buff, int buff_len)
     for(int dpy = 0; dpy < HWC_NUM_DISPLAY_TYPES; dpy++) {
         if(ctx->mMDPComp[dpy])
             ctx->mMDPComp[dpy]->dump(aBuf);
+        if(ctx->mCopyBit[dpy])
+            ctx->mCopyBit[dpy]->dump(aBuf);
     }
     char ovDump[2048] = {'\0'};
     ctx->mOverlay->getDump(ovDump, 2048);
@@ -788,6 +815,14 @@ void hwc_dump(struct hwc_composer_device_1* dev, char *buff, int buff_len)
     ovDump[0] = '\0';
     ctx->mRotMgr->getDump(ovDump, 2048);
     dumpsys_log(aBuf, ovDump);
+    ovDump[0] = '\0';
+    qdutils::PropCache::getInstance().getDump(ovDump, 2048);
+    dumpsys_log(aBuf, ovDump);
+    ovDump[0] = '\0';
+    ctx->mEventLoop->getDump(ovDump, 2048);
+    dumpsys_log(aBuf, ovDump);
+    DumpWriter::dump(aBuf);
+    CaptureWriter::dump(aBuf);
     strlcpy(buff, aBuf.string(), buff_len);
 }
 
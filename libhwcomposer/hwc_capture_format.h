@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HWC_CAPTURE_FORMAT_H
+#define HWC_CAPTURE_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * Layout of a frame capture file (.qcap), shared by the writer in the HWC
+ * and the qcap_extract host tool. Only plain types, so it builds anywhere.
+ *
+ * The file is a QcapHeader followed by chunks, each a QcapChunk and mSize
+ * bytes of body, padded to QCAP_ALIGN. Chunks of an unknown type are to be
+ * skipped. The file ends with the last complete chunk.
+ *
+ * QCAP_CHUNK_PAYLOAD: a QcapPayload, then the buffer contents.
+ * QCAP_CHUNK_FRAME: a QcapFrame, then mNumLayers QcapLayer.
+ *
+ * A payload is written once per distinct buffer contents of a capture.
+ * Layers refer to it by id, 0 being no payload (bufferless layer, no CPU
+ * mapping or the copy was dropped). A payload is always written before the
+ * first frame that refers to it. All fields are in the byte order of the
+ * device.
+ */
+
+namespace qhwc {
+
+enum {
+    QCAP_MAGIC = 0x50414351, //"QCAP"
+    QCAP_VERSION = 1,
+    QCAP_ALIGN = 8,
+};
+
+enum eQcapChunk {
+    QCAP_CHUNK_PAYLOAD = 1,
+    QCAP_CHUNK_FRAME = 2,
+};
+
+enum eQcapFrameFlags {
+    //Layers beyond mNumLayers weren't recorded
+    QCAP_FRAME_TRUNCATED = 1 << 0,
+    //HWC_GEOMETRY_CHANGED was set on the list
+    QCAP_FRAME_GEOMETRY_CHANGED = 1 << 1,
+};
+
+struct QcapHeader {
+    uint32_t mMagic;
+    uint32_t mVersion;
+    uint32_t mDpy;
+    uint32_t mReserved;
+    //CLOCK_REALTIME at the start of the capture, ns
+    int64_t mStartTime;
+};
+
+struct QcapChunk {
+    uint32_t mType;
+    uint32_t mSize;
+};
+
+struct QcapPayload {
+    uint32_t mId;
+    int32_t mFormat;
+    int32_t mWidth;
+    int32_t mHeight;
+    uint32_t mSize;
+    uint32_t mReserved;
+    uint64_t mHash;
+};
+
+struct QcapFrame {
+    uint32_t mFrame;
+    uint32_t mFlags;
+    //CLOCK_MONOTONIC, ns
+    int64_t mTimestamp;
+    uint32_t mNumLayers;
+    uint32_t mReserved;
+};
+
+struct QcapLayer {
+    uint32_t mPayloadId;
+    int32_t mFormat;
+    int32_t mWidth;
+    int32_t mHeight;
+    int32_t mSourceCrop[4]; //l, t, r, b
+    int32_t mDisplayFrame[4];
+    uint32_t mTransform;
+    uint32_t mBlending;
+    uint32_t mPlaneAlpha;
+    uint32_t mCompositionType;
+    uint32_t mFlags;
+    uint32_t mHints;
+};
+
+} // namespace qhwc
+
+#endif /* HWC_CAPTURE_FORMAT_H */
@@ -23,9 +23,12 @@
 #include "hwc_copybit.h"
 #include "comptype.h"
 #include "mdp_version.h"
+#include "prop_cache.h"
 #include "gr.h"
 #include "cb_utils.h"
 #include "sync/sync.h"
+#include "hwc_metrics.h"
+#include "hwc_frame_timeline.h"
 
 using namespace qdutils;
 namespace qhwc {
@@ -174,9 +177,6 @@ bool CopyBit::prepare(hwc_context_t *ctx, hwc_display_contents_1_t *list,
                                      HAL_PIXEL_FORMAT_RGBA_8888);
         if (ret < 0) {
             return false;
-        } else {
-            mCurRenderBufferIndex = (mCurRenderBufferIndex + 1) %
-                NUM_RENDER_BUFFERS;
         }
     }
 
@@ -251,23 +251,27 @@ bool CopyBit::draw(hwc_context_t *ctx, hwc_display_contents_1_t *list,
         last = list->numHwLayers - 1;
         renderBuffer = (private_handle_t *)list->hwLayers[last].handle;
     } else {
+        nsecs_t stallTime = mRenderBufferStallTime;
+        mCurRenderBufferIndex = acquireRenderBuffer();
         renderBuffer = getCurrentRenderBuffer();
+        if(mRenderBufferStallTime != stallTime) {
+            ctx->mMetrics->addFenceWait(mRenderBufferStallTime - stallTime);
+            ctx->mFrameTimeline->addFenceWait(dpy, true,
+                    mRenderBufferStallTime - stallTime);
+        }
     }
     if (!renderBuffer) {
         ALOGE("%s: Render buffer layer handle is NULL", __FUNCTION__);
         return false;
     }
 
-    if (ctx->mMDP.version > qdutils::MDP_V4_3) {
-        //Wait for the previous frame to complete before rendering onto it
-        if(mRelFd[mCurRenderBufferIndex] >=0) {
-            sync_wait(mRelFd[mCurRenderBufferIndex], 1000);
-            close(mRelFd[mCurRenderBufferIndex]);
-            mRelFd[mCurRenderBufferIndex] = -1;
-        }
-    } else {
+    if (ctx->mMDP.version <= qdutils::MDP_V4_3) {
         if(list->hwLayers[last].acquireFenceFd >=0) {
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
             sync_wait(list->hwLayers[last].acquireFenceFd, 1000);
+            nsecs_t waitTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            ctx->mMetrics->addFenceWait(waitTime);
+            ctx->mFrameTimeline->addFenceWait(dpy, false, waitTime);
             close(list->hwLayers[last].acquireFenceFd);
             list->hwLayers[last].acquireFenceFd = -1;
         }
@@ -287,7 +291,11 @@ bool CopyBit::draw(hwc_context_t *ctx, hwc_display_contents_1_t *list,
         int ret = -1;
         if (list->hwLayers[i].acquireFenceFd != -1 ) {
             // Wait for acquire Fence on the App buffers.
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
             ret = sync_wait(list->hwLayers[i].acquireFenceFd, 1000);
+            nsecs_t waitTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            ctx->mMetrics->addFenceWait(waitTime);
+            ctx->mFrameTimeline->addFenceWait(dpy, false, waitTime);
             if(ret < 0) {
                 ALOGE("%s: sync_wait error!! error no = %d err str = %s",
                                     __FUNCTION__, errno, strerror(errno));
@@ -304,6 +312,8 @@ bool CopyBit::draw(hwc_context_t *ctx, hwc_display_contents_1_t *list,
     }
 
     if (copybitLayerCount) {
+        ctx->mMetrics->addBlits(copybitLayerCount);
+        ctx->mFrameTimeline->addBlits(dpy, copybitLayerCount);
         copybit_device_t *copybit = getCopyBitDevice();
         // Async mode
         copybit->flush_get_fence(copybit, fd);
@@ -536,7 +546,7 @@ bool CopyBit::validateParams(hwc_context_t *ctx,
 int CopyBit::allocRenderBuffers(int w, int h, int f)
 {
     int ret = 0;
-    for (int i = 0; i < NUM_RENDER_BUFFERS; i++) {
+    for (int i = 0; i < mNumRenderBuffers; i++) {
         if (mRenderBuffer[i] == NULL) {
             ret = alloc_buffer(&mRenderBuffer[i],
                                w, h, f,
@@ -552,7 +562,7 @@ int CopyBit::allocRenderBuffers(int w, int h, int f)
 
 void CopyBit::freeRenderBuffers()
 {
-    for (int i = 0; i < NUM_RENDER_BUFFERS; i++) {
+    for (int i = 0; i < MAX_RENDER_BUFFERS; i++) {
         if(mRenderBuffer[i]) {
             //Since we are freeing buffer close the fence if it has a valid one.
             if(mRelFd[i] >= 0) {
@@ -565,6 +575,37 @@ void CopyBit::freeRenderBuffers()
     }
 }
 
+int CopyBit::acquireRenderBuffer() {
+    mRenderBufferAcquires++;
+    // Walk the ring starting after the buffer used last and take the first
+    // one whose release fence has already signaled.
+    for (int i = 1; i <= mNumRenderBuffers; i++) {
+        int index = (mCurRenderBufferIndex + i) % mNumRenderBuffers;
+        if(mRelFd[index] < 0)
+            return index;
+        if(sync_wait(mRelFd[index], 0) == 0) {
+            close(mRelFd[index]);
+            mRelFd[index] = -1;
+            return index;
+        }
+    }
+
+    // All buffers are still on the display, wait for the oldest one
+    int index = (mCurRenderBufferIndex + 1) % mNumRenderBuffers;
+    nsecs_t start = systemTime();
+    if(sync_wait(mRelFd[index], 1000) < 0) {
+        ALOGE("%s: sync_wait error!! error no = %d err str = %s",
+                                    __FUNCTION__, errno, strerror(errno));
+    }
+    close(mRelFd[index]);
+    mRelFd[index] = -1;
+    mRenderBufferStalls++;
+    mRenderBufferStallTime += systemTime() - start;
+    ALOGD_IF(DEBUG_COPYBIT, "%s: stalled on render buffer %d", __FUNCTION__,
+                                                                    index);
+    return index;
+}
+
 private_handle_t * CopyBit::getCurrentRenderBuffer() {
     return mRenderBuffer[mCurRenderBufferIndex];
 }
@@ -575,12 +616,21 @@ void CopyBit::setReleaseFd(int fd) {
     mRelFd[mCurRenderBufferIndex] = dup(fd);
 }
 
+void CopyBit::dump(android::String8& buf) {
+    dumpsys_log(buf, "Copybit render buffers: %d acquires: %u stalls: %u "
+                "stall time: %llu us\n", mNumRenderBuffers,
+                mRenderBufferAcquires, mRenderBufferStalls,
+                (unsigned long long) ns2us(mRenderBufferStallTime));
+}
+
 struct copybit_device_t* CopyBit::getCopyBitDevice() {
     return mEngine;
 }
 
 CopyBit::CopyBit(hwc_context_t *ctx, const int& dpy) : mIsModeOn(false),
-        mCopyBitDraw(false), mCurRenderBufferIndex(0) {
+        mCopyBitDraw(false), mCurRenderBufferIndex(0),
+        mRenderBufferAcquires(0), mRenderBufferStalls(0),
+        mRenderBufferStallTime(0) {
 
     getBufferSizeAndDimensions(ctx->dpyAttr[dpy].xres,
             ctx->dpyAttr[dpy].yres,
@@ -589,12 +639,19 @@ CopyBit::CopyBit(hwc_context_t *ctx, const int& dpy) : mIsModeOn(false),
             mAlignedFBHeight);
 
     hw_module_t const *module;
-    for (int i = 0; i < NUM_RENDER_BUFFERS; i++) {
+    for (int i = 0; i < MAX_RENDER_BUFFERS; i++) {
         mRenderBuffer[i] = NULL;
         mRelFd[i] = -1;
     }
 
     char value[PROPERTY_VALUE_MAX];
+    mNumRenderBuffers = qdutils::PropCache::getInstance().getInt(
+            qdutils::PROP_COPYBIT_RENDERBUFS, 2);
+    if(mNumRenderBuffers < MIN_RENDER_BUFFERS)
+        mNumRenderBuffers = MIN_RENDER_BUFFERS;
+    else if(mNumRenderBuffers > MAX_RENDER_BUFFERS)
+        mNumRenderBuffers = MAX_RENDER_BUFFERS;
+
     property_get("debug.hwc.dynThreshold", value, "2");
     mDynThreshold = atof(value);
 
@@ -21,7 +21,10 @@
 #define HWC_COPYBIT_H
 #include "hwc_utils.h"
 
-#define NUM_RENDER_BUFFERS 2
+// Depth of the intermediate render buffer ring, configurable between
+// MIN and MAX via debug.hwc.copybit.renderbufs
+#define MIN_RENDER_BUFFERS 2
+#define MAX_RENDER_BUFFERS 4
 
 namespace qhwc {
 
@@ -44,6 +47,8 @@ public:
 
     void setReleaseFd(int fd);
 
+    void dump(android::String8& buf);
+
 private:
     // holds the copybit device
     struct copybit_device_t *mEngine;
@@ -72,13 +77,25 @@ private:
 
     int clear (private_handle_t* hnd, hwc_rect_t& rect);
 
-    private_handle_t* mRenderBuffer[NUM_RENDER_BUFFERS];
+    // Picks the next render buffer that is free for drawing, blocking only
+    // if every buffer in the ring is still held by the display.
+    int acquireRenderBuffer();
+
+    private_handle_t* mRenderBuffer[MAX_RENDER_BUFFERS];
+
+    // Number of render buffers in use
+    int mNumRenderBuffers;
 
     // Index of the current intermediate render buffer
     int mCurRenderBufferIndex;
 
     // Release FDs of the intermediate render buffer
-    int mRelFd[NUM_RENDER_BUFFERS];
+    int mRelFd[MAX_RENDER_BUFFERS];
+
+    // Render buffer statistics
+    uint32_t mRenderBufferAcquires;
+    uint32_t mRenderBufferStalls;
+    nsecs_t mRenderBufferStallTime;
 
     //Dynamic composition threshold for deciding copybit usage.
     double mDynThreshold;
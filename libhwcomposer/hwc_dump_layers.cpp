@@ -36,8 +36,7 @@
 #include <cutils/log.h>
 #include <sys/stat.h>
 #include <comptype.h>
-#include <SkBitmap.h>
-#include <SkImageEncoder.h>
+#include <prop_cache.h>
 
 namespace qhwc {
 
@@ -53,26 +52,33 @@ bool HwcDebug::sDumpEnable = false;
 HwcDebug::HwcDebug(uint32_t dpy):
   mDumpCntLimRaw(0),
   mDumpCntrRaw(1),
+  mDumpPropRaw(-1),
   mDumpCntLimPng(0),
   mDumpCntrPng(1),
-  mDpy(dpy) {
-    char dumpPropStr[PROPERTY_VALUE_MAX];
+  mDumpPropPng(-1),
+  mDpy(dpy),
+  mDumping(false),
+  mCaptureCntLim(0),
+  mCaptureCntr(0),
+  mCaptureProp(-1),
+  mCapturePrevCount(0) {
     if(mDpy) {
         strncpy(mDisplayName, "external", strlen("external"));
     } else {
         strncpy(mDisplayName, "primary", strlen("primary"));
     }
-    sprintf(mDumpPropKeyDisplayType, "debug.sf.dump.%s", (char *)mDisplayName);
 
-    if ((property_get("debug.sf.dump.enable", dumpPropStr, NULL) > 0)) {
-        if(!strncmp(dumpPropStr, "true", strlen("true"))) {
-            sDumpEnable = true;
-        }
+    if (qdutils::PropCache::getInstance().getBool(
+            qdutils::PROP_SF_DUMP_ENABLE, false)) {
+        sDumpEnable = true;
     }
 }
 
 void HwcDebug::dumpLayers(hwc_display_contents_1_t* list)
 {
+    if (UNLIKELY(sDumpEnable) && LIKELY(list) && UNLIKELY(needToCapture()))
+        captureFrame(list);
+
     // Check need for dumping layers for debugging.
     if (UNLIKELY(sDumpEnable) && UNLIKELY(needToDumpLayers()) && LIKELY(list)) {
         logHwcProps(list->flags);
@@ -80,26 +86,26 @@ void HwcDebug::dumpLayers(hwc_display_contents_1_t* list)
             logLayer(i, list->hwLayers);
             dumpLayer(i, list->hwLayers);
         }
+        mDumping = true;
+    } else if (UNLIKELY(mDumping)) {
+        // Capture over, give back the staging memory
+        DumpWriter::getInstance()->trim();
+        mDumping = false;
     }
 }
 
 bool HwcDebug::needToDumpLayers()
 {
     bool bDumpLayer = false;
-    char dumpPropStr[PROPERTY_VALUE_MAX];
-    // Enable primary dump and disable external dump by default.
-    bool bDumpEnable = !mDpy;
+    qdutils::PropCache& props = qdutils::PropCache::getInstance();
     time_t timeNow;
     tm dumpTime;
 
-    // Override the bDumpEnable based on the property value, if the property
-    // is present in the build.prop file.
-    if ((property_get(mDumpPropKeyDisplayType, dumpPropStr, NULL) > 0)) {
-        if(!strncmp(dumpPropStr, "true", strlen("true")))
-            bDumpEnable = true;
-        else
-            bDumpEnable = false;
-    }
+    // Enable primary dump and disable external dump by default. Override
+    // based on the property value, if the property is present in the
+    // build.prop file.
+    bool bDumpEnable = props.getBool(mDpy ? qdutils::PROP_SF_DUMP_EXTERNAL :
+            qdutils::PROP_SF_DUMP_PRIMARY, !mDpy);
 
     if (false == bDumpEnable)
         return false;
@@ -107,11 +113,11 @@ bool HwcDebug::needToDumpLayers()
     time(&timeNow);
     localtime_r(&timeNow, &dumpTime);
 
-    if ((property_get("debug.sf.dump.png", dumpPropStr, NULL) > 0) &&
-            (strncmp(dumpPropStr, mDumpPropStrPng, PROPERTY_VALUE_MAX - 1))) {
-        // Strings exist & not equal implies it has changed, so trigger a dump
-        strncpy(mDumpPropStrPng, dumpPropStr, PROPERTY_VALUE_MAX - 1);
-        mDumpCntLimPng = atoi(dumpPropStr);
+    if (props.isSet(qdutils::PROP_SF_DUMP_PNG) &&
+            (props.getInt(qdutils::PROP_SF_DUMP_PNG, 0) != mDumpPropPng)) {
+        // Value exists & changed, so trigger a dump
+        mDumpPropPng = props.getInt(qdutils::PROP_SF_DUMP_PNG, 0);
+        mDumpCntLimPng = mDumpPropPng;
         if (mDumpCntLimPng > MAX_ALLOWED_FRAMEDUMPS) {
             ALOGW("Warning: Using debug.sf.dump.png %d (= max)",
                 MAX_ALLOWED_FRAMEDUMPS);
@@ -137,11 +143,11 @@ bool HwcDebug::needToDumpLayers()
     if (mDumpCntrPng <= mDumpCntLimPng)
         mDumpCntrPng++;
 
-    if ((property_get("debug.sf.dump", dumpPropStr, NULL) > 0) &&
-            (strncmp(dumpPropStr, mDumpPropStrRaw, PROPERTY_VALUE_MAX - 1))) {
-        // Strings exist & not equal implies it has changed, so trigger a dump
-        strncpy(mDumpPropStrRaw, dumpPropStr, PROPERTY_VALUE_MAX - 1);
-        mDumpCntLimRaw = atoi(dumpPropStr);
+    if (props.isSet(qdutils::PROP_SF_DUMP) &&
+            (props.getInt(qdutils::PROP_SF_DUMP, 0) != mDumpPropRaw)) {
+        // Value exists & changed, so trigger a dump
+        mDumpPropRaw = props.getInt(qdutils::PROP_SF_DUMP, 0);
+        mDumpCntLimRaw = mDumpPropRaw;
         if (mDumpCntLimRaw > MAX_ALLOWED_FRAMEDUMPS) {
             ALOGW("Warning: Using debug.sf.dump %d (= max)",
                 MAX_ALLOWED_FRAMEDUMPS);
@@ -171,6 +177,94 @@ bool HwcDebug::needToDumpLayers()
     return bDumpLayer;
 }
 
+bool HwcDebug::needToCapture()
+{
+    qdutils::PropCache& props = qdutils::PropCache::getInstance();
+
+    if (props.isSet(qdutils::PROP_SF_CAPTURE) &&
+            (props.getInt(qdutils::PROP_SF_CAPTURE, 0) != mCaptureProp)) {
+        // Value exists & changed, so end the capture in progress and
+        // trigger a new one
+        mCaptureProp = props.getInt(qdutils::PROP_SF_CAPTURE, 0);
+        if (mCaptureCntr < mCaptureCntLim)
+            CaptureWriter::getInstance()->end(mDpy);
+        mCaptureCntLim = mCaptureProp;
+        if (mCaptureCntLim > MAX_ALLOWED_FRAMEDUMPS) {
+            ALOGW("Warning: Using debug.sf.capture %d (= max)",
+                MAX_ALLOWED_FRAMEDUMPS);
+            mCaptureCntLim = MAX_ALLOWED_FRAMEDUMPS;
+        }
+        mCaptureCntLim = (mCaptureCntLim < 0) ? 0: mCaptureCntLim;
+        mCaptureCntr = mCaptureCntLim;
+
+        bool bDumpEnable = props.getBool(mDpy ?
+                qdutils::PROP_SF_DUMP_EXTERNAL :
+                qdutils::PROP_SF_DUMP_PRIMARY, !mDpy);
+        if (mCaptureCntLim && bDumpEnable) {
+            char fileName[PATH_MAX];
+            time_t timeNow;
+            tm captureTime;
+            time(&timeNow);
+            localtime_r(&timeNow, &captureTime);
+            snprintf(fileName, sizeof(fileName),
+                    "/data/sfcapture.%s.%04d.%02d.%02d.%02d.%02d.%02d.qcap",
+                    mDisplayName, captureTime.tm_year + 1900,
+                    captureTime.tm_mon + 1, captureTime.tm_mday,
+                    captureTime.tm_hour, captureTime.tm_min,
+                    captureTime.tm_sec);
+            if (CaptureWriter::getInstance()->begin(mDpy, fileName)) {
+                mCaptureCntr = 0;
+                mCapturePrevCount = 0;
+            }
+        }
+    }
+
+    return (mCaptureCntr < mCaptureCntLim);
+}
+
+void HwcDebug::captureFrame(hwc_display_contents_1_t* list)
+{
+    CaptureWriter::LayerSource sources[CaptureWriter::MAX_LAYERS];
+    const private_handle_t *handles[CaptureWriter::MAX_LAYERS];
+    int numLayers = list->numHwLayers;
+    if (numLayers > CaptureWriter::MAX_LAYERS)
+        numLayers = CaptureWriter::MAX_LAYERS;
+
+    for (int i = 0; i < numLayers; i++) {
+        private_handle_t *hnd = (private_handle_t *)list->hwLayers[i].handle;
+        handles[i] = hnd;
+        sources[i].mSource = CaptureWriter::SRC_NONE;
+        sources[i].mPrevIndex = -1;
+        if (NULL == hnd || !hnd->base)
+            continue;
+        // A buffer is only replaced by queueing another one, so a handle
+        // still on screen from the last frame has the same contents
+        sources[i].mSource = CaptureWriter::SRC_COPY;
+        for (int j = 0; j < mCapturePrevCount; j++) {
+            if (mCapturePrev[j] == hnd) {
+                sources[i].mSource = CaptureWriter::SRC_PREV;
+                sources[i].mPrevIndex = j;
+                break;
+            }
+        }
+    }
+
+    mCaptureCntr++;
+    if (!CaptureWriter::getInstance()->queueFrame(mDpy, mCaptureCntr, list,
+            sources)) {
+        ALOGI("Display[%s] [capture-frame: %03d of %03d] Dropped: staging "
+            "full or over rate", mDisplayName, mCaptureCntr, mCaptureCntLim);
+        // The file lost this frame, so the next one can't refer back to it
+        mCapturePrevCount = 0;
+    } else {
+        memcpy(mCapturePrev, handles, numLayers * sizeof(handles[0]));
+        mCapturePrevCount = numLayers;
+    }
+
+    if (mCaptureCntr == mCaptureCntLim)
+        CaptureWriter::getInstance()->end(mDpy);
+}
+
 void HwcDebug::logHwcProps(uint32_t listFlags)
 {
     static int hwcModuleCompType = -1;
@@ -178,10 +272,8 @@ void HwcDebug::logHwcProps(uint32_t listFlags)
     static String8 hwcModuleCompTypeLog("");
     if (-1 == hwcModuleCompType) {
         // One time stuff
-        char mdpCompPropStr[PROPERTY_VALUE_MAX];
-        if (property_get("debug.mdpcomp.maxlayer", mdpCompPropStr, NULL) > 0) {
-            sMdpCompMaxLayers = atoi(mdpCompPropStr);
-        }
+        sMdpCompMaxLayers = qdutils::PropCache::getInstance().getInt(
+                qdutils::PROP_MDPCOMP_MAXLAYER, 0);
         hwcModuleCompType =
             qdutils::QCCompositionType::getInstance().getCompositionType();
         hwcModuleCompTypeLog.appendFormat("%s%s%s%s%s%s",
@@ -304,58 +396,40 @@ void HwcDebug::dumpLayer(size_t layerIndex, hwc_layer_1_t hwLayers[])
     getHalPixelFormatStr(hnd->format, pixFormatStr);
 
     if (needDumpPng && hnd->base) {
-        bool bResult = false;
         char dumpFilename[PATH_MAX];
-        SkBitmap *tempSkBmp = new SkBitmap();
-        SkBitmap::Config tempSkBmpConfig = SkBitmap::kNo_Config;
         sprintf(dumpFilename, "%s/sfdump%03d.layer%d.%s.png", mDumpDirPng,
             mDumpCntrPng, layerIndex, mDisplayName);
 
-        switch (hnd->format) {
-            case HAL_PIXEL_FORMAT_RGBA_8888:
-            case HAL_PIXEL_FORMAT_RGBX_8888:
-            case HAL_PIXEL_FORMAT_BGRA_8888:
-                tempSkBmpConfig = SkBitmap::kARGB_8888_Config;
-                break;
-            case HAL_PIXEL_FORMAT_RGB_565:
-                tempSkBmpConfig = SkBitmap::kRGB_565_Config;
-                break;
-            case HAL_PIXEL_FORMAT_RGB_888:
-            default:
-                tempSkBmpConfig = SkBitmap::kNo_Config;
-                break;
-        }
-        if (SkBitmap::kNo_Config != tempSkBmpConfig) {
-            tempSkBmp->setConfig(tempSkBmpConfig, hnd->width, hnd->height);
-            tempSkBmp->setPixels((void*)hnd->base);
-            bResult = SkImageEncoder::EncodeFile(dumpFilename,
-                                    *tempSkBmp, SkImageEncoder::kPNG_Type, 100);
-            ALOGI("Display[%s] Layer[%d] %s Dump to %s: %s",
-                mDisplayName, layerIndex, dumpLogStrPng,
-                dumpFilename, bResult ? "Success" : "Fail");
+        if (DumpWriter::canEncodePng(hnd->format)) {
+            char logStr[128];
+            snprintf(logStr, sizeof(logStr), "Display[%s] Layer[%d] %s",
+                mDisplayName, layerIndex, dumpLogStrPng);
+            if (!DumpWriter::getInstance()->queue(hnd, DumpWriter::DUMP_PNG,
+                    dumpFilename, logStr)) {
+                ALOGI("%s Dropped dump to %s: staging full or over rate", logStr,
+                    dumpFilename);
+            }
         } else {
             ALOGI("Display[%s] Layer[%d] %s Skipping dump: Unsupported layer"
                 " format %s for png encoder",
                 mDisplayName, layerIndex, dumpLogStrPng, pixFormatStr);
         }
-        delete tempSkBmp; // Calls SkBitmap::freePixels() internally.
     }
 
     if (needDumpRaw && hnd->base) {
         char dumpFilename[PATH_MAX];
-        bool bResult = false;
+        char logStr[128];
         sprintf(dumpFilename, "%s/sfdump%03d.layer%d.%dx%d.%s.%s.raw",
             mDumpDirRaw, mDumpCntrRaw,
             layerIndex, hnd->width, hnd->height,
             pixFormatStr, mDisplayName);
-        FILE* fp = fopen(dumpFilename, "w+");
-        if (NULL != fp) {
-            bResult = (bool) fwrite((void*)hnd->base, hnd->size, 1, fp);
-            fclose(fp);
+        snprintf(logStr, sizeof(logStr), "Display[%s] Layer[%d] %s",
+            mDisplayName, layerIndex, dumpLogStrRaw);
+        if (!DumpWriter::getInstance()->queue(hnd, DumpWriter::DUMP_RAW,
+                dumpFilename, logStr)) {
+            ALOGI("%s Dropped dump to %s: staging full or over rate", logStr,
+                dumpFilename);
         }
-        ALOGI("Display[%s] Layer[%d] %s Dump to %s: %s",
-            mDisplayName, layerIndex, dumpLogStrRaw,
-            dumpFilename, bResult ? "Success" : "Fail");
     }
 }
 
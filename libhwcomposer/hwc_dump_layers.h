@@ -35,9 +35,222 @@
 #include <ui/Region.h>
 #include <hardware/hwcomposer.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
+#include <gr.h>
+#include <hwc_utils.h>
+#include "hwc_capture_format.h"
 
 namespace qhwc {
 
+/*
+ * Token bucket bounding the buffer copies of the writers: refills at rate
+ * bytes per second, up to rate, which is also the burst.
+ */
+class CopyBudget {
+public:
+    explicit CopyBudget(const int64_t& rate);
+    /* Takes size bytes of budget at time now, false if there isn't enough */
+    bool take(const size_t& size, const nsecs_t& now);
+    int64_t getBudget() const { return mBudget; }
+
+private:
+    int64_t mRate;
+    int64_t mBudget;
+    nsecs_t mLastRefill;
+};
+
+/*
+ * Writes layer dumps to files on a background thread. The frame path only
+ * copies the buffer into a slot of a bounded staging pool; a copy that
+ * doesn't fit the pool, or the copy rate budget, is dropped and counted.
+ * Raw dumps are gzipped when "debug.sf.dump.gzip" is true.
+ */
+class DumpWriter : public android::Thread {
+public:
+    enum eDumpType { DUMP_RAW, DUMP_PNG };
+
+    static DumpWriter *getInstance();
+    /* Appends the writer stats, if it ever ran */
+    static void dump(android::String8& buf);
+
+    /* Copies the buffer of hnd and queues it to be written to fileName.
+     * Never blocks. Returns false if the dump was dropped */
+    bool queue(const private_handle_t *hnd, const eDumpType& type,
+            const char *fileName, const char *logStr);
+    /* Frees the memory of idle slots */
+    void trim();
+    /* Whether a dump of format can be PNG encoded */
+    static bool canEncodePng(const int& format);
+
+    virtual bool threadLoop();
+
+private:
+    enum {
+        MAX_JOBS = 8,
+        MAX_POOL_BYTES = 48 << 20,
+        //Copy budget, bytes per second, also the burst
+        MAX_COPY_RATE = 256 << 20,
+    };
+    struct Job {
+        bool mBusy;
+        void *mData;
+        size_t mCapacity;
+        size_t mSize;
+        int mFormat;
+        int mWidth;
+        int mHeight;
+        eDumpType mType;
+        char mFileName[PATH_MAX];
+        char mLogStr[128];
+    };
+
+    //Drives a writer that isn't run, in place of its thread
+    friend class DumpWriterTest;
+
+    DumpWriter();
+    bool write(const Job& job);
+
+    Job mJobs[MAX_JOBS];
+    int mQueue[MAX_JOBS];
+    int mHead;
+    int mCount;
+    //Memory held by the slots
+    size_t mPoolBytes;
+    CopyBudget mBudget;
+    uint32_t mQueued;
+    uint32_t mWritten;
+    uint32_t mFailed;
+    uint32_t mDroppedFull;
+    uint32_t mDroppedRate;
+    uint64_t mBytesWritten;
+    nsecs_t mMaxCopyTime;
+    Locker mLock;
+    static android::sp<DumpWriter> sInstance;
+};
+
+/*
+ * Writes frame captures: one append-only file per display and capture,
+ * laid out as in hwc_capture_format.h and extracted offline by qcap_extract.
+ * Each frame records the metadata of its layers; buffer contents are
+ * written only when they change.
+ * The frame path copies only the buffers whose handle wasn't in the
+ * previous frame, within the same staging and rate bounds as DumpWriter.
+ * The writer thread hashes the copies, keeps only those not seen before in
+ * the capture, and appends through a window mapped over the file, which is
+ * grown by MAP_WINDOW at a time and trimmed to size when the capture ends.
+ */
+class CaptureWriter : public android::Thread {
+public:
+    enum { MAX_LAYERS = MAX_NUM_APP_LAYERS + 1 };
+    /* Where a layer of a queued frame takes its payload from */
+    enum eSource { SRC_NONE, SRC_PREV, SRC_COPY };
+    struct LayerSource {
+        int mSource;
+        //For SRC_PREV, the layer of the previous queued frame
+        int mPrevIndex;
+    };
+
+    static CaptureWriter *getInstance();
+    /* Appends the writer stats, if it ever ran */
+    static void dump(android::String8& buf);
+
+    /* Starts a capture of dpy to fileName, ending the one in progress */
+    bool begin(const int& dpy, const char *fileName);
+    /* Queues a frame of dpy. Buffers of SRC_COPY layers are copied.
+     * Never blocks. Returns false if the frame was dropped, in which
+     * case the next frame can't refer to this one */
+    bool queueFrame(const int& dpy, const uint32_t& frameNo,
+            hwc_display_contents_1_t *list, const LayerSource sources[]);
+    /* Ends the capture of dpy, after the frames queued so far */
+    bool end(const int& dpy);
+
+    virtual bool threadLoop();
+
+private:
+    enum {
+        MAX_FRAMES = 4,
+        MAX_CMDS = 16,
+        MAX_POOL_BYTES = 64 << 20,
+        //Copy budget, bytes per second, also the burst
+        MAX_COPY_RATE = 256 << 20,
+        MAP_WINDOW = 8 << 20,
+        //Payloads remembered for deduplication, a power of 2
+        HASH_SLOTS = 4096,
+    };
+    enum eCmd { CMD_BEGIN, CMD_FRAME, CMD_END };
+    struct Cmd {
+        int mCmd;
+        int mDpy;
+        //Frame slot for CMD_FRAME
+        int mSlot;
+        char mFileName[PATH_MAX];
+    };
+    struct Frame {
+        bool mBusy;
+        QcapFrame mInfo;
+        QcapLayer mLayers[MAX_LAYERS];
+        LayerSource mSources[MAX_LAYERS];
+        void *mData[MAX_LAYERS];
+        size_t mCapacity[MAX_LAYERS];
+        size_t mSize[MAX_LAYERS];
+    };
+    struct HashSlot {
+        uint64_t mHash;
+        uint32_t mSize;
+        uint32_t mId;
+    };
+    /* An open capture, only touched by the writer thread */
+    struct Stream {
+        int mFd;
+        uint8_t *mMap;
+        uint64_t mMapOffset;
+        uint64_t mOffset;
+        uint32_t mNextId;
+        uint32_t mPrevIds[MAX_LAYERS];
+        uint32_t mPrevCount;
+        HashSlot mHashes[HASH_SLOTS];
+        uint32_t mFrames;
+        uint32_t mPayloads;
+        uint32_t mDedups;
+    };
+
+    //Drives a writer that isn't run, in place of its thread
+    friend class CaptureWriterTest;
+
+    CaptureWriter();
+    bool pushCmd(const int& cmd, const int& dpy, const int& slot,
+            const char *fileName);
+    /* Grows the slot buffer of a layer, within the pool */
+    bool reserve(Frame& frame, const int& layer, const size_t& size);
+    void openStream(Stream& stream, const int& dpy, const char *fileName);
+    void closeStream(Stream& stream);
+    bool writeFrame(Stream& stream, Frame& frame);
+    /* Payload id of data, written first if new to the capture */
+    bool getPayloadId(Stream& stream, const QcapLayer& layer,
+            const void *data, const size_t& size, uint32_t& id);
+    bool writeChunk(Stream& stream, const uint32_t& type,
+            const void *head, const size_t& headSize,
+            const void *body, const size_t& bodySize);
+    bool append(Stream& stream, const void *data, size_t size);
+    static uint64_t hash(const void *data, const size_t& size);
+
+    Frame mFrames[MAX_FRAMES];
+    Cmd mCmds[MAX_CMDS];
+    int mHead;
+    int mCount;
+    Stream mStreams[HWC_NUM_DISPLAY_TYPES];
+    size_t mPoolBytes;
+    CopyBudget mBudget;
+    uint32_t mQueued;
+    uint32_t mDroppedFull;
+    uint32_t mDroppedRate;
+    uint32_t mFailed;
+    uint64_t mBytesCopied;
+    uint64_t mBytesWritten;
+    Locker mLock;
+    static android::sp<CaptureWriter> sInstance;
+};
+
 class HwcDebug {
 private:
 
@@ -45,15 +258,22 @@ private:
 // property)" does not work.
   int mDumpCntLimRaw;
   int mDumpCntrRaw;
-  char mDumpPropStrRaw[PROPERTY_VALUE_MAX];
+  int mDumpPropRaw;
   char mDumpDirRaw[PATH_MAX];
   int mDumpCntLimPng;
   int mDumpCntrPng;
-  char mDumpPropStrPng[PROPERTY_VALUE_MAX];
+  int mDumpPropPng;
   char mDumpDirPng[PATH_MAX];
   uint32_t mDpy;
   char mDisplayName[PROPERTY_VALUE_MAX];
-  char mDumpPropKeyDisplayType[PROPERTY_KEY_MAX];
+  // Dumps were queued in the last frame
+  bool mDumping;
+  int mCaptureCntLim;
+  int mCaptureCntr;
+  int mCaptureProp;
+  // Handles of the last frame queued for capture
+  const private_handle_t *mCapturePrev[CaptureWriter::MAX_LAYERS];
+  int mCapturePrevCount;
   static bool sDumpEnable;
 
 public:
@@ -69,6 +289,32 @@ public:
      */
     void dumpLayers(hwc_display_contents_1_t* list);
 
+/*
+ * Checks if frames need to be captured based on system property
+ * "debug.sf.capture", gated like the layer dumps by "debug.sf.dump.enable"
+ * and "debug.sf.dump.primary" / "debug.sf.dump.external".
+ *
+ * To capture 300 frames in a single file, do,
+ *     adb shell setprop debug.sf.capture 300
+ * The capture is written to /data/sfcapture.<display>.<time>.qcap and is
+ * turned into raw buffer files and a frame listing on a host with,
+ *     qcap_extract <file.qcap> [<output dir>]
+ * Setting another value starts a new capture, 0 ends the one in progress.
+ *
+ * @return: true if the frame needs to be captured.
+ */
+bool needToCapture();
+
+/*
+ * Queues the layers of a frame for capture. Layers whose handle was in the
+ * previous frame are taken as unchanged and refer to its payload, the
+ * others have their buffer copied.
+ *
+ * @param: list - The HWC layer-list to capture.
+ *
+ */
+void captureFrame(hwc_display_contents_1_t* list);
+
 /*
  * Checks if layers need to be dumped based on system property "debug.sf.dump"
  * for raw dumps and "debug.sf.dump.png" for png dumps.
@@ -96,6 +342,9 @@ public:
  * To dump another 25 or so frames in raw format, do,
  *     adb shell setprop debug.sf.dump 26
  *
+ * To write raw dumps gzipped, do,
+ *     adb shell setprop debug.sf.dump.gzip true
+ *
  * To turn off logcat logging of layer-info, set both properties to 0,
  *     adb shell setprop debug.sf.dump.png 0
  *     adb shell setprop debug.sf.dump 0
@@ -122,7 +371,8 @@ void logHwcProps(uint32_t listFlags);
 void logLayer(size_t layerIndex, hwc_layer_1_t hwLayers[]);
 
 /*
- * Dumps a layer buffer into raw/png files.
+ * Dumps a layer buffer into raw/png files. The buffer is copied and the
+ * files are written by DumpWriter, off the composition thread.
  *
  * @param: layerIndex - Index of layer being dumped.
  * @param: hwLayers - Address of hwc_layer_1_t to log and dump.
@@ -0,0 +1,656 @@
+/*
+ * Copyright (c) 2013, Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LOG_TAG
+#define LOG_TAG "qsfdump"
+#endif
+#include <hwc_dump_layers.h>
+#include <cutils/log.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <prop_cache.h>
+#include <SkBitmap.h>
+#include <SkImageEncoder.h>
+#include <zlib.h>
+
+namespace qhwc {
+
+android::sp<DumpWriter> DumpWriter::sInstance(0);
+android::sp<CaptureWriter> CaptureWriter::sInstance(0);
+
+CopyBudget::CopyBudget(const int64_t& rate) : mRate(rate), mBudget(rate),
+    mLastRefill(systemTime(SYSTEM_TIME_MONOTONIC)) {
+}
+
+bool CopyBudget::take(const size_t& size, const nsecs_t& now)
+{
+    mBudget += (int64_t)(now - mLastRefill) * mRate / 1000000000LL;
+    if(mBudget > mRate)
+        mBudget = mRate;
+    mLastRefill = now;
+    if(mBudget < (int64_t)size)
+        return false;
+    mBudget -= size;
+    return true;
+}
+
+static SkBitmap::Config getSkBitmapConfig(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return SkBitmap::kARGB_8888_Config;
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return SkBitmap::kRGB_565_Config;
+        case HAL_PIXEL_FORMAT_RGB_888:
+        default:
+            return SkBitmap::kNo_Config;
+    }
+}
+
+DumpWriter::DumpWriter(): Thread(false), mHead(0), mCount(0),
+    mPoolBytes(0), mBudget(MAX_COPY_RATE), mQueued(0), mWritten(0),
+    mFailed(0), mDroppedFull(0), mDroppedRate(0), mBytesWritten(0),
+    mMaxCopyTime(0) {
+    memset(mJobs, 0, sizeof(mJobs));
+}
+
+DumpWriter *DumpWriter::getInstance()
+{
+    if(sInstance.get() == NULL) {
+        sInstance = new DumpWriter();
+        sInstance->run("HwcDumpWriter", android::PRIORITY_BACKGROUND);
+    }
+    return sInstance.get();
+}
+
+bool DumpWriter::canEncodePng(const int& format)
+{
+    return getSkBitmapConfig(format) != SkBitmap::kNo_Config;
+}
+
+bool DumpWriter::queue(const private_handle_t *hnd, const eDumpType& type,
+        const char *fileName, const char *logStr)
+{
+    Locker::Autolock _l(mLock);
+    int slot = -1;
+    for(int i = 0; i < MAX_JOBS; i++) {
+        if(mJobs[i].mBusy)
+            continue;
+        //Prefer a slot that is big enough already
+        if(slot < 0 || mJobs[i].mCapacity >= (size_t)hnd->size)
+            slot = i;
+        if(mJobs[slot].mCapacity >= (size_t)hnd->size)
+            break;
+    }
+
+    if(slot < 0) {
+        mDroppedFull++;
+        return false;
+    }
+
+    Job& job = mJobs[slot];
+    if(job.mCapacity < (size_t)hnd->size) {
+        if(mPoolBytes - job.mCapacity + hnd->size > MAX_POOL_BYTES) {
+            mDroppedFull++;
+            return false;
+        }
+        free(job.mData);
+        mPoolBytes -= job.mCapacity;
+        job.mCapacity = 0;
+        job.mData = malloc(hnd->size);
+        if(!job.mData) {
+            mDroppedFull++;
+            return false;
+        }
+        job.mCapacity = hnd->size;
+        mPoolBytes += job.mCapacity;
+    }
+
+    if(!mBudget.take(hnd->size, systemTime(SYSTEM_TIME_MONOTONIC))) {
+        mDroppedRate++;
+        return false;
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    memcpy(job.mData, (void*)hnd->base, hnd->size);
+    nsecs_t copyTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    if(copyTime > mMaxCopyTime)
+        mMaxCopyTime = copyTime;
+
+    job.mSize = hnd->size;
+    job.mFormat = hnd->format;
+    job.mWidth = hnd->width;
+    job.mHeight = hnd->height;
+    job.mType = type;
+    strlcpy(job.mFileName, fileName, sizeof(job.mFileName));
+    strlcpy(job.mLogStr, logStr, sizeof(job.mLogStr));
+    job.mBusy = true;
+
+    mQueue[(mHead + mCount) % MAX_JOBS] = slot;
+    mCount++;
+    mQueued++;
+    mLock.signal();
+    return true;
+}
+
+void DumpWriter::trim()
+{
+    Locker::Autolock _l(mLock);
+    for(int i = 0; i < MAX_JOBS; i++) {
+        if(mJobs[i].mBusy || !mJobs[i].mData)
+            continue;
+        free(mJobs[i].mData);
+        mJobs[i].mData = NULL;
+        mPoolBytes -= mJobs[i].mCapacity;
+        mJobs[i].mCapacity = 0;
+    }
+}
+
+bool DumpWriter::write(const Job& job)
+{
+    bool bResult = false;
+    if (job.mType == DUMP_PNG) {
+        SkBitmap *tempSkBmp = new SkBitmap();
+        tempSkBmp->setConfig(getSkBitmapConfig(job.mFormat), job.mWidth,
+                job.mHeight);
+        tempSkBmp->setPixels(job.mData);
+        bResult = SkImageEncoder::EncodeFile(job.mFileName,
+                                *tempSkBmp, SkImageEncoder::kPNG_Type, 100);
+        delete tempSkBmp; // Calls SkBitmap::freePixels() internally.
+    } else if (qdutils::PropCache::getInstance().getBool(
+            qdutils::PROP_SF_DUMP_GZIP, false)) {
+        char gzFilename[PATH_MAX];
+        snprintf(gzFilename, sizeof(gzFilename), "%s.gz", job.mFileName);
+        //Fastest level, the pool drains faster than it would at 9
+        gzFile gz = gzopen(gzFilename, "wb1");
+        if (NULL != gz) {
+            bResult = (gzwrite(gz, job.mData, job.mSize) == (int)job.mSize);
+            bResult = (gzclose(gz) == Z_OK) && bResult;
+        }
+    } else {
+        FILE* fp = fopen(job.mFileName, "w+");
+        if (NULL != fp) {
+            bResult = (bool) fwrite(job.mData, job.mSize, 1, fp);
+            fclose(fp);
+        }
+    }
+    ALOGI("%s Dump to %s: %s", job.mLogStr, job.mFileName,
+            bResult ? "Success" : "Fail");
+    return bResult;
+}
+
+bool DumpWriter::threadLoop()
+{
+    int slot = -1;
+    {
+        Locker::Autolock _l(mLock);
+        while (!mCount)
+            mLock.wait();
+        slot = mQueue[mHead];
+        mHead = (mHead + 1) % MAX_JOBS;
+        mCount--;
+    }
+
+    //Busy slots are left alone by queue(), no lock needed
+    bool bResult = write(mJobs[slot]);
+
+    Locker::Autolock _l(mLock);
+    if (bResult) {
+        mWritten++;
+        mBytesWritten += mJobs[slot].mSize;
+    } else {
+        mFailed++;
+    }
+    mJobs[slot].mBusy = false;
+    return true;
+}
+
+void DumpWriter::dump(android::String8& buf)
+{
+    DumpWriter *writer = sInstance.get();
+    if (!writer)
+        return;
+    Locker::Autolock _l(writer->mLock);
+    buf.appendFormat("Layer dumps queued=%u written=%u failed=%u "
+            "dropped full=%u rate=%u pool=%uKB written=%lluKB "
+            "max copy=%lldus\n", writer->mQueued, writer->mWritten,
+            writer->mFailed, writer->mDroppedFull, writer->mDroppedRate,
+            (uint32_t)(writer->mPoolBytes / 1024),
+            writer->mBytesWritten / 1024, ns2us(writer->mMaxCopyTime));
+}
+
+CaptureWriter::CaptureWriter(): Thread(false), mHead(0), mCount(0),
+    mPoolBytes(0), mBudget(MAX_COPY_RATE), mQueued(0),
+    mDroppedFull(0), mDroppedRate(0), mFailed(0), mBytesCopied(0),
+    mBytesWritten(0) {
+    memset(mFrames, 0, sizeof(mFrames));
+    memset(mCmds, 0, sizeof(mCmds));
+    memset(mStreams, 0, sizeof(mStreams));
+    for(int i = 0; i < HWC_NUM_DISPLAY_TYPES; i++)
+        mStreams[i].mFd = -1;
+}
+
+CaptureWriter *CaptureWriter::getInstance()
+{
+    if(sInstance.get() == NULL) {
+        sInstance = new CaptureWriter();
+        sInstance->run("HwcCaptureWriter", android::PRIORITY_BACKGROUND);
+    }
+    return sInstance.get();
+}
+
+bool CaptureWriter::pushCmd(const int& cmd, const int& dpy, const int& slot,
+        const char *fileName)
+{
+    if(mCount == MAX_CMDS)
+        return false;
+    Cmd& c = mCmds[(mHead + mCount) % MAX_CMDS];
+    c.mCmd = cmd;
+    c.mDpy = dpy;
+    c.mSlot = slot;
+    c.mFileName[0] = '\0';
+    if(fileName)
+        strlcpy(c.mFileName, fileName, sizeof(c.mFileName));
+    mCount++;
+    mLock.signal();
+    return true;
+}
+
+bool CaptureWriter::begin(const int& dpy, const char *fileName)
+{
+    Locker::Autolock _l(mLock);
+    if(!pushCmd(CMD_BEGIN, dpy, -1, fileName)) {
+        ALOGE("%s: queue full, capture of display %d not started",
+                __FUNCTION__, dpy);
+        return false;
+    }
+    return true;
+}
+
+bool CaptureWriter::end(const int& dpy)
+{
+    Locker::Autolock _l(mLock);
+    if(!pushCmd(CMD_END, dpy, -1, NULL)) {
+        ALOGE("%s: queue full, capture of display %d left open",
+                __FUNCTION__, dpy);
+        return false;
+    }
+    return true;
+}
+
+bool CaptureWriter::reserve(Frame& frame, const int& layer, const size_t& size)
+{
+    if(frame.mCapacity[layer] >= size)
+        return true;
+    if(mPoolBytes - frame.mCapacity[layer] + size > MAX_POOL_BYTES)
+        return false;
+    free(frame.mData[layer]);
+    mPoolBytes -= frame.mCapacity[layer];
+    frame.mCapacity[layer] = 0;
+    frame.mData[layer] = malloc(size);
+    if(!frame.mData[layer])
+        return false;
+    frame.mCapacity[layer] = size;
+    mPoolBytes += size;
+    return true;
+}
+
+bool CaptureWriter::queueFrame(const int& dpy, const uint32_t& frameNo,
+        hwc_display_contents_1_t *list, const LayerSource sources[])
+{
+    Locker::Autolock _l(mLock);
+    int slot = -1;
+    for(int i = 0; i < MAX_FRAMES; i++) {
+        if(!mFrames[i].mBusy) {
+            slot = i;
+            break;
+        }
+    }
+    if(slot < 0 || mCount == MAX_CMDS) {
+        mDroppedFull++;
+        return false;
+    }
+
+    Frame& frame = mFrames[slot];
+    uint32_t numLayers = list->numHwLayers;
+    memset(&frame.mInfo, 0, sizeof(frame.mInfo));
+    if(numLayers > MAX_LAYERS) {
+        numLayers = MAX_LAYERS;
+        frame.mInfo.mFlags |= QCAP_FRAME_TRUNCATED;
+    }
+    if(list->flags & HWC_GEOMETRY_CHANGED)
+        frame.mInfo.mFlags |= QCAP_FRAME_GEOMETRY_CHANGED;
+
+    //The frame is queued whole or not at all, so that the next one can
+    //refer to it
+    size_t copyBytes = 0;
+    for(uint32_t i = 0; i < numLayers; i++) {
+        if(sources[i].mSource != SRC_COPY)
+            continue;
+        private_handle_t *hnd = (private_handle_t *)list->hwLayers[i].handle;
+        if(!reserve(frame, i, hnd->size)) {
+            mDroppedFull++;
+            return false;
+        }
+        copyBytes += hnd->size;
+    }
+    if(!mBudget.take(copyBytes, systemTime(SYSTEM_TIME_MONOTONIC))) {
+        mDroppedRate++;
+        return false;
+    }
+
+    for(uint32_t i = 0; i < numLayers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        private_handle_t *hnd = (private_handle_t *)layer->handle;
+        QcapLayer& rec = frame.mLayers[i];
+        memset(&rec, 0, sizeof(rec));
+        if(hnd) {
+            rec.mFormat = hnd->format;
+            rec.mWidth = hnd->width;
+            rec.mHeight = hnd->height;
+        }
+        hwc_rect_t crop = integerizeSourceCrop(layer->sourceCropf);
+        rec.mSourceCrop[0] = crop.left;
+        rec.mSourceCrop[1] = crop.top;
+        rec.mSourceCrop[2] = crop.right;
+        rec.mSourceCrop[3] = crop.bottom;
+        rec.mDisplayFrame[0] = layer->displayFrame.left;
+        rec.mDisplayFrame[1] = layer->displayFrame.top;
+        rec.mDisplayFrame[2] = layer->displayFrame.right;
+        rec.mDisplayFrame[3] = layer->displayFrame.bottom;
+        rec.mTransform = layer->transform;
+        rec.mBlending = layer->blending;
+        rec.mPlaneAlpha = layer->planeAlpha;
+        rec.mCompositionType = layer->compositionType;
+        rec.mFlags = layer->flags;
+        rec.mHints = layer->hints;
+        frame.mSources[i] = sources[i];
+        frame.mSize[i] = 0;
+        if(sources[i].mSource == SRC_COPY) {
+            memcpy(frame.mData[i], (void*)hnd->base, hnd->size);
+            frame.mSize[i] = hnd->size;
+        }
+    }
+
+    frame.mInfo.mFrame = frameNo;
+    frame.mInfo.mTimestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    frame.mInfo.mNumLayers = numLayers;
+    frame.mBusy = true;
+    pushCmd(CMD_FRAME, dpy, slot, NULL);
+    mQueued++;
+    mBytesCopied += copyBytes;
+    return true;
+}
+
+uint64_t CaptureWriter::hash(const void *data, const size_t& size)
+{
+    //FNV-1a over 64 bit words, then the tail bytes. Staging copies are
+    //malloc'ed, so word aligned
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const uint64_t *words = (const uint64_t *)data;
+    size_t count = size / sizeof(uint64_t);
+    for(size_t i = 0; i < count; i++)
+        h = (h ^ words[i]) * prime;
+    const uint8_t *tail = (const uint8_t *)(words + count);
+    for(size_t i = 0; i < size % sizeof(uint64_t); i++)
+        h = (h ^ tail[i]) * prime;
+    return h;
+}
+
+bool CaptureWriter::append(Stream& stream, const void *data, size_t size)
+{
+    const uint8_t *src = (const uint8_t *)data;
+    while(size) {
+        if(!stream.mMap ||
+                stream.mOffset >= stream.mMapOffset + MAP_WINDOW) {
+            if(stream.mMap)
+                munmap(stream.mMap, MAP_WINDOW);
+            stream.mMap = NULL;
+            //Windows are MAP_WINDOW aligned, so page aligned
+            stream.mMapOffset = stream.mOffset - stream.mOffset % MAP_WINDOW;
+            if(ftruncate(stream.mFd, stream.mMapOffset + MAP_WINDOW) < 0) {
+                ALOGE("%s: %s. Failed to grow capture", __FUNCTION__,
+                        strerror(errno));
+                return false;
+            }
+            void *map = mmap(NULL, MAP_WINDOW, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, stream.mFd, (off_t)stream.mMapOffset);
+            if(map == MAP_FAILED) {
+                ALOGE("%s: %s. Failed to map capture", __FUNCTION__,
+                        strerror(errno));
+                return false;
+            }
+            stream.mMap = (uint8_t *)map;
+        }
+        size_t pos = stream.mOffset - stream.mMapOffset;
+        size_t len = MAP_WINDOW - pos;
+        if(len > size)
+            len = size;
+        memcpy(stream.mMap + pos, src, len);
+        src += len;
+        size -= len;
+        stream.mOffset += len;
+    }
+    return true;
+}
+
+bool CaptureWriter::writeChunk(Stream& stream, const uint32_t& type,
+        const void *head, const size_t& headSize,
+        const void *body, const size_t& bodySize)
+{
+    static const uint8_t pad[QCAP_ALIGN] = {0};
+    QcapChunk chunk;
+    chunk.mType = type;
+    chunk.mSize = headSize + bodySize;
+    size_t padSize = ALIGN_TO(chunk.mSize, QCAP_ALIGN) - chunk.mSize;
+    return append(stream, &chunk, sizeof(chunk)) &&
+            append(stream, head, headSize) &&
+            append(stream, body, bodySize) &&
+            append(stream, pad, padSize);
+}
+
+bool CaptureWriter::getPayloadId(Stream& stream, const QcapLayer& layer,
+        const void *data, const size_t& size, uint32_t& id)
+{
+    uint64_t h = hash(data, size);
+    uint32_t i = (uint32_t)h & (HASH_SLOTS - 1);
+    //Kept at most 3/4 full, so there is always an empty slot to stop at
+    while(stream.mHashes[i].mId) {
+        if(stream.mHashes[i].mHash == h && stream.mHashes[i].mSize == size) {
+            id = stream.mHashes[i].mId;
+            stream.mDedups++;
+            return true;
+        }
+        i = (i + 1) & (HASH_SLOTS - 1);
+    }
+
+    QcapPayload payload;
+    memset(&payload, 0, sizeof(payload));
+    payload.mId = ++stream.mNextId;
+    payload.mFormat = layer.mFormat;
+    payload.mWidth = layer.mWidth;
+    payload.mHeight = layer.mHeight;
+    payload.mSize = size;
+    payload.mHash = h;
+    if(!writeChunk(stream, QCAP_CHUNK_PAYLOAD, &payload, sizeof(payload),
+            data, size))
+        return false;
+
+    //Past that, payloads are still written but not deduplicated against
+    if(stream.mPayloads < HASH_SLOTS * 3 / 4) {
+        stream.mHashes[i].mHash = h;
+        stream.mHashes[i].mSize = size;
+        stream.mHashes[i].mId = payload.mId;
+    }
+    stream.mPayloads++;
+    id = payload.mId;
+    return true;
+}
+
+bool CaptureWriter::writeFrame(Stream& stream, Frame& frame)
+{
+    uint32_t numLayers = frame.mInfo.mNumLayers;
+    for(uint32_t i = 0; i < numLayers; i++) {
+        QcapLayer& rec = frame.mLayers[i];
+        const LayerSource& src = frame.mSources[i];
+        if(src.mSource == SRC_PREV &&
+                src.mPrevIndex < (int)stream.mPrevCount) {
+            rec.mPayloadId = stream.mPrevIds[src.mPrevIndex];
+        } else if(src.mSource == SRC_COPY) {
+            if(!getPayloadId(stream, rec, frame.mData[i], frame.mSize[i],
+                    rec.mPayloadId))
+                return false;
+        }
+    }
+
+    for(uint32_t i = 0; i < numLayers; i++)
+        stream.mPrevIds[i] = frame.mLayers[i].mPayloadId;
+    stream.mPrevCount = numLayers;
+    stream.mFrames++;
+    return writeChunk(stream, QCAP_CHUNK_FRAME, &frame.mInfo,
+            sizeof(frame.mInfo), frame.mLayers,
+            numLayers * sizeof(QcapLayer));
+}
+
+void CaptureWriter::openStream(Stream& stream, const int& dpy,
+        const char *fileName)
+{
+    memset(&stream, 0, sizeof(stream));
+    stream.mFd = ::open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if(stream.mFd < 0) {
+        ALOGE("%s: %s. Failed to create capture %s", __FUNCTION__,
+                strerror(errno), fileName);
+        return;
+    }
+
+    QcapHeader header;
+    memset(&header, 0, sizeof(header));
+    header.mMagic = QCAP_MAGIC;
+    header.mVersion = QCAP_VERSION;
+    header.mDpy = dpy;
+    header.mStartTime = systemTime(SYSTEM_TIME_REALTIME);
+    if(!append(stream, &header, sizeof(header))) {
+        closeStream(stream);
+        return;
+    }
+    ALOGI("Display %d capture to %s started", dpy, fileName);
+}
+
+void CaptureWriter::closeStream(Stream& stream)
+{
+    if(stream.mFd < 0)
+        return;
+    if(stream.mMap)
+        munmap(stream.mMap, MAP_WINDOW);
+    //Drop the unused tail of the last window
+    if(ftruncate(stream.mFd, (off_t)stream.mOffset) < 0) {
+        ALOGE("%s: %s. Failed to trim capture", __FUNCTION__,
+                strerror(errno));
+    }
+    ::close(stream.mFd);
+    ALOGI("Display %d capture done: %u frames, %u payloads, %u deduplicated, "
+            "%lluKB", (int)(&stream - mStreams), stream.mFrames,
+            stream.mPayloads, stream.mDedups, stream.mOffset / 1024);
+    stream.mFd = -1;
+    stream.mMap = NULL;
+}
+
+bool CaptureWriter::threadLoop()
+{
+    Cmd cmd;
+    {
+        Locker::Autolock _l(mLock);
+        while (!mCount)
+            mLock.wait();
+        cmd = mCmds[mHead];
+        mHead = (mHead + 1) % MAX_CMDS;
+        mCount--;
+    }
+
+    Stream& stream = mStreams[cmd.mDpy];
+    uint64_t offset = stream.mOffset;
+    switch(cmd.mCmd) {
+        case CMD_BEGIN:
+            closeStream(stream);
+            openStream(stream, cmd.mDpy, cmd.mFileName);
+            break;
+        case CMD_END:
+        {
+            closeStream(stream);
+            //Give back the staging memory of the idle frames
+            Locker::Autolock _l(mLock);
+            for(int i = 0; i < MAX_FRAMES; i++) {
+                if(mFrames[i].mBusy)
+                    continue;
+                for(int j = 0; j < MAX_LAYERS; j++) {
+                    free(mFrames[i].mData[j]);
+                    mFrames[i].mData[j] = NULL;
+                    mPoolBytes -= mFrames[i].mCapacity[j];
+                    mFrames[i].mCapacity[j] = 0;
+                }
+            }
+            break;
+        }
+        case CMD_FRAME:
+        {
+            //Busy frames are left alone by queueFrame(), no lock needed
+            bool bResult = (stream.mFd >= 0) &&
+                    writeFrame(stream, mFrames[cmd.mSlot]);
+            if(!bResult)
+                closeStream(stream);
+            Locker::Autolock _l(mLock);
+            if(!bResult)
+                mFailed++;
+            else
+                mBytesWritten += stream.mOffset - offset;
+            mFrames[cmd.mSlot].mBusy = false;
+            break;
+        }
+    }
+    return true;
+}
+
+void CaptureWriter::dump(android::String8& buf)
+{
+    CaptureWriter *writer = sInstance.get();
+    if (!writer)
+        return;
+    Locker::Autolock _l(writer->mLock);
+    buf.appendFormat("Frame captures queued=%u failed=%u dropped full=%u "
+            "rate=%u pool=%uKB copied=%lluKB written=%lluKB\n",
+            writer->mQueued, writer->mFailed, writer->mDroppedFull,
+            writer->mDroppedRate, (uint32_t)(writer->mPoolBytes / 1024),
+            writer->mBytesCopied / 1024, writer->mBytesWritten / 1024);
+}
+
+} // namespace qhwc
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2013, Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define HWC_UTILS_DEBUG 0
+#include "hwc_utils.h"
+
+namespace qhwc {
+
+using namespace overlay::utils;
+
+/* Calculates the aspect ratio for based on src & dest */
+void getAspectRatioPosition(int destWidth, int destHeight, int srcWidth,
+                                int srcHeight, hwc_rect_t& rect) {
+   int x =0, y =0;
+
+   if (srcWidth * destHeight > destWidth * srcHeight) {
+        srcHeight = destWidth * srcHeight / srcWidth;
+        srcWidth = destWidth;
+    } else if (srcWidth * destHeight < destWidth * srcHeight) {
+        srcWidth = destHeight * srcWidth / srcHeight;
+        srcHeight = destHeight;
+    } else {
+        srcWidth = destWidth;
+        srcHeight = destHeight;
+    }
+    if (srcWidth > destWidth) srcWidth = destWidth;
+    if (srcHeight > destHeight) srcHeight = destHeight;
+    x = (destWidth - srcWidth) / 2;
+    y = (destHeight - srcHeight) / 2;
+    ALOGD_IF(HWC_UTILS_DEBUG, "%s: AS Position: x = %d, y = %d w = %d h = %d",
+             __FUNCTION__, x, y, srcWidth , srcHeight);
+    // Convert it back to hwc_rect_t
+    rect.left = x;
+    rect.top = y;
+    rect.right = srcWidth + rect.left;
+    rect.bottom = srcHeight + rect.top;
+}
+
+/* A ratio with the reciprocal of its den: for s = 31 + ceil(log2(den)) and
+ * recip = ceil(2^s / den), (n * recip) >> s is n / den for any n < 2^31,
+ * and n * recip stays below 2^63 */
+static inline ExtTransform::Ratio makeRatio(int num, int den) {
+    ExtTransform::Ratio ratio = {num, den, 0, 0};
+    if(den > 0) {
+        int log2 = 0;
+        while(((int64_t)1 << log2) < den)
+            log2++;
+        ratio.shift = 31 + log2;
+        ratio.recip = (((uint64_t)1 << ratio.shift) + den - 1) / den;
+    }
+    return ratio;
+}
+
+/* n / den rounded toward zero, like the division it replaces */
+static inline int divRatio(int64_t n, const ExtTransform::Ratio& ratio) {
+    uint64_t mag = (n < 0) ? -n : n;
+    if(mag >> 31) {
+        // Beyond the reciprocal's range, no position gets here
+        return (int)(n / ratio.den);
+    }
+    int q = (int)((mag * ratio.recip) >> ratio.shift);
+    return (n < 0) ? -q : q;
+}
+
+static inline int applyRatio(int value, const ExtTransform::Ratio& ratio) {
+    return divRatio((int64_t)value * ratio.num, ratio);
+}
+
+/* Moves a position into the action safe rectangle along an axis of size
+ * "size": value * scale + (size - size * scale) / 2, rounded down once */
+static inline int applyActionSafe(int value,
+        const ExtTransform::Ratio& scale, int size) {
+    return divRatio((int64_t)value * scale.num +
+            (int64_t)size * ((scale.den - scale.num) / 2), scale);
+}
+
+void buildExtTransform(ExtTransform& xf, const ExtTransform::Key& key) {
+    memset(&xf, 0, sizeof(xf));
+    xf.key = key;
+    if(key.xres <= 0 || key.yres <= 0 || key.asWidth <= 0 ||
+            key.asHeight <= 0 || (key.downScale &&
+            (key.extW <= 0 || key.extH <= 0))) {
+        // Not configured yet, calcExtDisplayPosition leaves layers as is
+        return;
+    }
+
+    const bool rot90 = key.extOrient & HWC_TRANSFORM_ROT_90;
+    const bool primaryPortrait = key.primaryXres < key.primaryYres;
+    const bool portrait = primaryPortrait ?
+            !(key.deviceOrientation & 0x1) : (key.deviceOrientation & 0x1);
+
+    // RGB: with a 90 rotation, the frame keeps the aspect ratio of primary
+    if(rot90) {
+        int srcWidth = key.primaryXres;
+        int srcHeight = key.primaryYres;
+        if(!primaryPortrait) {
+            swap(srcWidth, srcHeight);
+        }
+        getAspectRatioPosition(key.xres, key.yres, srcWidth, srcHeight,
+                               xf.rotFrame);
+        // For sidesync, the dest fb will be in portrait orientation, so the
+        // crop is updated to not show the black side bands.
+        xf.rotCrop = portrait;
+    }
+    if(key.downScale) {
+        xf.downScaleX = makeRatio(key.extW, key.xres);
+        xf.downScaleY = makeRatio(key.extH, key.yres);
+    }
+
+    // YUV: the position after rotation, scaled into the aspect ratio
+    // rectangle of the display
+    int width = key.xres;
+    int height = key.yres;
+    int actualWidth = key.xres;
+    int actualHeight = key.yres;
+    if(rot90) {
+        hwc_rect_t rect;
+        swapWidthHeight(actualWidth, actualHeight);
+        getAspectRatioPosition(key.xres, key.yres, actualWidth,
+                               actualHeight, rect);
+        xf.xPos = rect.left;
+        xf.yPos = rect.top;
+        width = rect.right - rect.left;
+        height = rect.bottom - rect.top;
+    }
+    xf.yuvScaleX = makeRatio(width, actualWidth);
+    xf.yuvScaleY = makeRatio(height, actualHeight);
+    // For sidesync the crop will be upscaled to fit the dest RB, so the
+    // position is mapped back to the framebuffer domain
+    if(rot90 && portrait) {
+        hwc_rect_t r;
+        getAspectRatioPosition(width, height, width, height, r);
+        xf.yuvSideSync = true;
+        xf.yuvSideScaleX = makeRatio(key.xres, width);
+        xf.yuvY = applyRatio(r.top, makeRatio(key.yres, height));
+        xf.yuvH = applyRatio(r.bottom - r.top, makeRatio(key.yres, height));
+    }
+
+    // Action safe: based on the ratio, scale into the centered rectangle
+    if(!key.underscan && (key.asWidthRatio || key.asHeightRatio)) {
+        xf.actionSafe = true;
+        xf.asScaleX = makeRatio(2 * (100 - key.asWidthRatio), 200);
+        xf.asScaleY = makeRatio(2 * (100 - key.asHeightRatio), 200);
+        xf.asWidth = key.asWidth;
+        xf.asHeight = key.asHeight;
+    }
+    xf.valid = true;
+}
+
+void applyExtTransform(const ExtTransform& xf, const bool& yuv,
+                       hwc_rect_t& sourceCrop, hwc_rect_t& displayFrame,
+                       int& transform, ovutils::eTransform& orient) {
+    if(!xf.valid)
+        return;
+
+    const int extOrient = xf.key.extOrient;
+    if(!yuv) {
+        if(extOrient & HWC_TRANSFORM_ROT_90) {
+            displayFrame = xf.rotFrame;
+            if(xf.rotCrop) {
+                sourceCrop = displayFrame;
+                displayFrame.left = 0;
+                displayFrame.top = 0;
+                displayFrame.right = xf.key.xres;
+                displayFrame.bottom = xf.key.yres;
+            }
+        }
+        if(xf.key.downScale) {
+            // if downscale is enabled, map the co-ordinates to new
+            // domain(downscaled)
+            displayFrame.left = applyRatio(displayFrame.left, xf.downScaleX);
+            displayFrame.top = applyRatio(displayFrame.top, xf.downScaleY);
+            displayFrame.right = applyRatio(displayFrame.right,
+                                            xf.downScaleX);
+            displayFrame.bottom = applyRatio(displayFrame.bottom,
+                                             xf.downScaleY);
+        }
+    } else if(extOrient || xf.key.downScale) {
+        Whf whf(xf.key.xres, xf.key.yres, 0);
+        Dim pos(displayFrame.left, displayFrame.top,
+                displayFrame.right - displayFrame.left,
+                displayFrame.bottom - displayFrame.top);
+        // To calculate the destination co-ordinates in the new orientation
+        preRotateSource(static_cast<eTransform>(extOrient), whf, pos);
+
+        int x = applyRatio(pos.x, xf.yuvScaleX) + xf.xPos;
+        int y = applyRatio(pos.y, xf.yuvScaleY) + xf.yPos;
+        int w = applyRatio(pos.w, xf.yuvScaleX);
+        int h = applyRatio(pos.h, xf.yuvScaleY);
+        if(xf.yuvSideSync) {
+            x = applyRatio(x - xf.xPos, xf.yuvSideScaleX);
+            y = xf.yuvY;
+            w = applyRatio(w, xf.yuvSideScaleX);
+            h = xf.yuvH;
+        }
+        if(xf.key.downScale) {
+            x = applyRatio(x, xf.downScaleX);
+            y = applyRatio(y, xf.downScaleY);
+            w = applyRatio(w, xf.downScaleX);
+            h = applyRatio(h, xf.downScaleY);
+        }
+        ALOGD_IF(HWC_UTILS_DEBUG, "%s: Calculated AspectRatio Position: "
+                 "x = %d, y = %d w = %d h = %d", __FUNCTION__, x, y, w, h);
+        displayFrame.left = x;
+        displayFrame.top = y;
+        displayFrame.right = x + w;
+        displayFrame.bottom = y + h;
+    }
+    // If there is a external orientation set, use that
+    if(extOrient) {
+        transform = extOrient;
+        orient = static_cast<ovutils::eTransform >(extOrient);
+    }
+    // Calculate the actionsafe dimensions for External(dpy = 1 or 2)
+    if(xf.actionSafe) {
+        int w = displayFrame.right - displayFrame.left;
+        int h = displayFrame.bottom - displayFrame.top;
+        displayFrame.left = applyActionSafe(displayFrame.left, xf.asScaleX,
+                                            xf.asWidth);
+        displayFrame.top = applyActionSafe(displayFrame.top, xf.asScaleY,
+                                           xf.asHeight);
+        displayFrame.right = displayFrame.left + applyRatio(w, xf.asScaleX);
+        displayFrame.bottom = displayFrame.top + applyRatio(h, xf.asScaleY);
+    }
+}
+
+};//namespace qhwc
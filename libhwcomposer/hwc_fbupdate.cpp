@@ -73,7 +73,7 @@ bool FBUpdateLowRes::preRotateExtDisplay(hwc_context_t *ctx,
     ovutils::eTransform orient = static_cast<ovutils::eTransform >(extOrient);
 
     if(mDpy && (extOrient & HWC_TRANSFORM_ROT_90)) {
-        mRot = ctx->mRotMgr->getNext();
+        mRot = ctx->mRotMgr->getNext(info);
         if(mRot == NULL) return false;
         Whf origWhf(mAlignedFBWidth, mAlignedFBHeight,
                     getMdpFormat(HAL_PIXEL_FORMAT_RGBA_8888));
@@ -166,7 +166,7 @@ bool FBUpdateLowRes::configure(hwc_context_t *ctx, hwc_display_contents_1 *list,
                                    transform, orient);
         //Store the displayFrame, will be used in getDisplayViewFrame
         ctx->dpyAttr[mDpy].mDstRect = displayFrame;
-        setMdpFlags(layer, mdpFlags, 0, transform);
+        setMdpFlags(layer, mdpFlags, transform);
         // For External use rotator if there is a rotation value set
         ret = preRotateExtDisplay(ctx, layer, info,
                 sourceCrop, mdpFlags, rotFlags);
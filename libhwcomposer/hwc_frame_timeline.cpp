@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2013, Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <overlay.h>
+#include "hwc_frame_timeline.h"
+#include "hwc_mdpcomp.h"
+
+using namespace android;
+
+namespace qhwc {
+
+FrameTimeline::FrameTimeline() : mArmed(0), mSlots(NULL), mNumSlots(0),
+        mStart(0), mCount(0), mPendingCount(0), mCycle(0), mRecorded(0),
+        mPrepareStart(0)
+{
+}
+
+FrameTimeline::~FrameTimeline()
+{
+    delete [] mSlots;
+}
+
+int FrameTimeline::arm(int numFrames)
+{
+    if(numFrames < 0 || numFrames > qdutils::FRAME_TIMELINE_MAX_FRAMES) {
+        ALOGE("%s: %d frames out of range", __FUNCTION__, numFrames);
+        return -EINVAL;
+    }
+    //At least a cycle of all displays fits
+    if(numFrames && numFrames < HWC_NUM_DISPLAY_TYPES)
+        numFrames = HWC_NUM_DISPLAY_TYPES;
+
+    Slot *slots = numFrames ? new Slot[numFrames] : NULL;
+    Locker::Autolock _l(mLock);
+    delete [] mSlots;
+    mSlots = slots;
+    mNumSlots = numFrames;
+    mStart = mCount = mPendingCount = 0;
+    mRecorded = 0;
+    android_atomic_release_store(numFrames ? 1 : 0, &mArmed);
+    ALOGI("%s: %s, %d frames", __FUNCTION__,
+            numFrames ? "armed" : "disarmed", numFrames);
+    return 0;
+}
+
+FrameTimeline::Slot *FrameTimeline::getPending(int dpy)
+{
+    for(int i = 0; i < mPendingCount; i++) {
+        if(mPendingDpy[i] == dpy)
+            return &mSlots[(mStart + mCount + i) % mNumSlots];
+    }
+    return NULL;
+}
+
+void FrameTimeline::beginCycle(const nsecs_t& prepareStart)
+{
+    if(!isArmed())
+        return;
+    Locker::Autolock _l(mLock);
+    //A prepare without its set leaves nothing
+    mPendingCount = 0;
+    mCycle++;
+    mPrepareStart = prepareStart;
+}
+
+void FrameTimeline::addFrame(hwc_context_t *ctx, int dpy,
+        hwc_display_contents_1_t *list)
+{
+    if(!isArmed())
+        return;
+    if(dpy < 0 || dpy >= HWC_NUM_DISPLAY_TYPES || !list ||
+            list->numHwLayers < 1 || !ctx->dpyAttr[dpy].connected ||
+            !ctx->dpyAttr[dpy].isActive)
+        return;
+
+    Locker::Autolock _l(mLock);
+    if(!mNumSlots || mPendingCount == HWC_NUM_DISPLAY_TYPES)
+        return;
+    if(mCount + mPendingCount == mNumSlots) {
+        if(!mCount)
+            return;
+        //Full, the oldest goes
+        mStart = (mStart + 1) % mNumSlots;
+        mCount--;
+    }
+    Slot& slot = mSlots[(mStart + mCount + mPendingCount) % mNumSlots];
+    mPendingDpy[mPendingCount++] = dpy;
+
+    qdutils::FrameTimelineFrame_t& f = slot.mFrame;
+    memset(&f, 0, sizeof(f));
+    uint32_t numAppLayers = list->numHwLayers - 1;
+    f.cycle = mCycle;
+    f.dpy = dpy;
+    f.prepareStart = mPrepareStart;
+    f.numAppLayers = numAppLayers;
+    f.numLayers = min(numAppLayers,
+            (uint32_t)qdutils::FRAME_TIMELINE_MAX_LAYERS);
+    if(f.numLayers < numAppLayers)
+        f.flags |= qdutils::TIMELINE_FRAME_TRUNCATED;
+    if(list->flags & HWC_GEOMETRY_CHANGED)
+        f.flags |= qdutils::TIMELINE_FRAME_GEOMETRY_CHANGED;
+    f.fbZ = -1;
+    f.pipes = ctx->mOverlay->pipesInUse(dpy);
+    f.rotSessions = ctx->mLayerRotMap[dpy]->getCount();
+
+    MDPComp *mdpComp = ctx->mMDPComp[dpy];
+    if(mdpComp) {
+        MDPComp::FramePlan plan;
+        mdpComp->getFramePlan(plan);
+        f.fbZ = plan.fbZ;
+        f.mdpCount = plan.mdpCount;
+        f.fbCount = plan.fbCount;
+        if(plan.needsRedraw)
+            f.flags |= qdutils::TIMELINE_FRAME_FB_REDRAW;
+        if(numAppLayers && !plan.mdpCount)
+            f.flags |= qdutils::TIMELINE_FRAME_MDP_FAILED;
+    }
+
+    for(uint32_t i = 0; i < f.numLayers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        private_handle_t *hnd = (private_handle_t *)layer->handle;
+        qdutils::FrameTimelineLayer_t& l = slot.mLayers[i];
+        l.flags = 0;
+        l.compositionType = layer->compositionType;
+        l.format = hnd ? hnd->format : -1;
+        l.width = hnd ? hnd->width : 0;
+        l.height = hnd ? hnd->height : 0;
+        l.displayFrame[0] = layer->displayFrame.left;
+        l.displayFrame[1] = layer->displayFrame.top;
+        l.displayFrame[2] = layer->displayFrame.right;
+        l.displayFrame[3] = layer->displayFrame.bottom;
+        l.transform = layer->transform;
+        l.blending = layer->blending;
+        l.planeAlpha = layer->planeAlpha;
+        l.zOrder = -1;
+        l.pipeType = -1;
+        l.pipes[0] = l.pipes[1] = -1;
+        l.rotSession = -1;
+        if(ctx->layerProp[dpy][i].mFlags & HWC_COPYBIT)
+            l.flags |= qdutils::TIMELINE_LAYER_COPYBIT;
+        if(isYuvBuffer(hnd))
+            l.flags |= qdutils::TIMELINE_LAYER_YUV;
+        if(isSecureBuffer(hnd))
+            l.flags |= qdutils::TIMELINE_LAYER_SECURE;
+        if(isSkipLayer(layer))
+            l.flags |= qdutils::TIMELINE_LAYER_SKIP;
+
+        MDPComp::LayerPlan plan;
+        if(!mdpComp || !mdpComp->getLayerPlan(i, plan))
+            continue;
+        if(plan.cached)
+            l.flags |= qdutils::TIMELINE_LAYER_CACHED;
+        if(!plan.mdp)
+            continue;
+        l.flags |= qdutils::TIMELINE_LAYER_MDP;
+        l.zOrder = plan.zOrder;
+        l.pipeType = plan.pipeType;
+        for(int p = 0; p < 2; p++) {
+            if(plan.dest[p] != ovutils::OV_INVALID)
+                l.pipes[p] = plan.dest[p];
+        }
+        l.rotSession = plan.rotSession;
+    }
+}
+
+void FrameTimeline::addFenceWait(int dpy, bool release, const nsecs_t& time)
+{
+    if(!isArmed())
+        return;
+    Locker::Autolock _l(mLock);
+    Slot *slot = getPending(dpy);
+    if(!slot)
+        return;
+    if(release)
+        slot->mFrame.releaseWait += (uint32_t)(time / 1000);
+    else
+        slot->mFrame.acquireWait += (uint32_t)(time / 1000);
+}
+
+void FrameTimeline::addBlits(int dpy, const uint32_t& count)
+{
+    if(!isArmed())
+        return;
+    Locker::Autolock _l(mLock);
+    Slot *slot = getPending(dpy);
+    if(slot)
+        slot->mFrame.copybitBlits += count;
+}
+
+void FrameTimeline::endCycle(const nsecs_t& prepareTime,
+        const nsecs_t& setEnd)
+{
+    if(!isArmed())
+        return;
+    Locker::Autolock _l(mLock);
+    for(int i = 0; i < mPendingCount; i++) {
+        Slot& slot = mSlots[(mStart + mCount + i) % mNumSlots];
+        slot.mFrame.prepareEnd = mPrepareStart + prepareTime;
+        slot.mFrame.setEnd = setEnd;
+    }
+    mCount += mPendingCount;
+    mRecorded += mPendingCount;
+    mPendingCount = 0;
+}
+
+void FrameTimeline::write(Parcel* out) const
+{
+    Locker::Autolock _l(mLock);
+    qdutils::FrameTimelineHeader_t header;
+    memset(&header, 0, sizeof(header));
+    header.version = qdutils::FRAME_TIMELINE_VERSION;
+    header.numFrames = mCount;
+    header.framesRecorded = mRecorded;
+
+    size_t size = sizeof(header);
+    for(int i = 0; i < mCount; i++) {
+        const Slot& slot = mSlots[(mStart + i) % mNumSlots];
+        size += sizeof(slot.mFrame) +
+                slot.mFrame.numLayers * sizeof(slot.mLayers[0]);
+    }
+    out->writeInt32(size);
+    out->write(&header, sizeof(header));
+    for(int i = 0; i < mCount; i++) {
+        const Slot& slot = mSlots[(mStart + i) % mNumSlots];
+        out->write(&slot.mFrame, sizeof(slot.mFrame));
+        out->write(slot.mLayers,
+                slot.mFrame.numLayers * sizeof(slot.mLayers[0]));
+    }
+}
+
+}; //namespace qhwc
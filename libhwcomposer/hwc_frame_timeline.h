@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2013, Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HWC_FRAME_TIMELINE_H
+#define HWC_FRAME_TIMELINE_H
+
+#include <cutils/atomic.h>
+#include <utils/Timers.h>
+#include <binder/Parcel.h>
+#include <display_config.h>
+#include "hwc_utils.h"
+
+namespace qhwc {
+
+/*
+ * Frame timeline, armed and read through QService. Records the
+ * composition decisions of each display frame into a ring allocated when
+ * armed, in the qdutils::FrameTimeline* layout, so that jank can be
+ * analysed offline. Unlike HwcDebug no buffer contents are touched.
+ * Disarmed, each hook costs an atomic load. Armed, a frame costs a copy of
+ * its layer decisions under mLock, which the binder threads only hold to
+ * arm or to copy the ring out.
+ */
+class FrameTimeline {
+public:
+    FrameTimeline();
+    ~FrameTimeline();
+    /* Arms a ring of numFrames, 0 disarms. Returns 0 or -errno */
+    int arm(int numFrames);
+    /* Writes the size and the timeline to out */
+    void write(android::Parcel* out) const;
+
+    /* Hooks of the composition thread, mDrawLock held */
+    void beginCycle(const nsecs_t& prepareStart);
+    /* Records the decisions for a display, after all displays prepared */
+    void addFrame(hwc_context_t *ctx, int dpy,
+            hwc_display_contents_1_t *list);
+    void addFenceWait(int dpy, bool release, const nsecs_t& time);
+    void addBlits(int dpy, const uint32_t& count);
+    void endCycle(const nsecs_t& prepareTime, const nsecs_t& setEnd);
+
+private:
+    struct Slot {
+        qdutils::FrameTimelineFrame_t mFrame;
+        qdutils::FrameTimelineLayer_t mLayers[
+                qdutils::FRAME_TIMELINE_MAX_LAYERS];
+    };
+
+    bool isArmed() const { return android_atomic_acquire_load(&mArmed); }
+    /* Slot recorded for dpy in this cycle, NULL if none. mLock held */
+    Slot *getPending(int dpy);
+
+    volatile int32_t mArmed;
+    Slot *mSlots;
+    int mNumSlots;
+    /* Committed frames, oldest first from mStart */
+    int mStart;
+    int mCount;
+    /* Frames of the cycle in progress, right after the committed ones */
+    int mPendingCount;
+    int mPendingDpy[HWC_NUM_DISPLAY_TYPES];
+    uint32_t mCycle;
+    uint32_t mRecorded;
+    nsecs_t mPrepareStart;
+    mutable Locker mLock;
+};
+
+}; //namespace qhwc
+
+#endif /* HWC_FRAME_TIMELINE_H */
@@ -35,7 +35,6 @@ namespace qhwc {
 //==============MDPComp========================================================
 
 IdleInvalidator *MDPComp::idleInvalidator = NULL;
-bool MDPComp::sIdleFallBack = false;
 bool MDPComp::sDebugLogs = false;
 bool MDPComp::sEnabled = false;
 bool MDPComp::sEnableMixedMode = true;
@@ -50,7 +49,17 @@ MDPComp* MDPComp::getObject(const int& width, int dpy) {
 }
 
 MDPComp::MDPComp(int dpy, int maxPipesPerLayer) : mDpy(dpy),
-        mMaxPipesPerLayer(maxPipesPerLayer) {
+        mMaxPipesPerLayer(maxPipesPerLayer), mIdleState(IDLE_ACTIVE),
+        mIdleUpdate(false), mIdleUpdates(0), mIdleFrameSig(0),
+        mIdleFetchBytes(0), mIdleFrameBytes(0), mIdleFallBacks(0),
+        mIdleKeptMDP(0) {
+    memset(mIdleResidency, 0, sizeof(mIdleResidency));
+    mIdleStateTime = systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+MDPComp::~MDPComp() {
+    if(idleInvalidator)
+        idleInvalidator->cancel(mDpy);
 }
 
 void MDPComp::dump(android::String8& buf)
@@ -76,9 +85,56 @@ void MDPComp::dump(android::String8& buf)
                      (mCurrentFrame.needsRedraw ? "GLES" : "CACHE") : "MDP"),
                     (mCurrentFrame.isFBComposed[index] ? mCurrentFrame.fbZ :
     mCurrentFrame.mdpToLayer[mCurrentFrame.layerToMDP[index]].pipeInfo->zOrder));
+
+    static const char *idleStates[IDLE_STATE_MAX] = {"ACTIVE", "IDLE-MDP",
+            "IDLE-GPU"};
+    Locker::Autolock _l(mIdleLock);
+    nsecs_t residency[IDLE_STATE_MAX];
+    memcpy(residency, mIdleResidency, sizeof(residency));
+    residency[mIdleState] += systemTime(SYSTEM_TIME_MONOTONIC) -
+            mIdleStateTime;
+    dumpsys_log(buf,"Idle: state:%s timeout:%ums fallbacks:%u keptMDP:%u "
+                "fetch:%lluKB frame:%lluKB\n", idleStates[mIdleState],
+                idleInvalidator ? idleInvalidator->getIdleTime() : 0,
+                mIdleFallBacks, mIdleKeptMDP, mIdleFetchBytes / 1024,
+                mIdleFrameBytes / 1024);
+    dumpsys_log(buf,"Idle residency: active:%llums idle-mdp:%llums "
+                "idle-gpu:%llums\n", ns2ms(residency[IDLE_ACTIVE]),
+                ns2ms(residency[IDLE_MDP]), ns2ms(residency[IDLE_FALLBACK]));
     dumpsys_log(buf,"\n");
 }
 
+void MDPComp::getFramePlan(FramePlan& plan) const {
+    plan.layerCount = mCurrentFrame.layerCount;
+    plan.mdpCount = mCurrentFrame.mdpCount;
+    plan.fbCount = mCurrentFrame.fbCount;
+    plan.fbZ = mCurrentFrame.fbCount ? mCurrentFrame.fbZ : -1;
+    plan.needsRedraw = mCurrentFrame.needsRedraw;
+}
+
+bool MDPComp::getLayerPlan(const int& index, LayerPlan& plan) const {
+    if(index < 0 || index >= mCurrentFrame.layerCount)
+        return false;
+    plan.mdp = !mCurrentFrame.isFBComposed[index];
+    plan.cached = mCurrentFrame.isNotUpdating[index];
+    plan.zOrder = -1;
+    plan.pipeType = MDPCOMP_OV_ANY;
+    plan.dest[0] = plan.dest[1] = ovutils::OV_INVALID;
+    plan.rotSession = -1;
+    int mdpIndex = mCurrentFrame.layerToMDP[index];
+    if(!plan.mdp || mdpIndex < 0)
+        return true;
+    const PipeLayerPair& info = mCurrentFrame.mdpToLayer[mdpIndex];
+    plan.pipeType = mCurrentFrame.pipeType[index];
+    if(info.pipeInfo) {
+        plan.zOrder = info.pipeInfo->zOrder;
+        info.pipeInfo->getDests(plan.dest[0], plan.dest[1]);
+    }
+    if(info.rot)
+        plan.rotSession = info.rot->getSessId();
+    return true;
+}
+
 bool MDPComp::init(hwc_context_t *ctx) {
 
     if(!ctx) {
@@ -126,7 +182,8 @@ bool MDPComp::init(hwc_context_t *ctx) {
     if(idleInvalidator == NULL) {
         ALOGE("%s: failed to instantiate idleInvalidator object", __FUNCTION__);
     } else {
-        idleInvalidator->init(timeout_handler, ctx, idle_timeout);
+        idleInvalidator->init(timeout_handler, ctx, idle_timeout,
+                ctx->mEventLoop);
     }
     return true;
 }
@@ -137,21 +194,127 @@ void MDPComp::reset(const int& numLayers, hwc_display_contents_1_t* list) {
     mCachedFrame.updateCounts(mCurrentFrame);
 }
 
-void MDPComp::timeout_handler(void *udata) {
+bool MDPComp::timeout_handler(void *udata, int dpy) {
     struct hwc_context_t* ctx = (struct hwc_context_t*)(udata);
 
     if(!ctx) {
         ALOGE("%s: received empty data in timer callback", __FUNCTION__);
-        return;
+        return true;
     }
 
     if(!ctx->proc) {
         ALOGE("%s: HWC proc not registered", __FUNCTION__);
-        return;
+        return true;
     }
-    sIdleFallBack = true;
+
+    //Displays are added and removed under the draw lock. It is held for
+    //a whole prepare or set, which the event loop must not wait for.
+    if(!ctx->mDrawLock.tryLock())
+        return false;
+    MDPComp *comp = ctx->mMDPComp[dpy];
+    bool redraw = comp && comp->onIdleTimeout(ctx);
+    ctx->mDrawLock.unlock();
+
     /* Trigger SF to redraw the current frame */
-    ctx->proc->invalidate(ctx->proc);
+    if(redraw)
+        ctx->proc->invalidate(ctx->proc);
+    return true;
+}
+
+void MDPComp::setIdleState(const int& state) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    mIdleResidency[mIdleState] += now - mIdleStateTime;
+    mIdleStateTime = now;
+    mIdleState = state;
+}
+
+bool MDPComp::onIdleTimeout(hwc_context_t *ctx) {
+    Locker::Autolock _l(mIdleLock);
+    if(mIdleState == IDLE_FALLBACK) {
+        //Updates too sparse to leave the fallback, start counting again
+        mIdleUpdates = 0;
+        return false;
+    }
+    if(mIdleState != IDLE_ACTIVE)
+        return false;
+
+    //Over another idle time, staying on MDP fetches the frame on each
+    //refresh. Falling back takes one GPU composition of the app layers into
+    //the FB, then MDP fetches only the FB.
+    uint64_t fbBytes = (uint64_t)ctx->dpyAttr[mDpy].xres *
+            ctx->dpyAttr[mDpy].yres * 4;
+    uint64_t refreshes = 1;
+    if(idleInvalidator && ctx->dpyAttr[mDpy].vsync_period)
+        refreshes = ms2ns(idleInvalidator->getIdleTime()) /
+                ctx->dpyAttr[mDpy].vsync_period;
+    uint64_t mdpCost = mIdleFetchBytes * refreshes;
+    uint64_t gpuCost = IDLE_GPU_BYTE_COST * (mIdleFrameBytes + fbBytes) +
+            fbBytes * refreshes;
+    if(mdpCost <= gpuCost) {
+        ALOGD_IF(isDebug(), "%s: dpy %d stays on MDP, cost %llu vs GPU %llu",
+                __FUNCTION__, mDpy, mdpCost, gpuCost);
+        setIdleState(IDLE_MDP);
+        mIdleKeptMDP++;
+        return false;
+    }
+    ALOGD_IF(isDebug(), "%s: dpy %d falls back, cost %llu vs GPU %llu",
+            __FUNCTION__, mDpy, mdpCost, gpuCost);
+    setIdleState(IDLE_FALLBACK);
+    mIdleUpdates = 0;
+    mIdleFallBacks++;
+    return true;
+}
+
+void MDPComp::updateIdleState(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    //A redraw brings the same buffers, an update at least one new one
+    const int numAppLayers = ctx->listStats[mDpy].numAppLayers;
+    uint64_t sig = numAppLayers;
+    for(int i = 0; i < numAppLayers; i++)
+        sig = sig * 31 + (uintptr_t)list->hwLayers[i].handle;
+    mIdleUpdate = (sig != mIdleFrameSig) ||
+            (list->flags & HWC_GEOMETRY_CHANGED);
+    mIdleFrameSig = sig;
+    if(!mIdleUpdate)
+        return;
+
+    Locker::Autolock _l(mIdleLock);
+    if(mIdleState == IDLE_MDP) {
+        setIdleState(IDLE_ACTIVE);
+    } else if(mIdleState == IDLE_FALLBACK &&
+            ++mIdleUpdates >= IDLE_EXIT_UPDATES) {
+        ALOGD_IF(isDebug(), "%s: dpy %d leaves idle fallback", __FUNCTION__,
+                mDpy);
+        setIdleState(IDLE_ACTIVE);
+    }
+}
+
+void MDPComp::updateIdleEstimate(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    uint64_t fetch = 0;
+    uint64_t frame = 0;
+    for(int i = 0; i < mCurrentFrame.layerCount; i++) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        private_handle_t *hnd = (private_handle_t *)layer->handle;
+        hwc_rect_t crop = integerizeSourceCrop(layer->sourceCropf);
+        int w = crop.right - crop.left;
+        int h = crop.bottom - crop.top;
+        if(!hnd || hnd->width <= 0 || hnd->height <= 0 || w <= 0 || h <= 0)
+            continue;
+        //The cropped share of the buffer, whatever its format
+        uint64_t bytes = (uint64_t)hnd->size * w * h /
+                ((uint64_t)hnd->width * hnd->height);
+        frame += bytes;
+        if(!mCurrentFrame.isFBComposed[i])
+            fetch += bytes;
+    }
+    if(mCurrentFrame.fbCount)
+        fetch += (uint64_t)ctx->dpyAttr[mDpy].xres *
+                ctx->dpyAttr[mDpy].yres * 4;
+
+    Locker::Autolock _l(mIdleLock);
+    mIdleFetchBytes = fetch;
+    mIdleFrameBytes = frame;
 }
 
 void MDPComp::setMDPCompLayerFlags(hwc_context_t *ctx,
@@ -236,6 +399,8 @@ void MDPComp::FrameInfo::reset(const int& numLayers) {
     mdpCount = 0;
     needsRedraw = true;
     fbZ = 0;
+    for(int i = 0; i < MAX_NUM_APP_LAYERS; i++)
+        pipeType[i] = MDPCOMP_OV_ANY;
 }
 
 void MDPComp::FrameInfo::map() {
@@ -286,8 +451,44 @@ bool MDPComp::isSupportedForMDPComp(hwc_context_t *ctx, hwc_layer_1_t* layer) {
     return true;
 }
 
+bool MDPComp::getSplitPlan(hwc_context_t *ctx, hwc_layer_1_t *layer,
+        SplitPlan& plan) {
+    int hw_w = ctx->dpyAttr[mDpy].xres;
+    int hw_h = ctx->dpyAttr[mDpy].yres;
+
+    hwc_rect_t crop = integerizeSourceCrop(layer->sourceCropf);
+    hwc_rect_t dst = layer->displayFrame;
+
+    if(dst.left < 0 || dst.top < 0 || dst.right > hw_w || dst.bottom > hw_h) {
+       hwc_rect_t scissor = {0, 0, hw_w, hw_h };
+       qhwc::calculate_crop_rects(crop, dst, scissor, layer->transform);
+    }
+
+    if(!planLayerSplit(crop, dst, layer->transform, plan))
+        return false;
+
+    if(plan.numPipes > 1 && hw_w > MAX_DISPLAY_DIM) {
+        //High res panels fetch each mixer half on its own pipe already,
+        //so each half has to fit a pipe
+        for(int i = 0; i < 2; i++) {
+            hwc_rect_t scissor = {i * hw_w / 2, 0, (i + 1) * hw_w / 2, hw_h};
+            if(dst.right <= scissor.left || dst.left >= scissor.right)
+                continue;
+            hwc_rect_t halfCrop = crop;
+            hwc_rect_t halfDst = dst;
+            SplitPlan halfPlan;
+            qhwc::calculate_crop_rects(halfCrop, halfDst, scissor,
+                    layer->transform);
+            if(!planLayerSplit(halfCrop, halfDst, layer->transform,
+                    halfPlan) || halfPlan.numPipes > 1)
+                return false;
+        }
+        plan.numPipes = 1;
+    }
+    return true;
+}
+
 bool MDPComp::isValidDimension(hwc_context_t *ctx, hwc_layer_1_t *layer) {
-    const int dpy = HWC_DISPLAY_PRIMARY;
     private_handle_t *hnd = (private_handle_t *)layer->handle;
 
     if(!hnd) {
@@ -300,23 +501,9 @@ bool MDPComp::isValidDimension(hwc_context_t *ctx, hwc_layer_1_t *layer) {
             isNonIntegralSourceCrop(layer->sourceCropf))
         return false;
 
-    int hw_w = ctx->dpyAttr[mDpy].xres;
-    int hw_h = ctx->dpyAttr[mDpy].yres;
-
     hwc_rect_t crop = integerizeSourceCrop(layer->sourceCropf);
-    hwc_rect_t dst = layer->displayFrame;
-
-    if(dst.left < 0 || dst.top < 0 || dst.right > hw_w || dst.bottom > hw_h) {
-       hwc_rect_t scissor = {0, 0, hw_w, hw_h };
-       qhwc::calculate_crop_rects(crop, dst, scissor, layer->transform);
-    }
-
     int crop_w = crop.right - crop.left;
     int crop_h = crop.bottom - crop.top;
-    int dst_w = dst.right - dst.left;
-    int dst_h = dst.bottom - dst.top;
-    float w_dscale = ceilf((float)crop_w / (float)dst_w);
-    float h_dscale = ceilf((float)crop_h / (float)dst_h);
 
     //Workaround for MDP HW limitation in DSI command mode panels where
     //FPS will not go beyond 30 if buffers on RGB pipes are of width < 5
@@ -324,35 +511,59 @@ bool MDPComp::isValidDimension(hwc_context_t *ctx, hwc_layer_1_t *layer) {
     if((crop_w < 5)||(crop_h < 5))
         return false;
 
-    if(ctx->mMDP.version >= qdutils::MDSS_V5) {
-        /* Workaround for downscales larger than 4x.
-         * Will be removed once decimator block is enabled for MDSS
-         */
-        if(w_dscale > 4.0f || h_dscale > 4.0f)
-            return false;
-    } else {
-        if(w_dscale > 8.0f || h_dscale > 8.0f)
-            // MDP 4 supports 1/8 downscale
-            return false;
+    //Downscale and fetch width limits, with decimation and source split
+    //where the MDP has them
+    SplitPlan plan;
+    if(!getSplitPlan(ctx, layer, plan)) {
+        ALOGD_IF(isDebug(), "%s: layer beyond MDP scale / width limits",
+                __FUNCTION__);
+        return false;
     }
 
     return true;
 }
 
-ovutils::eDest MDPComp::getMdpPipe(hwc_context_t *ctx, ePipeType type) {
+uint32_t MDPComp::getLayerKey(hwc_layer_1_t* layer) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    hwc_rect_t crop = integerizeSourceCrop(layer->sourceCropf);
+    const int fields[] = {
+        layer->displayFrame.left, layer->displayFrame.top,
+        layer->displayFrame.right, layer->displayFrame.bottom,
+        crop.left, crop.top, crop.right, crop.bottom,
+        (int)layer->transform, (int)layer->blending,
+        hnd ? hnd->format : 0, hnd ? hnd->width : 0, hnd ? hnd->height : 0
+    };
+
+    //FNV-1a, the buffer itself changes every frame so it is left out
+    uint32_t key = 2166136261u;
+    for(size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        key ^= (uint32_t)fields[i];
+        key *= 16777619u;
+    }
+    //0 means no key to the overlay
+    return key ? key : 1;
+}
+
+uint32_t MDPComp::getSplitKey(const uint32_t& layerKey) {
+    uint32_t key = layerKey ^ 0x80000000;
+    return key ? key : 1;
+}
+
+ovutils::eDest MDPComp::getMdpPipe(hwc_context_t *ctx, ePipeType type,
+                                   uint32_t layerKey) {
     overlay::Overlay& ov = *ctx->mOverlay;
     ovutils::eDest mdp_pipe = ovutils::OV_INVALID;
 
     switch(type) {
     case MDPCOMP_OV_DMA:
-        mdp_pipe = ov.nextPipe(ovutils::OV_MDP_PIPE_DMA, mDpy);
+        mdp_pipe = ov.nextPipe(ovutils::OV_MDP_PIPE_DMA, mDpy, layerKey);
         if(mdp_pipe != ovutils::OV_INVALID) {
             ctx->mDMAInUse = true;
             return mdp_pipe;
         }
     case MDPCOMP_OV_ANY:
     case MDPCOMP_OV_RGB:
-        mdp_pipe = ov.nextPipe(ovutils::OV_MDP_PIPE_RGB, mDpy);
+        mdp_pipe = ov.nextPipe(ovutils::OV_MDP_PIPE_RGB, mDpy, layerKey);
         if(mdp_pipe != ovutils::OV_INVALID) {
             return mdp_pipe;
         }
@@ -362,7 +573,7 @@ ovutils::eDest MDPComp::getMdpPipe(hwc_context_t *ctx, ePipeType type) {
             break;
         }
     case  MDPCOMP_OV_VG:
-        return ov.nextPipe(ovutils::OV_MDP_PIPE_VG, mDpy);
+        return ov.nextPipe(ovutils::OV_MDP_PIPE_VG, mDpy, layerKey);
     default:
         ALOGE("%s: Invalid pipe type",__FUNCTION__);
         return ovutils::OV_INVALID;
@@ -414,7 +625,7 @@ bool MDPComp::isFullFrameDoable(hwc_context_t *ctx,
 
     const int numAppLayers = ctx->listStats[mDpy].numAppLayers;
 
-    if(sIdleFallBack && !ctx->listStats[mDpy].secureUI) {
+    if(isIdleFallBack() && !ctx->listStats[mDpy].secureUI) {
         ALOGD_IF(isDebug(), "%s: Idle fallback dpy %d",__FUNCTION__, mDpy);
         return false;
     }
@@ -516,18 +727,9 @@ bool MDPComp::fullMDPComp(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     mCurrentFrame.fbZ = -1;
     memset(&mCurrentFrame.isFBComposed, 0, sizeof(mCurrentFrame.isFBComposed));
 
-    int mdpCount = mCurrentFrame.mdpCount;
-    if(mdpCount > sMaxPipesPerMixer) {
-        ALOGD_IF(isDebug(), "%s: Exceeds MAX_PIPES_PER_MIXER",__FUNCTION__);
-        return false;
-    }
-
-    int numPipesNeeded = pipesNeeded(ctx, list);
-    int availPipes = getAvailablePipes(ctx);
-
-    if(numPipesNeeded > availPipes) {
-        ALOGD_IF(isDebug(), "%s: Insufficient MDP pipes, needed %d, avail %d",
-                __FUNCTION__, numPipesNeeded, availPipes);
+    if(!assignPipeTypes(ctx, list)) {
+        ALOGD_IF(isDebug(), "%s: Insufficient MDP pipes or stages",
+                __FUNCTION__);
         return false;
     }
 
@@ -560,34 +762,11 @@ bool MDPComp::partialMDPComp(hwc_context_t *ctx, hwc_display_contents_1_t* list)
     }
 
     updateYUV(ctx, list);
-    bool ret = batchLayers(ctx, list); //sets up fbZ also
-    if(!ret) {
+    if(!batchLayers(ctx, list)) { //sets up fbZ also
         ALOGD_IF(isDebug(),"%s: batching failed, dpy %d",__FUNCTION__, mDpy);
         return false;
     }
 
-    int mdpCount = mCurrentFrame.mdpCount;
-    //Will benefit cases where a video has non-updating background.
-    if((mDpy > HWC_DISPLAY_PRIMARY) and
-            (mdpCount > MAX_SEC_LAYERS)) {
-        ALOGD_IF(isDebug(), "%s: Exceeds max secondary pipes",__FUNCTION__);
-        return false;
-    }
-
-    if(mdpCount > (sMaxPipesPerMixer - 1)) { // -1 since FB is used
-        ALOGD_IF(isDebug(), "%s: Exceeds MAX_PIPES_PER_MIXER",__FUNCTION__);
-        return false;
-    }
-
-    int numPipesNeeded = pipesNeeded(ctx, list);
-    int availPipes = getAvailablePipes(ctx);
-
-    if(numPipesNeeded > availPipes) {
-        ALOGD_IF(isDebug(), "%s: Insufficient MDP pipes, needed %d, avail %d",
-                __FUNCTION__, numPipesNeeded, availPipes);
-        return false;
-    }
-
     return true;
 }
 
@@ -597,7 +776,6 @@ bool MDPComp::isOnlyVideoDoable(hwc_context_t *ctx,
     mCurrentFrame.reset(numAppLayers);
     updateYUV(ctx, list);
     int mdpCount = mCurrentFrame.mdpCount;
-    int fbNeeded = int(mCurrentFrame.fbCount != 0);
 
     if(!isYuvPresent(ctx, mDpy)) {
         return false;
@@ -606,16 +784,9 @@ bool MDPComp::isOnlyVideoDoable(hwc_context_t *ctx,
     if(!mdpCount)
         return false;
 
-    if(mdpCount > (sMaxPipesPerMixer - fbNeeded)) {
-        ALOGD_IF(isDebug(), "%s: Exceeds MAX_PIPES_PER_MIXER",__FUNCTION__);
-        return false;
-    }
-
-    int numPipesNeeded = pipesNeeded(ctx, list);
-    int availPipes = getAvailablePipes(ctx);
-    if(numPipesNeeded > availPipes) {
-        ALOGD_IF(isDebug(), "%s: Insufficient MDP pipes, needed %d, avail %d",
-                __FUNCTION__, numPipesNeeded, availPipes);
+    if(!assignPipeTypes(ctx, list)) {
+        ALOGD_IF(isDebug(), "%s: Insufficient MDP pipes or stages",
+                __FUNCTION__);
         return false;
     }
 
@@ -668,56 +839,56 @@ bool MDPComp::isYUVDoable(hwc_context_t* ctx, hwc_layer_1_t* layer) {
 }
 
 bool MDPComp::batchLayers(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
-    /* Idea is to keep as many contiguous non-updating(cached) layers in FB and
-     * send rest of them through MDP. NEVER mark an updating layer for caching.
-     * But cached ones can be marked for MDP*/
-
-    int maxBatchStart = -1;
-    int maxBatchCount = 0;
-
-    /* All or Nothing is cached. No batching needed */
-    if(!mCurrentFrame.fbCount) {
-        mCurrentFrame.fbZ = -1;
-        return true;
-    }
-    if(!mCurrentFrame.mdpCount) {
-        mCurrentFrame.fbZ = 0;
-        return true;
-    }
-
-    /* Search for max number of contiguous (cached) layers */
-    int i = 0;
-    while (i < mCurrentFrame.layerCount) {
-        int count = 0;
-        while(mCurrentFrame.isFBComposed[i] && i < mCurrentFrame.layerCount) {
-            count++; i++;
-        }
-        if(count > maxBatchCount) {
-            maxBatchCount = count;
-            maxBatchStart = i - count;
-            mCurrentFrame.fbZ = maxBatchStart;
-        }
-        if(i < mCurrentFrame.layerCount) i++;
-    }
+    /* Idea is to keep contiguous non-updating(cached) layers in FB and send
+     * rest of them through MDP. NEVER mark an updating layer for caching.
+     * But cached ones can be marked for MDP. The batch is as short as the
+     * pipes and stages allow, so that the most layers are on MDP */
+    PipeDemand demands[MAX_NUM_APP_LAYERS];
+    const int count = mCurrentFrame.layerCount;
+
+    /* Nothing is cached, all of it would have to go on MDP */
+    if(!mCurrentFrame.fbCount)
+        return false;
 
-    /* reset rest of the layers for MDP comp */
-    for(int i = 0; i < mCurrentFrame.layerCount; i++) {
+    for(int i = 0; i < count; i++) {
         hwc_layer_1_t* layer = &list->hwLayers[i];
-        if(i != maxBatchStart) {
-            //If an unsupported layer is being attempted to be pulled out we
-            //should fail
-            if(not isSupportedForMDPComp(ctx, layer)) {
-                return false;
-            }
-            mCurrentFrame.isFBComposed[i] = false;
+        getPipeDemand(ctx, layer, demands[i]);
+        if(!mCurrentFrame.isFBComposed[i]) {
+            demands[i].place = PLACE_MDP;
+        } else if(not isSupportedForMDPComp(ctx, layer) ||
+                (isYuvBuffer((private_handle_t *)layer->handle) &&
+                 !isYUVDoable(ctx, layer))) {
+            //Cannot be pulled out of the FB
+            demands[i].place = PLACE_FB;
         } else {
-            i += maxBatchCount;
+            demands[i].place = PLACE_ANY;
         }
     }
 
-    mCurrentFrame.fbCount = maxBatchCount;
-    mCurrentFrame.mdpCount = mCurrentFrame.layerCount -
-            mCurrentFrame.fbCount;
+    PipeBudget budget;
+    getPipeBudget(ctx, budget);
+    int fbStart = -1;
+    int fbCount = 0;
+    if(!fitMostPipeTypes(demands, count, budget, fbStart, fbCount)) {
+        ALOGD_IF(isDebug(), "%s: No FB batch fits, VG %d RGB %d DMA %d free",
+                __FUNCTION__, budget.avail[OV_MDP_PIPE_VG],
+                budget.avail[OV_MDP_PIPE_RGB], budget.avail[OV_MDP_PIPE_DMA]);
+        return false;
+    }
+
+    for(int i = 0; i < count; i++) {
+        mCurrentFrame.isFBComposed[i] = (i >= fbStart &&
+                i < fbStart + fbCount);
+        if(!mCurrentFrame.isFBComposed[i])
+            mCurrentFrame.pipeType[i] = (ePipeType)demands[i].type;
+    }
+    //A split layer takes more than one stage, so the FB sits above the
+    //stages of the MDP layers below it, not at its layer index.
+    mCurrentFrame.fbZ = 0;
+    for(int i = 0; i < fbStart; i++)
+        mCurrentFrame.fbZ += demands[i].stages;
+    mCurrentFrame.fbCount = fbCount;
+    mCurrentFrame.mdpCount = count - fbCount;
 
     ALOGD_IF(isDebug(),"%s: cached count: %d",__FUNCTION__,
              mCurrentFrame.fbCount);
@@ -748,21 +919,80 @@ void MDPComp::updateLayerCache(hwc_context_t* ctx,
             mCurrentFrame.mdpCount, mCurrentFrame.fbCount);
 }
 
-int MDPComp::getAvailablePipes(hwc_context_t* ctx) {
-    int numDMAPipes = qdutils::MDPVersion::getInstance().getDMAPipes();
+void MDPComp::getPipeBudget(hwc_context_t *ctx, PipeBudget& budget) {
     overlay::Overlay& ov = *ctx->mOverlay;
-
-    int numAvailable = ov.availablePipes(mDpy);
+    for(int type = 0; type < OV_MDP_PIPE_ANY; type++)
+        budget.avail[type] = ov.availablePipes(mDpy, (eMdpPipeType)type);
 
     //Reserve DMA for rotator
     if(ctx->mNeedsRotator)
-        numAvailable -= numDMAPipes;
+        budget.avail[OV_MDP_PIPE_DMA] = 0;
 
-    //Reserve pipe(s)for FB
-    if(mCurrentFrame.fbCount)
-        numAvailable -= pipesForFB();
+    budget.maxStages = sMaxPipesPerMixer;
+    //Will benefit cases where a video has non-updating background.
+    budget.maxLayers = (mDpy > HWC_DISPLAY_PRIMARY) ? MAX_SEC_LAYERS : -1;
+    budget.fbPipes = pipesForFB();
+}
+
+int MDPComp::stagesBelow(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, const int& index) {
+    int stages = 0;
+    for(int i = 0; i < index && i < mCurrentFrame.layerCount; i++) {
+        if(!mCurrentFrame.isFBComposed[i])
+            stages += stagesForLayer(ctx, &list->hwLayers[i]);
+    }
+    return stages;
+}
 
-    return numAvailable;
+void MDPComp::getPipeDemand(hwc_context_t *ctx, hwc_layer_1_t *layer,
+        PipeDemand& demand) {
+    demand.caps = getPipeCaps(ctx, layer);
+    demand.pipes = pipesForLayer(ctx, layer);
+    demand.stages = stagesForLayer(ctx, layer);
+    demand.place = PLACE_MDP;
+    demand.type = OV_MDP_PIPE_ANY;
+}
+
+int MDPComp::getPipeCaps(hwc_context_t *ctx, hwc_layer_1_t *layer) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+
+    //Only VG pipes fetch YUV
+    if(isYuvBuffer(hnd))
+        return (1 << MDPCOMP_OV_VG);
+
+    int caps = (1 << MDPCOMP_OV_RGB) | (1 << MDPCOMP_OV_VG);
+    //DMA pipes can't scale, are taken by the rotator when it's needed and
+    //can't blend on MDP4
+    if(!qhwc::needsScaling(ctx, layer, mDpy) && !ctx->mNeedsRotator &&
+            ctx->mMDP.version >= qdutils::MDSS_V5)
+        caps |= (1 << MDPCOMP_OV_DMA);
+    return caps;
+}
+
+bool MDPComp::assignPipeTypes(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    PipeDemand demands[MAX_NUM_APP_LAYERS];
+    int layerIndex[MAX_NUM_APP_LAYERS];
+    int count = 0;
+
+    for(int i = 0; i < mCurrentFrame.layerCount; i++) {
+        if(mCurrentFrame.isFBComposed[i]) continue;
+        getPipeDemand(ctx, &list->hwLayers[i], demands[count]);
+        layerIndex[count++] = i;
+    }
+
+    PipeBudget budget;
+    getPipeBudget(ctx, budget);
+    if(!fitPipeTypes(demands, count, budget, mCurrentFrame.fbCount != 0)) {
+        ALOGD_IF(isDebug(), "%s: No pipe types fit, VG %d RGB %d DMA %d free",
+                __FUNCTION__, budget.avail[OV_MDP_PIPE_VG],
+                budget.avail[OV_MDP_PIPE_RGB], budget.avail[OV_MDP_PIPE_DMA]);
+        return false;
+    }
+
+    for(int i = 0; i < count; i++)
+        mCurrentFrame.pipeType[layerIndex[i]] = (ePipeType)demands[i].type;
+    return true;
 }
 
 void MDPComp::updateYUV(hwc_context_t* ctx, hwc_display_contents_1_t* list) {
@@ -806,7 +1036,8 @@ bool MDPComp::programMDP(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
             hwc_layer_1_t* layer = &list->hwLayers[index];
 
             MdpPipeInfo* cur_pipe = mCurrentFrame.mdpToLayer[mdpIndex].pipeInfo;
-            cur_pipe->zOrder = mdpNextZOrder++;
+            cur_pipe->zOrder = mdpNextZOrder;
+            mdpNextZOrder += cur_pipe->numStages;
 
             if(configure(ctx, layer, mCurrentFrame.mdpToLayer[mdpIndex]) != 0 ){
                 ALOGD_IF(isDebug(), "%s: Failed to configure overlay for \
@@ -814,8 +1045,20 @@ bool MDPComp::programMDP(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
                 return false;
             }
         } else if(fbBatch == false) {
-                mdpNextZOrder++;
-                fbBatch = true;
+            //The FB was configured at fbZ before the pipes were allocated
+            if(mdpNextZOrder != mCurrentFrame.fbZ) {
+                ALOGD_IF(isDebug(), "%s: FB at z %d, expected %d",
+                         __FUNCTION__, mCurrentFrame.fbZ, mdpNextZOrder);
+                return false;
+            }
+            mdpNextZOrder++;
+            fbBatch = true;
+        }
+
+        if(mdpNextZOrder > sMaxPipesPerMixer) {
+            ALOGD_IF(isDebug(), "%s: %d stages exceed the mixer's %d",
+                     __FUNCTION__, mdpNextZOrder, sMaxPipesPerMixer);
+            return false;
         }
     }
 
@@ -835,7 +1078,13 @@ bool MDPComp::programYUV(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
             int mdpIndex = mCurrentFrame.layerToMDP[index];
             MdpPipeInfo* cur_pipe =
                     mCurrentFrame.mdpToLayer[mdpIndex].pipeInfo;
-            cur_pipe->zOrder = mdpIdx++;
+            cur_pipe->zOrder = mdpIdx;
+            mdpIdx += cur_pipe->numStages;
+            if(mdpIdx + (mCurrentFrame.fbCount ? 1 : 0) > sMaxPipesPerMixer) {
+                ALOGD_IF(isDebug(), "%s: stages exceed the mixer's %d",
+                         __FUNCTION__, sMaxPipesPerMixer);
+                return false;
+            }
 
             if(configure(ctx, layer,
                         mCurrentFrame.mdpToLayer[mdpIndex]) != 0 ){
@@ -854,6 +1103,7 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     int ret = 1;
     //reset old data
     mCurrentFrame.reset(numLayers);
+    updateIdleState(ctx, list);
 
     //Do not cache the information for next draw cycle.
     if(numLayers > MAX_NUM_APP_LAYERS or (!numLayers)) {
@@ -890,6 +1140,8 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     //Check whether layers marked for MDP Composition is actually doable.
     if(isFullFrameDoable(ctx, list)) {
         mCurrentFrame.map();
+        //The pipes of the display are set together once all are configured
+        ctx->mOverlay->beginFrame(mDpy);
         //Configure framebuffer first if applicable
         if(mCurrentFrame.fbZ >= 0) {
             if(!ctx->mFBUpdate[mDpy]->prepare(ctx, list,
@@ -914,7 +1166,7 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
             }
         }
         //Acquire and Program MDP pipes
-        if(!programMDP(ctx, list)) {
+        if(!programMDP(ctx, list) || !ctx->mOverlay->commitFrame(mDpy)) {
             reset(numLayers, list);
             ctx->mOverlay->clear(mDpy);
             ctx->mLayerRotMap[mDpy]->clear();
@@ -939,9 +1191,11 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
         //Destination over
         mCurrentFrame.fbZ = -1;
         if(mCurrentFrame.fbCount)
-            mCurrentFrame.fbZ = mCurrentFrame.mdpCount;
+            mCurrentFrame.fbZ = stagesBelow(ctx, list,
+                                            mCurrentFrame.layerCount);
 
         mCurrentFrame.map();
+        ctx->mOverlay->beginFrame(mDpy);
 
         //Configure framebuffer first if applicable
         if(mCurrentFrame.fbZ >= 0) {
@@ -952,7 +1206,7 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
                 return -1;
             }
         }
-        if(!programYUV(ctx, list)) {
+        if(!programYUV(ctx, list) || !ctx->mOverlay->commitFrame(mDpy)) {
             reset(numLayers, list);
             ctx->mOverlay->clear(mDpy);
             ctx->mLayerRotMap[mDpy]->clear();
@@ -967,6 +1221,7 @@ int MDPComp::prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     //UpdateLayerFlags
     setMDPCompLayerFlags(ctx, list);
     mCachedFrame.updateCounts(mCurrentFrame);
+    updateIdleEstimate(ctx, list);
 
     // unlock it before calling dump function to avoid deadlock
 
@@ -997,17 +1252,50 @@ int MDPCompLowRes::configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
     ALOGD_IF(isDebug(),"%s: configuring: layer: %p z_order: %d dest_pipe: %d",
              __FUNCTION__, layer, zOrder, dest);
 
+    if(mdp_info.splitIndex != ovutils::OV_INVALID) {
+        PipeLayerPair.rot = NULL;
+        return configureSourceSplit(ctx, layer, mDpy, mdpFlags, zOrder, isFg,
+                dest, mdp_info.splitIndex);
+    }
+
     return configureLowRes(ctx, layer, mDpy, mdpFlags, zOrder, isFg, dest,
                            &PipeLayerPair.rot);
 }
 
-int MDPCompLowRes::pipesNeeded(hwc_context_t *ctx,
-                               hwc_display_contents_1_t* list) {
-    return mCurrentFrame.mdpCount;
+int MDPCompLowRes::pipesForLayer(hwc_context_t *ctx, hwc_layer_1_t *layer) {
+    SplitPlan plan;
+    if(getSplitPlan(ctx, layer, plan))
+        return plan.numPipes;
+    return 1;
+}
+
+int MDPCompLowRes::stagesForLayer(hwc_context_t *ctx, hwc_layer_1_t *layer) {
+    //Split halves are stacked on the one mixer
+    return pipesForLayer(ctx, layer);
+}
+
+bool MDPCompLowRes::allocSplitPipe(hwc_context_t *ctx, hwc_layer_1_t *layer,
+        MdpPipeInfoLowRes& pipe_info, ePipeType type) {
+    SplitPlan plan;
+    if(!getSplitPlan(ctx, layer, plan) || plan.numPipes < 2)
+        return true;
+
+    //Right half takes its own blend stage, above the left one
+    pipe_info.splitIndex = getMdpPipe(ctx, type,
+            getSplitKey(getLayerKey(layer)));
+    if(pipe_info.splitIndex == ovutils::OV_INVALID) {
+        ALOGD_IF(isDebug(), "%s: Unable to get pipe for the right half",
+                __FUNCTION__);
+        return false;
+    }
+    pipe_info.numStages = 2;
+    return true;
 }
 
 bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
                                     hwc_display_contents_1_t* list) {
+    //Pipe types and stages were settled with the FB by assignPipeTypes or
+    //batchLayers, before the FB took its pipe
     if(isYuvPresent(ctx, mDpy)) {
         int nYuvCount = ctx->listStats[mDpy].yuvCount;
         eDest yuvIndex[MAX_MDP_YUV_COUNT] = {OV_INVALID, OV_INVALID};
@@ -1028,12 +1316,15 @@ bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
             info.rot = NULL;
             MdpPipeInfoLowRes& pipe_info = *(MdpPipeInfoLowRes*)info.pipeInfo;
 
-            pipe_info.index = getMdpPipe(ctx, MDPCOMP_OV_VG);
+            pipe_info.index = getMdpPipe(ctx, MDPCOMP_OV_VG,
+                                          getLayerKey(layer));
             if(pipe_info.index == ovutils::OV_INVALID) {
                 ALOGD_IF(isDebug(), "%s: Unable to get pipe for Videos",
                          __FUNCTION__);
                 return false;
             }
+            if(!allocSplitPipe(ctx, layer, pipe_info, MDPCOMP_OV_VG))
+                return false;
             yuvIndex[counter++] = pipe_info.index;
         }
         if(counter == 1) {
@@ -1063,18 +1354,15 @@ bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
         info.rot = NULL;
         MdpPipeInfoLowRes& pipe_info = *(MdpPipeInfoLowRes*)info.pipeInfo;
 
-        ePipeType type = MDPCOMP_OV_ANY;
+        ePipeType type = mCurrentFrame.pipeType[index];
 
-        if(!qhwc::needsScaling(ctx,layer,mDpy) && !ctx->mNeedsRotator
-           && ctx->mMDP.version >= qdutils::MDSS_V5) {
-            type = MDPCOMP_OV_DMA;
-        }
-
-        pipe_info.index = getMdpPipe(ctx, type);
+        pipe_info.index = getMdpPipe(ctx, type, getLayerKey(layer));
         if(pipe_info.index == ovutils::OV_INVALID) {
             ALOGD_IF(isDebug(), "%s: Unable to get pipe for UI", __FUNCTION__);
             return false;
         }
+        if(!allocSplitPipe(ctx, layer, pipe_info, type))
+            return false;
     }
     return true;
 }
@@ -1097,8 +1385,9 @@ bool MDPCompLowRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     }
 
     /* reset Invalidator */
-    if(idleInvalidator && !sIdleFallBack && mCurrentFrame.mdpCount)
-        idleInvalidator->markForSleep();
+    if(idleInvalidator && mIdleUpdate &&
+            (mCurrentFrame.mdpCount || isIdleFallBack()))
+        idleInvalidator->markForSleep(mDpy);
 
     overlay::Overlay& ov = *ctx->mOverlay;
     LayerProp *layerProp = ctx->layerProp[mDpy];
@@ -1148,6 +1437,13 @@ bool MDPCompLowRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
             return false;
         }
 
+        if(pipe_info.splitIndex != ovutils::OV_INVALID &&
+                !ov.queueBuffer(fd, offset, pipe_info.splitIndex)) {
+            ALOGE("%s: queueBuffer failed for right half, display:%d ",
+                    __FUNCTION__, mDpy);
+            return false;
+        }
+
         layerProp[i].mFlags &= ~HWC_MDPCOMP;
     }
     return true;
@@ -1155,46 +1451,36 @@ bool MDPCompLowRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
 
 //=============MDPCompHighRes===================================================
 
-int MDPCompHighRes::pipesNeeded(hwc_context_t *ctx,
-                                hwc_display_contents_1_t* list) {
-    int pipesNeeded = 0;
+int MDPCompHighRes::pipesForLayer(hwc_context_t *ctx, hwc_layer_1_t *layer) {
     int hw_w = ctx->dpyAttr[mDpy].xres;
-
-    for(int i = 0; i < mCurrentFrame.layerCount; ++i) {
-        if(!mCurrentFrame.isFBComposed[i]) {
-            hwc_layer_1_t* layer = &list->hwLayers[i];
-            hwc_rect_t dst = layer->displayFrame;
-            if(dst.left > hw_w/2) {
-                pipesNeeded++;
-            } else if(dst.right <= hw_w/2) {
-                pipesNeeded++;
-            } else {
-                pipesNeeded += 2;
-            }
-        }
-    }
-    return pipesNeeded;
+    hwc_rect_t dst = layer->displayFrame;
+    if(dst.left > hw_w/2 || dst.right <= hw_w/2)
+        return 1;
+    return 2;
 }
 
 bool MDPCompHighRes::acquireMDPPipes(hwc_context_t *ctx, hwc_layer_1_t* layer,
                                      MdpPipeInfoHighRes& pipe_info,
                                      ePipeType type) {
     int hw_w = ctx->dpyAttr[mDpy].xres;
+    //Left and right halves of a layer are different pipe configs
+    uint32_t lKey = getLayerKey(layer);
+    uint32_t rKey = getSplitKey(lKey);
 
     hwc_rect_t dst = layer->displayFrame;
     if(dst.left > hw_w/2) {
         pipe_info.lIndex = ovutils::OV_INVALID;
-        pipe_info.rIndex = getMdpPipe(ctx, type);
+        pipe_info.rIndex = getMdpPipe(ctx, type, rKey);
         if(pipe_info.rIndex == ovutils::OV_INVALID)
             return false;
     } else if (dst.right <= hw_w/2) {
         pipe_info.rIndex = ovutils::OV_INVALID;
-        pipe_info.lIndex = getMdpPipe(ctx, type);
+        pipe_info.lIndex = getMdpPipe(ctx, type, lKey);
         if(pipe_info.lIndex == ovutils::OV_INVALID)
             return false;
     } else {
-        pipe_info.rIndex = getMdpPipe(ctx, type);
-        pipe_info.lIndex = getMdpPipe(ctx, type);
+        pipe_info.rIndex = getMdpPipe(ctx, type, rKey);
+        pipe_info.lIndex = getMdpPipe(ctx, type, lKey);
         if(pipe_info.rIndex == ovutils::OV_INVALID ||
            pipe_info.lIndex == ovutils::OV_INVALID)
             return false;
@@ -1204,7 +1490,6 @@ bool MDPCompHighRes::acquireMDPPipes(hwc_context_t *ctx, hwc_layer_1_t* layer,
 
 bool MDPCompHighRes::allocLayerPipes(hwc_context_t *ctx,
                                      hwc_display_contents_1_t* list) {
-    overlay::Overlay& ov = *ctx->mOverlay;
     int layer_count = ctx->listStats[mDpy].numAppLayers;
 
     if(isYuvPresent(ctx, mDpy)) {
@@ -1252,11 +1537,7 @@ bool MDPCompHighRes::allocLayerPipes(hwc_context_t *ctx,
         info.rot = NULL;
         MdpPipeInfoHighRes& pipe_info = *(MdpPipeInfoHighRes*)info.pipeInfo;
 
-        ePipeType type = MDPCOMP_OV_ANY;
-
-        if(!qhwc::needsScaling(ctx,layer,mDpy) && !ctx->mNeedsRotator
-           && ctx->mMDP.version >= qdutils::MDSS_V5)
-            type = MDPCOMP_OV_DMA;
+        ePipeType type = mCurrentFrame.pipeType[index];
 
         if(!acquireMDPPipes(ctx, layer, pipe_info, type)) {
             ALOGD_IF(isDebug(), "%s: Unable to get pipe for UI", __FUNCTION__);
@@ -1305,8 +1586,9 @@ bool MDPCompHighRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     }
 
     /* reset Invalidator */
-    if(idleInvalidator && !sIdleFallBack && mCurrentFrame.mdpCount)
-        idleInvalidator->markForSleep();
+    if(idleInvalidator && mIdleUpdate &&
+            (mCurrentFrame.mdpCount || isIdleFallBack()))
+        idleInvalidator->markForSleep(mDpy);
 
     overlay::Overlay& ov = *ctx->mOverlay;
     LayerProp *layerProp = ctx->layerProp[mDpy];
@@ -24,6 +24,7 @@
 #include <idle_invalidator.h>
 #include <cutils/properties.h>
 #include <overlay.h>
+#include <hwc_pipe_solver.h>
 
 #define DEFAULT_IDLE_TIME 2000
 #define MAX_PIPES_PER_MIXER 4
@@ -38,7 +39,7 @@ namespace ovutils = overlay::utils;
 class MDPComp {
 public:
     explicit MDPComp(int, int);
-    virtual ~MDPComp(){};
+    virtual ~MDPComp();
     /*sets up mdp comp for the current frame */
     int prepare(hwc_context_t *ctx, hwc_display_contents_1_t* list);
     /* draw */
@@ -46,16 +47,47 @@ public:
     /* dumpsys */
     void dump(android::String8& buf);
 
+    /* Decisions of the last prepare, for the frame timeline */
+    struct FramePlan {
+        int layerCount;
+        int mdpCount;
+        int fbCount;
+        int fbZ;
+        bool needsRedraw;
+    };
+    struct LayerPlan {
+        bool mdp;       /* composed by MDP, else on the FB */
+        bool cached;    /* not updating, its FB contents reused */
+        int zOrder;     /* MDP only */
+        int pipeType;   /* ePipeType, MDP only */
+        int dest[2];    /* pipes taken, OV_INVALID if fewer */
+        int rotSession; /* -1 if not rotated */
+    };
+    void getFramePlan(FramePlan& plan) const;
+    /* Returns false if index is not a layer of the frame */
+    bool getLayerPlan(const int& index, LayerPlan& plan) const;
+
     static MDPComp* getObject(const int& width, const int dpy);
-    /* Handler to invoke frame redraw on Idle Timer expiry */
-    static void timeout_handler(void *udata);
+    /* Handler to invoke frame redraw on Idle Timer expiry. Runs on the
+     * event loop, returns false instead of waiting for a busy draw lock */
+    static bool timeout_handler(void *udata, int dpy);
     /* Initialize MDP comp*/
     static bool init(hwc_context_t *ctx);
-    static void resetIdleFallBack() { sIdleFallBack = false; }
 
 protected:
     enum { MAX_SEC_LAYERS = 1 }; //TODO add property support
 
+    /* Idle states of the display. An idle display stays on MDP if fetching
+     * its frame on every refresh costs less than a GPU composition of it
+     * followed by fetching just the FB, else it falls back to GPU */
+    enum eIdleState { IDLE_ACTIVE, IDLE_MDP, IDLE_FALLBACK, IDLE_STATE_MAX };
+    enum {
+        /* Updates within an idle time that end a fallback */
+        IDLE_EXIT_UPDATES = 3,
+        /* Cost of a byte the GPU reads or writes, in bytes MDP fetches */
+        IDLE_GPU_BYTE_COST = 4,
+    };
+
     enum ePipeType {
         MDPCOMP_OV_RGB = ovutils::OV_MDP_PIPE_RGB,
         MDPCOMP_OV_VG = ovutils::OV_MDP_PIPE_VG,
@@ -66,7 +98,12 @@ protected:
     /* mdp pipe data */
     struct MdpPipeInfo {
         int zOrder;
+        /* blend stages taken, more than one if the layer is split */
+        int numStages;
+        MdpPipeInfo() : zOrder(0), numStages(1) {};
         virtual ~MdpPipeInfo(){};
+        /* pipes taken by the layer */
+        virtual void getDests(int& first, int& second) const = 0;
     };
 
     /* per layer data */
@@ -96,6 +133,9 @@ protected:
         bool needsRedraw;
         int fbZ;
 
+        /* pipe type picked for each MDP composed layer */
+        ePipeType pipeType[MAX_NUM_APP_LAYERS];
+
         /* c'tor */
         FrameInfo();
         /* clear old frame data */
@@ -121,9 +161,10 @@ protected:
 
     /* No of pipes needed for Framebuffer */
     virtual int pipesForFB() = 0;
-    /* calculates pipes needed for the panel */
-    virtual int pipesNeeded(hwc_context_t *ctx,
-                            hwc_display_contents_1_t* list) = 0;
+    /* pipes a layer takes, all of them of one type */
+    virtual int pipesForLayer(hwc_context_t *ctx, hwc_layer_1_t *layer) = 0;
+    /* blend stages a layer takes on a mixer */
+    virtual int stagesForLayer(hwc_context_t *ctx, hwc_layer_1_t *layer) = 0;
     /* allocates pipe from pipe book */
     virtual bool allocLayerPipes(hwc_context_t *ctx,
                                  hwc_display_contents_1_t* list) = 0;
@@ -131,11 +172,45 @@ protected:
     virtual int configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
                           PipeLayerPair& pipeLayerPair) = 0;
 
+    /* Idle time expired, picks IDLE_MDP or IDLE_FALLBACK. Called on the
+     * invalidator thread. Returns true if the frame needs a redraw */
+    bool onIdleTimeout(hwc_context_t *ctx);
+    /* Tells updates from redraws, and leaves the idle state on updates */
+    void updateIdleState(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* Bytes the frame, as composed, costs on each refresh */
+    void updateIdleEstimate(hwc_context_t *ctx,
+            hwc_display_contents_1_t* list);
+    /* Moves to state, accounting the residency. mIdleLock held */
+    void setIdleState(const int& state);
+    bool isIdleFallBack() const { return mIdleState == IDLE_FALLBACK; }
+
     /* set/reset flags for MDPComp */
     void setMDPCompLayerFlags(hwc_context_t *ctx,
                               hwc_display_contents_1_t* list);
-    /* allocate MDP pipes from overlay */
-    ovutils::eDest getMdpPipe(hwc_context_t *ctx, ePipeType type);
+    /* allocate MDP pipes from overlay, preferring the pipe that served
+     * the layer with the same key in the previous frame */
+    ovutils::eDest getMdpPipe(hwc_context_t *ctx, ePipeType type,
+                              uint32_t layerKey = 0);
+    /* identity of a layer across frames, based on its geometry */
+    static uint32_t getLayerKey(hwc_layer_1_t* layer);
+    /* key of the second pipe of a split layer, never 0 like layerKey */
+    static uint32_t getSplitKey(const uint32_t& layerKey);
+
+    /* pipe types, as a bitmask of 1 << ePipeType, that can fetch a layer */
+    int getPipeCaps(hwc_context_t *ctx, hwc_layer_1_t *layer);
+    /* free pipes and stages the display has for this frame */
+    void getPipeBudget(hwc_context_t *ctx, PipeBudget& budget);
+    /* pipes and stages a layer takes if composed on MDP */
+    void getPipeDemand(hwc_context_t *ctx, hwc_layer_1_t *layer,
+                       PipeDemand& demand);
+    /* mixer stages taken by the MDP layers below index, which is where
+     * the FB goes if it is blended at index */
+    int stagesBelow(hwc_context_t *ctx, hwc_display_contents_1_t* list,
+                    const int& index);
+    /* picks a pipe type for each MDP layer such that all of them, and the
+     * FB if needed, fit the free pipes and the stages of the mixer. Results
+     * in mCurrentFrame.pipeType. Returns false if no assignment fits */
+    bool assignPipeTypes(hwc_context_t *ctx, hwc_display_contents_1_t* list);
 
     /* checks for conditions where mdpcomp is not possible */
     bool isFrameDoable(hwc_context_t *ctx, hwc_display_contents_1_t* list);
@@ -158,11 +233,13 @@ protected:
     static bool isEnabled() { return sEnabled; };
     /* checks for mdp comp dimension limitation */
     bool isValidDimension(hwc_context_t *ctx, hwc_layer_1_t *layer);
+    /* plans the pipes for the on screen part of a layer */
+    bool getSplitPlan(hwc_context_t *ctx, hwc_layer_1_t *layer,
+                      SplitPlan& plan);
     /* tracks non updating layers*/
     void updateLayerCache(hwc_context_t* ctx, hwc_display_contents_1_t* list);
-    /* gets available pipes for mdp comp */
-    int getAvailablePipes(hwc_context_t* ctx);
-    /* optimize layers for mdp comp*/
+    /* picks the FB batch that leaves the most layers on MDP, and their
+     * pipe types */
     bool batchLayers(hwc_context_t *ctx, hwc_display_contents_1_t* list);
     /* updates cache map with YUV info */
     void updateYUV(hwc_context_t* ctx, hwc_display_contents_1_t* list);
@@ -176,11 +253,25 @@ protected:
     static bool sEnabled;
     static bool sEnableMixedMode;
     static bool sDebugLogs;
-    static bool sIdleFallBack;
     static int sMaxPipesPerMixer;
     static IdleInvalidator *idleInvalidator;
     struct FrameInfo mCurrentFrame;
     struct LayerCache mCachedFrame;
+    /* Idle state, shared with the invalidator thread */
+    int mIdleState;
+    /* The frame updated the display, as opposed to a redraw */
+    bool mIdleUpdate;
+    /* Updates since the fallback or its last idle time */
+    int mIdleUpdates;
+    uint64_t mIdleFrameSig;
+    /* Fetched by MDP on each refresh, and the app layers in all */
+    uint64_t mIdleFetchBytes;
+    uint64_t mIdleFrameBytes;
+    nsecs_t mIdleStateTime;
+    nsecs_t mIdleResidency[IDLE_STATE_MAX];
+    uint32_t mIdleFallBacks;
+    uint32_t mIdleKeptMDP;
+    Locker mIdleLock;
 };
 
 class MDPCompLowRes : public MDPComp {
@@ -194,7 +285,15 @@ private:
 
     struct MdpPipeInfoLowRes : public MdpPipeInfo {
         ovutils::eDest index;
+        /* pipe for the right half of a source split layer */
+        ovutils::eDest splitIndex;
+        MdpPipeInfoLowRes() : index(ovutils::OV_INVALID),
+                splitIndex(ovutils::OV_INVALID) {};
         virtual ~MdpPipeInfoLowRes() {};
+        virtual void getDests(int& first, int& second) const {
+            first = index;
+            second = splitIndex;
+        }
     };
 
     virtual int pipesForFB() { return 1; };
@@ -205,8 +304,12 @@ private:
     /* allocates pipes to selected candidates */
     virtual bool allocLayerPipes(hwc_context_t *ctx,
                                  hwc_display_contents_1_t* list);
+    /* allocates the right half pipe, if the layer needs a source split */
+    bool allocSplitPipe(hwc_context_t *ctx, hwc_layer_1_t *layer,
+                        MdpPipeInfoLowRes& pipe_info, ePipeType type);
 
-    virtual int pipesNeeded(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    virtual int pipesForLayer(hwc_context_t *ctx, hwc_layer_1_t *layer);
+    virtual int stagesForLayer(hwc_context_t *ctx, hwc_layer_1_t *layer);
 };
 
 class MDPCompHighRes : public MDPComp {
@@ -220,6 +323,10 @@ private:
         ovutils::eDest lIndex;
         ovutils::eDest rIndex;
         virtual ~MdpPipeInfoHighRes() {};
+        virtual void getDests(int& first, int& second) const {
+            first = lIndex;
+            second = rIndex;
+        }
     };
 
     bool acquireMDPPipes(hwc_context_t *ctx, hwc_layer_1_t* layer,
@@ -234,7 +341,11 @@ private:
     virtual bool allocLayerPipes(hwc_context_t *ctx,
                                  hwc_display_contents_1_t* list);
 
-    virtual int pipesNeeded(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    virtual int pipesForLayer(hwc_context_t *ctx, hwc_layer_1_t *layer);
+    /* a layer takes a stage on each mixer it spans */
+    virtual int stagesForLayer(hwc_context_t *ctx, hwc_layer_1_t *layer) {
+        return 1;
+    };
 };
 
 }; //namespace
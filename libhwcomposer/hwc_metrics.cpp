@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2013, Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <overlay.h>
+#include "hwc_metrics.h"
+
+namespace qhwc {
+
+HwcMetrics::HwcMetrics()
+{
+    memset(&mData, 0, sizeof(mData));
+    mData.version = qdutils::HWC_METRICS_VERSION;
+    mData.totalPipes = overlay::Overlay::getNumPipes();
+}
+
+void HwcMetrics::addToHist(uint32_t *hist, const nsecs_t& time)
+{
+    int bucket = 0;
+    for(nsecs_t us = time / 1000; us > 1 &&
+            bucket < qdutils::HWC_METRICS_BUCKETS - 1; us >>= 1)
+        bucket++;
+    hist[bucket]++;
+}
+
+void HwcMetrics::addFrame(hwc_context_t *ctx, int dpy,
+        hwc_display_contents_1_t *list)
+{
+    if(dpy < 0 || dpy >= qdutils::HWC_METRICS_DISPLAYS ||
+            !list || list->numHwLayers < 1 ||
+            !ctx->dpyAttr[dpy].connected || !ctx->dpyAttr[dpy].isActive)
+        return;
+
+    uint32_t numAppLayers = list->numHwLayers - 1;
+    uint32_t mdpLayers = 0, fbLayers = 0, blitLayers = 0;
+    for(uint32_t i = 0; i < numAppLayers; i++) {
+        switch(list->hwLayers[i].compositionType) {
+        case HWC_OVERLAY:
+            mdpLayers++;
+            break;
+        case HWC_BLIT:
+            blitLayers++;
+            break;
+        default:
+            fbLayers++;
+            break;
+        }
+    }
+    int strategy = qdutils::HWC_STRATEGY_GPU;
+    if(blitLayers)
+        strategy = qdutils::HWC_STRATEGY_COPYBIT;
+    else if(mdpLayers && fbLayers)
+        strategy = qdutils::HWC_STRATEGY_MIXED;
+    else if(mdpLayers)
+        strategy = qdutils::HWC_STRATEGY_MDP;
+    uint32_t pipes = ctx->mOverlay->pipesInUse(dpy);
+    uint32_t rotSessions = ctx->mLayerRotMap[dpy]->getCount();
+
+    Locker::Autolock _l(mLock);
+    qdutils::HwcDisplayMetrics_t& m = mData.dpy[dpy];
+    m.frames[strategy]++;
+    m.layers += numAppLayers;
+    m.mdpLayers += mdpLayers;
+    m.pipes += pipes;
+    m.maxPipes = max(m.maxPipes, pipes);
+    if(rotSessions) {
+        m.rotFrames++;
+        m.rotSessions += rotSessions;
+    }
+}
+
+void HwcMetrics::addCycle(const nsecs_t& prepareTime,
+        const nsecs_t& setTime)
+{
+    Locker::Autolock _l(mLock);
+    mData.cycles++;
+    mData.prepareTime += prepareTime;
+    mData.setTime += setTime;
+    addToHist(mData.prepareHist, prepareTime);
+    addToHist(mData.setHist, setTime);
+}
+
+void HwcMetrics::addFenceWait(const nsecs_t& time)
+{
+    Locker::Autolock _l(mLock);
+    mData.fenceWaits++;
+    mData.fenceWaitTime += time;
+    mData.maxFenceWaitTime = max(mData.maxFenceWaitTime, (uint64_t)time);
+    addToHist(mData.fenceWaitHist, time);
+}
+
+void HwcMetrics::addBlits(const uint32_t& count)
+{
+    Locker::Autolock _l(mLock);
+    mData.copybitBlits += count;
+}
+
+void HwcMetrics::getSnapshot(qdutils::HwcMetrics_t& metrics) const
+{
+    Locker::Autolock _l(mLock);
+    metrics = mData;
+    metrics.timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+}; //namespace qhwc
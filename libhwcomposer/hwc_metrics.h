@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2013, Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HWC_METRICS_H
+#define HWC_METRICS_H
+
+#include <utils/Timers.h>
+#include <display_config.h>
+#include "hwc_utils.h"
+
+namespace qhwc {
+
+/*
+ * Composition counters sent by the GET_HWC_METRICS command of QService, in
+ * the qdutils::HwcMetrics_t layout, so that telemetry can poll them without
+ * parsing dumpsys. Updated on the composition thread, read on binder
+ * threads; mLock is held only to copy counters in or out, never across a
+ * composition.
+ */
+class HwcMetrics {
+public:
+    HwcMetrics();
+    /* Accounts how a display composed its frame, after its prepare */
+    void addFrame(hwc_context_t *ctx, int dpy,
+            hwc_display_contents_1_t *list);
+    /* Accounts the time of a prepare and of the set that followed */
+    void addCycle(const nsecs_t& prepareTime, const nsecs_t& setTime);
+    /* Accounts a wait on a fence */
+    void addFenceWait(const nsecs_t& time);
+    void addBlits(const uint32_t& count);
+    void getSnapshot(qdutils::HwcMetrics_t& metrics) const;
+
+private:
+    static void addToHist(uint32_t *hist, const nsecs_t& time);
+
+    qdutils::HwcMetrics_t mData;
+    mutable Locker mLock;
+};
+
+}; //namespace qhwc
+
+#endif /* HWC_METRICS_H */
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2013, Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "hwc_pipe_solver.h"
+
+namespace qhwc {
+
+using namespace overlay::utils;
+
+/* The stages of a mixer bound the demands that can fit */
+enum { MAX_DEMANDS = 32 };
+
+static int countPipeTypes(const int& caps) {
+    int count = 0;
+    for(int type = 0; type < OV_MDP_PIPE_ANY; type++)
+        count += (caps >> type) & 1;
+    return count;
+}
+
+/* Depth first search over the types of the demands in order, from "next"
+ * on. The demands are few and the types three, so this is exact and
+ * cheap */
+static bool fitTypes(PipeDemand *demands, const int *order, const int& count,
+        int *avail, const int& next) {
+    static const int types[] = {OV_MDP_PIPE_DMA, OV_MDP_PIPE_RGB,
+            OV_MDP_PIPE_VG};
+    if(next == count)
+        return true;
+
+    PipeDemand& demand = demands[order[next]];
+    for(int i = 0; i < (int)(sizeof(types) / sizeof(types[0])); i++) {
+        int type = types[i];
+        if(!(demand.caps & (1 << type)) || avail[type] < demand.pipes)
+            continue;
+        avail[type] -= demand.pipes;
+        bool fits = fitTypes(demands, order, count, avail, next + 1);
+        avail[type] += demand.pipes;
+        if(fits) {
+            demand.type = type;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fitPipeTypes(PipeDemand *demands, const int& count,
+        const PipeBudget& budget, const bool& needsFB) {
+    int stages = needsFB ? 1 : 0;
+    for(int i = 0; i < count; i++)
+        stages += demands[i].stages;
+    if(stages > budget.maxStages || count > MAX_DEMANDS)
+        return false;
+    if(budget.maxLayers >= 0 && count > budget.maxLayers)
+        return false;
+
+    int avail[OV_MDP_PIPE_ANY];
+    for(int type = 0; type < OV_MDP_PIPE_ANY; type++)
+        avail[type] = budget.avail[type];
+    for(int i = 0; needsFB && i < budget.fbPipes; i++) {
+        if(avail[OV_MDP_PIPE_RGB])
+            avail[OV_MDP_PIPE_RGB]--;
+        else if(avail[OV_MDP_PIPE_VG])
+            avail[OV_MDP_PIPE_VG]--;
+        else
+            return false;
+    }
+
+    //Most constrained first, so that dead ends show up early
+    int order[MAX_DEMANDS];
+    for(int i = 0; i < count; i++) {
+        int j = i - 1;
+        for(; j >= 0 && countPipeTypes(demands[order[j]].caps) >
+                countPipeTypes(demands[i].caps); j--)
+            order[j + 1] = order[j];
+        order[j + 1] = i;
+    }
+    return fitTypes(demands, order, count, avail, 0);
+}
+
+bool fitMostPipeTypes(PipeDemand *demands, const int& count,
+        const PipeBudget& budget, int& fbStart, int& fbCount) {
+    if(count > MAX_DEMANDS)
+        return false;
+
+    PipeDemand outside[MAX_DEMANDS];
+    for(int len = 1; len <= count; len++) {
+        for(int start = 0; start + len <= count; start++) {
+            bool valid = true;
+            int n = 0;
+            for(int i = 0; valid && i < count; i++) {
+                bool inBatch = (i >= start && i < start + len);
+                if(inBatch)
+                    valid = (demands[i].place != PLACE_MDP);
+                else if(demands[i].place == PLACE_FB)
+                    valid = false;
+                else
+                    outside[n++] = demands[i];
+            }
+            if(!valid || !fitPipeTypes(outside, n, budget, true))
+                continue;
+
+            n = 0;
+            for(int i = 0; i < count; i++) {
+                if(i < start || i >= start + len)
+                    demands[i].type = outside[n++].type;
+            }
+            fbStart = start;
+            fbCount = len;
+            return true;
+        }
+    }
+    return false;
+}
+
+}; //namespace qhwc
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2013, Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HWC_PIPE_SOLVER_H
+#define HWC_PIPE_SOLVER_H
+
+#include "overlayUtils.h"
+
+namespace qhwc {
+
+/* Where a layer of a mixed mode frame may be composed */
+enum {
+    PLACE_MDP, //Updating, has to be on MDP
+    PLACE_FB,  //Has to be in the FB
+    PLACE_ANY, //Cached, either
+};
+
+/* A layer asking for pipes of a single type */
+struct PipeDemand {
+    /* Pipe types, as a bitmask of 1 << eMdpPipeType, that can fetch it */
+    int caps;
+    /* Pipes and blend stages the layer takes */
+    int pipes;
+    int stages;
+    /* PLACE_*, used by fitMostPipeTypes only */
+    int place;
+    /* Type picked, eMdpPipeType */
+    int type;
+};
+
+/* What a display has for the MDP composed part of a frame */
+struct PipeBudget {
+    /* Free pipes of each type */
+    int avail[overlay::utils::OV_MDP_PIPE_ANY];
+    /* Blend stages of a mixer, the FB takes one */
+    int maxStages;
+    /* Layers on MDP, the FB excluded, -1 for no limit */
+    int maxLayers;
+    /* Pipes the FB takes, each an RGB pipe or else a VG pipe, like
+     * getPipeForFb picks them */
+    int fbPipes;
+};
+
+/* Picks a type for each of the count demands such that all of them, and
+ * the FB if needsFB, fit the budget. Exact, the least capable types are
+ * tried first, leaving VG pipes to the layers that have to scale or are
+ * YUV. Returns false, with the types undefined, if they do not all fit */
+bool fitPipeTypes(PipeDemand *demands, const int& count,
+        const PipeBudget& budget, const bool& needsFB);
+
+/* Mixed mode. demands are the layers in z-order. Picks the FB batch, a
+ * non-empty run of adjacent layers that may be in FB and that covers all
+ * the layers that have to be, such that the layers outside it fit the
+ * budget with the FB. The shortest such batch is taken, which puts the
+ * most layers on MDP; the lowest one among equals. On success the batch
+ * is [fbStart, fbStart + fbCount) and the types of the other layers are
+ * set. Returns false if no batch fits */
+bool fitMostPipeTypes(PipeDemand *demands, const int& count,
+        const PipeBudget& budget, int& fbStart, int& fbCount);
+
+}; //namespace qhwc
+
+#endif //HWC_PIPE_SOLVER_H
@@ -30,6 +30,9 @@
 #include <hwc_qclient.h>
 #include <IQService.h>
 #include <hwc_utils.h>
+#include <prop_cache.h>
+#include <hwc_metrics.h>
+#include <hwc_frame_timeline.h>
 
 #define QCLIENT_DEBUG 0
 
@@ -98,20 +101,29 @@ static void setExtOrientation(hwc_context_t *ctx, uint32_t orientation) {
 
 static void isExternalConnected(hwc_context_t* ctx, Parcel* outParcel) {
     int connected;
-    connected = ctx->dpyAttr[HWC_DISPLAY_EXTERNAL].connected ? 1 : 0;
+    qhwc::DisplaySnapshot snapshot;
+    ctx->mSnapshot->read(snapshot);
+    connected = snapshot.dpyAttr[HWC_DISPLAY_EXTERNAL].connected ? 1 : 0;
     outParcel->writeInt32(connected);
 }
 
-static void getDisplayAttributes(hwc_context_t* ctx, const Parcel* inParcel,
-        Parcel* outParcel) {
+static status_t getDisplayAttributes(hwc_context_t* ctx,
+        const Parcel* inParcel, Parcel* outParcel) {
     int dpy = inParcel->readInt32();
-    outParcel->writeInt32(ctx->dpyAttr[dpy].vsync_period);
-    outParcel->writeInt32(ctx->dpyAttr[dpy].xres);
-    outParcel->writeInt32(ctx->dpyAttr[dpy].yres);
-    outParcel->writeFloat(ctx->dpyAttr[dpy].xdpi);
-    outParcel->writeFloat(ctx->dpyAttr[dpy].ydpi);
+    if(dpy < HWC_DISPLAY_PRIMARY || dpy > HWC_DISPLAY_VIRTUAL) {
+        ALOGE("In %s: invalid dpy index %d", __FUNCTION__, dpy);
+        return BAD_VALUE;
+    }
+    qhwc::DisplaySnapshot snapshot;
+    ctx->mSnapshot->read(snapshot);
+    outParcel->writeInt32(snapshot.dpyAttr[dpy].vsync_period);
+    outParcel->writeInt32(snapshot.dpyAttr[dpy].xres);
+    outParcel->writeInt32(snapshot.dpyAttr[dpy].yres);
+    outParcel->writeFloat(snapshot.dpyAttr[dpy].xdpi);
+    outParcel->writeFloat(snapshot.dpyAttr[dpy].ydpi);
     //XXX: Need to check what to return for HDMI
     outParcel->writeInt32(ctx->mMDP.panel);
+    return NO_ERROR;
 }
 static void setHSIC(hwc_context_t* ctx, const Parcel* inParcel) {
     int dpy = inParcel->readInt32();
@@ -132,20 +144,13 @@ static status_t getDisplayVisibleRegion(hwc_context_t* ctx, int dpy,
                                 Parcel* outParcel) {
     // Get the info only if the dpy is valid
     if(dpy >= HWC_DISPLAY_PRIMARY && dpy <= HWC_DISPLAY_VIRTUAL) {
-        Locker::Autolock _sl(ctx->mDrawLock);
-        if(dpy && (ctx->mExtOrientation || ctx->mBufferMirrorMode)) {
-            // Return the destRect on external, if external orienation
-            // is enabled
-            outParcel->writeInt32(ctx->dpyAttr[dpy].mDstRect.left);
-           outParcel->writeInt32(ctx->dpyAttr[dpy].mDstRect.top);
-            outParcel->writeInt32(ctx->dpyAttr[dpy].mDstRect.right);
-            outParcel->writeInt32(ctx->dpyAttr[dpy].mDstRect.bottom);
-        } else {
-            outParcel->writeInt32(ctx->mViewFrame[dpy].left);
-            outParcel->writeInt32(ctx->mViewFrame[dpy].top);
-            outParcel->writeInt32(ctx->mViewFrame[dpy].right);
-            outParcel->writeInt32(ctx->mViewFrame[dpy].bottom);
-        }
+        qhwc::DisplaySnapshot snapshot;
+        ctx->mSnapshot->read(snapshot);
+        hwc_rect_t rect = snapshot.getVisibleRegion(dpy);
+        outParcel->writeInt32(rect.left);
+        outParcel->writeInt32(rect.top);
+        outParcel->writeInt32(rect.right);
+        outParcel->writeInt32(rect.bottom);
         return NO_ERROR;
     } else {
         ALOGE("In %s: invalid dpy index %d", __FUNCTION__, dpy);
@@ -163,6 +168,7 @@ static status_t setViewFrame(hwc_context_t* ctx, const Parcel* inParcel) {
         ctx->mViewFrame[dpy].top    = inParcel->readInt32();
         ctx->mViewFrame[dpy].right  = inParcel->readInt32();
         ctx->mViewFrame[dpy].bottom = inParcel->readInt32();
+        ctx->mSnapshot->publish(ctx);
         ALOGD_IF(QCLIENT_DEBUG, "%s: mViewFrame[%d] = [%d %d %d %d]",
             __FUNCTION__, dpy,
             ctx->mViewFrame[dpy].left, ctx->mViewFrame[dpy].top,
@@ -174,6 +180,13 @@ static status_t setViewFrame(hwc_context_t* ctx, const Parcel* inParcel) {
     }
 }
 
+static void getHwcMetrics(hwc_context_t* ctx, Parcel* outParcel) {
+    qdutils::HwcMetrics_t metrics;
+    ctx->mMetrics->getSnapshot(metrics);
+    outParcel->writeInt32(sizeof(metrics));
+    outParcel->write(&metrics, sizeof(metrics));
+}
+
 status_t QClient::notifyCallback(uint32_t command, const Parcel* inParcel,
         Parcel* outParcel) {
     status_t ret = NO_ERROR;
@@ -202,7 +215,7 @@ status_t QClient::notifyCallback(uint32_t command, const Parcel* inParcel,
             isExternalConnected(mHwcContext, outParcel);
             break;
         case IQService::GET_DISPLAY_ATTRIBUTES:
-            getDisplayAttributes(mHwcContext, inParcel, outParcel);
+            ret = getDisplayAttributes(mHwcContext, inParcel, outParcel);
             break;
         case IQService::SET_HSIC_DATA:
             setHSIC(mHwcContext, inParcel);
@@ -210,6 +223,20 @@ status_t QClient::notifyCallback(uint32_t command, const Parcel* inParcel,
         case IQService::SET_VIEW_FRAME:
             setViewFrame(mHwcContext, inParcel);
             break;
+        case IQService::REFRESH_PROPERTIES:
+            //Read at the next prepare
+            qdutils::PropCache::getInstance().invalidate();
+            break;
+        case IQService::GET_HWC_METRICS:
+            getHwcMetrics(mHwcContext, outParcel);
+            break;
+        case IQService::SET_FRAME_TIMELINE:
+            outParcel->writeInt32(
+                    mHwcContext->mFrameTimeline->arm(inParcel->readInt32()));
+            break;
+        case IQService::GET_FRAME_TIMELINE:
+            mHwcContext->mFrameTimeline->write(outParcel);
+            break;
         default:
             ret = NO_ERROR;
     }
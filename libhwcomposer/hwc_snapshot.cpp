@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2013, Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cutils/atomic.h>
+#include <sched.h>
+#include <string.h>
+#include "hwc_utils.h"
+
+namespace qhwc {
+
+DisplaySnapshotLock::DisplaySnapshotLock() : mSeq(0) {
+    memset(&mSnapshot, 0, sizeof(mSnapshot));
+}
+
+void DisplaySnapshotLock::publish(hwc_context_t *ctx) {
+    int32_t seq = mSeq;
+    //Odd before any of the copy is visible
+    android_atomic_acquire_cas(seq, seq + 1, &mSeq);
+    mSnapshot.version++;
+    memcpy(mSnapshot.dpyAttr, ctx->dpyAttr, sizeof(mSnapshot.dpyAttr));
+    memcpy(mSnapshot.viewFrame, ctx->mViewFrame,
+            sizeof(mSnapshot.viewFrame));
+    mSnapshot.deviceOrientation = ctx->deviceOrientation;
+    mSnapshot.extOrientation = ctx->mExtOrientation;
+    mSnapshot.bufferMirrorMode = ctx->mBufferMirrorMode;
+    //Even after all of it is
+    android_atomic_release_store(seq + 2, &mSeq);
+}
+
+void DisplaySnapshotLock::read(DisplaySnapshot& snapshot) const {
+    for(int spins = 0; ; spins++) {
+        int32_t seq = android_atomic_acquire_load(&mSeq);
+        if(!(seq & 1)) {
+            memcpy(&snapshot, &mSnapshot, sizeof(snapshot));
+            //The barrier of the or keeps the copy before the re-read
+            if(android_atomic_or(0, &mSeq) == seq)
+                return;
+        }
+        if(spins >= MAX_SPINS)
+            sched_yield();
+    }
+}
+
+hwc_rect_t DisplaySnapshot::getVisibleRegion(const int& dpy) const {
+    // The destRect on external, if external orienation is enabled
+    if(dpy && (extOrientation || bufferMirrorMode))
+        return dpyAttr[dpy].mDstRect;
+    return viewFrame[dpy];
+}
+
+};//namespace qhwc
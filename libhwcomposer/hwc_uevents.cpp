@@ -21,10 +21,11 @@
 #define UEVENT_DEBUG 0
 #include <hardware_legacy/uevent.h>
 #include <utils/Log.h>
-#include <sys/resource.h>
-#include <sys/prctl.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include "hwc_utils.h"
 #include "hwc_fbupdate.h"
 #include "hwc_mdpcomp.h"
@@ -33,10 +34,11 @@
 #include "external.h"
 #include "virtual.h"
 #include "mdp_version.h"
+#include "event_loop.h"
+#include "prop_cache.h"
 using namespace overlay;
 namespace qhwc {
 #define HWC_UEVENT_SWITCH_STR  "change@/devices/virtual/switch/"
-#define HWC_UEVENT_THREAD_NAME "hwcUeventThread"
 
 /* External Display states */
 enum {
@@ -46,37 +48,53 @@ enum {
     EXTERNAL_RESUME
 };
 
-static void setup(hwc_context_t* ctx, int dpy)
+/* Builds the composition objects of a configured display, they are
+ * attached by the next prepare */
+static void setup(hwc_context_t* ctx, int dpy, HotplugState& st)
 {
-    ctx->mFBUpdate[dpy] =
-        IFBUpdate::getObject(ctx, ctx->dpyAttr[dpy].xres, dpy);
-    ctx->mMDPComp[dpy] =
-        MDPComp::getObject(ctx->dpyAttr[dpy].xres, dpy);
+    st.fbUpdate = IFBUpdate::getObject(ctx, ctx->dpyAttr[dpy].xres, dpy);
+    st.mdpComp = MDPComp::getObject(ctx->dpyAttr[dpy].xres, dpy);
     int compositionType =
                 qdutils::QCCompositionType::getInstance().getCompositionType();
     if (compositionType & (qdutils::COMPOSITION_TYPE_DYN |
                            qdutils::COMPOSITION_TYPE_MDP |
                            qdutils::COMPOSITION_TYPE_C2D)) {
-        ctx->mCopyBit[dpy] = new CopyBit(ctx, dpy);
+        st.copyBit = new CopyBit(ctx, dpy);
     }
 }
 
-static void clear(hwc_context_t* ctx, int dpy)
+/* Deletes the composition objects a detached display left behind */
+static void clear(HotplugState& st)
 {
-    if(ctx->mFBUpdate[dpy]) {
-        delete ctx->mFBUpdate[dpy];
-        ctx->mFBUpdate[dpy] = NULL;
+    if(st.fbUpdate) {
+        delete st.fbUpdate;
+        st.fbUpdate = NULL;
     }
-    if(ctx->mCopyBit[dpy]){
-        delete ctx->mCopyBit[dpy];
-        ctx->mCopyBit[dpy] = NULL;
+    if(st.copyBit){
+        delete st.copyBit;
+        st.copyBit = NULL;
     }
-    if(ctx->mMDPComp[dpy]) {
-        delete ctx->mMDPComp[dpy];
-        ctx->mMDPComp[dpy] = NULL;
+    if(st.mdpComp) {
+        delete st.mdpComp;
+        st.mdpComp = NULL;
     }
 }
 
+/* Attaches the objects of the transition and detaches the display's own,
+ * a pointer swap done by prepare */
+static void swapObjects(hwc_context_t* ctx, int dpy, HotplugState& st)
+{
+    IFBUpdate *fbUpdate = ctx->mFBUpdate[dpy];
+    MDPComp *mdpComp = ctx->mMDPComp[dpy];
+    CopyBit *copyBit = ctx->mCopyBit[dpy];
+    ctx->mFBUpdate[dpy] = st.fbUpdate;
+    ctx->mMDPComp[dpy] = st.mdpComp;
+    ctx->mCopyBit[dpy] = st.copyBit;
+    st.fbUpdate = fbUpdate;
+    st.mdpComp = mdpComp;
+    st.copyBit = copyBit;
+}
+
 /* Parse uevent data for devices which we are interested */
 static int getConnectedDisplay(const char* strUdata)
 {
@@ -119,262 +137,479 @@ static int getConnectedState(const char* strUdata, int len)
     return -1;
 }
 
-static void handle_uevent(hwc_context_t* ctx, const char* udata, int len)
-{
-    bool bpanelReset = getPanelResetStatus(ctx, udata, len);
-    if (bpanelReset) {
-        ctx->proc->invalidate(ctx->proc);
-        return;
-    }
+/*
+ * Hotplug state machine
+ *
+ * A uevent only stages the transition of its display and invalidates.
+ * hotplug_prepare() flips the attach and detach flags of the display at
+ * the start of a prepare, under mDrawLock, and hotplug_set() hands the
+ * transition back to the event loop once that cycle is set. The slow
+ * work, display commits, fb open and close, mode setting and building
+ * the composition objects, is done by the loop without mDrawLock, while
+ * composition carries on with the display detached.
+ *
+ * RELEASING: prepare releases what the display conflicts with.
+ *   REMOVE: detaches the display, so the cycle unsets its pipes.
+ *   ADD:    marks it configuring, so the cycle gives up pipes and closes
+ *           fbs it would conflict with.
+ *   PAUSE:  pauses it, so the cycle unsets its pipes.
+ *   RESUME: marks it configuring, so the other displays give up pipes.
+ * RELEASED: the loop does the work once that cycle is set.
+ *   REMOVE: notifies SF, commits to unstage the pipes and tears down.
+ *   ADD:    configures the display and builds its objects.
+ *   PAUSE:  commits to unstage the pipes.
+ * REMOVE and PAUSE are done there. ADD and RESUME are CONFIGURED, and
+ * the next prepare attaches or resumes the display. The loop notifies SF
+ * once that cycle is set.
+ *
+ * A switch state received during a transition is staged after it.
+ * mHotplugLock protects the states, it is never held across callbacks or
+ * the slow work. The loop only works on a display in RELEASED, which
+ * prepare leaves alone.
+ */
 
-    int dpy = getConnectedDisplay(udata);
-    if(dpy < 0) {
-        ALOGD_IF(UEVENT_DEBUG, "%s: Not disp Event ", __FUNCTION__);
-        return;
+static const char *getActionName(int action)
+{
+    switch(action) {
+    case HOTPLUG_ADD: return "add";
+    case HOTPLUG_REMOVE: return "remove";
+    case HOTPLUG_PAUSE: return "pause";
+    case HOTPLUG_RESUME: return "resume";
+    default: return "none";
     }
+}
 
-    int switch_state = getConnectedState(udata, len);
-
-    ALOGE_IF(UEVENT_DEBUG,"%s: uevent recieved: %s switch state: %d",
-             __FUNCTION__,udata, switch_state);
+static void setPhase(HotplugState& st, int phase)
+{
+    st.phase = phase;
+    st.phaseTime[phase] = systemTime(SYSTEM_TIME_MONOTONIC);
+}
 
-    switch(switch_state) {
-    case EXTERNAL_OFFLINE:
-        {
-            /* Display not connected */
-            if(!ctx->dpyAttr[dpy].connected){
-                ALOGE_IF(UEVENT_DEBUG,"%s: Ignoring EXTERNAL_OFFLINE event"
-                         "for display: %d", __FUNCTION__, dpy);
+/* Logs the time spent in each phase of a finished transition */
+static void logTransition(int dpy, const HotplugState& st)
+{
+    static const char *phaseNames[HOTPLUG_PHASE_MAX] = {
+        "staged", "releasing", "released", "configured", "applying",
+        "applied"
+    };
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    char buf[256];
+    size_t len = snprintf(buf, sizeof(buf), "dpy %d %s took %.2fms:", dpy,
+            getActionName(st.action),
+            (now - st.phaseTime[HOTPLUG_STAGED]) / 1000000.0);
+    for(int i = 0; i < HOTPLUG_PHASE_MAX && len < sizeof(buf); i++) {
+        if(!st.phaseTime[i])
+            continue;
+        nsecs_t end = now;
+        for(int j = i + 1; j < HOTPLUG_PHASE_MAX; j++) {
+            if(st.phaseTime[j]) {
+                end = st.phaseTime[j];
                 break;
             }
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, " %s %.2fms",
+                phaseNames[i], (end - st.phaseTime[i]) / 1000000.0);
+    }
+    ALOGI("%s: %s", __FUNCTION__, buf);
+}
 
-            ctx->mDrawLock.lock();
-            clear(ctx, dpy);
-            ctx->dpyAttr[dpy].connected = false;
-            ctx->dpyAttr[dpy].isActive = false;
-
-            /* We need to send hotplug to SF only when we are disconnecting
-             * (1) HDMI OR (2) proprietary WFD session */
-            if(dpy == HWC_DISPLAY_EXTERNAL ||
-                    ctx->mVirtualonExtActive) {
-                ALOGE_IF(UEVENT_DEBUG,"%s:Sending EXTERNAL OFFLINE hotplug"
-                        "event", __FUNCTION__);
-                ctx->proc->hotplug(ctx->proc, HWC_DISPLAY_EXTERNAL,
-                        EXTERNAL_OFFLINE);
-                ctx->mVirtualonExtActive = false;
-            }
-            ctx->proc->invalidate(ctx->proc);
-            ctx->mDrawLock.wait();
-            // At this point all the pipes used by External have been
-            // marked as UNSET.
-
-            // Perform commit to unstage the pipes.
-            if (!Overlay::displayCommit(ctx->dpyAttr[dpy].fd)) {
-                ALOGE("%s: display commit fail! for %d dpy",
-                        __FUNCTION__, dpy);
-            }
-
-            if(dpy == HWC_DISPLAY_EXTERNAL) {
-                ctx->mExtDisplay->teardown();
-            } else {
-                ctx->mVirtualDisplay->teardown();
-            }
-            ctx->mDrawLock.unlock();
+/* Stages the transition for a switch state, on the event loop. Returns
+ * true if composition has to run for it */
+static bool stage(hwc_context_t* ctx, int dpy, int switch_state)
+{
+    Locker::Autolock _l(ctx->mHotplugLock);
+    HotplugState& st = ctx->mHotplug[dpy];
+    if(st.action != HOTPLUG_NONE) {
+        ALOGD_IF(UEVENT_DEBUG, "%s: dpy %d busy with %s, state %d deferred",
+                __FUNCTION__, dpy, getActionName(st.action), switch_state);
+        st.hasNext = true;
+        st.next = switch_state;
+        return false;
+    }
 
+    int action = HOTPLUG_NONE;
+    switch(switch_state) {
+    case EXTERNAL_OFFLINE:
+        /* Display not connected */
+        if(!ctx->dpyAttr[dpy].connected){
+            ALOGE_IF(UEVENT_DEBUG,"%s: Ignoring EXTERNAL_OFFLINE event"
+                     "for display: %d", __FUNCTION__, dpy);
             break;
         }
+        action = HOTPLUG_REMOVE;
+        break;
     case EXTERNAL_ONLINE:
-        {
-            /* Display already connected */
-            if(ctx->dpyAttr[dpy].connected) {
-                ALOGE_IF(UEVENT_DEBUG,"%s: Ignoring EXTERNAL_ONLINE event"
-                         "for display: %d", __FUNCTION__, dpy);
-                break;
-            }
-
-            //Force composition to give up resources like pipes and
-            //close fb. For example if assertive display is going on,
-            //fb2 could be open, thus connecting Layer Mixer#0 to
-            //WriteBack module. If HDMI attempts to open fb1, the driver
-            //will try to attach Layer Mixer#0 to HDMI INT, which will
-            //fail, since Layer Mixer#0 is still connected to WriteBack.
-            //This block will force composition to close fb2 in above
-            //example.
-            ctx->mDrawLock.lock();
-            ctx->dpyAttr[dpy].isConfiguring = true;
-            ctx->proc->invalidate(ctx->proc);
-
-            ctx->mDrawLock.wait();
-            ctx->mDrawLock.unlock();
-            if(dpy == HWC_DISPLAY_EXTERNAL) {
-                if(ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].connected) {
-                    ALOGD_IF(UEVENT_DEBUG,"Received HDMI connection request"
-                             "when WFD is active");
-
-                    ctx->mDrawLock.lock();
-                    clear(ctx, HWC_DISPLAY_VIRTUAL);
-                    ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].connected = false;
-                    ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].isActive = false;
-
-                    /* Need to send hotplug only when connected WFD in
-                     * proprietary path */
-                    if(ctx->mVirtualonExtActive) {
-                        ALOGE_IF(UEVENT_DEBUG,"%s: Sending EXTERNAL OFFLINE"
-                                "hotplug event", __FUNCTION__);
-                        ctx->proc->hotplug(ctx->proc, HWC_DISPLAY_EXTERNAL,
-                                EXTERNAL_OFFLINE);
-                        ctx->mVirtualonExtActive = false;
-                    }
-                    ctx->proc->invalidate(ctx->proc);
-
-                    ctx->mDrawLock.wait();
-                    // At this point all the pipes used by WFD(Virtual) have been
-                    // marked as UNSET.
-                    // Perform commit to unstage the pipes.
-                    if (!Overlay::displayCommit(ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].fd)) {
-                        ALOGE("%s: display commit fail! for %d dpy",
-                                __FUNCTION__, HWC_DISPLAY_VIRTUAL);
-                    }
-                    ctx->mDrawLock.unlock();
-
-                    ctx->mVirtualDisplay->teardown();
-                }
-                ctx->mExtDisplay->configure();
-            } else {
-                {
-                    Locker::Autolock _l(ctx->mDrawLock);
-                    /* TRUE only when we are on proprietary WFD session */
-                    ctx->mVirtualonExtActive = true;
-                    char property[PROPERTY_VALUE_MAX];
-                    if((property_get("persist.sys.wfd.virtual",
-                                                  property, NULL) > 0) &&
-                       (!strncmp(property, "1", PROPERTY_VALUE_MAX ) ||
-                       (!strncasecmp(property,"true", PROPERTY_VALUE_MAX )))) {
-                        // This means we are on Google's WFD session
-                        ctx->mVirtualonExtActive = false;
-                    }
-                }
-                ctx->mVirtualDisplay->configure();
-            }
-
-            Locker::Autolock _l(ctx->mDrawLock);
-            setup(ctx, dpy);
-            ctx->dpyAttr[dpy].isPause = false;
-            ctx->dpyAttr[dpy].connected = true;
-            ctx->dpyAttr[dpy].isConfiguring = true;
-
-            if(dpy == HWC_DISPLAY_EXTERNAL ||
-               ctx->mVirtualonExtActive) {
-                /* External display is HDMI or non-hybrid WFD solution */
-                ALOGE_IF(UEVENT_DEBUG, "%s: Sending EXTERNAL_OFFLINE ONLINE"
-                         "hotplug event", __FUNCTION__);
-                ctx->proc->hotplug(ctx->proc,HWC_DISPLAY_EXTERNAL,
-                                   EXTERNAL_ONLINE);
+        /* Display already connected */
+        if(ctx->dpyAttr[dpy].connected) {
+            ALOGE_IF(UEVENT_DEBUG,"%s: Ignoring EXTERNAL_ONLINE event"
+                     "for display: %d", __FUNCTION__, dpy);
+            break;
+        }
+        if(dpy == HWC_DISPLAY_EXTERNAL &&
+                ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].connected) {
+            ALOGD_IF(UEVENT_DEBUG,"Received HDMI connection request"
+                     "when WFD is active");
+            //WFD is removed in the same cycle, the loop configures HDMI
+            //only after WFD is torn down
+            HotplugState& vst = ctx->mHotplug[HWC_DISPLAY_VIRTUAL];
+            if(vst.action == HOTPLUG_NONE) {
+                memset(&vst, 0, sizeof(vst));
+                vst.action = HOTPLUG_REMOVE;
+                setPhase(vst, HOTPLUG_STAGED);
             } else {
-                /* We wont be getting unblank for VIRTUAL DISPLAY and its
-                 * always guaranteed from WFD stack that CONNECT uevent for
-                 * VIRTUAL DISPLAY will be triggered before creating
-                 * surface for the same. */
-                ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].isActive = true;
+                vst.hasNext = true;
+                vst.next = EXTERNAL_OFFLINE;
             }
+        }
+        action = HOTPLUG_ADD;
+        break;
+    case EXTERNAL_PAUSE:
+        ALOGD("%s Received Pause event",__FUNCTION__);
+        /* Display already in pause */
+        if(ctx->dpyAttr[dpy].isPause) {
+            ALOGE_IF(UEVENT_DEBUG,"%s: Ignoring EXTERNAL_PAUSE event"
+                     "for display: %d", __FUNCTION__, dpy);
             break;
         }
-        case EXTERNAL_PAUSE:
-            {   // pause case
-
-                 ALOGD("%s Received Pause event",__FUNCTION__);
-                 /* Display already in pause */
-                 if(ctx->dpyAttr[dpy].isPause) {
-                    ALOGE_IF(UEVENT_DEBUG,"%s: Ignoring EXTERNAL_PAUSE event"
-                             "for display: %d", __FUNCTION__, dpy);
-                    break;
-                 }
-
-                 ctx->mDrawLock.lock();
-                 ctx->dpyAttr[dpy].isActive = true;
-                 ctx->dpyAttr[dpy].isPause = true;
-                 ctx->proc->invalidate(ctx->proc);
-
-                 ctx->mDrawLock.wait();
-                 // At this point all the pipes used by External have been
-                 // marked as UNSET.
-                 // Perform commit to unstage the pipes.
-                 if (!Overlay::displayCommit(ctx->dpyAttr[dpy].fd)) {
-                     ALOGE("%s: display commit fail! for %d dpy",
-                             __FUNCTION__, dpy);
-                 }
-                 ctx->mDrawLock.unlock();
-
-                 break;
-            }
-        case EXTERNAL_RESUME:
-            {  // resume case
+        action = HOTPLUG_PAUSE;
+        break;
+    case EXTERNAL_RESUME:
+        ALOGD("%s Received resume event",__FUNCTION__);
+        /* Display already is resumed */
+        if(not ctx->dpyAttr[dpy].isPause) {
+            ALOGE_IF(UEVENT_DEBUG,"%s: Ignoring EXTERNAL_RESUME event"
+                     "for display: %d", __FUNCTION__, dpy);
+            break;
+        }
+        action = HOTPLUG_RESUME;
+        break;
+    default:
+        ALOGE("%s: Invalid state to swtich:%d", __FUNCTION__, switch_state);
+        break;
+    }
 
-                ALOGD("%s Received resume event",__FUNCTION__);
+    if(action == HOTPLUG_NONE)
+        return false;
+    memset(&st, 0, sizeof(st));
+    st.action = action;
+    setPhase(st, HOTPLUG_STAGED);
+    return true;
+}
 
-                /* Display already is resumed */
-                if(not ctx->dpyAttr[dpy].isPause) {
-                    ALOGE_IF(UEVENT_DEBUG,"%s: Ignoring EXTERNAL_RESUME event"
-                             "for display: %d", __FUNCTION__, dpy);
-                    break;
-                }
+/* Releases what the display conflicts with, first cycle of a transition */
+static void release(hwc_context_t* ctx, int dpy, HotplugState& st)
+{
+    switch(st.action) {
+    case HOTPLUG_REMOVE:
+        swapObjects(ctx, dpy, st);
+        ctx->dpyAttr[dpy].connected = false;
+        ctx->dpyAttr[dpy].isActive = false;
+        /* We need to send hotplug to SF only when we are
+         * disconnecting (1) HDMI OR (2) proprietary WFD session */
+        st.notify = (dpy == HWC_DISPLAY_EXTERNAL || ctx->mVirtualonExtActive);
+        if(st.notify)
+            ctx->mVirtualonExtActive = false;
+        break;
+    case HOTPLUG_ADD:
+        //Force composition to give up resources like pipes and
+        //close fb. For example if assertive display is going on,
+        //fb2 could be open, thus connecting Layer Mixer#0 to
+        //WriteBack module. If HDMI attempts to open fb1, the
+        //driver will try to attach Layer Mixer#0 to HDMI INT,
+        //which will fail, since Layer Mixer#0 is still connected
+        //to WriteBack.
+        ctx->dpyAttr[dpy].isConfiguring = true;
+        break;
+    case HOTPLUG_PAUSE:
+        ctx->dpyAttr[dpy].isActive = true;
+        ctx->dpyAttr[dpy].isPause = true;
+        break;
+    case HOTPLUG_RESUME:
+        //Since external didnt have any pipes, force primary to
+        //give up its pipes; we don't allow inter-mixer pipe
+        //transfers.
+        ctx->dpyAttr[dpy].isConfiguring = true;
+        ctx->dpyAttr[dpy].isActive = true;
+        break;
+    }
+}
 
-                //Treat Resume as Online event
-                //Since external didnt have any pipes, force primary to give up
-                //its pipes; we don't allow inter-mixer pipe transfers.
+/* Notifies SF of the external slot, on the event loop */
+static void notify(hwc_context_t* ctx, int action)
+{
+    if(action == HOTPLUG_REMOVE) {
+        ALOGE_IF(UEVENT_DEBUG,"%s:Sending EXTERNAL OFFLINE hotplug"
+                "event", __FUNCTION__);
+        ctx->proc->hotplug(ctx->proc, HWC_DISPLAY_EXTERNAL,
+                EXTERNAL_OFFLINE);
+    } else if(action == HOTPLUG_ADD) {
+        /* External display is HDMI or non-hybrid WFD solution */
+        ALOGE_IF(UEVENT_DEBUG, "%s: Sending EXTERNAL_OFFLINE ONLINE"
+                 "hotplug event", __FUNCTION__);
+        ctx->proc->hotplug(ctx->proc,HWC_DISPLAY_EXTERNAL,
+                           EXTERNAL_ONLINE);
+    }
+}
 
-                ctx->mDrawLock.lock();
-                ctx->dpyAttr[dpy].isConfiguring = true;
+/* Does the slow work of the transition once the cycle that released is
+ * set, on the event loop and without mDrawLock. Composition does not use
+ * the display meanwhile. Returns true if a prepare still has to attach
+ * the display */
+static bool reconfigure(hwc_context_t* ctx, int dpy, HotplugState& st)
+{
+    switch(st.action) {
+    case HOTPLUG_REMOVE:
+        //SF stops using the display before it is torn down
+        if(st.notify)
+            notify(ctx, HOTPLUG_REMOVE);
+        //Fall through
+    case HOTPLUG_PAUSE:
+        // At this point all the pipes used by the display have been
+        // marked as UNSET.
+        // Perform commit to unstage the pipes.
+        if (!Overlay::displayCommit(ctx->dpyAttr[dpy].fd)) {
+            ALOGE("%s: display commit fail! for %d dpy",
+                    __FUNCTION__, dpy);
+        }
+        if(st.action == HOTPLUG_PAUSE)
+            return false;
+        if(dpy == HWC_DISPLAY_EXTERNAL) {
+            ctx->mExtDisplay->teardown();
+        } else {
+            ctx->mVirtualDisplay->teardown();
+        }
+        clear(st);
+        return false;
+    case HOTPLUG_ADD:
+        if(dpy == HWC_DISPLAY_EXTERNAL) {
+            ctx->mExtDisplay->configure();
+            st.notify = true;
+        } else {
+            /* TRUE only when we are on proprietary WFD session,
+             * persist.sys.wfd.virtual means Google's WFD session */
+            st.notify = !qdutils::PropCache::getInstance().getBool(
+                    qdutils::PROP_WFD_VIRTUAL, false);
+            ctx->mVirtualDisplay->configure();
+        }
+        setup(ctx, dpy, st);
+        return true;
+    case HOTPLUG_RESUME:
+        return true;
+    }
+    return false;
+}
+
+/* Attaches or resumes a configured display, in the prepare after the
+ * loop is done with it */
+static void attach(hwc_context_t* ctx, int dpy, HotplugState& st)
+{
+    switch(st.action) {
+    case HOTPLUG_ADD:
+        swapObjects(ctx, dpy, st);
+        ctx->dpyAttr[dpy].isPause = false;
+        ctx->dpyAttr[dpy].connected = true;
+        ctx->dpyAttr[dpy].isConfiguring = true;
+        if(dpy == HWC_DISPLAY_VIRTUAL) {
+            ctx->mVirtualonExtActive = st.notify;
+            /* We wont be getting unblank for VIRTUAL DISPLAY and
+             * its always guaranteed from WFD stack that CONNECT
+             * uevent for VIRTUAL DISPLAY will be triggered before
+             * creating surface for the same. */
+            if(!st.notify)
                 ctx->dpyAttr[dpy].isActive = true;
-                ctx->proc->invalidate(ctx->proc);
+        }
+        break;
+    case HOTPLUG_RESUME:
+        //At this point external has all the pipes it would need.
+        ctx->dpyAttr[dpy].isPause = false;
+        break;
+    }
+}
 
-                ctx->mDrawLock.wait();
-                //At this point external has all the pipes it would need.
-                ctx->dpyAttr[dpy].isPause = false;
-                ctx->proc->invalidate(ctx->proc);
-                ctx->mDrawLock.unlock();
+void hotplug_prepare(hwc_context_t* ctx)
+{
+    Locker::Autolock _l(ctx->mHotplugLock);
+    //Removals first, they free what the additions take
+    for(int pass = 0; pass < 2; pass++) {
+        for(int dpy = HWC_DISPLAY_EXTERNAL; dpy < HWC_NUM_DISPLAY_TYPES;
+                dpy++) {
+            HotplugState& st = ctx->mHotplug[dpy];
+            if(st.action == HOTPLUG_NONE ||
+                    (st.action == HOTPLUG_REMOVE) != (pass == 0))
+                continue;
+
+            if(st.phase == HOTPLUG_STAGED) {
+                release(ctx, dpy, st);
+                setPhase(st, HOTPLUG_RELEASING);
+            } else if(st.phase == HOTPLUG_CONFIGURED) {
+                attach(ctx, dpy, st);
+                setPhase(st, HOTPLUG_APPLYING);
+            }
+        }
+    }
+}
 
-                break;
+void hotplug_set(hwc_context_t* ctx)
+{
+    bool wake = false;
+    {
+        Locker::Autolock _l(ctx->mHotplugLock);
+        for(int dpy = HWC_DISPLAY_EXTERNAL; dpy < HWC_NUM_DISPLAY_TYPES;
+                dpy++) {
+            HotplugState& st = ctx->mHotplug[dpy];
+            if(st.action == HOTPLUG_NONE)
+                continue;
+            if(st.phase == HOTPLUG_RELEASING) {
+                setPhase(st, HOTPLUG_RELEASED);
+                wake = true;
+            } else if(st.phase == HOTPLUG_APPLYING) {
+                setPhase(st, HOTPLUG_APPLIED);
+                wake = true;
             }
-    default:
-        {
-            ALOGE("%s: Invalid state to swtich:%d", __FUNCTION__, switch_state);
-            break;
         }
     }
+    if(wake && ctx->mHotplugFd >= 0) {
+        uint64_t one = 1;
+        if(write(ctx->mHotplugFd, &one, sizeof(one)) < 0)
+            ALOGE("%s: wake failed: %s", __FUNCTION__, strerror(errno));
+    }
 }
 
-static void *uevent_loop(void *param)
+/* Notifies SF of an applied transition and stages the switch state
+ * received during it, on the event loop. Returns true if composition has
+ * to run for the next one */
+static bool finish(hwc_context_t* ctx, int dpy)
+{
+    int action;
+    bool notifySF;
+    bool hasNext = false;
+    int next = 0;
+    {
+        Locker::Autolock _l(ctx->mHotplugLock);
+        HotplugState& st = ctx->mHotplug[dpy];
+        action = st.action;
+        //A removal notified SF before the teardown
+        notifySF = st.notify && action == HOTPLUG_ADD;
+        logTransition(dpy, st);
+        hasNext = st.hasNext;
+        next = st.next;
+        st.action = HOTPLUG_NONE;
+    }
+
+    if(notifySF)
+        notify(ctx, action);
+    return hasNext && stage(ctx, dpy, next);
+}
+
+static void handle_hotplug_event(void *param, int fd, uint32_t events)
 {
-    int len = 0;
-    static char udata[PAGE_SIZE];
     hwc_context_t * ctx = reinterpret_cast<hwc_context_t *>(param);
-    char thread_name[64] = HWC_UEVENT_THREAD_NAME;
-    prctl(PR_SET_NAME, (unsigned long) &thread_name, 0, 0, 0);
-    setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY);
-    if(!uevent_init()) {
-        ALOGE("%s: failed to init uevent ",__FUNCTION__);
-        return NULL;
+    uint64_t count;
+    if(read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        ALOGE("%s: read failed: %s", __FUNCTION__, strerror(errno));
+        return;
     }
 
-    while(1) {
-        len = uevent_next_event(udata, sizeof(udata) - 2);
-        handle_uevent(ctx, udata, len);
+    bool invalidate = false;
+    //Removals first, SF sees the display go before another one comes
+    for(int pass = 0; pass < 2; pass++) {
+        for(int dpy = HWC_DISPLAY_EXTERNAL; dpy < HWC_NUM_DISPLAY_TYPES;
+                dpy++) {
+            HotplugState& st = ctx->mHotplug[dpy];
+            int phase;
+            {
+                Locker::Autolock _l(ctx->mHotplugLock);
+                if(st.action == HOTPLUG_NONE ||
+                        (st.action == HOTPLUG_REMOVE) != (pass == 0))
+                    continue;
+                //HDMI waits for WFD to be torn down before taking the mixer
+                const HotplugState& vst = ctx->mHotplug[HWC_DISPLAY_VIRTUAL];
+                if(st.phase == HOTPLUG_RELEASED &&
+                        st.action == HOTPLUG_ADD &&
+                        dpy == HWC_DISPLAY_EXTERNAL &&
+                        vst.action == HOTPLUG_REMOVE &&
+                        vst.phase <= HOTPLUG_RELEASED)
+                    continue;
+                phase = st.phase;
+            }
+            if(phase == HOTPLUG_RELEASED) {
+                //Prepare leaves the display alone in this phase
+                bool needsAttach = reconfigure(ctx, dpy, st);
+                Locker::Autolock _l(ctx->mHotplugLock);
+                phase = needsAttach ? HOTPLUG_CONFIGURED : HOTPLUG_APPLIED;
+                setPhase(st, phase);
+                //The next prepare attaches it
+                if(needsAttach)
+                    invalidate = true;
+            }
+            if(phase == HOTPLUG_APPLIED && finish(ctx, dpy))
+                invalidate = true;
+        }
     }
+    if(invalidate)
+        ctx->proc->invalidate(ctx->proc);
+}
 
-    return NULL;
+static void handle_uevent(hwc_context_t* ctx, const char* udata, int len)
+{
+    bool bpanelReset = getPanelResetStatus(ctx, udata, len);
+    if (bpanelReset) {
+        ctx->proc->invalidate(ctx->proc);
+        return;
+    }
+
+    int dpy = getConnectedDisplay(udata);
+    if(dpy < 0) {
+        ALOGD_IF(UEVENT_DEBUG, "%s: Not disp Event ", __FUNCTION__);
+        return;
+    }
+
+    int switch_state = getConnectedState(udata, len);
+
+    ALOGE_IF(UEVENT_DEBUG,"%s: uevent recieved: %s switch state: %d",
+             __FUNCTION__,udata, switch_state);
+
+    if(stage(ctx, dpy, switch_state))
+        ctx->proc->invalidate(ctx->proc);
+}
+
+static void handle_uevent_event(void *param, int fd, uint32_t events)
+{
+    static char udata[PAGE_SIZE];
+    hwc_context_t * ctx = reinterpret_cast<hwc_context_t *>(param);
+    int len = uevent_next_event(udata, sizeof(udata) - 2);
+    if(len > 0)
+        handle_uevent(ctx, udata, len);
 }
 
-void init_uevent_thread(hwc_context_t* ctx)
+void init_uevent(hwc_context_t* ctx)
 {
-    pthread_t uevent_thread;
-    int ret;
-
-    ALOGI("Initializing UEVENT Thread");
-    ret = pthread_create(&uevent_thread, NULL, uevent_loop, (void*) ctx);
-    if (ret) {
-        ALOGE("%s: failed to create %s: %s", __FUNCTION__,
-            HWC_UEVENT_THREAD_NAME, strerror(ret));
+    ALOGI("Initializing UEVENT source");
+    if(!uevent_init()) {
+        ALOGE("%s: failed to init uevent ",__FUNCTION__);
+        return;
+    }
+    int ret = ctx->mEventLoop->addSource("uevent", uevent_get_fd(), EPOLLIN,
+            handle_uevent_event, ctx);
+    if (ret < 0) {
+        ALOGE("%s: failed to add uevent source: %s", __FUNCTION__,
+            strerror(-ret));
+        return;
+    }
+
+    ctx->mHotplugFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ctx->mHotplugFd < 0) {
+        ALOGE("%s: hotplug eventfd failed: %s", __FUNCTION__,
+            strerror(errno));
+        return;
+    }
+    ret = ctx->mEventLoop->addSource("hotplug", ctx->mHotplugFd, EPOLLIN,
+            handle_hotplug_event, ctx);
+    if (ret < 0) {
+        ALOGE("%s: failed to add hotplug source: %s", __FUNCTION__,
+            strerror(-ret));
+        close(ctx->mHotplugFd);
+        ctx->mHotplugFd = -1;
     }
 }
 
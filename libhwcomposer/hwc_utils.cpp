@@ -29,8 +29,12 @@
 #include "hwc_mdpcomp.h"
 #include "hwc_fbupdate.h"
 #include "mdp_version.h"
+#include "prop_cache.h"
+#include "event_loop.h"
 #include "hwc_copybit.h"
 #include "hwc_dump_layers.h"
+#include "hwc_metrics.h"
+#include "hwc_frame_timeline.h"
 #include "external.h"
 #include "virtual.h"
 #include "hwc_qclient.h"
@@ -168,6 +172,11 @@ void initContext(hwc_context_t *ctx)
         ctx->mPrevHwLayerCount[i] = 0;
     }
 
+    ctx->mEventLoop = qdutils::EventLoop::getInstance();
+    ctx->mHotplugFd = -1;
+    ctx->mMetrics = new HwcMetrics();
+    ctx->mFrameTimeline = new FrameTimeline();
+    ctx->mSnapshot = new DisplaySnapshotLock();
     MDPComp::init(ctx);
 
     ctx->vstate.enable = false;
@@ -187,6 +196,7 @@ void initContext(hwc_context_t *ctx)
     ctx->deviceOrientation = 0;
     ctx->mBufferMirrorMode = false;
     ctx->mSocId = getSocIdFromSystem();
+    ctx->mSnapshot->publish(ctx);
     ALOGI("Initializing Qualcomm Hardware Composer");
     ALOGI("MDP version: %d", ctx->mMDP.version);
 }
@@ -237,6 +247,28 @@ void closeContext(hwc_context_t *ctx)
             delete ctx->mHwcDebug[i];
             ctx->mHwcDebug[i] = NULL;
         }
+        //Objects of a transition that was not attached or cleared yet
+        delete ctx->mHotplug[i].fbUpdate;
+        delete ctx->mHotplug[i].mdpComp;
+        delete ctx->mHotplug[i].copyBit;
+        ctx->mHotplug[i].fbUpdate = NULL;
+        ctx->mHotplug[i].mdpComp = NULL;
+        ctx->mHotplug[i].copyBit = NULL;
+    }
+
+    if(ctx->mMetrics) {
+        delete ctx->mMetrics;
+        ctx->mMetrics = NULL;
+    }
+
+    if(ctx->mFrameTimeline) {
+        delete ctx->mFrameTimeline;
+        ctx->mFrameTimeline = NULL;
+    }
+
+    if(ctx->mSnapshot) {
+        delete ctx->mSnapshot;
+        ctx->mSnapshot = NULL;
     }
 
 
@@ -258,226 +290,6 @@ int getExtOrientation(hwc_context_t* ctx) {
     return extOrient;
 }
 
-/* Calculates the destination position based on the action safe rectangle */
-void getActionSafePosition(hwc_context_t *ctx, int dpy, hwc_rect_t& rect) {
-    // Position
-    int x = rect.left, y = rect.top;
-    int w = rect.right - rect.left;
-    int h = rect.bottom - rect.top;
-
-    // if external supports underscan, do nothing
-    // it will be taken care in the driver
-    if(ctx->mExtDisplay->isCEUnderscanSupported())
-        return;
-
-    char value[PROPERTY_VALUE_MAX];
-    // Read action safe properties
-    property_get("persist.sys.actionsafe.width", value, "0");
-    int asWidthRatio = atoi(value);
-    property_get("persist.sys.actionsafe.height", value, "0");
-    int asHeightRatio = atoi(value);
-
-    if(!asWidthRatio && !asHeightRatio) {
-        //No action safe ratio set, return
-        return;
-    }
-
-    float wRatio = 1.0;
-    float hRatio = 1.0;
-    float xRatio = 1.0;
-    float yRatio = 1.0;
-
-    int fbWidth = ctx->dpyAttr[dpy].xres;
-    int fbHeight = ctx->dpyAttr[dpy].yres;
-    if(ctx->dpyAttr[dpy].mDownScaleMode) {
-        // if downscale Mode is enabled for external, need to query
-        // the actual width and height, as that is the physical w & h
-         ctx->mExtDisplay->getAttributes(fbWidth, fbHeight);
-    }
-
-
-    // Since external is rotated 90, need to swap width/height
-    int extOrient = getExtOrientation(ctx);
-
-    if(extOrient & HWC_TRANSFORM_ROT_90)
-        swap(fbWidth, fbHeight);
-
-    float asX = 0;
-    float asY = 0;
-    float asW = fbWidth;
-    float asH = fbHeight;
-
-    // based on the action safe ratio, get the Action safe rectangle
-    asW = fbWidth * (1.0f -  asWidthRatio / 100.0f);
-    asH = fbHeight * (1.0f -  asHeightRatio / 100.0f);
-    asX = (fbWidth - asW) / 2;
-    asY = (fbHeight - asH) / 2;
-
-    // calculate the position ratio
-    xRatio = (float)x/fbWidth;
-    yRatio = (float)y/fbHeight;
-    wRatio = (float)w/fbWidth;
-    hRatio = (float)h/fbHeight;
-
-    //Calculate the position...
-    x = (xRatio * asW) + asX;
-    y = (yRatio * asH) + asY;
-    w = (wRatio * asW);
-    h = (hRatio * asH);
-
-    // Convert it back to hwc_rect_t
-    rect.left = x;
-    rect.top = y;
-    rect.right = w + rect.left;
-    rect.bottom = h + rect.top;
-
-    return;
-}
-
-/* Calculates the aspect ratio for based on src & dest */
-void getAspectRatioPosition(int destWidth, int destHeight, int srcWidth,
-                                int srcHeight, hwc_rect_t& rect) {
-   int x =0, y =0;
-
-   if (srcWidth * destHeight > destWidth * srcHeight) {
-        srcHeight = destWidth * srcHeight / srcWidth;
-        srcWidth = destWidth;
-    } else if (srcWidth * destHeight < destWidth * srcHeight) {
-        srcWidth = destHeight * srcWidth / srcHeight;
-        srcHeight = destHeight;
-    } else {
-        srcWidth = destWidth;
-        srcHeight = destHeight;
-    }
-    if (srcWidth > destWidth) srcWidth = destWidth;
-    if (srcHeight > destHeight) srcHeight = destHeight;
-    x = (destWidth - srcWidth) / 2;
-    y = (destHeight - srcHeight) / 2;
-    ALOGD_IF(HWC_UTILS_DEBUG, "%s: AS Position: x = %d, y = %d w = %d h = %d",
-             __FUNCTION__, x, y, srcWidth , srcHeight);
-    // Convert it back to hwc_rect_t
-    rect.left = x;
-    rect.top = y;
-    rect.right = srcWidth + rect.left;
-    rect.bottom = srcHeight + rect.top;
-}
-
-// This function gets the destination position for Seconday display
-// based on the position and aspect ratio with orientation
-void getAspectRatioPosition(hwc_context_t* ctx, int dpy, int extOrientation,
-                            hwc_rect_t& inRect, hwc_rect_t& outRect) {
-    // Physical display resolution
-    float fbWidth  = ctx->dpyAttr[dpy].xres;
-    float fbHeight = ctx->dpyAttr[dpy].yres;
-    //display position(x,y,w,h) in correct aspectratio after rotation
-    int xPos = 0;
-    int yPos = 0;
-    float width = fbWidth;
-    float height = fbHeight;
-    // Width/Height used for calculation, after rotation
-    float actualWidth = fbWidth;
-    float actualHeight = fbHeight;
-
-    float wRatio = 1.0;
-    float hRatio = 1.0;
-    float xRatio = 1.0;
-    float yRatio = 1.0;
-    hwc_rect_t rect = {0, 0, (int)fbWidth, (int)fbHeight};
-
-    Dim inPos(inRect.left, inRect.top, inRect.right - inRect.left,
-                inRect.bottom - inRect.top);
-    Dim outPos(outRect.left, outRect.top, outRect.right - outRect.left,
-                outRect.bottom - outRect.top);
-
-    Whf whf(fbWidth, fbHeight, 0);
-    eTransform extorient = static_cast<eTransform>(extOrientation);
-    // To calculate the destination co-ordinates in the new orientation
-    preRotateSource(extorient, whf, inPos);
-
-    if(extOrientation & HAL_TRANSFORM_ROT_90) {
-        // Swap width/height for input position
-        swapWidthHeight(actualWidth, actualHeight);
-        getAspectRatioPosition(fbWidth, fbHeight, (int)actualWidth,
-                               (int)actualHeight, rect);
-        xPos = rect.left;
-        yPos = rect.top;
-        width = rect.right - rect.left;
-        height = rect.bottom - rect.top;
-    }
-
-    //Calculate the position...
-    xRatio = inPos.x/actualWidth;
-    yRatio = inPos.y/actualHeight;
-    wRatio = inPos.w/actualWidth;
-    hRatio = inPos.h/actualHeight;
-
-    outPos.x = (xRatio * width) + xPos;
-    outPos.y = (yRatio * height) + yPos;
-    outPos.w = wRatio * width;
-    outPos.h = hRatio * height;
-    ALOGD_IF(HWC_UTILS_DEBUG, "%s: Calculated AspectRatio Position: x = %d,"
-                 "y = %d w = %d h = %d", __FUNCTION__, outPos.x, outPos.y,
-                 outPos.w, outPos.h);
-
-    // For sidesync, the dest fb will be in portrait orientation, and the crop
-    // will be updated to avoid the black side bands, and it will be upscaled
-    // to fit the dest RB, so recalculate
-    // the position based on the new width and height
-    if ((extOrientation & HWC_TRANSFORM_ROT_90) &&
-                        isOrientationPortrait(ctx)) {
-        hwc_rect_t r;
-        //Calculate the position
-        xRatio = (outPos.x - xPos)/width;
-        // GetaspectRatio -- tricky to get the correct aspect ratio
-        // But we need to do this.
-        getAspectRatioPosition(width, height, width, height, r);
-        xPos = r.left;
-        yPos = r.top;
-        float tempWidth = r.right - r.left;
-        float tempHeight = r.bottom - r.top;
-        yRatio = yPos/height;
-        wRatio = outPos.w/width;
-        hRatio = tempHeight/height;
-
-        //Map the coordinates back to Framebuffer domain
-        outPos.x = (xRatio * fbWidth);
-        outPos.y = (yRatio * fbHeight);
-        outPos.w = wRatio * fbWidth;
-        outPos.h = hRatio * fbHeight;
-
-        ALOGD_IF(HWC_UTILS_DEBUG, "%s: Calculated AspectRatio for device in"
-                 "portrait: x = %d,y = %d w = %d h = %d", __FUNCTION__,
-                 outPos.x, outPos.y,
-                 outPos.w, outPos.h);
-    }
-    if(ctx->dpyAttr[dpy].mDownScaleMode) {
-        int extW, extH;
-        if(dpy == HWC_DISPLAY_EXTERNAL)
-            ctx->mExtDisplay->getAttributes(extW, extH);
-        else
-            ctx->mVirtualDisplay->getAttributes(extW, extH);
-        fbWidth  = ctx->dpyAttr[dpy].xres;
-        fbHeight = ctx->dpyAttr[dpy].yres;
-        //Calculate the position...
-        xRatio = outPos.x/fbWidth;
-        yRatio = outPos.y/fbHeight;
-        wRatio = outPos.w/fbWidth;
-        hRatio = outPos.h/fbHeight;
-
-        outPos.x = xRatio * extW;
-        outPos.y = yRatio * extH;
-        outPos.w = wRatio * extW;
-        outPos.h = hRatio * extH;
-    }
-    // Convert Dim to hwc_rect_t
-    outRect.left = outPos.x;
-    outRect.top = outPos.y;
-    outRect.right = outPos.x + outPos.w;
-    outRect.bottom = outPos.y + outPos.h;
-
-    return;
-}
-
 bool isPrimaryPortrait(hwc_context_t *ctx) {
     int fbWidth = ctx->dpyAttr[HWC_DISPLAY_PRIMARY].xres;
     int fbHeight = ctx->dpyAttr[HWC_DISPLAY_PRIMARY].yres;
@@ -494,6 +306,53 @@ bool isOrientationPortrait(hwc_context_t *ctx) {
     return (ctx->deviceOrientation & 0x1);
 }
 
+void updateExtTransform(hwc_context_t *ctx, int dpy) {
+    ExtTransform::Key key;
+    // The key is compared with memcmp, padding included
+    memset(&key, 0, sizeof(key));
+    key.extOrient = getExtOrientation(ctx);
+    key.deviceOrientation = ctx->deviceOrientation;
+    key.xres = ctx->dpyAttr[dpy].xres;
+    key.yres = ctx->dpyAttr[dpy].yres;
+    key.primaryXres = ctx->dpyAttr[HWC_DISPLAY_PRIMARY].xres;
+    key.primaryYres = ctx->dpyAttr[HWC_DISPLAY_PRIMARY].yres;
+    key.downScale = ctx->dpyAttr[dpy].mDownScaleMode;
+    if(key.downScale) {
+        // query MDP configured attributes
+        if(dpy == HWC_DISPLAY_EXTERNAL)
+            ctx->mExtDisplay->getAttributes(key.extW, key.extH);
+        else
+            ctx->mVirtualDisplay->getAttributes(key.extW, key.extH);
+    }
+    // if external supports underscan, action safe is
+    // taken care in the driver
+    key.underscan = ctx->mExtDisplay->isCEUnderscanSupported();
+    qdutils::PropCache& props = qdutils::PropCache::getInstance();
+    key.asWidthRatio = props.getInt(qdutils::PROP_ACTIONSAFE_WIDTH, 0);
+    key.asHeightRatio = props.getInt(qdutils::PROP_ACTIONSAFE_HEIGHT, 0);
+    key.asWidth = key.xres;
+    key.asHeight = key.yres;
+    if(key.downScale) {
+        // in downscale mode the action safe rectangle is taken from the
+        // physical w & h of external
+        ctx->mExtDisplay->getAttributes(key.asWidth, key.asHeight);
+    }
+    // Since external is rotated 90, need to swap width/height
+    if(key.extOrient & HWC_TRANSFORM_ROT_90)
+        swap(key.asWidth, key.asHeight);
+
+    ExtTransform& xf = ctx->mExtTransform[dpy];
+    if(xf.valid && !memcmp(&xf.key, &key, sizeof(key)))
+        return;
+
+    buildExtTransform(xf, key);
+    ALOGD_IF(HWC_UTILS_DEBUG, "%s: dpy %d orient %d device orient %d "
+             "downscale %d [%d x %d] action safe %d [%d x %d]", __FUNCTION__,
+             dpy, key.extOrient, key.deviceOrientation, key.downScale,
+             key.extW, key.extH, xf.actionSafe, key.asWidthRatio,
+             key.asHeightRatio);
+}
+
 void calcExtDisplayPosition(hwc_context_t *ctx,
                                private_handle_t *hnd,
                                int dpy,
@@ -501,66 +360,16 @@ void calcExtDisplayPosition(hwc_context_t *ctx,
                                hwc_rect_t& displayFrame,
                                int& transform,
                                ovutils::eTransform& orient) {
-    // Swap width and height when there is a 90deg transform
-    int extOrient = getExtOrientation(ctx);
-    if(dpy) {
-        if(!isYuvBuffer(hnd)) {
-            if(extOrient & HWC_TRANSFORM_ROT_90) {
-                int dstWidth = ctx->dpyAttr[dpy].xres;
-                int dstHeight = ctx->dpyAttr[dpy].yres;;
-                int srcWidth = ctx->dpyAttr[HWC_DISPLAY_PRIMARY].xres;
-                int srcHeight = ctx->dpyAttr[HWC_DISPLAY_PRIMARY].yres;
-                if(!isPrimaryPortrait(ctx)) {
-                    swap(srcWidth, srcHeight);
-                }                    // Get Aspect Ratio for external
-                getAspectRatioPosition(dstWidth, dstHeight, srcWidth,
-                                    srcHeight, displayFrame);
-                // Crop - this is needed, because for sidesync, the dest fb will
-                // be in portrait orientation, so update the crop to not show the
-                // black side bands.
-                if (isOrientationPortrait(ctx)) {
-                    sourceCrop = displayFrame;
-                    displayFrame.left = 0;
-                    displayFrame.top = 0;
-                    displayFrame.right = dstWidth;
-                    displayFrame.bottom = dstHeight;
-                }
-            }
-            if(ctx->dpyAttr[dpy].mDownScaleMode) {
-                int extW, extH;
-                // if downscale is enabled, map the co-ordinates to new
-                // domain(downscaled)
-                float fbWidth  = ctx->dpyAttr[dpy].xres;
-                float fbHeight = ctx->dpyAttr[dpy].yres;
-                // query MDP configured attributes
-                if(dpy == HWC_DISPLAY_EXTERNAL)
-                    ctx->mExtDisplay->getAttributes(extW, extH);
-                else
-                    ctx->mVirtualDisplay->getAttributes(extW, extH);
-                //Calculate the ratio...
-                float wRatio = ((float)extW)/fbWidth;
-                float hRatio = ((float)extH)/fbHeight;
-
-                //convert Dim to hwc_rect_t
-                displayFrame.left *= wRatio;
-                displayFrame.top *= hRatio;
-                displayFrame.right *= wRatio;
-                displayFrame.bottom *= hRatio;
-            }
-        }else {
-            if(extOrient || ctx->dpyAttr[dpy].mDownScaleMode) {
-                getAspectRatioPosition(ctx, dpy, extOrient,
-                                       displayFrame, displayFrame);
-            }
-        }
-        // If there is a external orientation set, use that
-        if(extOrient) {
-            transform = extOrient;
-            orient = static_cast<ovutils::eTransform >(extOrient);
-        }
-        // Calculate the actionsafe dimensions for External(dpy = 1 or 2)
-        getActionSafePosition(ctx, dpy, displayFrame);
-    }
+    if(!dpy)
+        return;
+    ExtTransform& xf = ctx->mExtTransform[dpy];
+    if(!xf.valid)
+        updateExtTransform(ctx, dpy);
+    if(!xf.valid)
+        return;
+
+    applyExtTransform(xf, isYuvBuffer(hnd), sourceCrop, displayFrame,
+                      transform, orient);
 }
 
 /* Returns the orientation which needs to be set on External for
@@ -627,18 +436,17 @@ bool isAlphaPresent(hwc_layer_1_t const* layer) {
 
 // Let CABL know we have a YUV layer
 static void setYUVProp(int yuvCount) {
-    static char property[PROPERTY_VALUE_MAX];
+    qdutils::PropCache& props = qdutils::PropCache::getInstance();
+    //Only if CABL defined it
+    if(!props.isSet(qdutils::PROP_CABL_YUV))
+        return;
     if(yuvCount > 0) {
-        if (property_get("hw.cabl.yuv", property, NULL) > 0) {
-            if (atoi(property) != 1) {
-                property_set("hw.cabl.yuv", "1");
-            }
+        if (props.getInt(qdutils::PROP_CABL_YUV, 0) != 1) {
+            property_set("hw.cabl.yuv", "1");
         }
     } else {
-        if (property_get("hw.cabl.yuv", property, NULL) > 0) {
-            if (atoi(property) != 0) {
-                property_set("hw.cabl.yuv", "0");
-            }
+        if (props.getInt(qdutils::PROP_CABL_YUV, 0) != 0) {
+            property_set("hw.cabl.yuv", "0");
         }
     }
 }
@@ -1021,11 +829,9 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
     data.acq_fen_fd = acquireFd;
     data.rel_fen_fd = &releaseFd;
 
-    char property[PROPERTY_VALUE_MAX];
-    if(property_get("debug.egl.swapinterval", property, "1") > 0) {
-        if(atoi(property) == 0)
-            swapzero = true;
-    }
+    if(qdutils::PropCache::getInstance().getInt(
+            qdutils::PROP_EGL_SWAP_INTERVAL, 1) == 0)
+        swapzero = true;
     bool isExtAnimating = false;
     if(dpy)
        isExtAnimating = ctx->listStats[dpy].isDisplayAnimating;
@@ -1133,11 +939,9 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
     if (ctx->mCopyBit[dpy])
         ctx->mCopyBit[dpy]->setReleaseFd(releaseFd);
 
-    //A-family
-    if(mdpVersion < qdutils::MDSS_V5) {
-        //Signals when MDP finishes reading rotator buffers.
-        ctx->mLayerRotMap[dpy]->setReleaseFd(releaseFd);
-    }
+    //Signals when MDP finishes reading rotator buffers. The rotators only
+    //rewrite a buffer after its fence has signaled.
+    ctx->mLayerRotMap[dpy]->setReleaseFd(releaseFd);
 
     // if external is animating, close the relaseFd
     if(isExtAnimating) {
@@ -1166,9 +970,19 @@ void trimLayer(hwc_context_t *ctx, const int& dpy, const int& transform,
     }
 }
 
+void splitTransform(const int& transform, int& pipeFlips, int& rotTransform) {
+    if(transform & HWC_TRANSFORM_ROT_90) {
+        //The rotator pass is needed anyway and does the flips for free
+        pipeFlips = 0;
+        rotTransform = transform;
+    } else {
+        pipeFlips = transform & (HWC_TRANSFORM_FLIP_H | HWC_TRANSFORM_FLIP_V);
+        rotTransform = 0;
+    }
+}
+
 void setMdpFlags(hwc_layer_1_t *layer,
-        ovutils::eMdpFlags &mdpFlags,
-        int rotDownscale, int transform) {
+        ovutils::eMdpFlags &mdpFlags, int transform) {
     private_handle_t *hnd = (private_handle_t *)layer->handle;
     MetaData_t *metadata = hnd ? (MetaData_t *)hnd->base_metadata : NULL;
 
@@ -1201,16 +1015,16 @@ void setMdpFlags(hwc_layer_1_t *layer,
         ovutils::setMdpFlags(mdpFlags,
                              ovutils::OV_MDP_SECURE_DISPLAY_OVERLAY_SESSION);
     }
-    //No 90 component and no rot-downscale then flips done by MDP
-    //If we use rot then it might as well do flips
-    if(!(transform & HWC_TRANSFORM_ROT_90) && !rotDownscale) {
-        if(transform & HWC_TRANSFORM_FLIP_H) {
-            ovutils::setMdpFlags(mdpFlags, ovutils::OV_MDP_FLIP_H);
-        }
+    //No 90 component then flips done by MDP, even if the rotator is used
+    //for downscale. With a 90 component the rotator does the flips.
+    int pipeFlips = 0, rotTransform = 0;
+    splitTransform(transform, pipeFlips, rotTransform);
+    if(pipeFlips & HWC_TRANSFORM_FLIP_H) {
+        ovutils::setMdpFlags(mdpFlags, ovutils::OV_MDP_FLIP_H);
+    }
 
-        if(transform & HWC_TRANSFORM_FLIP_V) {
-            ovutils::setMdpFlags(mdpFlags,  ovutils::OV_MDP_FLIP_V);
-        }
+    if(pipeFlips & HWC_TRANSFORM_FLIP_V) {
+        ovutils::setMdpFlags(mdpFlags,  ovutils::OV_MDP_FLIP_V);
     }
 
     if(metadata &&
@@ -1221,6 +1035,16 @@ void setMdpFlags(hwc_layer_1_t *layer,
     }
 }
 
+void addRotBypass(hwc_context_t *ctx, hwc_layer_1_t *layer,
+        const eMdpFlags& mdpFlags, const int& rotFlags) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    if(!isYuvBuffer(hnd) || (rotFlags & ROT_PREROTATED))
+        return;
+    if(mdpFlags & (OV_MDP_FLIP_H | OV_MDP_FLIP_V)) {
+        ctx->mRotMgr->addBypassed(hnd->size);
+    }
+}
+
 inline int configRotator(Rotator *rot, Whf& whf,
         const Whf& origWhf, const eMdpFlags& mdpFlags,
         const eTransform& orient,
@@ -1295,9 +1119,10 @@ ovutils::eDest getPipeForFb(hwc_context_t *ctx, int dpy) {
 inline int configMdp(Overlay *ov, const PipeArgs& parg,
         const eTransform& orient, const hwc_rect_t& crop,
         const hwc_rect_t& pos, const MetaData_t *metadata,
-        const eDest& dest) {
+        const eDest& dest, const int& horzDeci, const int& vertDeci) {
     ov->setSource(parg, dest);
     ov->setTransform(orient, dest);
+    ov->setDecimation(horzDeci, vertDeci, dest);
 
     int crop_w = crop.right - crop.left;
     int crop_h = crop.bottom - crop.top;
@@ -1361,6 +1186,129 @@ bool needToForceRotator(hwc_context_t *ctx, const int& dpy,
     return forceRot;
 }
 
+bool planLayerSplit(const hwc_rect_t& crop, const hwc_rect_t& dst,
+        const int& transform, SplitPlan& plan) {
+    qdutils::MDPVersion& mdpHw = qdutils::MDPVersion::getInstance();
+    const int maxDownscale = mdpHw.getMaxMDPDownscale();
+    const int maxPipeWidth = mdpHw.getMaxPipeWidth();
+    int crop_w = crop.right - crop.left;
+    int crop_h = crop.bottom - crop.top;
+    int dst_w = dst.right - dst.left;
+    int dst_h = dst.bottom - dst.top;
+
+    //The pipe fetches what the rotator outputs
+    if(transform & HWC_TRANSFORM_ROT_90)
+        swap(crop_w, crop_h);
+
+    plan.numPipes = 1;
+    plan.horzDeci = 0;
+    plan.vertDeci = 0;
+
+    if(crop_w <= 0 || crop_h <= 0 || dst_w <= 0 || dst_h <= 0)
+        return false;
+
+    if(mdpHw.supportsDecimation()) {
+        const int maxDeci = mdpHw.getMaxDecimation();
+        while(plan.horzDeci < maxDeci &&
+                (crop_w >> plan.horzDeci) > dst_w * maxDownscale)
+            plan.horzDeci++;
+        while(plan.vertDeci < maxDeci &&
+                (crop_h >> plan.vertDeci) > dst_h * maxDownscale)
+            plan.vertDeci++;
+        //Too wide for a pipe, but downscaled 2x or more anyway. Decimating
+        //costs one pipe less than a split and half the fetch.
+        while(plan.horzDeci < maxDeci &&
+                (crop_w >> plan.horzDeci) > maxPipeWidth &&
+                (crop_w >> (plan.horzDeci + 1)) >= dst_w)
+            plan.horzDeci++;
+    }
+
+    crop_w >>= plan.horzDeci;
+    crop_h >>= plan.vertDeci;
+    if(crop_w > dst_w * maxDownscale || crop_h > dst_h * maxDownscale) {
+        ALOGD_IF(HWC_UTILS_DEBUG, "%s: downscale %dx%d -> %dx%d beyond MDP",
+                __FUNCTION__, crop_w, crop_h, dst_w, dst_h);
+        return false;
+    }
+
+    if(crop_w > maxPipeWidth) {
+        //Rotated layers go through the rotator in one piece, and MDP4
+        //downscales YUV there too, so only split unrotated layers on MDSS
+        if(crop_w > 2 * maxPipeWidth || (transform & HWC_TRANSFORM_ROT_90) ||
+                mdpHw.getMDPVersion() < qdutils::MDSS_V5) {
+            ALOGD_IF(HWC_UTILS_DEBUG, "%s: crop width %d beyond 2 pipes",
+                    __FUNCTION__, crop_w);
+            return false;
+        }
+        plan.numPipes = 2;
+    }
+    return true;
+}
+
+int configureSourceSplit(hwc_context_t *ctx, hwc_layer_1_t *layer,
+        const int& dpy, eMdpFlags& mdpFlags, eZorder& z,
+        eIsFg& isFg, const eDest& lDest, const eDest& rDest) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    if(!hnd) {
+        ALOGE("%s: layer handle is NULL", __FUNCTION__);
+        return -1;
+    }
+
+    MetaData_t *metadata = (MetaData_t *)hnd->base_metadata;
+
+    hwc_rect_t crop = integerizeSourceCrop(layer->sourceCropf);
+    hwc_rect_t dst = layer->displayFrame;
+    int transform = layer->transform;
+    eTransform orient = static_cast<eTransform>(transform);
+    Whf whf(getWidth(hnd), getHeight(hnd),
+            getMdpFormat(hnd->format), hnd->size);
+
+    calcExtDisplayPosition(ctx, hnd, dpy, crop, dst, transform, orient);
+    setMdpFlags(layer, mdpFlags, transform);
+    trimLayer(ctx, dpy, transform, crop, dst);
+    //Both halves are fetched flipped, the layer is counted once
+    addRotBypass(ctx, layer, mdpFlags, ROT_FLAGS_NONE);
+
+    SplitPlan plan;
+    if(!planLayerSplit(crop, dst, transform, plan)) {
+        ALOGE("%s: layer can't be fetched by the MDP", __FUNCTION__);
+        return -1;
+    }
+
+    //Each pipe takes one half of the destination. The flips decide which
+    //half of the crop feeds it, the pipes then flip their own half.
+    int mid = dst.left + (((dst.right - dst.left) / 2) & ~1);
+    hwc_rect_t cropL = crop, dstL = dst;
+    hwc_rect_t cropR = crop, dstR = dst;
+    hwc_rect_t scissorL = {dst.left, dst.top, mid, dst.bottom};
+    hwc_rect_t scissorR = {mid, dst.top, dst.right, dst.bottom};
+    qhwc::calculate_crop_rects(cropL, dstL, scissorL, transform);
+    qhwc::calculate_crop_rects(cropR, dstR, scissorR, transform);
+
+    orient = OVERLAY_TRANSFORM_0;
+    ovutils::eBlending blending =
+            (ovutils::eBlending) getBlending(layer->blending);
+
+    PipeArgs pargL(mdpFlags, whf, z, isFg, ROT_FLAGS_NONE,
+            layer->planeAlpha, blending);
+    if(configMdp(ctx->mOverlay, pargL, orient, cropL, dstL, metadata, lDest,
+            plan.horzDeci, plan.vertDeci) < 0) {
+        ALOGE("%s: commit failed for left half", __FUNCTION__);
+        return -1;
+    }
+
+    //Right half blends in the stage above
+    eZorder zR = static_cast<eZorder>(z + 1);
+    PipeArgs pargR(mdpFlags, whf, zR, IS_FG_OFF, ROT_FLAGS_NONE,
+            layer->planeAlpha, blending);
+    if(configMdp(ctx->mOverlay, pargR, orient, cropR, dstR, metadata, rDest,
+            plan.horzDeci, plan.vertDeci) < 0) {
+        ALOGE("%s: commit failed for right half", __FUNCTION__);
+        return -1;
+    }
+    return 0;
+}
+
 int configureLowRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
         const int& dpy, eMdpFlags& mdpFlags, eZorder& z,
         eIsFg& isFg, const eDest& dest, Rotator **rot) {
@@ -1402,15 +1350,20 @@ int configureLowRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
 
     }
 
-    setMdpFlags(layer, mdpFlags, downscale, transform);
+    setMdpFlags(layer, mdpFlags, transform);
     trimLayer(ctx, dpy, transform, crop, dst);
 
+    int pipeFlips = 0, rotTransform = 0;
+    splitTransform(transform, pipeFlips, rotTransform);
+
     if(isYuvBuffer(hnd) && //if 90 component or downscale, use rot
-            ((transform & HWC_TRANSFORM_ROT_90) || downscale || forceRot)) {
-        *rot = ctx->mRotMgr->getNext();
+            (rotTransform || downscale || forceRot)) {
+        *rot = ctx->mRotMgr->getNext(whf);
         if(*rot == NULL) return -1;
         Whf origWhf(hnd->width, hnd->height,
                     getMdpFormat(hnd->format), hnd->size);
+        //Flips, if any, are left to the pipe
+        orient = static_cast<eTransform>(rotTransform);
         if(configRotator(*rot, whf, origWhf,  mdpFlags, orient, downscale) < 0) {
         //Configure rotator for pre-rotation
             ALOGE("%s: configRotator failed!", __FUNCTION__);
@@ -1421,6 +1374,7 @@ int configureLowRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
         updateSource(orient, whf, crop);
         rotFlags |= ovutils::ROT_PREROTATED;
     }
+    addRotBypass(ctx, layer, mdpFlags, rotFlags);
 
     //For the mdp, since either we are pre-rotating or MDP does flips
     orient = OVERLAY_TRANSFORM_0;
@@ -1430,7 +1384,15 @@ int configureLowRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
                   static_cast<eRotFlags>(rotFlags), layer->planeAlpha,
                   (ovutils::eBlending) getBlending(layer->blending));
 
-    if(configMdp(ctx->mOverlay, parg, orient, crop, dst, metadata, dest) < 0) {
+    //crop is as the pipe fetches it by now
+    SplitPlan plan;
+    if(!planLayerSplit(crop, dst, transform, plan)) {
+        ALOGE("%s: layer can't be fetched by the MDP", __FUNCTION__);
+        return -1;
+    }
+
+    if(configMdp(ctx->mOverlay, parg, orient, crop, dst, metadata, dest,
+            plan.horzDeci, plan.vertDeci) < 0) {
         ALOGE("%s: commit failed for low res panel", __FUNCTION__);
         return -1;
     }
@@ -1468,14 +1430,19 @@ int configureHighRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
                      (uint32_t)getHeight(hnd), transform, lDest);
     }
 
-    setMdpFlags(layer, mdpFlagsL, 0, transform);
+    setMdpFlags(layer, mdpFlagsL, transform);
     trimLayer(ctx, dpy, transform, crop, dst);
 
-    if(isYuvBuffer(hnd) && ((transform & HWC_TRANSFORM_ROT_90) || forceRot)) {
-        (*rot) = ctx->mRotMgr->getNext();
+    int pipeFlips = 0, rotTransform = 0;
+    splitTransform(transform, pipeFlips, rotTransform);
+
+    if(isYuvBuffer(hnd) && (rotTransform || forceRot)) {
+        (*rot) = ctx->mRotMgr->getNext(whf);
         if((*rot) == NULL) return -1;
         Whf origWhf(hnd->width, hnd->height,
                     getMdpFormat(hnd->format), hnd->size);
+        //Flips, if any, are left to the pipe
+        orient = static_cast<eTransform>(rotTransform);
         if(configRotator(*rot, whf, origWhf, mdpFlagsL, orient, downscale) < 0) {
         //Configure rotator for pre-rotation
             ALOGE("%s: configRotator failed!", __FUNCTION__);
@@ -1486,6 +1453,7 @@ int configureHighRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
         updateSource(orient, whf, crop);
         rotFlags |= ROT_PREROTATED;
     }
+    addRotBypass(ctx, layer, mdpFlagsL, rotFlags);
 
     eMdpFlags mdpFlagsR = mdpFlagsL;
     setMdpFlags(mdpFlagsR, OV_MDSS_MDP_RIGHT_MIXER);
@@ -1531,6 +1499,13 @@ int configureHighRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
     orient = OVERLAY_TRANSFORM_0;
     transform = 0;
 
+    //Halves scale like the whole, so one decimation serves both mixers
+    SplitPlan plan;
+    if(!planLayerSplit(crop, dst, transform, plan)) {
+        ALOGE("%s: layer can't be fetched by the MDP", __FUNCTION__);
+        return -1;
+    }
+
     //configure left mixer
     if(lDest != OV_INVALID) {
         PipeArgs pargL(mdpFlagsL, whf, z, isFg,
@@ -1538,7 +1513,8 @@ int configureHighRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
                        (ovutils::eBlending) getBlending(layer->blending));
 
         if(configMdp(ctx->mOverlay, pargL, orient,
-                tmp_cropL, tmp_dstL, metadata, lDest) < 0) {
+                tmp_cropL, tmp_dstL, metadata, lDest,
+                plan.horzDeci, plan.vertDeci) < 0) {
             ALOGE("%s: commit failed for left mixer config", __FUNCTION__);
             return -1;
         }
@@ -1553,7 +1529,8 @@ int configureHighRes(hwc_context_t *ctx, hwc_layer_1_t *layer,
         tmp_dstR.right = tmp_dstR.right - tmp_dstR.left;
         tmp_dstR.left = 0;
         if(configMdp(ctx->mOverlay, pargR, orient,
-                tmp_cropR, tmp_dstR, metadata, rDest) < 0) {
+                tmp_cropR, tmp_dstR, metadata, rDest,
+                plan.horzDeci, plan.vertDeci) < 0) {
             ALOGE("%s: commit failed for right mixer config", __FUNCTION__);
             return -1;
         }
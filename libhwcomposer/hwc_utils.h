@@ -28,6 +28,7 @@
 #include <gr.h>
 #include <gralloc_priv.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
 #include <linux/fb.h>
 #include "qdMetaData.h"
 #include <overlayUtils.h>
@@ -50,6 +51,10 @@ class Rotator;
 class RotMgr;
 }
 
+namespace qdutils {
+class EventLoop;
+}
+
 namespace qhwc {
 //fwrd decl
 class QueuedBufferStore;
@@ -60,6 +65,8 @@ class IVideoOverlay;
 class MDPComp;
 class CopyBit;
 class HwcDebug;
+class HwcMetrics;
+class FrameTimeline;
 
 
 struct MDPInfo {
@@ -93,6 +100,42 @@ struct DisplayAttributes {
     hwc_rect_t mDstRect;
 };
 
+/* Display transitions staged by uevents, see hwc_uevents.cpp */
+enum eHotplugAction {
+    HOTPLUG_NONE = 0,
+    HOTPLUG_ADD,
+    HOTPLUG_REMOVE,
+    HOTPLUG_PAUSE,
+    HOTPLUG_RESUME,
+};
+
+enum eHotplugPhase {
+    HOTPLUG_STAGED = 0, //Waiting for a prepare
+    HOTPLUG_RELEASING,  //Prepared, the cycle gives up the pipes
+    HOTPLUG_RELEASED,   //Set done, the event loop configures the display
+    HOTPLUG_CONFIGURED, //Configured, the next prepare attaches it
+    HOTPLUG_APPLYING,   //Prepared with the display attached
+    HOTPLUG_APPLIED,    //Set done, the event loop notifies SF
+    HOTPLUG_PHASE_MAX
+};
+
+struct HotplugState {
+    int action; //eHotplugAction
+    int phase;  //eHotplugPhase
+    //Sends the hotplug of the external slot to SF
+    bool notify;
+    //Composition objects of the display while it is not attached. Built
+    //or deleted by the event loop, swapped with the context by prepare.
+    IFBUpdate *fbUpdate;
+    MDPComp *mdpComp;
+    CopyBit *copyBit;
+    //Switch state received during the transition, staged after it
+    bool hasNext;
+    int next;
+    //When each phase was entered, 0 if skipped
+    nsecs_t phaseTime[HOTPLUG_PHASE_MAX];
+};
+
 struct ListStats {
     int numAppLayers; //Total - 1, excluding FB layer.
     int skipCount;
@@ -160,6 +203,103 @@ inline overlay::Rotator* LayerRotMap::getRot(uint32_t index) const {
     return mRot[index];
 }
 
+/* Display state as of the last prepare */
+struct DisplaySnapshot {
+    //Publishes since HWC started, a reader can tell a newer snapshot
+    uint32_t version;
+    DisplayAttributes dpyAttr[HWC_NUM_DISPLAY_TYPES];
+    hwc_rect_t viewFrame[HWC_NUM_DISPLAY_TYPES];
+    int deviceOrientation;
+    int extOrientation;
+    bool bufferMirrorMode;
+    /* The region of dpy that QClient reports as visible */
+    hwc_rect_t getVisibleRegion(const int& dpy) const;
+};
+
+/* Seqlock around a DisplaySnapshot, so that QClient handlers can read the
+ * display state without waiting on mDrawLock for a whole composition.
+ * The sequence is odd while a publish is copying in; readers copy out and
+ * retry if the sequence was odd or changed meanwhile. */
+class DisplaySnapshotLock {
+public:
+    DisplaySnapshotLock();
+    /* Copies the state of ctx in. Called with mDrawLock held, which keeps
+     * publishers to one at a time */
+    void publish(hwc_context_t *ctx);
+    /* Copies the last published snapshot out. Never blocks */
+    void read(DisplaySnapshot& snapshot) const;
+private:
+    //Reads that find a publish in progress spin this many times before
+    //yielding to a possibly preempted publisher
+    enum { MAX_SPINS = 64 };
+    mutable volatile int32_t mSeq;
+    DisplaySnapshot mSnapshot;
+};
+
+/* Mapping of layer positions from the primary to an external or virtual
+ * display. It depends only on the display modes, the orientations and the
+ * action safe properties, so it is rebuilt when one of those changes and
+ * calcExtDisplayPosition() applies it to each layer in integer math.
+ * Scales are integer ratios, applied as value * num / den in 64 bit, so
+ * that positions round down like the float math they replace, without its
+ * error. The division is a multiply by a reciprocal of den made at build,
+ * exact for the magnitudes below 2^31 positions have */
+struct ExtTransform {
+    //What the transform was built from, compared as a whole
+    struct Key {
+        int extOrient;
+        int deviceOrientation;
+        int xres;
+        int yres;
+        int primaryXres;
+        int primaryYres;
+        bool downScale;
+        //MDP configured size in downscale mode
+        int extW;
+        int extH;
+        bool underscan;
+        int asWidthRatio;
+        int asHeightRatio;
+        //Size the action safe rectangle is taken from
+        int asWidth;
+        int asHeight;
+    };
+    struct Ratio {
+        int num;
+        int den;
+        //n / den is (n * recip) >> shift for 0 <= n < 2^31
+        uint64_t recip;
+        int shift;
+    };
+    Key key;
+    bool valid;
+    //RGB with a 90 rotation: the aspect ratio frame, which sidesync
+    //(device in portrait) uses as the crop of a full screen frame
+    hwc_rect_t rotFrame;
+    bool rotCrop;
+    //Downscale mode: display resolution to the MDP configured one
+    Ratio downScaleX;
+    Ratio downScaleY;
+    //YUV: pre-rotated position to the aspect ratio rectangle at (xPos, yPos)
+    Ratio yuvScaleX;
+    Ratio yuvScaleY;
+    int xPos;
+    int yPos;
+    //YUV sidesync: horizontal rescale, the height is always yuvY, yuvH
+    bool yuvSideSync;
+    Ratio yuvSideScaleX;
+    int yuvY;
+    int yuvH;
+    //Action safe rectangle, if a ratio is set and the sink can't underscan.
+    //Positions scale by asScale and move by half of what it takes off, so
+    //the ratios are kept over 200 to have that half whole
+    bool actionSafe;
+    Ratio asScaleX;
+    Ratio asScaleY;
+    int asWidth;
+    int asHeight;
+};
+
 inline hwc_rect_t integerizeSourceCrop(const hwc_frect_t& cropF) {
     hwc_rect_t cropI = {0};
     cropI.left = int(ceilf(cropF.left));
@@ -212,14 +352,20 @@ hwc_rect_t getUnion(const hwc_rect_t& rect1, const hwc_rect_t& rect2);
 void optimizeLayerRects(hwc_context_t *ctx,
                         const hwc_display_contents_1_t *list, const int& dpy);
 
-/* Calculates the destination position based on the action safe rectangle */
-void getActionSafePosition(hwc_context_t *ctx, int dpy, hwc_rect_t& dst);
-
 void getAspectRatioPosition(int destWidth, int destHeight, int srcWidth,
                                 int srcHeight, hwc_rect_t& rect);
 
-void getAspectRatioPosition(hwc_context_t* ctx, int dpy, int extOrientation,
-                                hwc_rect_t& inRect, hwc_rect_t& outRect);
+/* Rebuilds the transform calcExtDisplayPosition() uses for dpy, if the
+ * display mode, orientation or action safe settings changed since */
+void updateExtTransform(hwc_context_t *ctx, int dpy);
+
+/* Builds the transform for the display state in key */
+void buildExtTransform(ExtTransform& xf, const ExtTransform::Key& key);
+
+/* Maps a layer of the primary onto the display of xf, in place */
+void applyExtTransform(const ExtTransform& xf, const bool& yuv,
+                       hwc_rect_t& sourceCrop, hwc_rect_t& displayFrame,
+                       int& transform, ovutils::eTransform& orient);
 
 bool isPrimaryPortrait(hwc_context_t *ctx);
 
@@ -251,10 +397,20 @@ void trimLayer(hwc_context_t *ctx, const int& dpy, const int& transform,
 //get Pipe for FB target
 ovutils::eDest getPipeForFb(hwc_context_t *ctx, int dpy);
 
+//Splits a layer transform into the flips the MDP pipe can do while fetching
+//and the residual that needs the rotator. 180 is fetched as H + V flips, so
+//only a 90 component engages the rotator, which then applies all of it.
+void splitTransform(const int& transform, int& pipeFlips, int& rotTransform);
+
 //Sets appropriate mdp flags for a layer.
 void setMdpFlags(hwc_layer_1_t *layer,
-        ovutils::eMdpFlags &mdpFlags,
-        int rotDownscale, int transform);
+        ovutils::eMdpFlags &mdpFlags, int transform);
+
+//Accounts the rotator pass a flipped YUV layer did without, once the pipe
+//fetches it with the flips setMdpFlags set. A layer the rotator is used for
+//anyway, like for downscale, saves nothing and isn't counted.
+void addRotBypass(hwc_context_t *ctx, hwc_layer_1_t *layer,
+        const ovutils::eMdpFlags& mdpFlags, const int& rotFlags);
 
 int configRotator(overlay::Rotator *rot, ovutils::Whf& whf,
         const ovutils::Whf& origWhf, const ovutils::eMdpFlags& mdpFlags,
@@ -263,7 +419,8 @@ int configRotator(overlay::Rotator *rot, ovutils::Whf& whf,
 int configMdp(overlay::Overlay *ov, const ovutils::PipeArgs& parg,
         const ovutils::eTransform& orient, const hwc_rect_t& crop,
         const hwc_rect_t& pos, const MetaData_t *metadata,
-        const ovutils::eDest& dest);
+        const ovutils::eDest& dest, const int& horzDeci = 0,
+        const int& vertDeci = 0);
 
 void updateSource(ovutils::eTransform& orient, ovutils::Whf& whf,
         hwc_rect_t& crop);
@@ -271,6 +428,27 @@ void updateSource(ovutils::eTransform& orient, ovutils::Whf& whf,
 bool needToForceRotator(hwc_context_t *ctx, const int& dpy,
          uint32_t w, uint32_t h, int transform, const overlay::utils::eDest& dest);
 
+//How a layer is fetched by the MDP: on one pipe or split in two halves
+//side by side, with log2 of the decimation each pipe applies.
+struct SplitPlan {
+    int numPipes;
+    int horzDeci;
+    int vertDeci;
+};
+
+//Plans the pipes for a crop scaled to dst, within the MDPVersion limits on
+//fetch width and downscale. Decimation is preferred over splitting when the
+//layer is downscaled anyway. Returns false if the MDP can't fetch it.
+bool planLayerSplit(const hwc_rect_t& crop, const hwc_rect_t& dst,
+        const int& transform, SplitPlan& plan);
+
+//Routine to configure a layer wider than a pipe on a low res panel, as two
+//pipes at adjacent z-orders
+int configureSourceSplit(hwc_context_t *ctx, hwc_layer_1_t *layer,
+        const int& dpy, ovutils::eMdpFlags& mdpFlags, ovutils::eZorder& z,
+        ovutils::eIsFg& isFg, const ovutils::eDest& lDest,
+        const ovutils::eDest& rDest);
+
 //Routine to configure low resolution panels (<= 2048 width)
 int configureLowRes(hwc_context_t *ctx, hwc_layer_1_t *layer, const int& dpy,
         ovutils::eMdpFlags& mdpFlags, ovutils::eZorder& z,
@@ -346,10 +524,14 @@ static inline bool isSecureDisplayBuffer(const private_handle_t* hnd) {
 template<typename T> inline T max(T a, T b) { return (a > b) ? a : b; }
 template<typename T> inline T min(T a, T b) { return (a < b) ? a : b; }
 
-// Initialize uevent thread
-void init_uevent_thread(hwc_context_t* ctx);
-// Initialize vsync thread
-void init_vsync_thread(hwc_context_t* ctx);
+// Add the uevent socket to the event loop
+void init_uevent(hwc_context_t* ctx);
+// Add the vsync source to the event loop
+void init_vsync(hwc_context_t* ctx);
+// Applies the staged hotplug transitions, at the start of prepare
+void hotplug_prepare(hwc_context_t* ctx);
+// Hands the transitions of this cycle to the event loop, at the end of set
+void hotplug_set(hwc_context_t* ctx);
 
 inline void getLayerResolution(const hwc_layer_1_t* layer,
                                int& width, int& height)
@@ -430,6 +612,21 @@ struct hwc_context_t {
     bool mBasePipeSetup;
     //Lock to protect drawing data structures
     mutable Locker mDrawLock;
+    //Runs the vsync, uevent and idle timer handlers
+    qdutils::EventLoop *mEventLoop;
+    //Hotplug transitions, under mHotplugLock
+    qhwc::HotplugState mHotplug[HWC_NUM_DISPLAY_TYPES];
+    mutable Locker mHotplugLock;
+    //eventfd that wakes the event loop to go on with a transition
+    int mHotplugFd;
+    //Composition counters for QService
+    qhwc::HwcMetrics *mMetrics;
+    //Composition decisions per frame, for QService once armed
+    qhwc::FrameTimeline *mFrameTimeline;
+    //Time the last prepare took, accounted with its set
+    nsecs_t mPrepareTime;
+    //Display state for readers that don't take mDrawLock
+    qhwc::DisplaySnapshotLock *mSnapshot;
     //Drawing round when we use GPU
     bool isPaddingRound;
     // External Orientation
@@ -437,6 +634,8 @@ struct hwc_context_t {
     //Used for SideSync feature
     //which overrides the mExtOrientation
     bool mBufferMirrorMode;
+    //Primary to external/virtual mapping, refreshed once per prepare
+    qhwc::ExtTransform mExtTransform[HWC_NUM_DISPLAY_TYPES];
     //used for enabling C2D Feature only for 8960 Non Pro Device
     int mSocId;
     qhwc::LayerRotMap *mLayerRotMap[HWC_NUM_DISPLAY_TYPES];
@@ -23,17 +23,15 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <linux/msm_mdp.h>
-#include <sys/resource.h>
-#include <sys/prctl.h>
+#include <sys/timerfd.h>
 #include "hwc_utils.h"
 #include "string.h"
 #include "external.h"
 #include "overlay.h"
+#include "event_loop.h"
 
 namespace qhwc {
 
-#define HWC_VSYNC_THREAD_NAME "hwcVsyncThread"
-
 int hwc_vsync_control(hwc_context_t* ctx, int dpy, int enable)
 {
     int ret = 0;
@@ -47,29 +45,59 @@ int hwc_vsync_control(hwc_context_t* ctx, int dpy, int enable)
     return ret;
 }
 
-static void *vsync_loop(void *param)
-{
-    const char* vsync_timestamp_fb0 = "/sys/class/graphics/fb0/vsync_event";
-    const char* vsync_timestamp_fb1 = "/sys/class/graphics/fb1/vsync_event";
-    int dpy = HWC_DISPLAY_PRIMARY;
+static bool sLogVsync = false;
 
+static void handle_vsync_event(void *param, int fd, uint32_t events)
+{
     hwc_context_t * ctx = reinterpret_cast<hwc_context_t *>(param);
-
-    char thread_name[64] = HWC_VSYNC_THREAD_NAME;
-    prctl(PR_SET_NAME, (unsigned long) &thread_name, 0, 0, 0);
-    setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY +
-                android::PRIORITY_MORE_FAVORABLE);
-
     const int MAX_DATA = 64;
-    static char vdata[MAX_DATA];
+    char vdata[MAX_DATA];
+    uint64_t cur_timestamp = 0;
+
+    if (LIKELY(!ctx->vstate.fakevsync)) {
+        /* Currently read vsync timestamp from drivers
+           e.g. VSYNC=41800875994
+           */
+        ssize_t len = pread(fd, vdata, MAX_DATA - 1, 0);
+        if (len < 0) {
+            // If the read was just interrupted - it is not a fatal error
+            // In either case, just continue.
+            if (errno != EAGAIN &&
+                errno != EINTR  &&
+                errno != EBUSY) {
+                ALOGE ("FATAL:%s:not able to read vsync timestamp, %s",
+                       __FUNCTION__, strerror(errno));
+            }
+            return;
+        }
+        vdata[len] = '\0';
+        // extract timestamp
+        const char *str = vdata;
+        if (!strncmp(str, "VSYNC=", strlen("VSYNC="))) {
+            cur_timestamp = strtoull(str + strlen("VSYNC="), NULL, 0);
+            ctx->mEventLoop->setEventTime(fd, cur_timestamp);
+        }
+    } else {
+        uint64_t expirations = 0;
+        if (read(fd, &expirations, sizeof(expirations)) < 0)
+            return;
+        cur_timestamp = systemTime();
+    }
+    // send timestamp to HAL
+    if(ctx->vstate.enable) {
+        ALOGD_IF (sLogVsync, "%s: timestamp %llu sent to HWC for %s",
+                  __FUNCTION__, cur_timestamp, "fb0");
+        ctx->proc->vsync(ctx->proc, HWC_DISPLAY_PRIMARY, cur_timestamp);
+    }
+}
 
-    uint64_t cur_timestamp=0;
-    ssize_t len = -1;
+void init_vsync(hwc_context_t* ctx)
+{
+    const char* vsync_timestamp_fb0 = "/sys/class/graphics/fb0/vsync_event";
     int fd_timestamp = -1;
-    int ret = 0;
-    bool fb1_vsync = false;
-    bool logvsync = false;
+    uint32_t events = EPOLLPRI | EPOLLERR;
 
+    ALOGI("Initializing VSYNC source");
     char property[PROPERTY_VALUE_MAX];
     if(property_get("debug.hwc.fakevsync", property, NULL) > 0) {
         if(atoi(property) == 1)
@@ -78,69 +106,53 @@ static void *vsync_loop(void *param)
 
     if(property_get("debug.hwc.logvsync", property, 0) > 0) {
         if(atoi(property) == 1)
-            logvsync = true;
-    }
-
-    /* Currently read vsync timestamp from drivers
-       e.g. VSYNC=41800875994
-       */
-    fd_timestamp = open(vsync_timestamp_fb0, O_RDONLY);
-    if (fd_timestamp < 0) {
-        // Make sure fb device is opened before starting this thread so this
-        // never happens.
-        ALOGE ("FATAL:%s:not able to open file:%s, %s",  __FUNCTION__,
-               (fb1_vsync) ? vsync_timestamp_fb1 : vsync_timestamp_fb0,
-               strerror(errno));
-        ctx->vstate.fakevsync = true;
+            sLogVsync = true;
     }
 
-    do {
-        if (LIKELY(!ctx->vstate.fakevsync)) {
-            len = pread(fd_timestamp, vdata, MAX_DATA, 0);
-            if (len < 0) {
-                // If the read was just interrupted - it is not a fatal error
-                // In either case, just continue.
-                if (errno != EAGAIN &&
-                    errno != EINTR  &&
-                    errno != EBUSY) {
-                    ALOGE ("FATAL:%s:not able to read file:%s, %s",
-                           __FUNCTION__,
-                           vsync_timestamp_fb0, strerror(errno));
-                }
-                continue;
-            }
-            // extract timestamp
-            const char *str = vdata;
-            if (!strncmp(str, "VSYNC=", strlen("VSYNC="))) {
-                cur_timestamp = strtoull(str + strlen("VSYNC="), NULL, 0);
-            }
+    if (!ctx->vstate.fakevsync) {
+        fd_timestamp = open(vsync_timestamp_fb0, O_RDONLY);
+        if (fd_timestamp < 0) {
+            // Make sure fb device is opened before starting this thread so
+            // this never happens.
+            ALOGE ("FATAL:%s:not able to open file:%s, %s",  __FUNCTION__,
+                   vsync_timestamp_fb0, strerror(errno));
+            ctx->vstate.fakevsync = true;
         } else {
-            usleep(16666);
-            cur_timestamp = systemTime();
-        }
-        // send timestamp to HAL
-        if(ctx->vstate.enable) {
-            ALOGD_IF (logvsync, "%s: timestamp %llu sent to HWC for %s",
-                      __FUNCTION__, cur_timestamp, "fb0");
-            ctx->proc->vsync(ctx->proc, dpy, cur_timestamp);
+            // The driver notifies the attribute on each vsync; a read is
+            // needed before the first notification is sent
+            char dummy[64];
+            if (pread(fd_timestamp, dummy, sizeof(dummy), 0) < 0) {
+                ALOGW("%s: initial vsync read failed: %s", __FUNCTION__,
+                      strerror(errno));
+            }
         }
+    }
 
-    } while (true);
-    if(fd_timestamp >= 0)
-        close (fd_timestamp);
-
-    return NULL;
-}
+    if (ctx->vstate.fakevsync) {
+        nsecs_t period = ctx->dpyAttr[HWC_DISPLAY_PRIMARY].vsync_period;
+        if (!period)
+            period = 16666666;
+        struct itimerspec spec;
+        spec.it_interval.tv_sec = period / 1000000000LL;
+        spec.it_interval.tv_nsec = period % 1000000000LL;
+        spec.it_value = spec.it_interval;
+        fd_timestamp = timerfd_create(CLOCK_MONOTONIC,
+                TFD_CLOEXEC | TFD_NONBLOCK);
+        if (fd_timestamp < 0 ||
+                timerfd_settime(fd_timestamp, 0, &spec, NULL) < 0) {
+            ALOGE("%s: failed to set up fake vsync: %s", __FUNCTION__,
+                  strerror(errno));
+            return;
+        }
+        events = EPOLLIN;
+    }
 
-void init_vsync_thread(hwc_context_t* ctx)
-{
-    int ret;
-    pthread_t vsync_thread;
-    ALOGI("Initializing VSYNC Thread");
-    ret = pthread_create(&vsync_thread, NULL, vsync_loop, (void*) ctx);
-    if (ret) {
-        ALOGE("%s: failed to create %s: %s", __FUNCTION__,
-              HWC_VSYNC_THREAD_NAME, strerror(ret));
+    int ret = ctx->mEventLoop->addSource("vsync", fd_timestamp, events,
+            handle_vsync_event, ctx);
+    if (ret < 0) {
+        ALOGE("%s: failed to add vsync source: %s", __FUNCTION__,
+              strerror(-ret));
+        close(fd_timestamp);
     }
 }
 
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host tool for the frame captures of HwcDebug (debug.sf.capture).
+ *
+ *     qcap_extract <capture.qcap> [<output dir>]
+ *
+ * Lists the frames of the capture and the layers of each, with the payload
+ * every layer showed. With an output dir, every payload is also written
+ * there once, as payload<id>.<w>x<h>.fmt<format>.raw, the same contents
+ * a raw layer dump of debug.sf.dump would have.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "qcap_reader.h"
+
+using namespace qhwc;
+
+static bool writePayload(const char *dir, const QcapPayload& payload,
+        const void *data)
+{
+    char fileName[4096];
+    snprintf(fileName, sizeof(fileName), "%s/payload%05u.%dx%d.fmt0x%x.raw",
+            dir, payload.mId, payload.mWidth, payload.mHeight,
+            payload.mFormat);
+    FILE *fp = fopen(fileName, "wb");
+    if(!fp) {
+        fprintf(stderr, "%s: %s\n", fileName, strerror(errno));
+        return false;
+    }
+    bool bResult = (fwrite(data, payload.mSize, 1, fp) == 1);
+    bResult = (fclose(fp) == 0) && bResult;
+    return bResult;
+}
+
+static void printFrame(const QcapFrame& frame, const QcapLayer *layers,
+        const int64_t& startTimestamp)
+{
+    printf("frame %u +%lld.%03lldms layers=%u%s%s\n", frame.mFrame,
+            (long long)((frame.mTimestamp - startTimestamp) / 1000000),
+            (long long)((frame.mTimestamp - startTimestamp) / 1000 % 1000),
+            frame.mNumLayers,
+            (frame.mFlags & QCAP_FRAME_GEOMETRY_CHANGED) ?
+                " [Geometry Changed]" : "",
+            (frame.mFlags & QCAP_FRAME_TRUNCATED) ? " [Truncated]" : "");
+    for(uint32_t i = 0; i < frame.mNumLayers; i++) {
+        const QcapLayer& l = layers[i];
+        printf("  layer %u payload %u fmt 0x%x %dx%d "
+                "crop [%d, %d, %d, %d] frame [%d, %d, %d, %d] comp %u "
+                "transform %u blending 0x%x alpha %u flags 0x%x "
+                "hints 0x%x\n", i, l.mPayloadId, l.mFormat, l.mWidth,
+                l.mHeight, l.mSourceCrop[0], l.mSourceCrop[1],
+                l.mSourceCrop[2], l.mSourceCrop[3], l.mDisplayFrame[0],
+                l.mDisplayFrame[1], l.mDisplayFrame[2], l.mDisplayFrame[3],
+                l.mCompositionType, l.mTransform, l.mBlending,
+                l.mPlaneAlpha, l.mFlags, l.mHints);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <capture.qcap> [<output dir>]\n", argv[0]);
+        return 1;
+    }
+    const char *outDir = (argc == 3) ? argv[2] : NULL;
+
+    QcapReader reader;
+    if(!reader.open(argv[1])) {
+        fprintf(stderr, "%s: %s\n", argv[1], reader.getError());
+        return 1;
+    }
+    const QcapHeader& header = reader.getHeader();
+    printf("display %u, started at %lld.%09llds\n", header.mDpy,
+            (long long)(header.mStartTime / 1000000000LL),
+            (long long)(header.mStartTime % 1000000000LL));
+
+    uint32_t numFrames = 0, numPayloads = 0;
+    uint64_t payloadBytes = 0;
+    int64_t startTimestamp = 0;
+    int ret = 0;
+    while(reader.next()) {
+        if(reader.getType() == QCAP_CHUNK_PAYLOAD) {
+            const QcapPayload& payload = reader.getPayload();
+            numPayloads++;
+            payloadBytes += payload.mSize;
+            if(outDir && !writePayload(outDir, payload,
+                    reader.getPayloadData())) {
+                ret = 1;
+                break;
+            }
+        } else if(reader.getType() == QCAP_CHUNK_FRAME) {
+            const QcapFrame& frame = reader.getFrame();
+            if(!numFrames)
+                startTimestamp = frame.mTimestamp;
+            numFrames++;
+            printFrame(frame, reader.getLayers(), startTimestamp);
+        }
+        //Other chunk types are from newer writers, skipped
+    }
+    if(reader.getError()) {
+        fprintf(stderr, "%s\n", reader.getError());
+        ret = 1;
+    } else if(reader.isTruncated()) {
+        fprintf(stderr, "Incomplete last chunk, ignored\n");
+    }
+
+    printf("%u frames, %u payloads, %llu KB of payloads\n", numFrames,
+            numPayloads, (unsigned long long)(payloadBytes / 1024));
+    return ret;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "qcap_reader.h"
+
+namespace qhwc {
+
+QcapReader::QcapReader() : mFp(NULL), mBody(NULL), mCapacity(0),
+    mTruncated(false) {
+    memset(&mHeader, 0, sizeof(mHeader));
+    memset(&mChunk, 0, sizeof(mChunk));
+    mError[0] = '\0';
+}
+
+QcapReader::~QcapReader()
+{
+    free(mBody);
+    if(mFp)
+        fclose(mFp);
+}
+
+bool QcapReader::open(const char *fileName)
+{
+    mFp = fopen(fileName, "rb");
+    if(!mFp) {
+        snprintf(mError, sizeof(mError), "%s", strerror(errno));
+        return false;
+    }
+    if(fread(&mHeader, sizeof(mHeader), 1, mFp) != 1 ||
+            mHeader.mMagic != QCAP_MAGIC) {
+        snprintf(mError, sizeof(mError), "not a capture");
+        return false;
+    }
+    if(mHeader.mVersion != QCAP_VERSION) {
+        snprintf(mError, sizeof(mError), "version %u, expected %u",
+                mHeader.mVersion, QCAP_VERSION);
+        return false;
+    }
+    return true;
+}
+
+bool QcapReader::next()
+{
+    if(!mFp || mError[0] || fread(&mChunk, sizeof(mChunk), 1, mFp) != 1)
+        return false;
+
+    size_t size = (mChunk.mSize + QCAP_ALIGN - 1) & ~(QCAP_ALIGN - 1);
+    if(size > mCapacity) {
+        free(mBody);
+        mBody = (uint8_t *)malloc(size);
+        mCapacity = mBody ? size : 0;
+        if(!mBody) {
+            snprintf(mError, sizeof(mError),
+                    "Out of memory for a %zu byte chunk", size);
+            return false;
+        }
+    }
+    if(fread(mBody, size, 1, mFp) != 1) {
+        //The writer was stopped mid-chunk
+        mTruncated = true;
+        return false;
+    }
+
+    if(mChunk.mType == QCAP_CHUNK_PAYLOAD) {
+        if(mChunk.mSize < sizeof(QcapPayload)) {
+            snprintf(mError, sizeof(mError), "Short payload chunk");
+            return false;
+        }
+        if(getPayload().mSize > mChunk.mSize - sizeof(QcapPayload)) {
+            snprintf(mError, sizeof(mError), "Payload %u is corrupt",
+                    getPayload().mId);
+            return false;
+        }
+    } else if(mChunk.mType == QCAP_CHUNK_FRAME) {
+        if(mChunk.mSize < sizeof(QcapFrame)) {
+            snprintf(mError, sizeof(mError), "Short frame chunk");
+            return false;
+        }
+        if(getFrame().mNumLayers >
+                (mChunk.mSize - sizeof(QcapFrame)) / sizeof(QcapLayer)) {
+            snprintf(mError, sizeof(mError), "Frame %u is corrupt",
+                    getFrame().mFrame);
+            return false;
+        }
+    }
+    //Other chunk types are from newer writers, for the caller to skip
+    return true;
+}
+
+const QcapPayload& QcapReader::getPayload() const
+{
+    //Chunk bodies are malloc'ed, so aligned for the header structs
+    return *(const QcapPayload *)mBody;
+}
+
+const void *QcapReader::getPayloadData() const
+{
+    return mBody + sizeof(QcapPayload);
+}
+
+const QcapFrame& QcapReader::getFrame() const
+{
+    return *(const QcapFrame *)mBody;
+}
+
+const QcapLayer *QcapReader::getLayers() const
+{
+    return (const QcapLayer *)(mBody + sizeof(QcapFrame));
+}
+
+} // namespace qhwc
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QCAP_READER_H
+#define QCAP_READER_H
+
+#include <stdio.h>
+#include "hwc_capture_format.h"
+
+namespace qhwc {
+
+/*
+ * Reads a frame capture chunk by chunk, checking each against the layout
+ * of hwc_capture_format.h. Shared by qcap_extract and the tests of the
+ * writer, so it builds on the host like the format does.
+ */
+class QcapReader {
+public:
+    QcapReader();
+    ~QcapReader();
+
+    /* Opens a capture and reads its header. False if it can't be read or
+     * isn't a capture of this version, see getError() */
+    bool open(const char *fileName);
+    const QcapHeader& getHeader() const { return mHeader; }
+
+    /* Reads the next chunk. False at the end of the capture or on a
+     * corrupt chunk, see getError() */
+    bool next();
+    uint32_t getType() const { return mChunk.mType; }
+    /* The payload of a QCAP_CHUNK_PAYLOAD and its contents */
+    const QcapPayload& getPayload() const;
+    const void *getPayloadData() const;
+    /* The frame of a QCAP_CHUNK_FRAME and its mNumLayers layers */
+    const QcapFrame& getFrame() const;
+    const QcapLayer *getLayers() const;
+
+    /* Why open() or next() failed, NULL at the clean end of a capture */
+    const char *getError() const { return mError[0] ? mError : NULL; }
+    /* Whether the capture ended mid-chunk, the writer being stopped */
+    bool isTruncated() const { return mTruncated; }
+
+private:
+    FILE *mFp;
+    QcapHeader mHeader;
+    QcapChunk mChunk;
+    uint8_t *mBody;
+    size_t mCapacity;
+    bool mTruncated;
+    char mError[128];
+};
+
+} // namespace qhwc
+
+#endif /* QCAP_READER_H */
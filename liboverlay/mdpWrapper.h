@@ -45,6 +45,30 @@
 namespace overlay{
 
 namespace mdp_wrapper{
+
+/* Backend the wrappers below issue their requests to. Without one they go
+ * to the kernel driver. A software model, like MdpModel in tests/, can be
+ * installed instead to run liboverlay without MDP hardware. The device
+ * nodes liboverlay opens, see openDevice(), are served by the backend too.
+ */
+class Driver {
+public:
+    virtual ~Driver() {}
+    /* Same contract as ioctl(2), errno is set on failure */
+    virtual int ioctl(int fd, unsigned long request, void *arg) = 0;
+    /* Same contracts as open(2) and close(2) */
+    virtual int open(const char* const dev, int flags) = 0;
+    virtual int close(int fd) = 0;
+};
+
+/* Installs a driver backend, NULL restores the kernel driver.
+ * Not to be changed while overlays are in use */
+void setDriver(Driver *driver);
+Driver* getDriver();
+
+/* ioctl(2) routed to the installed backend */
+int mdpIoctl(int fd, unsigned long request, void *arg);
+
 /* FBIOGET_FSCREENINFO */
 bool getFScreenInfo(int fd, fb_fix_screeninfo& finfo);
 
@@ -63,6 +87,11 @@ bool rotate(int fd, msm_rotator_data_info& rot);
 /* MSMFB_OVERLAY_SET */
 bool setOverlay(int fd, mdp_overlay& ov);
 
+#ifdef MSMFB_OVERLAY_PREPARE
+/* MSMFB_OVERLAY_PREPARE */
+bool validateAndSet(int fd, mdp_overlay_list& list);
+#endif
+
 /* MSM_ROTATOR_IOCTL_FINISH */
 bool endRotator(int fd, int sessionId);
 
@@ -99,10 +128,21 @@ void dump(const char* const s, const msm_rotator_data_info& rot);
 void dump(const char* const s, const fb_fix_screeninfo& finfo);
 void dump(const char* const s, const fb_var_screeninfo& vinfo);
 
+/* MSMFB_MIXER_INFO */
+bool getMixerInfo(int fd, msmfb_mixer_info_req& req);
+
 //---------------Inlines -------------------------------------
 
+inline int mdpIoctl(int fd, unsigned long request, void *arg) {
+    Driver *driver = getDriver();
+    if(driver) {
+        return driver->ioctl(fd, request, arg);
+    }
+    return ::ioctl(fd, request, arg);
+}
+
 inline bool getFScreenInfo(int fd, fb_fix_screeninfo& finfo) {
-    if (ioctl(fd, FBIOGET_FSCREENINFO, &finfo) < 0) {
+    if (mdpIoctl(fd, FBIOGET_FSCREENINFO, &finfo) < 0) {
         ALOGE("Failed to call ioctl FBIOGET_FSCREENINFO err=%s",
                 strerror(errno));
         return false;
@@ -111,7 +151,7 @@ inline bool getFScreenInfo(int fd, fb_fix_screeninfo& finfo) {
 }
 
 inline bool getVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
-    if (ioctl(fd, FBIOGET_VSCREENINFO, &vinfo) < 0) {
+    if (mdpIoctl(fd, FBIOGET_VSCREENINFO, &vinfo) < 0) {
         ALOGE("Failed to call ioctl FBIOGET_VSCREENINFO err=%s",
                 strerror(errno));
         return false;
@@ -120,7 +160,7 @@ inline bool getVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
 }
 
 inline bool setVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
-    if (ioctl(fd, FBIOPUT_VSCREENINFO, &vinfo) < 0) {
+    if (mdpIoctl(fd, FBIOPUT_VSCREENINFO, &vinfo) < 0) {
         ALOGE("Failed to call ioctl FBIOPUT_VSCREENINFO err=%s",
                 strerror(errno));
         return false;
@@ -129,7 +169,7 @@ inline bool setVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
 }
 
 inline bool startRotator(int fd, msm_rotator_img_info& rot) {
-    if (ioctl(fd, MSM_ROTATOR_IOCTL_START, &rot) < 0){
+    if (mdpIoctl(fd, MSM_ROTATOR_IOCTL_START, &rot) < 0){
         ALOGE("Failed to call ioctl MSM_ROTATOR_IOCTL_START err=%s",
                 strerror(errno));
         return false;
@@ -138,7 +178,7 @@ inline bool startRotator(int fd, msm_rotator_img_info& rot) {
 }
 
 inline bool rotate(int fd, msm_rotator_data_info& rot) {
-    if (ioctl(fd, MSM_ROTATOR_IOCTL_ROTATE, &rot) < 0) {
+    if (mdpIoctl(fd, MSM_ROTATOR_IOCTL_ROTATE, &rot) < 0) {
         ALOGE("Failed to call ioctl MSM_ROTATOR_IOCTL_ROTATE err=%s",
                 strerror(errno));
         return false;
@@ -147,7 +187,7 @@ inline bool rotate(int fd, msm_rotator_data_info& rot) {
 }
 
 inline bool setOverlay(int fd, mdp_overlay& ov) {
-    if (ioctl(fd, MSMFB_OVERLAY_SET, &ov) < 0) {
+    if (mdpIoctl(fd, MSMFB_OVERLAY_SET, &ov) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_SET err=%s",
                 strerror(errno));
         return false;
@@ -155,8 +195,20 @@ inline bool setOverlay(int fd, mdp_overlay& ov) {
     return true;
 }
 
+#ifdef MSMFB_OVERLAY_PREPARE
+inline bool validateAndSet(int fd, mdp_overlay_list& list) {
+    if (mdpIoctl(fd, MSMFB_OVERLAY_PREPARE, &list) < 0) {
+        ALOGE("Failed to call ioctl MSMFB_OVERLAY_PREPARE err=%s "
+                "processed=%d of %d", strerror(errno),
+                list.processed_overlays, list.num_overlays);
+        return false;
+    }
+    return true;
+}
+#endif
+
 inline bool endRotator(int fd, uint32_t sessionId) {
-    if (ioctl(fd, MSM_ROTATOR_IOCTL_FINISH, &sessionId) < 0) {
+    if (mdpIoctl(fd, MSM_ROTATOR_IOCTL_FINISH, &sessionId) < 0) {
         ALOGE("Failed to call ioctl MSM_ROTATOR_IOCTL_FINISH err=%s",
                 strerror(errno));
         return false;
@@ -165,7 +217,7 @@ inline bool endRotator(int fd, uint32_t sessionId) {
 }
 
 inline bool unsetOverlay(int fd, int ovId) {
-    if (ioctl(fd, MSMFB_OVERLAY_UNSET, &ovId) < 0) {
+    if (mdpIoctl(fd, MSMFB_OVERLAY_UNSET, &ovId) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_UNSET err=%s",
                 strerror(errno));
         return false;
@@ -174,7 +226,7 @@ inline bool unsetOverlay(int fd, int ovId) {
 }
 
 inline bool getOverlay(int fd, mdp_overlay& ov) {
-    if (ioctl(fd, MSMFB_OVERLAY_GET, &ov) < 0) {
+    if (mdpIoctl(fd, MSMFB_OVERLAY_GET, &ov) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_GET err=%s",
                 strerror(errno));
         return false;
@@ -183,7 +235,7 @@ inline bool getOverlay(int fd, mdp_overlay& ov) {
 }
 
 inline bool play(int fd, msmfb_overlay_data& od) {
-    if (ioctl(fd, MSMFB_OVERLAY_PLAY, &od) < 0) {
+    if (mdpIoctl(fd, MSMFB_OVERLAY_PLAY, &od) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_PLAY err=%s",
                 strerror(errno));
         return false;
@@ -192,7 +244,7 @@ inline bool play(int fd, msmfb_overlay_data& od) {
 }
 
 inline bool set3D(int fd, msmfb_overlay_3d& ov) {
-    if (ioctl(fd, MSMFB_OVERLAY_3D, &ov) < 0) {
+    if (mdpIoctl(fd, MSMFB_OVERLAY_3D, &ov) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_3D err=%s",
                 strerror(errno));
         return false;
@@ -201,7 +253,7 @@ inline bool set3D(int fd, msmfb_overlay_3d& ov) {
 }
 
 inline bool displayCommit(int fd, mdp_display_commit& info) {
-    if(ioctl(fd, MSMFB_DISPLAY_COMMIT, &info) == -1) {
+    if(mdpIoctl(fd, MSMFB_DISPLAY_COMMIT, &info) == -1) {
         ALOGE("Failed to call ioctl MSMFB_DISPLAY_COMMIT err=%s",
                 strerror(errno));
         return false;
@@ -209,6 +261,15 @@ inline bool displayCommit(int fd, mdp_display_commit& info) {
     return true;
 }
 
+inline bool getMixerInfo(int fd, msmfb_mixer_info_req& req) {
+    if (mdpIoctl(fd, MSMFB_MIXER_INFO, &req) < 0) {
+        ALOGE("Failed to call ioctl MSMFB_MIXER_INFO err=%s",
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
 /* dump funcs */
 inline void dump(const char* const s, const msmfb_overlay_data& ov) {
     ALOGE("%s msmfb_overlay_data id=%d",
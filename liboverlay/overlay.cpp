@@ -42,6 +42,10 @@ Overlay::Overlay() {
     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
         mPipeBook[i].init();
     }
+    for(int i = 0; i < DPY_MAX; i++) {
+        mInFrame[i] = false;
+    }
+    memset(&mAffinityStats, 0, sizeof(mAffinityStats));
 
     mDumpStr[0] = '\0';
 }
@@ -81,43 +85,61 @@ void Overlay::configDone() {
     PipeBook::save();
 }
 
-eDest Overlay::nextPipe(eMdpPipeType type, int dpy) {
+int Overlay::getPipeScore(int index, eMdpPipeType type, int dpy,
+        uint32_t layerKey) {
+    //Match requested pipe type
+    if(type != OV_MDP_PIPE_ANY && type != PipeBook::getPipeType((eDest)index))
+        return -1;
+    if(PipeBook::isAllocated(index))
+        return -1;
+
+    //Check if the pipe is used by the requested display
+    //already in previous round.
+    if(mPipeBook[index].mDisplay == dpy) {
+        //Served this very layer
+        if(layerKey && mPipeBook[index].mLayerKey == layerKey)
+            return 4;
+        //Served no particular layer, nobody else will ask for it
+        if(mPipeBook[index].mLayerKey == 0)
+            return 3;
+        //Its layer may still ask for it later in this round, which an
+        //unused pipe spares
+        return 1;
+    }
+
+    //Check if the pipe is not allocated to any display
+    if(mPipeBook[index].mDisplay == DPY_UNUSED)
+        return 2;
+
+    return -1;
+}
+
+eDest Overlay::nextPipe(eMdpPipeType type, int dpy, uint32_t layerKey) {
     eDest dest = OV_INVALID;
+    int bestScore = -1;
 
     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
-        //Match requested pipe type
-        if(type == OV_MDP_PIPE_ANY || type == PipeBook::getPipeType((eDest)i)) {
-            //Check if the pipe is used by the requested display
-            //already in previous round.
-            if(mPipeBook[i].mDisplay == dpy &&
-                    PipeBook::isNotAllocated(i)) {
-                dest = (eDest)i;
-                PipeBook::setAllocation(i);
-                break;
-            }
+        int score = getPipeScore(i, type, dpy, layerKey);
+        if(score > bestScore) {
+            bestScore = score;
+            dest = (eDest)i;
         }
     }
 
-    if(dest == OV_INVALID) {
-        for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
-            //Match requested pipe type
-            if(type == OV_MDP_PIPE_ANY || type == PipeBook::getPipeType((eDest)i)) {
-                //Check if the pipe is not allocated to any display
-                if(mPipeBook[i].mDisplay == DPY_UNUSED &&
-                   PipeBook::isNotAllocated(i)) {
-                    dest = (eDest)i;
-                    PipeBook::setAllocation(i);
-                    break;
-                }
-            }
-        }
+    if(layerKey && dest != OV_INVALID) {
+        if(bestScore == 4)
+            mAffinityStats.mHits++;
+        else
+            mAffinityStats.mMisses++;
     }
 
     if(dest != OV_INVALID) {
         int index = (int)dest;
+        PipeBook::setAllocation(index);
         //If the pipe is not registered with any display OR if the pipe is
         //requested again by the same display using it, then go ahead.
         mPipeBook[index].mDisplay = dpy;
+        mPipeBook[index].mLayerKey = layerKey;
         if(not mPipeBook[index].valid()) {
             mPipeBook[index].mPipe = new GenericPipe(dpy);
             char str[32];
@@ -133,14 +155,30 @@ eDest Overlay::nextPipe(eMdpPipeType type, int dpy) {
     return dest;
 }
 
+void Overlay::updateSetStats(int index, uint32_t setCountBefore) {
+    if(mPipeBook[index].mPipe->getSetCount() == setCountBefore)
+        mAffinityStats.mSetsSkipped++;
+    else
+        mAffinityStats.mSetsIssued++;
+}
+
 bool Overlay::commit(utils::eDest dest) {
     bool ret = false;
     int index = (int)dest;
     validate(index);
 
+    if(mInFrame[mPipeBook[index].mDisplay]) {
+        //Set at commitFrame()
+        mPipeBook[index].mCommitPending = true;
+        PipeBook::setUse(index);
+        return true;
+    }
+
+    uint32_t setCount = mPipeBook[index].mPipe->getSetCount();
     if(mPipeBook[index].mPipe->commit()) {
         ret = true;
         PipeBook::setUse((int)dest);
+        updateSetStats(index, setCount);
     } else {
         int dpy = mPipeBook[index].mDisplay;
         for(int i = 0; i < PipeBook::NUM_PIPES; i++)
@@ -162,11 +200,83 @@ bool Overlay::queueBuffer(int fd, uint32_t offset,
     validate(index);
     //Queue only if commit() has succeeded (and the bit set)
     if(PipeBook::isUsed((int)dest)) {
+        if(mInFrame[mPipeBook[index].mDisplay]) {
+            //Played at commitFrame()
+            mPipeBook[index].mPlayPending = true;
+            mPipeBook[index].mPlayFd = fd;
+            mPipeBook[index].mPlayOffset = offset;
+            return true;
+        }
         ret = mPipeBook[index].mPipe->queueBuffer(fd, offset);
     }
     return ret;
 }
 
+void Overlay::beginFrame(int dpy) {
+    OVASSERT(dpy >= 0 && dpy < DPY_MAX, "Invalid dpy %d", dpy);
+    mInFrame[dpy] = true;
+}
+
+bool Overlay::commitFrame(int dpy, bool *status) {
+    OVASSERT(dpy >= 0 && dpy < DPY_MAX, "Invalid dpy %d", dpy);
+    GenericPipe* pipeArray[OV_MAX];
+    bool result[OV_MAX];
+    int pipeIndex[OV_MAX];
+    uint32_t setCount[OV_MAX];
+    int num = 0;
+    bool ret = true;
+
+    mInFrame[dpy] = false;
+    if(status) {
+        for(int i = 0; i < OV_MAX; i++)
+            status[i] = true;
+    }
+
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay == dpy && mPipeBook[i].mCommitPending) {
+            mPipeBook[i].mCommitPending = false;
+            if(mPipeBook[i].valid() && PipeBook::isUsed(i)) {
+                pipeArray[num] = mPipeBook[i].mPipe;
+                pipeIndex[num] = i;
+                setCount[num] = mPipeBook[i].mPipe->getSetCount();
+                num++;
+            }
+        }
+    }
+
+    if(num && !GenericPipe::validateAndSet(pipeArray, num, result)) {
+        ret = false;
+    }
+    for(int j = 0; j < num; j++) {
+        if(result[j]) {
+            updateSetStats(pipeIndex[j], setCount[j]);
+        } else {
+            int i = pipeIndex[j];
+            ALOGE("%s: set failed pipe=%s dpy=%d", __FUNCTION__,
+                    PipeBook::getDestStr((eDest)i), dpy);
+            PipeBook::resetUse(i);
+            mPipeBook[i].mPipe->forceSet();
+            if(status)
+                status[i] = false;
+        }
+    }
+
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay == dpy && mPipeBook[i].mPlayPending) {
+            mPipeBook[i].mPlayPending = false;
+            //Skips the pipes whose set failed above
+            if(PipeBook::isNotUsed(i) || not mPipeBook[i].valid() ||
+                    !mPipeBook[i].mPipe->queueBuffer(mPipeBook[i].mPlayFd,
+                    mPipeBook[i].mPlayOffset)) {
+                ret = false;
+                if(status)
+                    status[i] = false;
+            }
+        }
+    }
+    return ret;
+}
+
 void Overlay::setCrop(const utils::Dim& d,
         utils::eDest dest) {
     int index = (int)dest;
@@ -213,6 +323,13 @@ void Overlay::setSource(const utils::PipeArgs args,
     mPipeBook[index].mPipe->setSource(newArgs);
 }
 
+void Overlay::setDecimation(const int& horz, const int& vert,
+        utils::eDest dest) {
+    int index = (int)dest;
+    validate(index);
+    mPipeBook[index].mPipe->setDecimation(horz, vert);
+}
+
 void Overlay::setVisualParams(const MetaData_t& metadata, utils::eDest dest) {
     int index = (int)dest;
     validate(index);
@@ -254,16 +371,16 @@ int Overlay::initOverlay() {
         for(int i = 0; i < MAX_FB_DEVICES; i++) {
             snprintf(name, 64, FB_DEVICE_TEMPLATE, i);
             ALOGD("initoverlay:: opening the device:: %s", name);
-            fd = ::open(name, O_RDWR, 0);
+            fd = mdp_wrapper::openDevice(name, O_RDWR);
             if(fd < 0) {
                 ALOGE("cannot open framebuffer(%d)", i);
                 return -1;
             }
             //Get the mixer configuration */
             req.mixer_num = i;
-            if (ioctl(fd, MSMFB_MIXER_INFO, &req) == -1) {
+            if (!mdp_wrapper::getMixerInfo(fd, req)) {
                 ALOGE("ERROR: MSMFB_MIXER_INFO ioctl failed");
-                close(fd);
+                mdp_wrapper::closeDevice(fd);
                 return -1;
             }
             minfo = req.info;
@@ -273,19 +390,19 @@ int Overlay::initOverlay() {
                 // clear any pipe connected to mixer including base pipe.
                 int index = minfo->pndx;
                 ALOGD("Unset overlay with index: %d at mixer %d", index, i);
-                if(ioctl(fd, MSMFB_OVERLAY_UNSET, &index) == -1) {
+                if(!mdp_wrapper::unsetOverlay(fd, index)) {
                     ALOGE("ERROR: MSMFB_OVERLAY_UNSET failed");
-                    close(fd);
+                    mdp_wrapper::closeDevice(fd);
                     return -1;
                 }
                 minfo++;
             }
-            close(fd);
+            mdp_wrapper::closeDevice(fd);
             fd = -1;
         }
     }
 
-    FILE *displayDeviceFP = NULL;
+    int displayDeviceFd = -1;
     const int MAX_FRAME_BUFFER_NAME_SIZE = 128;
     char fbType[MAX_FRAME_BUFFER_NAME_SIZE];
     char msmFbTypePath[MAX_FRAME_BUFFER_NAME_SIZE];
@@ -295,11 +412,12 @@ int Overlay::initOverlay() {
     for(int num = 1; num < MAX_FB_DEVICES; num++) {
         snprintf (msmFbTypePath, sizeof(msmFbTypePath),
                 "/sys/class/graphics/fb%d/msm_fb_type", num);
-        displayDeviceFP = fopen(msmFbTypePath, "r");
+        //Through the driver backend, like the fb nodes themselves
+        displayDeviceFd = mdp_wrapper::openDevice(msmFbTypePath, O_RDONLY);
 
-        if(displayDeviceFP){
-            fread(fbType, sizeof(char), MAX_FRAME_BUFFER_NAME_SIZE,
-                    displayDeviceFP);
+        if(displayDeviceFd >= 0) {
+            memset(fbType, 0, sizeof(fbType));
+            read(displayDeviceFd, fbType, MAX_FRAME_BUFFER_NAME_SIZE - 1);
 
             if(strncmp(fbType, strDtvPanel, strlen(strDtvPanel)) == 0) {
                 sDpyFbMap[DPY_EXTERNAL] = num;
@@ -307,7 +425,7 @@ int Overlay::initOverlay() {
                 sDpyFbMap[DPY_WRITEBACK] = num;
             }
 
-            fclose(displayDeviceFP);
+            mdp_wrapper::closeDevice(displayDeviceFd);
         }
     }
 
@@ -349,14 +467,25 @@ void Overlay::getDump(char *buf, size_t len) {
     char str_pipes[64] = {'\0'};
     snprintf(str_pipes, 64, "Pipes used=%d\n\n", totalPipes);
     strncat(buf, str_pipes, strlen(str_pipes));
+    char str_stats[128] = {'\0'};
+    snprintf(str_stats, 128, "Pipe affinity hits=%u misses=%u, "
+            "sets skipped=%u issued=%u\n\n", mAffinityStats.mHits,
+            mAffinityStats.mMisses, mAffinityStats.mSetsSkipped,
+            mAffinityStats.mSetsIssued);
+    strncat(buf, str_stats, strlen(str_stats));
 }
 
 void Overlay::clear(int dpy) {
+    //Drops a frame transaction in progress, later commits are immediate
+    if(dpy >= 0 && dpy < DPY_MAX)
+        mInFrame[dpy] = false;
     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
         if (mPipeBook[i].mDisplay == dpy) {
             // Mark as available for this round
             PipeBook::resetUse(i);
             PipeBook::resetAllocation(i);
+            mPipeBook[i].mCommitPending = false;
+            mPipeBook[i].mPlayPending = false;
             if(mPipeBook[i].valid()) {
                 mPipeBook[i].mPipe->forceSet();
             }
@@ -367,6 +496,11 @@ void Overlay::clear(int dpy) {
 void Overlay::PipeBook::init() {
     mPipe = NULL;
     mDisplay = DPY_UNUSED;
+    mLayerKey = 0;
+    mCommitPending = false;
+    mPlayPending = false;
+    mPlayFd = -1;
+    mPlayOffset = 0;
 }
 
 void Overlay::PipeBook::destroy() {
@@ -375,6 +509,9 @@ void Overlay::PipeBook::destroy() {
         mPipe = NULL;
     }
     mDisplay = DPY_UNUSED;
+    mLayerKey = 0;
+    mCommitPending = false;
+    mPlayPending = false;
 }
 
 Overlay* Overlay::sInstance = 0;
@@ -66,23 +66,50 @@ public:
      * is requested, the first available VG or RGB is returned. If no pipe is
      * available for the display "dpy" then INV is returned. Note: If a pipe is
      * assigned to a certain display, then it cannot be assigned to another
-     * display without being garbage-collected once */
-    utils::eDest nextPipe(utils::eMdpPipeType, int dpy);
+     * display without being garbage-collected once.
+     * layerKey identifies the layer the pipe is for, 0 if unknown. The pipe
+     * that served the same key in the previous round is handed back when
+     * possible, so that its config is unchanged and the set is skipped */
+    utils::eDest nextPipe(utils::eMdpPipeType, int dpy,
+            uint32_t layerKey = 0);
 
     void setSource(const utils::PipeArgs args, utils::eDest dest);
     void setCrop(const utils::Dim& d, utils::eDest dest);
     void setTransform(const int orientation, utils::eDest dest);
     void setPosition(const utils::Dim& dim, utils::eDest dest);
     void setVisualParams(const MetaData_t& data, utils::eDest dest);
+    /* log2 of the horizontal and vertical pipe decimation */
+    void setDecimation(const int& horz, const int& vert, utils::eDest dest);
     bool commit(utils::eDest dest);
     bool queueBuffer(int fd, uint32_t offset, utils::eDest dest);
 
+    /* Frame transaction for a display. Between beginFrame() and
+     * commitFrame() the commit() and queueBuffer() calls on pipes of "dpy"
+     * are only recorded and report success. commitFrame() sets all the
+     * recorded pipes in a single batch (a set per pipe on kernels without
+     * MSMFB_OVERLAY_PREPARE) and then plays the recorded buffers of the pipes
+     * that were set. A failed pipe is released at the next configDone(), the
+     * other pipes of the display are left alone. clear() on the display
+     * abandons the frame and what was recorded in it.
+     * If status is not NULL it must hold utils::OV_MAX entries and receives
+     * the result of each pipe, indexed by eDest. Returns true if all the
+     * recorded operations succeeded.
+     */
+    void beginFrame(int dpy);
+    bool commitFrame(int dpy, bool *status = NULL);
+
     /* Closes open pipes, called during startup */
     static int initOverlay();
     /* Returns the singleton instance of overlay */
     static Overlay* getInstance();
     /* Returns available ("unallocated") pipes for a display */
     int availablePipes(int dpy);
+    /* Returns available pipes of a type for a display */
+    int availablePipes(int dpy, utils::eMdpPipeType type);
+    /* Returns the pipes held by a display */
+    int pipesInUse(int dpy);
+    /* Returns the number of pipes MDP has */
+    static int getNumPipes();
     /* Returns pipe dump. Expects a NULL terminated buffer of big enough size
      * to populate.
      */
@@ -111,6 +138,13 @@ private:
         GenericPipe *mPipe;
         /* Display using this pipe. Refer to enums above */
         int mDisplay;
+        /* Key of the layer last served by this pipe, 0 if none */
+        uint32_t mLayerKey;
+        /* Operations recorded during a frame transaction */
+        bool mCommitPending;
+        bool mPlayPending;
+        int mPlayFd;
+        uint32_t mPlayOffset;
 
         /* operations on bitmap */
         static bool pipeUsageUnchanged();
@@ -148,6 +182,27 @@ private:
 
     PipeBook mPipeBook[utils::OV_INVALID]; //Used as max
 
+    /* Displays with an open frame transaction */
+    bool mInFrame[DPY_MAX];
+
+    /* Scores a pipe for a nextPipe() request, -1 if it cannot be used */
+    int getPipeScore(int index, utils::eMdpPipeType type, int dpy,
+            uint32_t layerKey);
+    /* Counts the set issued or skipped by a commit of the pipe */
+    void updateSetStats(int index, uint32_t setCountBefore);
+
+    /* Pipe affinity stats since boot */
+    struct AffinityStats {
+        /* Keyed requests that got the pipe of the previous round */
+        uint32_t mHits;
+        /* Keyed requests that had to take another pipe */
+        uint32_t mMisses;
+        /* Commits that found the config unchanged and skipped the set */
+        uint32_t mSetsSkipped;
+        /* Commits that issued a set */
+        uint32_t mSetsIssued;
+    } mAffinityStats;
+
     /* Dump string */
     char mDumpStr[256];
 
@@ -174,6 +229,33 @@ inline int Overlay::availablePipes(int dpy) {
     return avail;
 }
 
+inline int Overlay::availablePipes(int dpy, utils::eMdpPipeType type) {
+     int avail = 0;
+     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+       if(type != utils::OV_MDP_PIPE_ANY &&
+               type != PipeBook::getPipeType((utils::eDest)i))
+           continue;
+       if((mPipeBook[i].mDisplay == DPY_UNUSED ||
+           mPipeBook[i].mDisplay == dpy) && PipeBook::isNotAllocated(i)) {
+                avail++;
+        }
+    }
+    return avail;
+}
+
+inline int Overlay::pipesInUse(int dpy) {
+    int inUse = 0;
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay == dpy)
+            inUse++;
+    }
+    return inUse;
+}
+
+inline int Overlay::getNumPipes() {
+    return PipeBook::NUM_PIPES;
+}
+
 inline int Overlay::getFbForDpy(const int& dpy) {
     OVASSERT(dpy >= 0 && dpy < DPY_MAX, "Invalid dpy %d", dpy);
     return sDpyFbMap[dpy];
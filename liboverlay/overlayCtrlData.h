@@ -67,8 +67,16 @@ public:
     void setPosition(const utils::Dim& dim);
     /* set mdp visual params using metadata */
     bool setVisualParams(const MetaData_t &metadata);
+    /* set log2 of the mdp pipe decimation */
+    void setDecimation(const int& horz, const int& vert);
     /* mdp set overlay/commit changes */
     bool commit();
+    /* deferred calcs of commit, true if the mdp needs a set */
+    bool prepareCommit();
+    /* underlying mdp ctrl, used for batched sets */
+    MdpCtrl* getMdpCtrl();
+    /* number of overlay sets issued */
+    uint32_t getSetCount() const;
 
     /* ctrl id */
     int  getPipeId() const;
@@ -174,6 +182,11 @@ inline void Ctrl::setCrop(const utils::Dim& d)
     mMdp.setCrop(d);
 }
 
+inline void Ctrl::setDecimation(const int& horz, const int& vert)
+{
+    mMdp.setDecimation(horz, vert);
+}
+
 inline bool Ctrl::setVisualParams(const MetaData_t &metadata)
 {
     if (!mMdp.setVisualParams(metadata)) {
@@ -197,6 +210,18 @@ inline bool Ctrl::commit() {
     return true;
 }
 
+inline bool Ctrl::prepareCommit() {
+    return mMdp.prepareSet();
+}
+
+inline MdpCtrl* Ctrl::getMdpCtrl() {
+    return &mMdp;
+}
+
+inline uint32_t Ctrl::getSetCount() const {
+    return mMdp.getSetCount();
+}
+
 inline int Ctrl::getPipeId() const {
     return mMdp.getPipeId();
 }
@@ -61,6 +61,9 @@ void MdpCtrl::reset() {
     mOrientation = utils::OVERLAY_TRANSFORM_0;
     mDownscale = 0;
     mForceSet = false;
+    mSetCount = 0;
+    mDirty = DIRTY_NONE;
+    memset(mDirtyCount, 0, sizeof(mDirtyCount));
 #ifdef USES_POST_PROCESSING
     mPPChanged = false;
     memset(&mParams, 0, sizeof(struct compute_params));
@@ -106,6 +109,8 @@ void MdpCtrl::setSource(const utils::PipeArgs& args) {
     setIsFg(args.isFg);
     setPlaneAlpha(args.planeAlpha);
     setBlending(args.blending);
+    //Pipes are reused across layers, decimation is set per config
+    setDecimation(0, 0);
 }
 
 void MdpCtrl::setCrop(const utils::Dim& d) {
@@ -141,6 +146,12 @@ void MdpCtrl::doDownscale() {
 }
 
 bool MdpCtrl::set() {
+    if(!prepareSet())
+        return true;
+    return doSet();
+}
+
+bool MdpCtrl::prepareSet() {
     //deferred calcs, so APIs could be called in any order.
     doTransform();
     doDownscale();
@@ -152,22 +163,111 @@ bool MdpCtrl::set() {
         utils::even_floor(mOVInfo.dst_rect.h);
     }
 
-    if(this->ovChanged() || mForceSet) {
-        mForceSet = false;
-        if(!mdp_wrapper::setOverlay(mFd.getFD(), mOVInfo)) {
-            ALOGE("MdpCtrl failed to setOverlay, restoring last known "
-                  "good ov info");
-            mdp_wrapper::dump("== Bad OVInfo is: ", mOVInfo);
-            mdp_wrapper::dump("== Last good known OVInfo is: ", mLkgo);
-            this->restore();
-            return false;
-        }
-        this->save();
+    updateDirty();
+    return (this->ovChanged() || mForceSet);
+}
+
+void MdpCtrl::updateDirty() {
+    mDirty = DIRTY_NONE;
+    if(::memcmp(&mOVInfo.src, &mLkgo.src, sizeof(mOVInfo.src)))
+        mDirty |= DIRTY_SRC;
+    if(::memcmp(&mOVInfo.src_rect, &mLkgo.src_rect, sizeof(mdp_rect)))
+        mDirty |= DIRTY_CROP;
+    if(::memcmp(&mOVInfo.dst_rect, &mLkgo.dst_rect, sizeof(mdp_rect)))
+        mDirty |= DIRTY_DST;
+    if(mOVInfo.flags != mLkgo.flags ||
+            mOVInfo.user_data[0] != mLkgo.user_data[0] ||
+            mOVInfo.blend_op != mLkgo.blend_op ||
+            mOVInfo.alpha != mLkgo.alpha ||
+            mOVInfo.is_fg != mLkgo.is_fg ||
+            mOVInfo.transp_mask != mLkgo.transp_mask)
+        mDirty |= DIRTY_FLAGS;
+    if(mOVInfo.z_order != mLkgo.z_order)
+        mDirty |= DIRTY_Z;
+#ifdef USES_POST_PROCESSING
+    // Some pp params are stored as pointer address,
+    // so can't compare their content directly.
+    if(mPPChanged)
+        mDirty |= DIRTY_PP;
+#endif
+    //Anything else, like the id of a new session
+    if(mDirty == DIRTY_NONE &&
+            ::memcmp(&mOVInfo, &mLkgo, sizeof(mdp_overlay)))
+        mDirty |= DIRTY_OTHER;
+}
+
+void MdpCtrl::commitDirty() {
+    for(int i = 0; i < DIRTY_FIELD_COUNT; i++) {
+        if(mDirty & (1 << i))
+            mDirtyCount[i]++;
     }
+    mDirty = DIRTY_NONE;
+#ifdef USES_POST_PROCESSING
+    mPPChanged = false;
+#endif
+}
 
+bool MdpCtrl::doSet() {
+    mForceSet = false;
+    mSetCount++;
+    if(!mdp_wrapper::setOverlay(mFd.getFD(), mOVInfo)) {
+        ALOGE("MdpCtrl failed to setOverlay, restoring last known "
+              "good ov info");
+        mdp_wrapper::dump("== Bad OVInfo is: ", mOVInfo);
+        mdp_wrapper::dump("== Last good known OVInfo is: ", mLkgo);
+        this->restore();
+        return false;
+    }
+    this->save();
+    this->commitDirty();
     return true;
 }
 
+bool MdpCtrl::validateAndSet(MdpCtrl* mdpCtrlArray[], const int& count,
+        bool result[]) {
+    if(count <= 0)
+        return true;
+
+    //A lone change gains nothing from list validation
+    if(count == 1) {
+        result[0] = mdpCtrlArray[0]->doSet();
+        return result[0];
+    }
+
+#ifdef MSMFB_OVERLAY_PREPARE
+    mdp_overlay* ovArray[utils::OV_MAX];
+    for(int i = 0; i < count; i++) {
+        ovArray[i] = &mdpCtrlArray[i]->mOVInfo;
+    }
+
+    mdp_overlay_list list;
+    memset(&list, 0, sizeof(struct mdp_overlay_list));
+    list.num_overlays = count;
+    list.overlay_list = ovArray;
+
+    //All the ctrls of a display are opened on the same fb node
+    if(mdp_wrapper::validateAndSet(mdpCtrlArray[0]->getFd(), list)) {
+        for(int i = 0; i < count; i++) {
+            mdpCtrlArray[i]->mForceSet = false;
+            mdpCtrlArray[i]->mSetCount++;
+            mdpCtrlArray[i]->save();
+            mdpCtrlArray[i]->commitDirty();
+            result[i] = true;
+        }
+        return true;
+    }
+    ALOGD_IF(DEBUG_OVERLAY, "%s: batch rejected, falling back to a set per "
+            "pipe", __FUNCTION__);
+#endif
+
+    bool ret = true;
+    for(int i = 0; i < count; i++) {
+        result[i] = mdpCtrlArray[i]->doSet();
+        ret = ret && result[i];
+    }
+    return ret;
+}
+
 bool MdpCtrl::get() {
     mdp_overlay ov;
     ov.id = mOVInfo.id;
@@ -195,6 +295,12 @@ void MdpCtrl::dump() const {
 
 void MdpCtrl::getDump(char *buf, size_t len) {
     ovutils::getDump(buf, len, "Ctrl(mdp_overlay)", mOVInfo);
+    char str[256] = {'\0'};
+    snprintf(str, 256, "Ctrl changes src=%u crop=%u dst=%u flags=%u z=%u "
+            "pp=%u other=%u\n", mDirtyCount[0], mDirtyCount[1],
+            mDirtyCount[2], mDirtyCount[3], mDirtyCount[4], mDirtyCount[5],
+            mDirtyCount[6]);
+    strncat(buf, str, strlen(str));
 }
 
 void MdpData::dump() const {
@@ -35,6 +35,19 @@ namespace overlay{
 * */
 class MdpCtrl {
 public:
+    /* Fields of the ov info that differ from the last known good one */
+    enum eDirtyField {
+        DIRTY_NONE  = 0,
+        DIRTY_SRC   = 1 << 0, //source width, height, format
+        DIRTY_CROP  = 1 << 1,
+        DIRTY_DST   = 1 << 2,
+        DIRTY_FLAGS = 1 << 3, //flags, orientation, blending, alpha
+        DIRTY_Z     = 1 << 4,
+        DIRTY_PP    = 1 << 5,
+        DIRTY_OTHER = 1 << 6,
+    };
+    enum { DIRTY_FIELD_COUNT = 7 };
+
     /* ctor reset */
     explicit MdpCtrl();
     /* dtor close */
@@ -50,6 +63,19 @@ public:
      * Only if it is different, set would actually exectue ioctl.
      * On a sucess ioctl. last good known ov instance is updated */
     bool set();
+    /* Performs the deferred calculations of set(). Returns true if the
+     * overlay changed and needs to be set on the driver. Must be called once
+     * per commit, followed by doSet() or a batched validateAndSet() */
+    bool prepareSet();
+    /* Issues the overlay set for a prepared ov info */
+    bool doSet();
+    /* Sets the prepared ov info of all the ctrls in a single
+     * MSMFB_OVERLAY_PREPARE. Falls back to a set per ctrl if the kernel
+     * lacks it or rejects the list. result[i] holds the status of ctrl i */
+    static bool validateAndSet(MdpCtrl* mdpCtrlArray[], const int& count,
+            bool result[]);
+    /* Number of overlay sets issued to the driver */
+    uint32_t getSetCount() const;
     /* Sets the source total width, height, format */
     void setSource(const utils::PipeArgs& pargs);
     /*
@@ -64,6 +90,9 @@ public:
     void setRotationFlags();
     /* Performs downscale calculations */
     void setDownscale(int dscale_factor);
+    /* Sets log2 of the pipe decimation, the crop stays undecimated.
+     * Ignored if the kernel has no decimation */
+    void setDecimation(const int& horz, const int& vert);
     /* Update the src format with rotator's dest*/
     void updateSrcFormat(const uint32_t& rotDstFormat);
     /* dump state of the object */
@@ -118,6 +147,10 @@ private:
     /* return true if current overlay is different
      * than last known good overlay */
     bool ovChanged() const;
+    /* compares mOVInfo with mLkgo field by field into mDirty */
+    void updateDirty();
+    /* counts the dirty fields of a successful set and clears them */
+    void commitDirty();
     /* save mOVInfo to be last known good ov*/
     void save();
     /* restore last known good ov to be the current */
@@ -132,6 +165,10 @@ private:
     OvFD          mFd;
     int mDownscale;
     bool mForceSet;
+    uint32_t mSetCount;
+    uint32_t mDirty;
+    /* Number of sets each eDirtyField was part of */
+    uint32_t mDirtyCount[DIRTY_FIELD_COUNT];
 
 #ifdef USES_POST_PROCESSING
     /* PP Compute Params */
@@ -246,6 +283,13 @@ inline void MdpCtrl::setDownscale(int dscale) {
     mDownscale = dscale;
 }
 
+inline void MdpCtrl::setDecimation(const int& horz, const int& vert) {
+#ifdef MDP_DECIMATION_EN
+    mOVInfo.horz_deci = horz;
+    mOVInfo.vert_deci = vert;
+#endif
+}
+
 inline void MdpCtrl::setPlaneAlpha(int planeAlpha) {
     mOVInfo.alpha = planeAlpha;
 }
@@ -267,18 +311,7 @@ inline void MdpCtrl::setBlending(overlay::utils::eBlending blending) {
 }
 
 inline bool MdpCtrl::ovChanged() const {
-#ifdef USES_POST_PROCESSING
-    // Some pp params are stored as pointer address,
-    // so can't compare their content directly.
-    if (mPPChanged) {
-        return true;
-    }
-#endif
-    // 0 means same
-    if(0 == ::memcmp(&mOVInfo, &mLkgo, sizeof (mdp_overlay))) {
-        return false;
-    }
-    return true;
+    return mDirty != DIRTY_NONE;
 }
 
 inline void MdpCtrl::save() {
@@ -351,6 +384,10 @@ inline void MdpCtrl::forceSet() {
     mForceSet = true;
 }
 
+inline uint32_t MdpCtrl::getSetCount() const {
+    return mSetCount;
+}
+
 ///////    MdpCtrl3D //////
 
 inline MdpCtrl3D::MdpCtrl3D() { reset(); }
@@ -167,9 +167,9 @@ bool MdpRot::open_i(uint32_t numbufs, uint32_t bufsz)
 
     OVASSERT(MAP_FAILED == mem.addr(), "MAP failed in open_i");
 
-    if(!mem.open(numbufs, bufsz, mRotImgInfo.secure)){
+    if(!RotMgr::getInstance()->getMem(mem, numbufs, bufsz,
+            mRotImgInfo.secure)) {
         ALOGE("%s: Failed to open", __func__);
-        mem.close();
         return false;
     }
 
@@ -179,6 +179,7 @@ bool MdpRot::open_i(uint32_t numbufs, uint32_t bufsz)
     mRotDataInfo.dst.memory_id = mem.getFD();
     mRotDataInfo.dst.offset = 0;
     mMem.curr().m = mem;
+    mMem.curr().mSecure = mRotImgInfo.secure;
     return true;
 }
 
@@ -204,15 +205,18 @@ bool MdpRot::close() {
 }
 
 bool MdpRot::remap(uint32_t numbufs) {
-    // if current size changed, remap
-    uint32_t opBufSize = calcOutputBufSize();
+    // if current size class changed, remap
+    uint32_t opBufSize = RotMgr::getSizeClass(calcOutputBufSize());
     if(opBufSize == mMem.curr().size()) {
         ALOGE_IF(DEBUG_OVERLAY, "%s: same size %d", __FUNCTION__, opBufSize);
         return true;
     }
 
     ALOGE_IF(DEBUG_OVERLAY, "%s: size changed - remapping", __FUNCTION__);
-    OVASSERT(!mMem.prev().valid(), "Prev should not be valid");
+    //Memory of an earlier remap that the display has not released yet
+    if(mMem.prev().valid() && !mMem.prev().close()) {
+        ALOGE("%s error in closing prev rot mem", __FUNCTION__);
+    }
 
     // ++mMem will make curr to be prev, and prev will be curr
     ++mMem;
@@ -242,13 +246,12 @@ bool MdpRot::queueBuffer(int fd, uint32_t offset) {
         mRotDataInfo.src.memory_id = fd;
         mRotDataInfo.src.offset = offset;
 
-        remap(RotMem::Mem::ROT_NUM_BUFS);
+        remap(RotMgr::getInstance()->getRotBufCount());
         OVASSERT(mMem.curr().m.numBufs(),
                 "queueBuffer numbufs is 0");
+        mMem.curr().nextSlot();
         mRotDataInfo.dst.offset =
                 mMem.curr().mRotOffset[mMem.curr().mCurrOffset];
-        mMem.curr().mCurrOffset =
-                (mMem.curr().mCurrOffset + 1) % mMem.curr().m.numBufs();
 
         if(!overlay::mdp_wrapper::rotate(mFd.getFD(), mRotDataInfo)) {
             ALOGE("MdpRot failed rotate");
@@ -256,11 +259,8 @@ bool MdpRot::queueBuffer(int fd, uint32_t offset) {
             return false;
         }
 
-        // if the prev mem is valid, we need to close
-        if(mMem.prev().valid()) {
-            // FIXME if no wait for vsync the above
-            // play will return immediatly and might cause
-            // tearing when prev.close is called.
+        // The prev mem is released once the display is done reading it
+        if(mMem.prev().valid() && !mMem.prev().isBusy()) {
             if(!mMem.prev().close()) {
                 ALOGE("%s error in closing prev rot mem", __FUNCTION__);
                 return false;
@@ -282,6 +282,10 @@ void MdpRot::dump() const {
 void MdpRot::getDump(char *buf, size_t len) const {
     ovutils::getDump(buf, len, "MdpRotCtrl(msm_rotator_img_info)", mRotImgInfo);
     ovutils::getDump(buf, len, "MdpRotData(msm_rotator_data_info)", mRotDataInfo);
+    char str[64] = {'\0'};
+    snprintf(str, 64, "Rot ring bufs=%u stalls=%u\n",
+            mMem.curr().m.numBufs(), mMem.curr().mStalls);
+    strncat(buf, str, strlen(str));
 }
 
 } // namespace overlay
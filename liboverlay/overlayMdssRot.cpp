@@ -132,13 +132,12 @@ bool MdssRot::queueBuffer(int fd, uint32_t offset) {
         mRotData.data.memory_id = fd;
         mRotData.data.offset = offset;
 
-        remap(RotMem::Mem::ROT_NUM_BUFS);
+        remap(RotMgr::getInstance()->getRotBufCount());
         OVASSERT(mMem.curr().m.numBufs(), "queueBuffer numbufs is 0");
 
+        mMem.curr().nextSlot();
         mRotData.dst_data.offset =
                 mMem.curr().mRotOffset[mMem.curr().mCurrOffset];
-        mMem.curr().mCurrOffset =
-                (mMem.curr().mCurrOffset + 1) % mMem.curr().m.numBufs();
 
         if(!overlay::mdp_wrapper::play(mFd.getFD(), mRotData)) {
             ALOGE("MdssRot play failed!");
@@ -146,11 +145,8 @@ bool MdssRot::queueBuffer(int fd, uint32_t offset) {
             return false;
         }
 
-        // if the prev mem is valid, we need to close
-        if(mMem.prev().valid()) {
-            // FIXME if no wait for vsync the above
-            // play will return immediatly and might cause
-            // tearing when prev.close is called.
+        // The prev mem is released once the display is done reading it
+        if(mMem.prev().valid() && !mMem.prev().isBusy()) {
             if(!mMem.prev().close()) {
                 ALOGE("%s error in closing prev rot mem", __FUNCTION__);
                 return false;
@@ -166,9 +162,8 @@ bool MdssRot::open_i(uint32_t numbufs, uint32_t bufsz)
     OVASSERT(MAP_FAILED == mem.addr(), "MAP failed in open_i");
     bool isSecure = mRotInfo.flags & utils::OV_MDP_SECURE_OVERLAY_SESSION;
 
-    if(!mem.open(numbufs, bufsz, isSecure)){
+    if(!RotMgr::getInstance()->getMem(mem, numbufs, bufsz, isSecure)) {
         ALOGE("%s: Failed to open", __func__);
-        mem.close();
         return false;
     }
 
@@ -178,20 +173,24 @@ bool MdssRot::open_i(uint32_t numbufs, uint32_t bufsz)
     mRotData.dst_data.memory_id = mem.getFD();
     mRotData.dst_data.offset = 0;
     mMem.curr().m = mem;
+    mMem.curr().mSecure = isSecure;
     return true;
 }
 
 bool MdssRot::remap(uint32_t numbufs) {
     // Calculate the size based on rotator's dst format, w and h.
-    uint32_t opBufSize = calcOutputBufSize();
-    // If current size changed, remap
+    uint32_t opBufSize = RotMgr::getSizeClass(calcOutputBufSize());
+    // If current size class changed, remap
     if(opBufSize == mMem.curr().size()) {
         ALOGE_IF(DEBUG_OVERLAY, "%s: same size %d", __FUNCTION__, opBufSize);
         return true;
     }
 
     ALOGE_IF(DEBUG_OVERLAY, "%s: size changed - remapping", __FUNCTION__);
-    OVASSERT(!mMem.prev().valid(), "Prev should not be valid");
+    //Memory of an earlier remap that the display has not released yet
+    if(mMem.prev().valid() && !mMem.prev().close()) {
+        ALOGE("%s error in closing prev rot mem", __FUNCTION__);
+    }
 
     // ++mMem will make curr to be prev, and prev will be curr
     ++mMem;
@@ -264,6 +263,10 @@ uint32_t MdssRot::calcOutputBufSize() {
 void MdssRot::getDump(char *buf, size_t len) const {
     ovutils::getDump(buf, len, "MdssRotCtrl(mdp_overlay)", mRotInfo);
     ovutils::getDump(buf, len, "MdssRotData(msmfb_overlay_data)", mRotData);
+    char str[64] = {'\0'};
+    snprintf(str, 64, "Rot ring bufs=%u stalls=%u\n",
+            mMem.curr().m.numBufs(), mMem.curr().mStalls);
+    strncat(buf, str, strlen(str));
 }
 
 } // namespace overlay
@@ -20,7 +20,10 @@
 #include "overlayRotator.h"
 #include "overlayUtils.h"
 #include "mdp_version.h"
+#include "prop_cache.h"
 #include "gr.h"
+#include <cutils/properties.h>
+#include <limits.h>
 
 namespace ovutils = overlay::utils;
 
@@ -75,38 +78,81 @@ bool RotMem::close() {
     return ret;
 }
 
-RotMem::Mem::Mem() : mCurrOffset(0) {
+RotMem::Mem::Mem() : mCurrOffset(0), mStalls(0), mSecure(false) {
     utils::memset0(mRotOffset);
-    for(int i = 0; i < ROT_NUM_BUFS; i++) {
+    for(int i = 0; i < ROT_MAX_BUFS; i++) {
         mRelFence[i] = -1;
     }
 }
 
 RotMem::Mem::~Mem() {
-    for(int i = 0; i < ROT_NUM_BUFS; i++) {
-        ::close(mRelFence[i]);
+    for(int i = 0; i < ROT_MAX_BUFS; i++) {
+        if(mRelFence[i] >= 0)
+            ::close(mRelFence[i]);
         mRelFence[i] = -1;
     }
 }
 
-void RotMem::Mem::setReleaseFd(const int& fence) {
-    int ret = 0;
+bool RotMem::Mem::close() {
+    if(!valid())
+        return true;
+    //The pool holds on to the fences, so a fresh session never writes a
+    //buffer the display is still reading
+    return RotMgr::getInstance()->putMem(m, mSecure, mRelFence);
+}
 
+void RotMem::Mem::setReleaseFd(const int& fence) {
+    //The slot was free when it was picked, so any fence still attached is
+    //older than this one.
     if(mRelFence[mCurrOffset] >= 0) {
-        //Wait for previous usage of this buffer to be over.
-        //Can happen if rotation takes > vsync and a fast producer. i.e queue
-        //happens in subsequent vsyncs either because content is 60fps or
-        //because the producer is hasty sometimes.
-        ret = sync_wait(mRelFence[mCurrOffset], 1000);
-        if(ret < 0) {
-            ALOGE("%s: sync_wait error!! error no = %d err str = %s",
-                __FUNCTION__, errno, strerror(errno));
-        }
         ::close(mRelFence[mCurrOffset]);
     }
     mRelFence[mCurrOffset] = fence;
 }
 
+void RotMem::Mem::nextSlot() {
+    uint32_t numBufs = m.numBufs();
+    OVASSERT(numBufs && numBufs <= ROT_MAX_BUFS, "numbufs is %d", numBufs);
+
+    for(uint32_t i = 1; i <= numBufs; i++) {
+        uint32_t slot = (mCurrOffset + i) % numBufs;
+        if(mRelFence[slot] < 0 || sync_wait(mRelFence[slot], 0) == 0) {
+            if(mRelFence[slot] >= 0)
+                ::close(mRelFence[slot]);
+            mRelFence[slot] = -1;
+            mCurrOffset = slot;
+            return;
+        }
+    }
+
+    //All in flight. Can happen if rotation takes > vsync and a fast
+    //producer. Wait for the oldest, the next one in ring order.
+    uint32_t slot = (mCurrOffset + 1) % numBufs;
+    mStalls++;
+    if(sync_wait(mRelFence[slot], 1000) < 0) {
+        ALOGE("%s: sync_wait error!! error no = %d err str = %s",
+                __FUNCTION__, errno, strerror(errno));
+    }
+    ::close(mRelFence[slot]);
+    mRelFence[slot] = -1;
+    mCurrOffset = slot;
+}
+
+bool RotMem::Mem::isBusy() {
+    bool busy = false;
+    for(int i = 0; i < ROT_MAX_BUFS; i++) {
+        if(mRelFence[i] >= 0) {
+            if(sync_wait(mRelFence[i], 0) == 0) {
+                ::close(mRelFence[i]);
+                mRelFence[i] = -1;
+            } else {
+                busy = true;
+            }
+        }
+    }
+    return busy;
+}
+
 //============RotMgr=========================
 RotMgr * RotMgr::sRotMgr = NULL;
 
@@ -120,9 +166,23 @@ RotMgr* RotMgr::getInstance() {
 RotMgr::RotMgr() {
     for(int i = 0; i < MAX_ROT_SESS; i++) {
         mRot[i] = 0;
+        mLastUsed[i] = 0;
     }
     mUseCount = 0;
     mRotDevFd = -1;
+    mPoolCount = 0;
+    memset(&mStats, 0, sizeof(mStats));
+    mStats.mMinStart = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    qdutils::PropCache& props = qdutils::PropCache::getInstance();
+    int timeoutMs = props.getInt(qdutils::PROP_ROT_IDLE_TIMEOUT_MS,
+            DEFAULT_IDLE_TIMEOUT_MS);
+    mIdleTimeout = ms2ns(timeoutMs);
+
+    mNumRotBufs = DEFAULT_ROT_BUFS;
+    int numBufs = props.getInt(qdutils::PROP_ROT_NUM_BUFS, DEFAULT_ROT_BUFS);
+    if(numBufs >= 2 && numBufs <= RotMem::Mem::ROT_MAX_BUFS)
+        mNumRotBufs = numBufs;
 }
 
 RotMgr::~RotMgr() {
@@ -135,26 +195,92 @@ void RotMgr::configBegin() {
 }
 
 void RotMgr::configDone() {
-    //Remove the top most unused objects. Videos come and go.
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for(uint32_t i = 0; i < mUseCount; i++) {
+        mLastUsed[i] = now;
+    }
+    //Videos come and go, often straight back. Keep the unused objects
+    //around for a while, so that their sessions and memory are reused.
+    //Sessions that hold a pipe are needed by the layers right away.
+    const bool pipeBacked = isPipeBacked();
     for(int i = mUseCount; i < MAX_ROT_SESS; i++) {
-        if(mRot[i]) {
+        if(mRot[i] && (pipeBacked || now - mLastUsed[i] >= mIdleTimeout)) {
             delete mRot[i];
             mRot[i] = 0;
+            mStats.mSessDestroyed++;
         }
     }
+    trimPool(now - mIdleTimeout);
+    updateStats(now);
 }
 
-Rotator* RotMgr::getNext() {
+Rotator* RotMgr::getNext(const utils::Whf& whf) {
     //Return a rot object, creating one if necessary
-    overlay::Rotator *rot = NULL;
     if(mUseCount >= MAX_ROT_SESS) {
         ALOGE("%s, MAX rotator sessions reached", __func__);
-    } else {
-        if(mRot[mUseCount] == NULL)
-            mRot[mUseCount] = overlay::Rotator::getRotator();
-        rot = mRot[mUseCount++];
+        return NULL;
+    }
+
+    //The session of the same source has the buffers and the driver setup
+    //it needs. Otherwise take an empty slot, leaving the idle sessions for
+    //their videos, and only then reconfigure the least recently used one.
+    uint32_t pick = MAX_ROT_SESS;
+    for(uint32_t i = mUseCount; i < MAX_ROT_SESS; i++) {
+        if(mRot[i] && mSrc[i] == whf) {
+            pick = i;
+            break;
+        }
+    }
+    for(uint32_t i = mUseCount; pick == MAX_ROT_SESS && i < MAX_ROT_SESS;
+            i++) {
+        if(mRot[i] == NULL)
+            pick = i;
+    }
+    if(pick == MAX_ROT_SESS) {
+        pick = mUseCount;
+        for(uint32_t i = mUseCount + 1; i < MAX_ROT_SESS; i++) {
+            if(mLastUsed[i] < mLastUsed[pick])
+                pick = i;
+        }
     }
-    return rot;
+
+    //Sessions in use stay below mUseCount
+    swapSess(pick, mUseCount);
+    if(mRot[mUseCount] == NULL) {
+        mRot[mUseCount] = overlay::Rotator::getRotator();
+        mStats.mSessCreated++;
+        mStats.mMinSessCreated++;
+    }
+    mSrc[mUseCount] = whf;
+    return mRot[mUseCount++];
+}
+
+void RotMgr::swapSess(const uint32_t& i, const uint32_t& j) {
+    if(i == j)
+        return;
+    overlay::Rotator *rot = mRot[i];
+    mRot[i] = mRot[j];
+    mRot[j] = rot;
+    nsecs_t lastUsed = mLastUsed[i];
+    mLastUsed[i] = mLastUsed[j];
+    mLastUsed[j] = lastUsed;
+    utils::Whf src = mSrc[i];
+    mSrc[i] = mSrc[j];
+    mSrc[j] = src;
+}
+
+uint32_t RotMgr::getIdleSessCount() const {
+    uint32_t count = 0;
+    for(uint32_t i = mUseCount; i < MAX_ROT_SESS; i++) {
+        if(mRot[i])
+            count++;
+    }
+    return count;
+}
+
+bool RotMgr::isPipeBacked() {
+    //The MDSS rotator runs a DMA pipe through writeback
+    return Rotator::getRotatorHwType() == Rotator::TYPE_MDSS;
 }
 
 void RotMgr::clear() {
@@ -163,20 +289,177 @@ void RotMgr::clear() {
         if(mRot[i]) {
             delete mRot[i];
             mRot[i] = 0;
+            mStats.mSessDestroyed++;
         }
     }
     mUseCount = 0;
-    ::close(mRotDevFd);
+    //The objects above just returned their memory
+    trimPool(LLONG_MAX);
+    if(mRotDevFd >= 0)
+        mdp_wrapper::closeDevice(mRotDevFd);
     mRotDevFd = -1;
 }
 
+uint32_t RotMgr::getSizeClass(const uint32_t& size) {
+    const uint32_t pageSize = getpagesize();
+    if(size <= pageSize * 4)
+        return utils::align(size, pageSize);
+
+    int msb = 31 - __builtin_clz(size);
+    return utils::align(size, 1 << (msb - 2));
+}
+
+bool RotMgr::PoolMem::isIdle() {
+    bool idle = true;
+    for(int i = 0; i < RotMem::Mem::ROT_MAX_BUFS; i++) {
+        if(mRelFence[i] < 0)
+            continue;
+        if(sync_wait(mRelFence[i], 0) == 0) {
+            ::close(mRelFence[i]);
+            mRelFence[i] = -1;
+        } else {
+            idle = false;
+        }
+    }
+    return idle;
+}
+
+bool RotMgr::getMem(OvMem& mem, const uint32_t& numbufs,
+        const uint32_t& bufSz, const bool& isSecure) {
+    for(uint32_t i = 0; i < mPoolCount; i++) {
+        PoolMem& entry = mPool[i];
+        if(entry.mSecure == isSecure && entry.mMem.bufSz() == bufSz &&
+                entry.mMem.numBufs() == numbufs && entry.isIdle()) {
+            mem = entry.mMem;
+            //Keep the pool packed, oldest first
+            for(uint32_t j = i + 1; j < mPoolCount; j++) {
+                mPool[j - 1] = mPool[j];
+            }
+            mPoolCount--;
+            mPool[mPoolCount].mMem = OvMem();
+            mStats.mPoolHits++;
+            return true;
+        }
+    }
+
+    if(!mem.open(numbufs, bufSz, isSecure)) {
+        mem.close();
+        return false;
+    }
+    mStats.mBytesAlloc += (uint64_t)numbufs * bufSz;
+    mStats.mMinBytesAlloc += (uint64_t)numbufs * bufSz;
+    return true;
+}
+
+bool RotMgr::putMem(OvMem& mem, const bool& isSecure,
+        int relFences[RotMem::Mem::ROT_MAX_BUFS]) {
+    if(!mem.valid()) {
+        for(int i = 0; i < RotMem::Mem::ROT_MAX_BUFS; i++) {
+            if(relFences[i] >= 0)
+                ::close(relFences[i]);
+            relFences[i] = -1;
+        }
+        return true;
+    }
+
+    bool ret = true;
+    if(mPoolCount == MAX_POOL_MEM) {
+        //Evict the oldest
+        ret = freePoolMem(0);
+        for(uint32_t j = 1; j < mPoolCount; j++) {
+            mPool[j - 1] = mPool[j];
+        }
+        mPoolCount--;
+    }
+
+    PoolMem& entry = mPool[mPoolCount++];
+    entry.mMem = mem;
+    entry.mSecure = isSecure;
+    entry.mFreeTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    for(int i = 0; i < RotMem::Mem::ROT_MAX_BUFS; i++) {
+        entry.mRelFence[i] = relFences[i];
+        relFences[i] = -1;
+    }
+    mem = OvMem();
+    return ret;
+}
+
+bool RotMgr::freePoolMem(const uint32_t& index) {
+    PoolMem& entry = mPool[index];
+    //The driver keeps its own reference to a buffer being scanned out
+    for(int i = 0; i < RotMem::Mem::ROT_MAX_BUFS; i++) {
+        if(entry.mRelFence[i] >= 0)
+            ::close(entry.mRelFence[i]);
+        entry.mRelFence[i] = -1;
+    }
+    if(!entry.mMem.close()) {
+        ALOGE("%s: error freeing pooled rot mem", __FUNCTION__);
+        return false;
+    }
+    return true;
+}
+
+void RotMgr::trimPool(const nsecs_t& expiry) {
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < mPoolCount; i++) {
+        if(mPool[i].mFreeTime <= expiry) {
+            freePoolMem(i);
+        } else {
+            mPool[kept++] = mPool[i];
+        }
+    }
+    for(uint32_t i = kept; i < mPoolCount; i++) {
+        mPool[i].mMem = OvMem();
+    }
+    mPoolCount = kept;
+}
+
+void RotMgr::addBypassed(const uint32_t& bufSz) {
+    //A rotator pass writes the frame out and the pipe reads it back
+    mStats.mBypassed++;
+    mStats.mBytesSaved += 2ULL * bufSz;
+    mStats.mMinBytesSaved += 2ULL * bufSz;
+}
+
+void RotMgr::updateStats(const nsecs_t& now) {
+    if(now - mStats.mMinStart < s2ns(60))
+        return;
+    mStats.mLastMinSessCreated = mStats.mMinSessCreated;
+    mStats.mLastMinBytesAlloc = mStats.mMinBytesAlloc;
+    mStats.mLastMinBytesSaved = mStats.mMinBytesSaved;
+    mStats.mMinSessCreated = 0;
+    mStats.mMinBytesAlloc = 0;
+    mStats.mMinBytesSaved = 0;
+    mStats.mMinStart = now;
+}
+
 void RotMgr::getDump(char *buf, size_t len) {
     for(int i = 0; i < MAX_ROT_SESS; i++) {
         if(mRot[i]) {
             mRot[i]->getDump(buf, len);
         }
     }
-    char str[32] = {'\0'};
+    uint64_t pooledBytes = 0;
+    for(uint32_t i = 0; i < mPoolCount; i++) {
+        pooledBytes += (uint64_t)mPool[i].mMem.bufSz() *
+                mPool[i].mMem.numBufs();
+    }
+    char str[256] = {'\0'};
+    snprintf(str, 256, "\nRotator sessions created=%u destroyed=%u "
+            "last min=%u\nRotator mem allocated=%lluKB last min=%lluKB "
+            "pool hits=%u pooled=%u (%lluKB)\n",
+            mStats.mSessCreated, mStats.mSessDestroyed,
+            mStats.mLastMinSessCreated,
+            (unsigned long long)(mStats.mBytesAlloc >> 10),
+            (unsigned long long)(mStats.mLastMinBytesAlloc >> 10),
+            mStats.mPoolHits, mPoolCount,
+            (unsigned long long)(pooledBytes >> 10));
+    strncat(buf, str, strlen(str));
+    snprintf(str, 256, "Rotator bypassed layers=%u saved=%lluKB "
+            "last min=%lluKB\n", mStats.mBypassed,
+            (unsigned long long)(mStats.mBytesSaved >> 10),
+            (unsigned long long)(mStats.mLastMinBytesSaved >> 10));
+    strncat(buf, str, strlen(str));
     snprintf(str, 32, "\n================\n");
     strncat(buf, str, strlen(str));
 }
@@ -184,7 +467,7 @@ void RotMgr::getDump(char *buf, size_t len) {
 int RotMgr::getRotDevFd() {
     //2nd check just in case
     if(mRotDevFd < 0 && Rotator::getRotatorHwType() == Rotator::TYPE_MDP) {
-        mRotDevFd = ::open("/dev/msm_rotator", O_RDWR, 0);
+        mRotDevFd = mdp_wrapper::openDevice("/dev/msm_rotator", O_RDWR);
         if(mRotDevFd < 0) {
             ALOGE("%s failed to open rotator device", __FUNCTION__);
         }
@@ -31,6 +31,7 @@
 #define OVERlAY_ROTATOR_H
 
 #include <stdlib.h>
+#include <utils/Timers.h>
 
 #include "mdpWrapper.h"
 #include "overlayUtils.h"
@@ -49,21 +50,34 @@ struct RotMem {
     // Max rotator memory allocations
     enum { MAX_ROT_MEM = 2};
 
-    //Manages the rotator buffer offsets.
+    //Manages the rotator buffer offsets as a ring. A slot is written again
+    //only once the release fence of its last frame has signaled.
     struct Mem {
         Mem();
         ~Mem();
         bool valid() { return m.valid(); }
-        bool close() { return m.close(); }
+        /* Hands the buffers back to the RotMgr pool, along with the release
+         * fences of slots the display may still read. Doesn't wait */
+        bool close();
         uint32_t size() const { return m.bufSz(); }
+        /* Attaches the release fence of this frame to the current slot */
         void setReleaseFd(const int& fence);
-        // Max rotator buffers
-        enum { ROT_NUM_BUFS = 2 };
+        /* Makes mCurrOffset the next slot the display is done with, in ring
+         * order. Waits on the oldest one if all of them are in flight */
+        void nextSlot();
+        /* True if the display may still read any of the slots */
+        bool isBusy();
+        // Max rotator buffers, the ring depth is RotMgr::getRotBufCount()
+        enum { ROT_MAX_BUFS = 4 };
         // rotator data info dst offset
-        uint32_t mRotOffset[ROT_NUM_BUFS];
-        int mRelFence[ROT_NUM_BUFS];
-        // current offset slot from mRotOffset
+        uint32_t mRotOffset[ROT_MAX_BUFS];
+        int mRelFence[ROT_MAX_BUFS];
+        // slot written for the current frame
         uint32_t mCurrOffset;
+        // frames that had to wait for a slot
+        uint32_t mStalls;
+        // allocated from the secure heap
+        bool mSecure;
         OvMem m;
     };
 
@@ -228,11 +242,20 @@ public:
     //Maximum sessions based on VG pipes, since rotator is used only for videos.
     //Even though we can have 4 mixer stages, that much may be unnecessary.
     enum { MAX_ROT_SESS = 3 };
+    //Freed rotator buffers kept for reuse
+    enum { MAX_POOL_MEM = 4 };
+    //Unused sessions of the MDP rotator and pooled buffers are torn down
+    //after this long. Overridden by debug.rotator.idle_timeout_ms
+    enum { DEFAULT_IDLE_TIMEOUT_MS = 5000 };
+    //Depth of the rotator output ring. Overridden by debug.rotator.num_bufs
+    enum { DEFAULT_ROT_BUFS = 2 };
 
     ~RotMgr();
     void configBegin();
     void configDone();
-    overlay::Rotator *getNext();
+    /* Returns a session for a source of whf, the one last used for the same
+     * format and size if it is idle */
+    overlay::Rotator *getNext(const utils::Whf& whf);
     void clear(); //Removes all instances
     //Resets the usage of top count objects, making them available for reuse
     void markUnusedTop(const uint32_t& count) { mUseCount -= count; }
@@ -241,16 +264,82 @@ public:
      */
     void getDump(char *buf, size_t len);
     int getRotDevFd(); //Called on A-fam only
+    /* Number of output buffers in each rotator's ring */
+    uint32_t getRotBufCount() const { return mNumRotBufs; }
+    /* Sessions kept around that no display has used this frame */
+    uint32_t getIdleSessCount() const;
+    /* True if rotator sessions hold an MDP pipe, they are then released as
+     * soon as a frame doesn't use them */
+    static bool isPipeBacked();
+
+    /* Rounds a buffer size up to its size class, 4 classes per power of 2.
+     * Rotators size their buffers by class so that a buffer freed by one
+     * video fits the next one of about the same size. */
+    static uint32_t getSizeClass(const uint32_t& size);
+    /* Fills mem with numbufs buffers of bufSz, reusing a pooled allocation
+     * of the same shape if there is one */
+    bool getMem(OvMem& mem, const uint32_t& numbufs, const uint32_t& bufSz,
+            const bool& isSecure);
+    /* Takes mem back into the pool, mem is left invalid. The pool owns the
+     * relFences from here on, and won't hand mem out before they signal */
+    bool putMem(OvMem& mem, const bool& isSecure,
+            int relFences[RotMem::Mem::ROT_MAX_BUFS]);
+    /* Accounts a layer the pipe fetched flipped instead of taking a
+     * rotator pass of bufSz */
+    void addBypassed(const uint32_t& bufSz);
 
     static RotMgr *getInstance();
 
 private:
     RotMgr();
+    /* Exchanges two session slots */
+    void swapSess(const uint32_t& i, const uint32_t& j);
+    /* Frees pooled buffers idle since before "expiry" */
+    void trimPool(const nsecs_t& expiry);
+    /* Frees a pooled entry, closing its fences without waiting on them */
+    bool freePoolMem(const uint32_t& index);
+    /* Rolls the per minute stats over */
+    void updateStats(const nsecs_t& now);
     static RotMgr *sRotMgr;
 
     overlay::Rotator *mRot[MAX_ROT_SESS];
+    //Last round each rotator object was used in
+    nsecs_t mLastUsed[MAX_ROT_SESS];
+    //Source each rotator object was last handed out for
+    utils::Whf mSrc[MAX_ROT_SESS];
     uint32_t mUseCount;
     int mRotDevFd; //A-fam
+    nsecs_t mIdleTimeout;
+    uint32_t mNumRotBufs;
+
+    struct PoolMem {
+        OvMem mMem;
+        bool mSecure;
+        nsecs_t mFreeTime;
+        int mRelFence[RotMem::Mem::ROT_MAX_BUFS];
+        /* True once the display is done with all of the buffers */
+        bool isIdle();
+    };
+    PoolMem mPool[MAX_POOL_MEM];
+    uint32_t mPoolCount;
+
+    struct Stats {
+        uint32_t mSessCreated;
+        uint32_t mSessDestroyed;
+        uint32_t mPoolHits;
+        uint64_t mBytesAlloc;
+        uint32_t mBypassed;
+        //Rotator write + read traffic avoided by bypass
+        uint64_t mBytesSaved;
+        //Counts of the current and of the last complete minute
+        uint32_t mMinSessCreated;
+        uint64_t mMinBytesAlloc;
+        uint64_t mMinBytesSaved;
+        uint32_t mLastMinSessCreated;
+        uint64_t mLastMinBytesAlloc;
+        uint64_t mLastMinBytesSaved;
+        nsecs_t mMinStart;
+    } mStats;
 };
 
 
@@ -413,4 +413,32 @@ void getDump(char *buf, size_t len, const char *prefix,
 
 } // utils
 
+namespace mdp_wrapper {
+
+static Driver *sDriver = NULL;
+
+void setDriver(Driver *driver) {
+    sDriver = driver;
+}
+
+Driver* getDriver() {
+    return sDriver;
+}
+
+int openDevice(const char* const dev, int flags) {
+    if(sDriver) {
+        return sDriver->open(dev, flags);
+    }
+    return ::open(dev, flags, 0);
+}
+
+int closeDevice(int fd) {
+    if(sDriver) {
+        return sDriver->close(fd);
+    }
+    return ::close(fd);
+}
+
+} // mdp_wrapper
+
 } // overlay
@@ -93,6 +93,13 @@ class OvFD;
 bool open(OvFD& fd, uint32_t fbnum, const char* const dev,
     int flags = O_RDWR);
 
+namespace mdp_wrapper {
+/* open(2) and close(2) of device nodes, routed to the installed backend
+ * like the ioctls in mdpWrapper.h */
+int openDevice(const char* const dev, int flags);
+int closeDevice(int fd);
+}
+
 namespace utils {
 struct Whf;
 struct Dim;
@@ -806,7 +813,7 @@ inline OvFD::~OvFD() {
 
 inline bool OvFD::open(const char* const dev, int flags)
 {
-    mFD = ::open(dev, flags, 0);
+    mFD = mdp_wrapper::openDevice(dev, flags);
     if (mFD < 0) {
         // FIXME errno, strerror in bionic?
         ALOGE("Cant open device %s err=%d", dev, errno);
@@ -825,7 +832,7 @@ inline bool OvFD::close()
 {
     int ret = 0;
     if(valid()) {
-        ret = ::close(mFD);
+        ret = mdp_wrapper::closeDevice(mFD);
         mFD = INVAL;
     }
     return (ret == 0);
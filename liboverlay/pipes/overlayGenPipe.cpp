@@ -102,13 +102,16 @@ void GenericPipe::setPosition(const utils::Dim& d) {
     mCtrlData.ctrl.setPosition(d);
 }
 
+void GenericPipe::setDecimation(const int& horz, const int& vert) {
+    mCtrlData.ctrl.setDecimation(horz, vert);
+}
+
 bool GenericPipe::setVisualParams(const MetaData_t &metadata)
 {
         return mCtrlData.ctrl.setVisualParams(metadata);
 }
 
-bool GenericPipe::commit() {
-    bool ret = false;
+void GenericPipe::updateDownscale() {
     int downscale_factor = utils::ROT_DS_NONE;
 
     if(mRotDownscaleOpt) {
@@ -119,12 +122,47 @@ bool GenericPipe::commit() {
     }
 
     mCtrlData.ctrl.setDownscale(downscale_factor);
+}
+
+bool GenericPipe::commit() {
+    bool ret = false;
+
+    updateDownscale();
     ret = mCtrlData.ctrl.commit();
 
     pipeState = ret ? OPEN : CLOSED;
     return ret;
 }
 
+bool GenericPipe::validateAndSet(GenericPipe* pipeArray[], const int& count,
+        bool result[]) {
+    MdpCtrl* mdpCtrlArray[utils::OV_MAX];
+    bool mdpResult[utils::OV_MAX];
+    int mdpIndex[utils::OV_MAX];
+    int num = 0;
+
+    for(int i = 0; i < count; i++) {
+        result[i] = true;
+        pipeArray[i]->updateDownscale();
+        //Unchanged pipes need no set
+        if(pipeArray[i]->mCtrlData.ctrl.prepareCommit()) {
+            mdpCtrlArray[num] = pipeArray[i]->mCtrlData.ctrl.getMdpCtrl();
+            mdpIndex[num] = i;
+            num++;
+        }
+    }
+
+    bool ret = MdpCtrl::validateAndSet(mdpCtrlArray, num, mdpResult);
+    for(int j = 0; j < num; j++) {
+        result[mdpIndex[j]] = mdpResult[j];
+    }
+
+    for(int i = 0; i < count; i++) {
+        pipeArray[i]->pipeState = result[i] ? OPEN : CLOSED;
+    }
+    return ret;
+}
+
 bool GenericPipe::queueBuffer(int fd, uint32_t offset) {
     //TODO Move pipe-id transfer to CtrlData class. Make ctrl and data private.
     OVASSERT(isOpen(), "State is closed, cannot queueBuffer");
@@ -140,6 +178,10 @@ int GenericPipe::getCtrlFd() const {
     return mCtrlData.ctrl.getFd();
 }
 
+uint32_t GenericPipe::getSetCount() const {
+    return mCtrlData.ctrl.getSetCount();
+}
+
 utils::Dim GenericPipe::getCrop() const
 {
     return mCtrlData.ctrl.getCrop();
@@ -54,8 +54,14 @@ public:
     void setPosition(const utils::Dim& dim);
     /* set visual param */
     bool setVisualParams(const MetaData_t &metadata);
+    /* set log2 of the pipe decimation */
+    void setDecimation(const int& horz, const int& vert);
     /* commit changes to the overlay "set"*/
     bool commit();
+    /* commit changes of all the pipes in one batch, see
+     * MdpCtrl::validateAndSet. result[i] holds the status of pipe i */
+    static bool validateAndSet(GenericPipe* pipeArray[], const int& count,
+            bool result[]);
     /* Data APIs */
     /* queue buffer to the overlay */
     bool queueBuffer(int fd, uint32_t offset);
@@ -69,6 +75,8 @@ public:
     bool isOpen() const;
     /* return Ctrl fd. Used for S3D */
     int getCtrlFd() const;
+    /* number of overlay sets issued by commits */
+    uint32_t getSetCount() const;
     /* dump the state of the object */
     void dump() const;
     /* Return the dump in the specified buffer */
@@ -81,6 +89,8 @@ public:
 private:
     /* set Closed pipe */
     bool setClosed();
+    /* apply the rotator downscale request to the ctrl */
+    void updateDownscale();
 
     int mDpy;
     /* Ctrl/Data aggregator */
@@ -9,11 +9,13 @@ LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
 LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdutils\"
 LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
 LOCAL_COPY_HEADERS_TO         := $(common_header_export_path)
-LOCAL_COPY_HEADERS            := display_config.h mdp_version.h
+LOCAL_COPY_HEADERS            := display_config.h mdp_version.h prop_cache.h \
+                                 event_loop.h
 LOCAL_SRC_FILES               := profiler.cpp mdp_version.cpp \
                                  idle_invalidator.cpp \
                                  comptype.cpp display_config.cpp \
-                                 cb_utils.cpp
+                                 cb_utils.cpp prop_cache.cpp \
+                                 event_loop.cpp
 include $(BUILD_SHARED_LIBRARY)
 
 include $(CLEAR_VARS)
@@ -29,6 +29,7 @@
 
 #include <display_config.h>
 #include <QServiceUtils.h>
+#include <errno.h>
 
 using namespace android;
 using namespace qService;
@@ -134,4 +135,62 @@ int setViewFrame(int dpy, int l, int t, int r, int b) {
     return err;
 }
 
+int getHwcMetrics(HwcMetrics_t& metrics) {
+    status_t err = (status_t) FAILED_TRANSACTION;
+    sp<IQService> binder = getBinder();
+    Parcel inParcel, outParcel;
+    if(binder != NULL) {
+        err = binder->dispatch(IQService::GET_HWC_METRICS,
+                &inParcel, &outParcel);
+    }
+    if(!err) {
+        //An older HWC may send less, a newer one more
+        size_t size = outParcel.readInt32();
+        memset(&metrics, 0, sizeof(metrics));
+        err = outParcel.read(&metrics,
+                size < sizeof(metrics) ? size : sizeof(metrics));
+    }
+    if(err)
+        ALOGE("%s: Failed to get HWC metrics err=%d", __FUNCTION__, err);
+    return err;
+}
+
+int setFrameTimeline(int numFrames) {
+    status_t err = (status_t) FAILED_TRANSACTION;
+    sp<IQService> binder = getBinder();
+    Parcel inParcel, outParcel;
+    inParcel.writeInt32(numFrames);
+    if(binder != NULL) {
+        err = binder->dispatch(IQService::SET_FRAME_TIMELINE,
+                &inParcel, &outParcel);
+    }
+    if(!err)
+        err = outParcel.readInt32();
+    if(err)
+        ALOGE("%s: Failed to arm the frame timeline err=%d", __FUNCTION__,
+                err);
+    return err;
+}
+
+int getFrameTimeline(void *buf, size_t& size) {
+    status_t err = (status_t) FAILED_TRANSACTION;
+    sp<IQService> binder = getBinder();
+    Parcel inParcel, outParcel;
+    if(binder != NULL) {
+        err = binder->dispatch(IQService::GET_FRAME_TIMELINE,
+                &inParcel, &outParcel);
+    }
+    if(!err) {
+        size_t capacity = size;
+        size = outParcel.readInt32();
+        if(size > capacity)
+            return -ENOSPC;
+        err = outParcel.read(buf, size);
+    }
+    if(err)
+        ALOGE("%s: Failed to get the frame timeline err=%d", __FUNCTION__,
+                err);
+    return err;
+}
+
 }; //namespace
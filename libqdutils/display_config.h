@@ -26,6 +26,10 @@
  * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
  * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+
+#ifndef INCLUDE_LIBQCOMUTILS_DISPLAY_CONFIG
+#define INCLUDE_LIBQCOMUTILS_DISPLAY_CONFIG
+
 #include <gralloc_priv.h>
 #include <qdMetaData.h>
 #include <mdp_version.h>
@@ -76,4 +80,155 @@ int getDisplayVisibleRegion(int dpy, hwc_rect_t &rect);
 
 // set the view frame information in hwc context from surfaceflinger
 int setViewFrame(int dpy, int l, int t, int r, int b);
+
+// Composition counters of HWC, all since HWC started.
+// The snapshot is sent as is, clients check version before reading it.
+enum {
+    HWC_METRICS_VERSION = 1,
+    HWC_METRICS_DISPLAYS = 3, // primary, external, virtual
+    // Bucket i of a histogram counts times in [2^i, 2^(i+1)) us, the first
+    // one also those below 1us and the last one all above
+    HWC_METRICS_BUCKETS = 16,
+};
+
+// How the app layers of a frame were composed
+enum {
+    HWC_STRATEGY_GPU = 0,  // All on the framebuffer
+    HWC_STRATEGY_MDP,      // All on MDP pipes
+    HWC_STRATEGY_MIXED,    // Some on MDP pipes, the rest on the framebuffer
+    HWC_STRATEGY_COPYBIT,  // Some blitted by copybit
+    HWC_STRATEGY_MAX,
+};
+
+struct HwcDisplayMetrics_t {
+    uint32_t frames[HWC_STRATEGY_MAX];
+    // App layers, and those composed by MDP, over all frames
+    uint64_t layers;
+    uint64_t mdpLayers;
+    // Pipes held by the display at the end of prepare, over all frames,
+    // and the most in one frame
+    uint64_t pipes;
+    uint32_t maxPipes;
+    // Frames that used the rotator, and the sessions they used
+    uint32_t rotFrames;
+    uint64_t rotSessions;
+};
+
+struct HwcMetrics_t {
+    uint32_t version;
+    // Pipes MDP has
+    uint32_t totalPipes;
+    // CLOCK_MONOTONIC of the snapshot, ns
+    int64_t timestamp;
+    HwcDisplayMetrics_t dpy[HWC_METRICS_DISPLAYS];
+    // Layers blitted by copybit
+    uint64_t copybitBlits;
+    // Waits of HWC on fences, and their time in ns
+    uint32_t fenceWaits;
+    uint32_t reserved;
+    uint64_t fenceWaitTime;
+    uint64_t maxFenceWaitTime;
+    uint32_t fenceWaitHist[HWC_METRICS_BUCKETS];
+    // Composition cycles, time in ns spent in prepare and set
+    uint32_t cycles;
+    uint32_t reserved2;
+    uint64_t prepareTime;
+    uint64_t setTime;
+    uint32_t prepareHist[HWC_METRICS_BUCKETS];
+    uint32_t setHist[HWC_METRICS_BUCKETS];
+};
+
+// Get the composition counters of HWC
+// Returns 0 on success, negative values on errors
+int getHwcMetrics(HwcMetrics_t& metrics);
+
+// Frame timeline: the composition decisions HWC made for each display
+// frame, kept for the last frames in a ring once armed.
+// The timeline is a FrameTimelineHeader_t followed by numFrames records,
+// oldest first, each a FrameTimelineFrame_t and its numLayers
+// FrameTimelineLayer_t.
+enum {
+    FRAME_TIMELINE_VERSION = 1,
+    FRAME_TIMELINE_MAX_FRAMES = 256,
+    // Layers of a frame beyond this are not recorded
+    FRAME_TIMELINE_MAX_LAYERS = 16,
+};
+
+// FrameTimelineFrame_t::flags
+enum {
+    TIMELINE_FRAME_GEOMETRY_CHANGED = 1 << 0,
+    TIMELINE_FRAME_FB_REDRAW = 1 << 1,    // FB target had to be redrawn
+    TIMELINE_FRAME_TRUNCATED = 1 << 2,    // Not all layers recorded
+    TIMELINE_FRAME_MDP_FAILED = 1 << 3,   // MDP comp fell back to GPU
+};
+
+// FrameTimelineLayer_t::flags
+enum {
+    TIMELINE_LAYER_MDP = 1 << 0,      // Composed by an MDP pipe
+    TIMELINE_LAYER_CACHED = 1 << 1,   // Not updating, cached on the FB
+    TIMELINE_LAYER_COPYBIT = 1 << 2,  // Blitted by copybit
+    TIMELINE_LAYER_YUV = 1 << 3,
+    TIMELINE_LAYER_SECURE = 1 << 4,
+    TIMELINE_LAYER_SKIP = 1 << 5,
+};
+
+struct FrameTimelineHeader_t {
+    uint32_t version;
+    uint32_t numFrames;
+    // Frames recorded since armed, the ones not sent were overwritten
+    uint32_t framesRecorded;
+    uint32_t reserved;
+};
+
+struct FrameTimelineFrame_t {
+    // Composition cycle, displays composed together share it
+    uint32_t cycle;
+    uint32_t dpy;
+    // CLOCK_MONOTONIC, ns
+    int64_t prepareStart;
+    int64_t prepareEnd;
+    int64_t setEnd;
+    uint32_t flags;
+    uint32_t numAppLayers;
+    uint32_t numLayers;
+    int32_t fbZ;          // -1 if no layer on the FB
+    uint32_t mdpCount;
+    uint32_t fbCount;
+    uint32_t pipes;       // Pipes the display held
+    uint32_t rotSessions;
+    uint32_t copybitBlits;
+    // Waits of HWC on the acquire fences of layers and on the release
+    // fences of its own buffers, us
+    uint32_t acquireWait;
+    uint32_t releaseWait;
+    uint32_t reserved;
+};
+
+struct FrameTimelineLayer_t {
+    uint32_t flags;
+    int32_t compositionType;
+    int32_t format;
+    int32_t width;
+    int32_t height;
+    int32_t displayFrame[4]; // l, t, r, b
+    uint32_t transform;
+    uint32_t blending;
+    uint32_t planeAlpha;
+    int32_t zOrder;          // -1 if not on MDP
+    int32_t pipeType;
+    int32_t pipes[2];        // Overlay pipes, -1 if unused
+    int32_t rotSession;      // -1 if not rotated
+};
+
+// Arms the frame timeline with a ring of numFrames frames, dropping what
+// was recorded. 0 disarms it
+// Returns 0 on success, negative values on errors
+int setFrameTimeline(int numFrames);
+
+// Copies the frame timeline into buf. size is the capacity of buf in, the
+// size of the timeline out
+// Returns 0 on success, -ENOSPC if buf is too small, negative values on
+// other errors
+int getFrameTimeline(void *buf, size_t& size);
 }; //namespace
+#endif //INCLUDE_LIBQCOMUTILS_DISPLAY_CONFIG
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cutils/log.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "event_loop.h"
+
+namespace qdutils {
+
+android::sp<EventLoop> EventLoop::sInstance(0);
+
+EventLoop::EventLoop() : Thread(false), mEpollFd(-1), mWakeFd(-1),
+        mWakeups(0) {
+    memset(mSources, 0, sizeof(mSources));
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(mEpollFd < 0) {
+        ALOGE("%s: epoll_create1 failed: %s", __FUNCTION__, strerror(errno));
+        return;
+    }
+    mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(mWakeFd < 0) {
+        ALOGE("%s: eventfd failed: %s", __FUNCTION__, strerror(errno));
+        return;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = mWakeFd;
+    if(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &ev) < 0) {
+        ALOGE("%s: epoll_ctl failed: %s", __FUNCTION__, strerror(errno));
+    }
+}
+
+EventLoop::~EventLoop() {
+    if(mWakeFd >= 0)
+        close(mWakeFd);
+    if(mEpollFd >= 0)
+        close(mEpollFd);
+}
+
+EventLoop *EventLoop::getInstance() {
+    if(sInstance.get() == NULL)
+        sInstance = new EventLoop();
+    return sInstance.get();
+}
+
+int EventLoop::findSource(int fd) const {
+    for(int i = 0; i < MAX_SOURCES; i++) {
+        if(mSources[i].mInUse && mSources[i].mFd == fd)
+            return i;
+    }
+    return -1;
+}
+
+int EventLoop::addSource(const char *name, int fd, uint32_t events,
+        EventHandler handler, void *data) {
+    Locker::Autolock _l(mLock);
+    if(mEpollFd < 0 || fd < 0 || !handler)
+        return -EINVAL;
+    if(findSource(fd) >= 0)
+        return -EEXIST;
+    int slot = -1;
+    for(int i = 0; i < MAX_SOURCES; i++) {
+        if(!mSources[i].mInUse) {
+            slot = i;
+            break;
+        }
+    }
+    if(slot < 0) {
+        ALOGE("%s: no room for source %s", __FUNCTION__, name);
+        return -ENOSPC;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        int err = errno;
+        ALOGE("%s: epoll_ctl for %s failed: %s", __FUNCTION__, name,
+                strerror(err));
+        return -err;
+    }
+
+    Source& src = mSources[slot];
+    memset(&src, 0, sizeof(src));
+    src.mInUse = true;
+    src.mFd = fd;
+    strlcpy(src.mName, name, sizeof(src.mName));
+    src.mHandler = handler;
+    src.mData = data;
+    return 0;
+}
+
+int EventLoop::removeSource(int fd) {
+    Locker::Autolock _l(mLock);
+    int slot = findSource(fd);
+    if(slot < 0)
+        return -ENOENT;
+    if(epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL) < 0) {
+        ALOGE("%s: epoll_ctl for %s failed: %s", __FUNCTION__,
+                mSources[slot].mName, strerror(errno));
+    }
+    mSources[slot].mInUse = false;
+    return 0;
+}
+
+void EventLoop::setEventTime(int fd, const nsecs_t& when) {
+    Locker::Autolock _l(mLock);
+    int slot = findSource(fd);
+    if(slot >= 0)
+        mSources[slot].mEventTime = when;
+}
+
+void EventLoop::wake() {
+    uint64_t one = 1;
+    if(write(mWakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        ALOGE("%s: write failed: %s", __FUNCTION__, strerror(errno));
+    }
+}
+
+int EventLoop::runOnce(int timeoutMs) {
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(mEpollFd, events, MAX_EVENTS, timeoutMs);
+    if(count < 0)
+        return -errno;
+    nsecs_t woke = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    int handled = 0;
+    for(int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        if(fd == mWakeFd) {
+            uint64_t value;
+            if(read(mWakeFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                ALOGE("%s: read failed: %s", __FUNCTION__, strerror(errno));
+            continue;
+        }
+
+        EventHandler handler = NULL;
+        void *data = NULL;
+        {
+            Locker::Autolock _l(mLock);
+            int slot = findSource(fd);
+            //Removed since the wait
+            if(slot < 0)
+                continue;
+            handler = mSources[slot].mHandler;
+            data = mSources[slot].mData;
+            mSources[slot].mEventTime = 0;
+        }
+
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        handler(data, fd, events[i].events);
+        nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+        handled++;
+
+        Locker::Autolock _l(mLock);
+        int slot = findSource(fd);
+        if(slot < 0)
+            continue;
+        Source& src = mSources[slot];
+        src.mCount++;
+        if(start - woke > src.mMaxDispatch)
+            src.mMaxDispatch = start - woke;
+        src.mTotalRun += end - start;
+        if(end - start > src.mMaxRun)
+            src.mMaxRun = end - start;
+        if(src.mEventTime && src.mEventTime <= start) {
+            nsecs_t latency = start - src.mEventTime;
+            src.mLatencyCount++;
+            src.mTotalLatency += latency;
+            if(latency > src.mMaxLatency)
+                src.mMaxLatency = latency;
+        }
+    }
+
+    Locker::Autolock _l(mLock);
+    mWakeups++;
+    return handled;
+}
+
+int EventLoop::start(const char *name, int priority) {
+    if(mEpollFd < 0)
+        return -ENODEV;
+    return run(name, priority);
+}
+
+bool EventLoop::threadLoop() {
+    int ret = runOnce(-1);
+    if(ret < 0 && ret != -EINTR) {
+        ALOGE("%s: epoll_wait failed: %s", __FUNCTION__, strerror(-ret));
+        return false;
+    }
+    return true;
+}
+
+void EventLoop::getDump(char *buf, size_t len) {
+    Locker::Autolock _l(mLock);
+    char str[256] = {'\0'};
+    snprintf(str, sizeof(str), "Event loop wakeups: %u\n", mWakeups);
+    strncat(buf, str, len - strlen(buf) - 1);
+    for(int i = 0; i < MAX_SOURCES; i++) {
+        const Source& src = mSources[i];
+        if(!src.mInUse)
+            continue;
+        snprintf(str, sizeof(str), "  %-10s events=%u dispatch max=%lldus "
+                "run avg=%lldus max=%lldus latency avg=%lldus max=%lldus\n",
+                src.mName, src.mCount, ns2us(src.mMaxDispatch),
+                src.mCount ? ns2us(src.mTotalRun / src.mCount) : 0,
+                ns2us(src.mMaxRun),
+                src.mLatencyCount ?
+                    ns2us(src.mTotalLatency / src.mLatencyCount) : 0,
+                ns2us(src.mMaxLatency));
+        strncat(buf, str, len - strlen(buf) - 1);
+    }
+}
+
+}; //namespace qdutils
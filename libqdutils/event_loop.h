@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INCLUDE_LIBQCOMUTILS_EVENTLOOP
+#define INCLUDE_LIBQCOMUTILS_EVENTLOOP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/epoll.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <gr.h>
+
+namespace qdutils {
+
+/* Runs on the loop thread when the fd of a source has events */
+typedef void (*EventHandler)(void *data, int fd, uint32_t events);
+
+/*
+ * One thread waiting on an epoll set for the display event sources: the
+ * sysfs vsync fd, the uevent socket, timerfds and eventfds. Handlers run on
+ * that thread, one at a time, so they must not block.
+ * For each source it counts events and measures the time from the wakeup
+ * to its handler and the time the handler took. A handler that knows when
+ * its event happened, like a vsync timestamp, reports it with
+ * setEventTime() to get the event to callback latency too.
+ * runOnce() runs an iteration on the calling thread instead, so that the
+ * loop can be driven on a host with pipes or eventfds as fake sources.
+ */
+class EventLoop : public android::Thread {
+public:
+    enum { MAX_SOURCES = 8, NAME_LEN = 16 };
+
+    EventLoop();
+    ~EventLoop();
+    /* Watches fd for events, EPOLLIN, EPOLLPRI etc. Level triggered.
+     * Returns 0 or -errno */
+    int addSource(const char *name, int fd, uint32_t events,
+            EventHandler handler, void *data);
+    /* Stops watching fd. Its handler may still be running */
+    int removeSource(int fd);
+    /* When the event being handled for fd happened, from its handler */
+    void setEventTime(int fd, const nsecs_t& when);
+    /* Waits up to timeoutMs, -1 for ever, and runs the handlers of the
+     * sources that are ready. Returns the handlers run, or -errno */
+    int runOnce(int timeoutMs);
+    /* Runs the loop on its own thread */
+    int start(const char *name, int priority);
+    /* Makes a wait in runOnce() return, from any thread */
+    void wake();
+    /* Returns the per source stats.
+     * Expects a NULL terminated buffer of big enough size.
+     */
+    void getDump(char *buf, size_t len);
+
+    /* The loop of the display HAL */
+    static EventLoop *getInstance();
+
+    virtual bool threadLoop();
+
+private:
+    enum { MAX_EVENTS = MAX_SOURCES + 1 };
+    struct Source {
+        bool mInUse;
+        int mFd;
+        char mName[NAME_LEN];
+        EventHandler mHandler;
+        void *mData;
+        //Set by setEventTime() for the current event
+        nsecs_t mEventTime;
+        uint32_t mCount;
+        nsecs_t mMaxDispatch;
+        nsecs_t mTotalRun;
+        nsecs_t mMaxRun;
+        uint32_t mLatencyCount;
+        nsecs_t mTotalLatency;
+        nsecs_t mMaxLatency;
+    };
+
+    int findSource(int fd) const;
+
+    int mEpollFd;
+    //eventfd for wake()
+    int mWakeFd;
+    Source mSources[MAX_SOURCES];
+    uint32_t mWakeups;
+    mutable Locker mLock;
+    static android::sp<EventLoop> sInstance;
+};
+
+}; //namespace qdutils
+#endif //INCLUDE_LIBQCOMUTILS_EVENTLOOP
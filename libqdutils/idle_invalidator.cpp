@@ -29,58 +29,144 @@
 
 #include "idle_invalidator.h"
 #include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/timerfd.h>
 
 #define II_DEBUG 0
 
-static const char *threadName = "Invalidator";
 InvalidatorHandler IdleInvalidator::mHandler = NULL;
 android::sp<IdleInvalidator> IdleInvalidator::sInstance(0);
 
-IdleInvalidator::IdleInvalidator(): Thread(false), mHwcContext(0),
-    mSleepAgain(false), mSleepTime(0) {
+IdleInvalidator::IdleInvalidator(): mHwcContext(0), mLoop(NULL),
+    mTimerFd(-1), mIdleTime(0), mArmedTime(0) {
         ALOGD_IF(II_DEBUG, "%s", __func__);
+        memset(mLastUpdate, 0, sizeof(mLastUpdate));
+        memset(mWaiting, 0, sizeof(mWaiting));
     }
 
+IdleInvalidator::~IdleInvalidator() {
+    if(mTimerFd >= 0) {
+        if(mLoop)
+            mLoop->removeSource(mTimerFd);
+        close(mTimerFd);
+    }
+}
+
 int IdleInvalidator::init(InvalidatorHandler reg_handler, void* user_data,
-                          unsigned int idleSleepTime) {
+                          unsigned int idleSleepTime,
+                          qdutils::EventLoop *loop) {
     ALOGD_IF(II_DEBUG, "%s", __func__);
 
     Locker::Autolock _l(mLock);
     /* store registered handler */
     mHandler = reg_handler;
     mHwcContext = user_data;
-    mSleepTime = idleSleepTime; //Time in millis
+    mIdleTime = ms2ns(idleSleepTime);
+    if(mTimerFd < 0) {
+        mTimerFd = timerfd_create(CLOCK_MONOTONIC,
+                TFD_CLOEXEC | TFD_NONBLOCK);
+        if(mTimerFd < 0) {
+            ALOGE("%s: timerfd_create failed: %s", __FUNCTION__,
+                    strerror(errno));
+            return -errno;
+        }
+        int ret = loop->addSource("idle", mTimerFd, EPOLLIN, onTimer, this);
+        if(ret < 0) {
+            close(mTimerFd);
+            mTimerFd = -1;
+            return ret;
+        }
+        mLoop = loop;
+    }
     return 0;
 }
 
-bool IdleInvalidator::threadLoop() {
-    ALOGD_IF(II_DEBUG, "%s", __func__);
-    usleep(mSleepTime * 500);
+void IdleInvalidator::arm(const nsecs_t& when) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = when / 1000000000LL;
+    spec.it_value.tv_nsec = when % 1000000000LL;
+    if(timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        ALOGE("%s: timerfd_settime failed: %s", __FUNCTION__,
+                strerror(errno));
+        mArmedTime = 0;
+        return;
+    }
+    mArmedTime = when;
+}
 
+void IdleInvalidator::markForSleep(int dpy) {
+    if(dpy < 0 || dpy >= MAX_DISPLAYS)
+        return;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
     Locker::Autolock _l(mLock);
-    if(mSleepAgain) {
-        //We need to sleep again!
-        mSleepAgain = false;
-        return true;
-    }
+    mLastUpdate[dpy] = now;
+    mWaiting[dpy] = true;
+    //An armed timer expires no later than this deadline and gets moved then
+    if(!mArmedTime && mTimerFd >= 0)
+        arm(now + mIdleTime);
+}
 
-    mHandler((void*)mHwcContext);
-    return false;
+void IdleInvalidator::cancel(int dpy) {
+    if(dpy < 0 || dpy >= MAX_DISPLAYS)
+        return;
+    Locker::Autolock _l(mLock);
+    mWaiting[dpy] = false;
 }
 
-int IdleInvalidator::readyToRun() {
-    ALOGD_IF(II_DEBUG, "%s", __func__);
-    return 0; /*NO_ERROR*/
+void IdleInvalidator::onTimer(void *data, int fd, uint32_t events) {
+    IdleInvalidator *self = (IdleInvalidator *)data;
+    uint64_t expirations = 0;
+    if(read(fd, &expirations, sizeof(expirations)) < 0) {
+        //Moved by markForSleep() since it expired
+        if(errno != EAGAIN)
+            ALOGE("%s: read failed: %s", __FUNCTION__, strerror(errno));
+        return;
+    }
+    self->handleTimeout();
 }
 
-void IdleInvalidator::onFirstRef() {
+void IdleInvalidator::handleTimeout() {
     ALOGD_IF(II_DEBUG, "%s", __func__);
+    bool idle[MAX_DISPLAYS] = {false};
+    {
+        Locker::Autolock _l(mLock);
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        nsecs_t next = 0;
+        mLoop->setEventTime(mTimerFd, mArmedTime);
+        for(int dpy = 0; dpy < MAX_DISPLAYS; dpy++) {
+            if(!mWaiting[dpy])
+                continue;
+            nsecs_t deadline = mLastUpdate[dpy] + mIdleTime;
+            if(deadline <= now) {
+                mWaiting[dpy] = false;
+                idle[dpy] = true;
+            } else if(!next || deadline < next) {
+                next = deadline;
+            }
+        }
+        mArmedTime = 0;
+        if(next)
+            arm(next);
+    }
+
+    for(int dpy = 0; dpy < MAX_DISPLAYS; dpy++) {
+        if(idle[dpy] && !mHandler((void*)mHwcContext, dpy))
+            retry(dpy);
+    }
 }
 
-void IdleInvalidator::markForSleep() {
-    mSleepAgain = true;
-    //Triggers the threadLoop to run, if not already running.
-    run(threadName, android::PRIORITY_AUDIO);
+void IdleInvalidator::retry(int dpy) {
+    Locker::Autolock _l(mLock);
+    //Updated since, its own idle time applies
+    if(mWaiting[dpy])
+        return;
+    nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + ms2ns(RETRY_MS);
+    mLastUpdate[dpy] = deadline - mIdleTime;
+    mWaiting[dpy] = true;
+    if(mTimerFd >= 0 && (!mArmedTime || deadline < mArmedTime))
+        arm(deadline);
 }
 
 IdleInvalidator *IdleInvalidator::getInstance() {
@@ -32,28 +32,57 @@
 
 #include <cutils/log.h>
 #include <utils/threads.h>
+#include <utils/Timers.h>
 #include <gr.h>
+#include "event_loop.h"
 
-typedef void (*InvalidatorHandler)(void*);
+/* Returns false if it could not handle the timeout without blocking, the
+ * display then times out again after a short retry delay */
+typedef bool (*InvalidatorHandler)(void*, int);
 
-class IdleInvalidator : public android::Thread {
+/*
+ * Tells when a display has had no updates for the idle time. A timerfd,
+ * watched by the display event loop, is armed for the earliest display
+ * deadline.
+ * markForSleep() only records the time of the update; the timer is moved
+ * when it expires, or set if it wasn't armed, so an updating display costs
+ * no syscall per frame. The handler is called on the event loop thread,
+ * once per idle period of a display, and again after a short delay if
+ * it was busy.
+ */
+class IdleInvalidator : public android::RefBase {
+    enum { MAX_DISPLAYS = 3, RETRY_MS = 4 };
     void *mHwcContext;
-    bool mSleepAgain;
-    unsigned int mSleepTime;
+    qdutils::EventLoop *mLoop;
+    int mTimerFd;
+    nsecs_t mIdleTime;
+    //Absolute time the timer is set to, 0 if disarmed
+    nsecs_t mArmedTime;
+    nsecs_t mLastUpdate[MAX_DISPLAYS];
+    bool mWaiting[MAX_DISPLAYS];
     static InvalidatorHandler mHandler;
     static android::sp<IdleInvalidator> sInstance;
     mutable Locker mLock;
 
+    /* Sets the timer to the absolute monotonic time */
+    void arm(const nsecs_t& when);
+    /* Timer expired, runs on the event loop */
+    void handleTimeout();
+    /* The handler was busy, times the display out again in RETRY_MS */
+    void retry(int dpy);
+    static void onTimer(void *data, int fd, uint32_t events);
+
     public:
     IdleInvalidator();
-    /* init timer obj */
+    ~IdleInvalidator();
+    /* init timer obj, watched by loop */
     int init(InvalidatorHandler reg_handler, void* user_data, unsigned int
-             idleSleepTime);
-    void markForSleep();
-    /*Overrides*/
-    virtual bool        threadLoop();
-    virtual int         readyToRun();
-    virtual void        onFirstRef();
+             idleSleepTime, qdutils::EventLoop *loop);
+    /* The display updated, restarts its idle time */
+    void markForSleep(int dpy);
+    /* No idle timeout for the display until its next update */
+    void cancel(int dpy);
+    unsigned int getIdleTime() const { return (unsigned int)ns2ms(mIdleTime); }
     static IdleInvalidator *getInstance();
 };
 
@@ -46,6 +46,7 @@ MDPVersion::MDPVersion()
     mMdpRev = 0;
     mRGBPipes = mVGPipes = 0;
     mDMAPipes = 0;
+    mFeatures = 0;
 
     if (ioctl(fb_fd, FBIOGET_FSCREENINFO, &fb_finfo) < 0) {
         ALOGE("FBIOGET_FSCREENINFO failed");
@@ -80,6 +81,9 @@ MDPVersion::MDPVersion()
                 mRGBPipes = metadata.data.caps.rgb_pipes;
                 mVGPipes = metadata.data.caps.vig_pipes;
                 mDMAPipes = metadata.data.caps.dma_pipes;
+#ifdef MDP_DECIMATION_EN
+                mFeatures = metadata.data.caps.features;
+#endif
             }
 #endif
         } else {
@@ -113,5 +117,18 @@ bool MDPVersion::is8x26() {
     return false;
 }
 
+int MDPVersion::getMaxMDPDownscale() {
+    //MDP 4 supports 1/8 downscale
+    return (mMDPVersion >= MDSS_V5) ? 4 : 8;
+}
+
+bool MDPVersion::supportsDecimation() {
+#ifdef MDP_DECIMATION_EN
+    return (mFeatures & MDP_DECIMATION_EN);
+#else
+    return false;
+#endif
+}
+
 }; //namespace qdutils
 
@@ -83,7 +83,16 @@ public:
     uint8_t getVGPipes() { return mVGPipes; }
     uint8_t getDMAPipes() { return mDMAPipes; }
     bool is8x26();
+    /* Widest source crop a single pipe can fetch */
+    int getMaxPipeWidth() { return MAX_PIPE_WIDTH; }
+    /* Downscale a pipe can do on its own, decimation excluded */
+    int getMaxMDPDownscale();
+    /* Whether pipes can decimate their source before scaling */
+    bool supportsDecimation();
+    /* log2 of the largest decimation */
+    int getMaxDecimation() { return MAX_DECIMATION; }
 private:
+    enum { MAX_PIPE_WIDTH = 2048, MAX_DECIMATION = 4 };
     int mMDPVersion;
     char mPanelType;
     bool mHasOverlay;
@@ -91,6 +100,7 @@ private:
     uint8_t mRGBPipes;
     uint8_t mVGPipes;
     uint8_t mDMAPipes;
+    uint32_t mFeatures;
 };
 }; //namespace qdutils
 #endif //INCLUDE_LIBQCOMUTILS_MDPVER
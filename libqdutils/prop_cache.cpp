@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <sys/_system_properties.h>
+#include "prop_cache.h"
+
+ANDROID_SINGLETON_STATIC_INSTANCE(qdutils::PropCache);
+namespace qdutils {
+
+const char *PropCache::sNames[PROP_COUNT] = {
+    "debug.egl.swapinterval",
+    "hw.cabl.yuv",
+    "debug.sf.dump.enable",
+    "debug.sf.dump.primary",
+    "debug.sf.dump.external",
+    "debug.sf.dump",
+    "debug.sf.dump.png",
+    "debug.sf.dump.gzip",
+    "debug.sf.capture",
+    "debug.mdpcomp.maxlayer",
+    "debug.hwc.copybit.renderbufs",
+    "debug.rotator.idle_timeout_ms",
+    "debug.rotator.num_bufs",
+    "persist.sys.actionsafe.width",
+    "persist.sys.actionsafe.height",
+    "persist.sys.wfd.virtual",
+};
+
+PropCache::PropCache()
+{
+    memset(mEntries, 0, sizeof(mEntries));
+    mInvalid = 0;
+    mRefreshes = 0;
+    mReads = 0;
+    mRefreshTime = 0;
+
+    //What reading them all used to cost each frame
+    char value[PROPERTY_VALUE_MAX];
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for(int i = 0; i < PROP_COUNT; i++) {
+        property_get(sNames[i], value, NULL);
+    }
+    mLoadTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    for(int i = 0; i < PROP_COUNT; i++) {
+        update(i, true);
+    }
+}
+
+void PropCache::store(const int& id, const char *value)
+{
+    Entry& entry = mEntries[id];
+    int32_t state = STATE_SET;
+    if(!strncmp(value, "true", strlen("true")) || atoi(value) != 0)
+        state |= STATE_TRUE;
+    android_atomic_release_store(atoi(value), &entry.mValue);
+    android_atomic_release_store(state, &entry.mState);
+}
+
+bool PropCache::update(const int& id, const bool& find)
+{
+    Entry& entry = mEntries[id];
+    if(!entry.mInfo) {
+        if(!find)
+            return false;
+        //Properties are never deleted, so a found one stays valid
+        entry.mInfo = __system_property_find(sNames[id]);
+        if(!entry.mInfo)
+            return false;
+        //Forces the first read
+        entry.mSerial = ~__system_property_serial(entry.mInfo);
+    }
+
+    uint32_t serial = __system_property_serial(entry.mInfo);
+    if(serial == entry.mSerial)
+        return false;
+
+    char name[PROP_NAME_MAX];
+    char value[PROP_VALUE_MAX];
+    //Reads retry on their own while a write is in progress
+    __system_property_read(entry.mInfo, name, value);
+    entry.mSerial = serial;
+    store(id, value);
+    return true;
+}
+
+void PropCache::refresh()
+{
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    bool find = (android_atomic_swap(0, &mInvalid) != 0) ||
+            (mRefreshes % FIND_INTERVAL) == 0;
+    for(int i = 0; i < PROP_COUNT; i++) {
+        if(update(i, find))
+            mReads++;
+    }
+    mRefreshes++;
+    mRefreshTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+}
+
+void PropCache::invalidate()
+{
+    android_atomic_release_store(1, &mInvalid);
+}
+
+bool PropCache::isSet(const ePropId& id)
+{
+    return (android_atomic_acquire_load(&mEntries[id].mState) & STATE_SET);
+}
+
+int PropCache::getInt(const ePropId& id, const int& def)
+{
+    if(!isSet(id))
+        return def;
+    return android_atomic_acquire_load(&mEntries[id].mValue);
+}
+
+bool PropCache::getBool(const ePropId& id, const bool& def)
+{
+    int32_t state = android_atomic_acquire_load(&mEntries[id].mState);
+    if(!(state & STATE_SET))
+        return def;
+    return (state & STATE_TRUE);
+}
+
+const char *PropCache::getName(const ePropId& id)
+{
+    return sNames[id];
+}
+
+void PropCache::getDump(char *buf, size_t len)
+{
+    char str[256] = {'\0'};
+    nsecs_t avg = mRefreshes ? (mRefreshTime / mRefreshes) : 0;
+    snprintf(str, 256, "Props refreshes=%u reads=%u avg refresh=%lldns "
+            "property_get all=%lldns\n", mRefreshes, mReads, avg,
+            mLoadTime);
+    strncat(buf, str, len - strlen(buf) - 1);
+}
+
+}; //namespace qdutils
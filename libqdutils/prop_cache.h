@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INCLUDE_LIBQCOMUTILS_PROPCACHE
+#define INCLUDE_LIBQCOMUTILS_PROPCACHE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <utils/Singleton.h>
+#include <utils/Timers.h>
+#include <cutils/properties.h>
+
+struct prop_info;
+
+using namespace android;
+namespace qdutils {
+
+/* Display properties read on per-frame or per-config paths */
+enum ePropId {
+    PROP_EGL_SWAP_INTERVAL,     // debug.egl.swapinterval
+    PROP_CABL_YUV,              // hw.cabl.yuv
+    PROP_SF_DUMP_ENABLE,        // debug.sf.dump.enable
+    PROP_SF_DUMP_PRIMARY,       // debug.sf.dump.primary
+    PROP_SF_DUMP_EXTERNAL,      // debug.sf.dump.external
+    PROP_SF_DUMP,               // debug.sf.dump
+    PROP_SF_DUMP_PNG,           // debug.sf.dump.png
+    PROP_SF_DUMP_GZIP,          // debug.sf.dump.gzip
+    PROP_SF_CAPTURE,            // debug.sf.capture
+    PROP_MDPCOMP_MAXLAYER,      // debug.mdpcomp.maxlayer
+    PROP_COPYBIT_RENDERBUFS,    // debug.hwc.copybit.renderbufs
+    PROP_ROT_IDLE_TIMEOUT_MS,   // debug.rotator.idle_timeout_ms
+    PROP_ROT_NUM_BUFS,          // debug.rotator.num_bufs
+    PROP_ACTIONSAFE_WIDTH,      // persist.sys.actionsafe.width
+    PROP_ACTIONSAFE_HEIGHT,     // persist.sys.actionsafe.height
+    PROP_WFD_VIRTUAL,           // persist.sys.wfd.virtual
+    PROP_COUNT
+};
+
+/* Snapshot of the display properties. All of them are read once, then
+ * refresh() re-reads only those whose serial in the property area moved,
+ * which is a load per property instead of a walk of the property trie.
+ * Properties not set yet are looked up again every FIND_INTERVAL refreshes,
+ * or at the next refresh after invalidate().
+ * refresh() is meant for the composition thread, once per frame. The
+ * accessors are lock free and can be used from any thread.
+ */
+class PropCache : public Singleton <PropCache>
+{
+public:
+    PropCache();
+    ~PropCache() { }
+    /* Re-reads the properties that changed */
+    void refresh();
+    /* Looks up every property again at the next refresh. Any thread */
+    void invalidate();
+    /* Whether the property is set */
+    bool isSet(const ePropId& id);
+    /* Property as a number, def if not set */
+    int getInt(const ePropId& id, const int& def);
+    /* "true" or a non zero number, def if not set */
+    bool getBool(const ePropId& id, const bool& def);
+    /* Name of the property */
+    static const char *getName(const ePropId& id);
+    /* Refresh stats against a property_get of every property.
+     * Expects a NULL terminated buffer of big enough size.
+     */
+    void getDump(char *buf, size_t len);
+
+private:
+    enum { FIND_INTERVAL = 60 };
+    enum { STATE_SET = 1 << 0, STATE_TRUE = 1 << 1 };
+    struct Entry {
+        const prop_info *mInfo;
+        uint32_t mSerial;
+        volatile int32_t mValue;
+        volatile int32_t mState;
+    };
+    /* Looks up the property if needed and reads it if its serial moved.
+     * Returns true if the value was read */
+    bool update(const int& id, const bool& find);
+    void store(const int& id, const char *value);
+
+    Entry mEntries[PROP_COUNT];
+    volatile int32_t mInvalid;
+    uint32_t mRefreshes;
+    uint32_t mReads;
+    nsecs_t mRefreshTime;
+    //Time a property_get() of each property took at load
+    nsecs_t mLoadTime;
+    static const char *sNames[PROP_COUNT];
+};
+
+}; //namespace qdutils
+#endif //INCLUDE_LIBQCOMUTILS_PROPCACHE
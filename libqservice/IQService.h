@@ -48,6 +48,10 @@ public:
         SET_HSIC_DATA,           // Set HSIC on dspp
 	GET_DISPLAY_VISIBLE_REGION,  // Get the visibleRegion for dpy
         SET_VIEW_FRAME,          // Set view frame of display
+        REFRESH_PROPERTIES,      // Re-read display properties
+        GET_HWC_METRICS,         // Get the composition counters
+        SET_FRAME_TIMELINE,      // Arm or disarm the frame timeline
+        GET_FRAME_TIMELINE,      // Get the frame timeline
         COMMAND_LIST_END = 400,
 
     };
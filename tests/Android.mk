@@ -0,0 +1,78 @@
+LOCAL_PATH := $(call my-dir)
+include $(LOCAL_PATH)/../common.mk
+
+# Software MDP model and reference compositor, test only
+include $(CLEAR_VARS)
+LOCAL_MODULE                  := libqdmdpmodel
+LOCAL_MODULE_TAGS             := tests
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdmdpmodel\"
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+LOCAL_SRC_FILES               := overlayMdpModel.cpp \
+                                 overlayRefCompositor.cpp
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE                  := qdisplay_tests
+LOCAL_MODULE_TAGS             := tests
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes) \
+                                 $(TOP)/external/skia/include/core \
+                                 $(TOP)/external/skia/include/images
+LOCAL_SHARED_LIBRARIES        := $(common_libs) liboverlay libqdutils \
+                                 libmemalloc libsync libdl libskia libz
+LOCAL_STATIC_LIBRARIES        := libqdmdpmodel
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdtests\"
+# copybit resolves the C2D entry points of c2dStub.cpp from the test itself
+LOCAL_CFLAGS                  += -DCOPYBIT_Z180=1 -DC2D_LIBRARY=NULL
+LOCAL_LDFLAGS                 := -rdynamic
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+LOCAL_SRC_FILES               := mdp_model_test.cpp \
+                                 ref_compositor_test.cpp \
+                                 pipe_solver_test.cpp \
+                                 rot_mem_test.cpp \
+                                 rot_session_test.cpp \
+                                 overlay_frame_test.cpp \
+                                 software_converter_test.cpp \
+                                 event_loop_test.cpp \
+                                 idle_invalidator_test.cpp \
+                                 display_snapshot_test.cpp \
+                                 ext_transform_test.cpp \
+                                 prop_cache_test.cpp \
+                                 dump_writer_test.cpp \
+                                 copybit_c2d_test.cpp \
+                                 c2dStub.cpp \
+                                 ../libhwcomposer/hwc_pipe_solver.cpp \
+                                 ../libhwcomposer/hwc_snapshot.cpp \
+                                 ../libhwcomposer/hwc_ext_transform.cpp \
+                                 ../libhwcomposer/hwc_dump_writer.cpp \
+                                 ../libcopybit/software_converter.cpp \
+                                 ../libcopybit/copybit_c2d.cpp
+include $(BUILD_NATIVE_TEST)
+
+# The overlay tests on the build host: the MDP model stands in for the
+# driver and serves the device nodes, hostTarget.cpp for the target libraries
+include $(CLEAR_VARS)
+LOCAL_MODULE                  := qdisplay_host_tests
+LOCAL_MODULE_TAGS             := tests
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
+LOCAL_SHARED_LIBRARIES        := liblog libutils libcutils
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdtests\"
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+LOCAL_SRC_FILES               := mdp_model_test.cpp \
+                                 ref_compositor_test.cpp \
+                                 pipe_solver_test.cpp \
+                                 rot_session_test.cpp \
+                                 overlay_frame_test.cpp \
+                                 overlayMdpModel.cpp \
+                                 overlayRefCompositor.cpp \
+                                 hostTarget.cpp \
+                                 ../liboverlay/overlay.cpp \
+                                 ../liboverlay/overlayUtils.cpp \
+                                 ../liboverlay/overlayMdp.cpp \
+                                 ../liboverlay/overlayRotator.cpp \
+                                 ../liboverlay/overlayMdpRot.cpp \
+                                 ../liboverlay/overlayMdssRot.cpp \
+                                 ../liboverlay/pipes/overlayGenPipe.cpp \
+                                 ../libqdutils/prop_cache.cpp \
+                                 ../libhwcomposer/hwc_pipe_solver.cpp
+include $(BUILD_HOST_NATIVE_TEST)
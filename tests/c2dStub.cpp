@@ -0,0 +1,296 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include "c2dStub.h"
+
+namespace c2dstub {
+
+namespace {
+
+/* Surfaces and mappings a batch of draws reads */
+struct Batch {
+    std::set<uint32> surfaces;
+    std::set<uint32> addrs;
+    nsecs_t done; // engine time the batch retires at
+};
+
+pthread_mutex_t sLock = PTHREAD_MUTEX_INITIALIZER;
+nsecs_t sLatency = 0;
+nsecs_t sEngineIdle = 0; // engine time the last flushed batch retires at
+uint32 sNextSurface = 1;
+uint32 sNextAddr = 0x1000;
+Stats sStats;
+Batch sOpen; // drawn, not flushed yet
+std::map<uint32, Batch> sFlushed; // by timestamp
+uint32 sNextTimestamp = 1;
+std::set<uint32> sSurfaces;
+// Kept in a vector, which stops allocating once it has grown to the most
+// mappings copybit holds, so the stub doesn't add to the allocations that
+// the tests count in copybit
+std::vector<uint32> sAddrs;
+std::map<uint32, uint32> sBindings; // surface -> gpu address it points at
+std::vector<C2D_RECT> sScissors;
+
+/* Whether a batch the engine has not retired yet reads the surface or
+ * address. Call locked. */
+bool inFlight(uint32 surface, uint32 addr) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    std::map<uint32, Batch>::iterator it;
+    for (it = sFlushed.begin(); it != sFlushed.end(); ++it) {
+        if (it->second.done <= now)
+            continue;
+        if ((surface && it->second.surfaces.count(surface)) ||
+            (addr && it->second.addrs.count(addr)))
+            return true;
+    }
+    return false;
+}
+
+void sleepUntil(nsecs_t when) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (when > now)
+        usleep((useconds_t)ns2us(when - now));
+}
+
+/* Retire time of a batch handed to the engine now. Call locked. */
+nsecs_t submit() {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sEngineIdle = (sEngineIdle > now ? sEngineIdle : now) + sLatency;
+    return sEngineIdle;
+}
+
+uint32 countInFlight() {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    uint32 count = 0;
+    std::map<uint32, Batch>::iterator it;
+    for (it = sFlushed.begin(); it != sFlushed.end(); ++it) {
+        if (it->second.done > now)
+            count++;
+    }
+    return count;
+}
+
+} //namespace
+
+void reset(nsecs_t latency) {
+    pthread_mutex_lock(&sLock);
+    sLatency = latency;
+    sEngineIdle = 0;
+    memset(&sStats, 0, sizeof(sStats));
+    sStats.surfaces = sSurfaces.size();
+    sStats.mapped = sAddrs.size();
+    sOpen = Batch();
+    sFlushed.clear();
+    sScissors.clear();
+    pthread_mutex_unlock(&sLock);
+}
+
+Stats getStats() {
+    pthread_mutex_lock(&sLock);
+    Stats stats = sStats;
+    pthread_mutex_unlock(&sLock);
+    return stats;
+}
+
+std::vector<C2D_RECT> getScissors() {
+    pthread_mutex_lock(&sLock);
+    std::vector<C2D_RECT> scissors = sScissors;
+    pthread_mutex_unlock(&sLock);
+    return scissors;
+}
+
+} //namespace c2dstub
+
+using namespace c2dstub;
+
+/* The address a surface definition points the engine at */
+static uint32 getPhys(C2D_SURFACE_TYPE type, void *definition) {
+    if ((type & 0x7) == C2D_SURFACE_YUV_HOST)
+        return (uint32)(uintptr_t)((C2D_YUV_SURFACE_DEF*)definition)->phys0;
+    return (uint32)(uintptr_t)((C2D_RGB_SURFACE_DEF*)definition)->phys;
+}
+
+extern "C" {
+
+C2D_STATUS c2dCreateSurface(uint32 *surface_id, uint32, C2D_SURFACE_TYPE,
+                            void *) {
+    pthread_mutex_lock(&sLock);
+    *surface_id = sNextSurface++;
+    sSurfaces.insert(*surface_id);
+    sStats.surfaces = sSurfaces.size();
+    pthread_mutex_unlock(&sLock);
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dUpdateSurface(uint32 surface_id, uint32,
+                            C2D_SURFACE_TYPE surface_type,
+                            void *surface_definition) {
+    pthread_mutex_lock(&sLock);
+    C2D_STATUS status = C2D_STATUS_OK;
+    if (!sSurfaces.count(surface_id)) {
+        status = C2D_STATUS_INVALID_PARAM;
+    } else {
+        if (inFlight(surface_id, 0))
+            sStats.hazards++;
+        sBindings[surface_id] = getPhys(surface_type, surface_definition);
+    }
+    pthread_mutex_unlock(&sLock);
+    return status;
+}
+
+C2D_STATUS c2dReadSurface(uint32, C2D_SURFACE_TYPE, void *, int32, int32) {
+    return C2D_STATUS_NOT_SUPPORTED;
+}
+
+C2D_STATUS c2dDraw(uint32 target_id, uint32, C2D_RECT *target_scissor,
+                   uint32, uint32, C2D_OBJECT *objects_list,
+                   uint32 num_objects) {
+    pthread_mutex_lock(&sLock);
+    sStats.draws++;
+    C2D_RECT none = {0, 0, 0, 0};
+    sScissors.push_back(target_scissor ? *target_scissor : none);
+    sOpen.surfaces.insert(target_id);
+    sOpen.addrs.insert(sBindings[target_id]);
+    C2D_OBJECT *object = objects_list;
+    for (uint32 i = 0; object && (!num_objects || i < num_objects); i++) {
+        sOpen.surfaces.insert(object->surface_id);
+        sOpen.addrs.insert(sBindings[object->surface_id]);
+        object = object->next;
+    }
+    pthread_mutex_unlock(&sLock);
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dFlush(uint32, c2d_ts_handle *timestamp) {
+    pthread_mutex_lock(&sLock);
+    uint32 ts = sNextTimestamp++;
+    sOpen.done = submit();
+    sFlushed[ts] = sOpen;
+    sOpen = Batch();
+    sStats.flushes++;
+    uint32 count = countInFlight();
+    if (count > sStats.maxInFlight)
+        sStats.maxInFlight = count;
+    *timestamp = (c2d_ts_handle)(uintptr_t)ts;
+    pthread_mutex_unlock(&sLock);
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dWaitTimestamp(c2d_ts_handle timestamp) {
+    pthread_mutex_lock(&sLock);
+    uint32 ts = (uint32)(uintptr_t)timestamp;
+    nsecs_t done = sFlushed.count(ts) ? sFlushed[ts].done : 0;
+    pthread_mutex_unlock(&sLock);
+    sleepUntil(done);
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dFinish(uint32) {
+    pthread_mutex_lock(&sLock);
+    // The engine works in order, so the batch waits for the flushed ones
+    nsecs_t done = sOpen.surfaces.empty() ? sEngineIdle : submit();
+    sOpen = Batch();
+    sStats.finishes++;
+    pthread_mutex_unlock(&sLock);
+    sleepUntil(done);
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dDestroySurface(uint32 surface_id) {
+    pthread_mutex_lock(&sLock);
+    C2D_STATUS status = C2D_STATUS_OK;
+    if (!sSurfaces.erase(surface_id)) {
+        status = C2D_STATUS_INVALID_PARAM;
+    } else {
+        if (inFlight(surface_id, 0))
+            sStats.hazards++;
+        sBindings.erase(surface_id);
+    }
+    sStats.surfaces = sSurfaces.size();
+    pthread_mutex_unlock(&sLock);
+    return status;
+}
+
+C2D_STATUS c2dMapAddr(int, void *, uint32, uint32, uint32, void **gpuaddr) {
+    pthread_mutex_lock(&sLock);
+    uint32 addr = sNextAddr;
+    sNextAddr += 0x1000;
+    sAddrs.push_back(addr);
+    sStats.mapped = sAddrs.size();
+    *gpuaddr = (void*)(uintptr_t)addr;
+    pthread_mutex_unlock(&sLock);
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dUnMapAddr(void *gpuaddr) {
+    pthread_mutex_lock(&sLock);
+    uint32 addr = (uint32)(uintptr_t)gpuaddr;
+    C2D_STATUS status = C2D_STATUS_OK;
+    std::vector<uint32>::iterator it =
+            std::find(sAddrs.begin(), sAddrs.end(), addr);
+    if (it == sAddrs.end()) {
+        status = C2D_STATUS_INVALID_PARAM;
+    } else {
+        sAddrs.erase(it);
+        if (inFlight(0, addr))
+            sStats.hazards++;
+    }
+    sStats.mapped = sAddrs.size();
+    pthread_mutex_unlock(&sLock);
+    return status;
+}
+
+C2D_STATUS c2dGetDriverCapabilities(C2D_DRIVER_INFO *driver_info) {
+    memset(driver_info, 0, sizeof(*driver_info));
+    // Like A3xx, so a transform change does not force a finish
+    driver_info->capabilities_mask =
+            C2D_DRIVER_SUPPORTS_OVERRIDE_TARGET_ROTATE_OP;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dCreateFenceFD(uint32, c2d_ts_handle, int32 *fd) {
+    *fd = -1;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dFillSurface(uint32 surface_id, uint32, C2D_RECT *) {
+    pthread_mutex_lock(&sLock);
+    if (inFlight(surface_id, 0))
+        sStats.hazards++;
+    pthread_mutex_unlock(&sLock);
+    return C2D_STATUS_OK;
+}
+
+} //extern "C"
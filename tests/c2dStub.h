@@ -0,0 +1,66 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef C2D_STUB_H
+#define C2D_STUB_H
+
+#include <stdint.h>
+#include <vector>
+#include <utils/Timers.h>
+#include "c2d2.h"
+
+namespace c2dstub {
+
+/*
+ * Stand-in for the C2D driver, so copybit can be run on a host. The tests
+ * build copybit with C2D_LIBRARY=NULL, which resolves the c2d* entry
+ * points defined here from the test binary itself.
+ * Draws are not rendered. The engine retires each flushed batch a fixed
+ * time after the previous one, and the stub flags any surface update or
+ * unmap of an address that a batch still in flight reads.
+ */
+struct Stats {
+    uint32_t surfaces;      // live surfaces
+    uint32_t mapped;        // live gpu address mappings
+    uint32_t draws;         // c2dDraw calls
+    uint32_t flushes;       // batches handed over with c2dFlush
+    uint32_t finishes;      // batches completed with c2dFinish
+    uint32_t maxInFlight;   // most flushed batches the engine held at once
+    uint32_t hazards;       // surfaces or mappings changed while in flight
+};
+
+/* Forget all state, the engine takes latency to retire a batch */
+void reset(nsecs_t latency);
+Stats getStats();
+/* Scissor of every draw since the reset, {0, 0, 0, 0} if none was given */
+std::vector<C2D_RECT> getScissors();
+
+} //namespace c2dstub
+
+#endif // C2D_STUB_H
@@ -0,0 +1,354 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <utils/Timers.h>
+#include <gralloc_priv.h>
+#include "copybit.h"
+#include "c2dStub.h"
+
+extern struct copybit_module_t HAL_MODULE_INFO_SYM;
+
+// Heap allocations made while sCountAllocs is set
+static volatile int sAllocs = 0;
+static volatile bool sCountAllocs = false;
+
+void *operator new(size_t size) {
+    if (sCountAllocs)
+        sAllocs++;
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr)
+        abort();
+    return ptr;
+}
+
+void operator delete(void *ptr) throw() {
+    free(ptr);
+}
+
+namespace {
+
+enum {
+    WIDTH = 1080,
+    HEIGHT = 1920,
+    NUM_LAYERS = 3,
+    NUM_FRAMES = 20,
+    // Three frames queued on the engine plus the one being flushed
+    MAX_IN_FLIGHT = 4,
+    // C2D_TILE_MIN_WIDTH and C2D_TILE_HEIGHT of copybit_c2d.cpp
+    TILE_MIN_WIDTH = 2048,
+    TILE_HEIGHT = 256,
+    WIDE_WIDTH = 2560,
+    WIDE_HEIGHT = 1600,
+};
+
+/* Iterates a single clip rectangle */
+struct OneRect : public copybit_region_t {
+    OneRect(const copybit_rect_t& rect) : mRect(rect), mDone(false) {
+        next = iterate;
+    }
+    static int iterate(copybit_region_t const *self, copybit_rect_t *rect) {
+        OneRect* me = (OneRect*)self;
+        if (me->mDone)
+            return 0;
+        *rect = me->mRect;
+        me->mDone = true;
+        return 1;
+    }
+    copybit_rect_t mRect;
+    bool mDone;
+};
+
+/* An ion buffer copybit maps itself. The stub never touches the pixels. */
+struct Buffer {
+    Buffer(int w, int h, int format) :
+            hnd(-1, w * h * 4, private_handle_t::PRIV_FLAGS_USES_ION, 0,
+                format, w, h) {
+        static int sNextBase = 0x10000000;
+        hnd.base = sNextBase;
+        sNextBase += 0x1000000;
+        img.w = w;
+        img.h = h;
+        img.format = format;
+        img.base = (void*)hnd.base;
+        img.handle = &hnd;
+        img.horiz_padding = 0;
+        img.vert_padding = 0;
+    }
+    private_handle_t hnd;
+    copybit_image_t img;
+};
+
+class CopybitC2dTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        mDev = NULL;
+        hw_device_t* dev = NULL;
+        ASSERT_EQ(0, HAL_MODULE_INFO_SYM.common.methods->open(
+                &HAL_MODULE_INFO_SYM.common, COPYBIT_HARDWARE_COPYBIT0,
+                &dev));
+        mDev = (copybit_device_t*)dev;
+    }
+
+    virtual void TearDown() {
+        if (mDev)
+            mDev->common.close(&mDev->common);
+        // Closing retires the frames still in flight
+        c2dstub::Stats stats = c2dstub::getStats();
+        EXPECT_EQ(0u, stats.surfaces);
+        EXPECT_EQ(0u, stats.mapped);
+    }
+
+    /* Composes one frame of layers the way hwc does, full screen each */
+    void compose(Buffer& dst, Buffer* layers, int count) {
+        copybit_rect_t full = {0, 0, (int)dst.img.w, (int)dst.img.h};
+        ASSERT_EQ(0, mDev->clear(mDev, &dst.img, &full));
+        for (int i = 0; i < count; i++) {
+            copybit_rect_t src = {0, 0, (int)layers[i].img.w,
+                                  (int)layers[i].img.h};
+            OneRect region(full);
+            mDev->set_parameter(mDev, COPYBIT_TRANSFORM, 0);
+            mDev->set_parameter(mDev, COPYBIT_PLANE_ALPHA, 255);
+            mDev->set_parameter(mDev, COPYBIT_BLEND_MODE,
+                                COPYBIT_BLENDING_PREMULT);
+            ASSERT_EQ(0, mDev->stretch(mDev, &dst.img, &layers[i].img,
+                                       &full, &src, &region));
+        }
+    }
+
+    /* Draws one layer to rect of dst, with transform, in a frame of its
+     * own. Returns the scissor of every c2dDraw of the frame. */
+    std::vector<C2D_RECT> drawOne(Buffer& dst, const copybit_rect_t& rect,
+                                  int transform) {
+        Buffer layer(rect.r - rect.l, rect.b - rect.t,
+                     HAL_PIXEL_FORMAT_RGBA_8888);
+        copybit_rect_t src = {0, 0, (int)layer.img.w, (int)layer.img.h};
+        copybit_rect_t full = {0, 0, (int)dst.img.w, (int)dst.img.h};
+        OneRect region(rect);
+        c2dstub::reset(0);
+        EXPECT_EQ(0, mDev->clear(mDev, &dst.img, &full));
+        mDev->set_parameter(mDev, COPYBIT_TRANSFORM, transform);
+        mDev->set_parameter(mDev, COPYBIT_PLANE_ALPHA, 255);
+        mDev->set_parameter(mDev, COPYBIT_BLEND_MODE,
+                            COPYBIT_BLENDING_NONE);
+        EXPECT_EQ(0, mDev->stretch(mDev, &dst.img, &layer.img, &rect, &src,
+                                   &region));
+        EXPECT_EQ(0, mDev->finish(mDev));
+        return c2dstub::getScissors();
+    }
+
+    /* Runs the frames with cpuTime of other work per frame, pipelined
+     * through flush_get_fence or waited for with finish. Returns the
+     * average frame time. */
+    nsecs_t runFrames(nsecs_t cpuTime, bool pipelined) {
+        Buffer dst[3] = {
+            Buffer(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888),
+            Buffer(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888),
+            Buffer(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888),
+        };
+        Buffer layers[NUM_LAYERS] = {
+            Buffer(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888),
+            Buffer(WIDTH, HEIGHT / 2, HAL_PIXEL_FORMAT_RGBX_8888),
+            Buffer(WIDTH / 2, HEIGHT / 2, HAL_PIXEL_FORMAT_RGB_565),
+        };
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < NUM_FRAMES; i++) {
+            usleep((useconds_t)ns2us(cpuTime));
+            compose(dst[i % 3], layers, NUM_LAYERS);
+            if (pipelined) {
+                int fd = -1;
+                EXPECT_EQ(0, mDev->flush_get_fence(mDev, &fd));
+            } else {
+                EXPECT_EQ(0, mDev->finish(mDev));
+            }
+        }
+        return (systemTime(SYSTEM_TIME_MONOTONIC) - start) / NUM_FRAMES;
+    }
+
+    copybit_device_t* mDev;
+};
+
+TEST_F(CopybitC2dTest, FramesInFlightNeverShareSurfaces) {
+    c2dstub::reset(ms2ns(4));
+    runFrames(0, true);
+    c2dstub::Stats stats = c2dstub::getStats();
+    printf("%u frames, at most %u in flight\n", stats.flushes,
+           stats.maxInFlight);
+    EXPECT_EQ((uint32_t)NUM_FRAMES, stats.flushes);
+    EXPECT_EQ(0u, stats.hazards);
+    EXPECT_GE(stats.maxInFlight, 2u);
+    EXPECT_LE(stats.maxInFlight, (uint32_t)MAX_IN_FLIGHT);
+}
+
+TEST_F(CopybitC2dTest, PipelinedFramesOutrunFinishedFrames) {
+    // Other work per frame and engine time per frame are close, so
+    // overlapping them should come close to halving the frame time.
+    const nsecs_t cpuTime = ms2ns(3);
+    c2dstub::reset(ms2ns(4));
+    nsecs_t finished = runFrames(cpuTime, false);
+    c2dstub::reset(ms2ns(4));
+    nsecs_t pipelined = runFrames(cpuTime, true);
+    printf("finish: %.1f fps, flush_get_fence: %.1f fps\n",
+           1e9 / finished, 1e9 / pipelined);
+    EXPECT_EQ(0u, c2dstub::getStats().hazards);
+    EXPECT_LT(pipelined * 10, finished * 8);
+}
+
+TEST_F(CopybitC2dTest, BlitsDoNotAllocate) {
+    c2dstub::reset(0);
+    Buffer dst(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888);
+    Buffer layers[NUM_LAYERS] = {
+        Buffer(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888),
+        Buffer(WIDTH, HEIGHT / 2, HAL_PIXEL_FORMAT_RGBX_8888),
+        Buffer(WIDTH / 2, HEIGHT / 2, HAL_PIXEL_FORMAT_RGB_565),
+    };
+    // The first frame grows whatever keeps its size afterwards
+    compose(dst, layers, NUM_LAYERS);
+    EXPECT_EQ(0, mDev->finish(mDev));
+
+    // Only the blits are counted, the stub allocates when drawing
+    sAllocs = 0;
+    for (int i = 0; i < NUM_FRAMES; i++) {
+        sCountAllocs = true;
+        compose(dst, layers, NUM_LAYERS);
+        sCountAllocs = false;
+        EXPECT_EQ(0, mDev->finish(mDev));
+    }
+    EXPECT_EQ(0, sAllocs);
+}
+
+TEST_F(CopybitC2dTest, BenchBlit) {
+    enum { NUM_BENCH_FRAMES = 500 };
+    c2dstub::reset(0);
+    Buffer dst(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888);
+    Buffer layers[NUM_LAYERS] = {
+        Buffer(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888),
+        Buffer(WIDTH, HEIGHT / 2, HAL_PIXEL_FORMAT_RGBX_8888),
+        Buffer(WIDTH / 2, HEIGHT / 2, HAL_PIXEL_FORMAT_RGB_565),
+    };
+    // Time spent in copybit per blit, the engine being free. The clear of
+    // each frame is spread over its blits
+    nsecs_t blitTime = 0;
+    for (int i = 0; i < NUM_BENCH_FRAMES; i++) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        compose(dst, layers, NUM_LAYERS);
+        blitTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        EXPECT_EQ(0, mDev->finish(mDev));
+    }
+    const double perBlit = (double)blitTime / (NUM_BENCH_FRAMES * NUM_LAYERS);
+    printf("%.2f us per blit\n", perBlit / 1000);
+    // Far below the frame it is part of
+    EXPECT_LT(perBlit, (double)us2ns(100));
+}
+
+TEST_F(CopybitC2dTest, DrawsWideTargetsInBands) {
+    Buffer dst(WIDE_WIDTH, WIDE_HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888);
+    copybit_rect_t full = {0, 0, WIDE_WIDTH, WIDE_HEIGHT};
+    std::vector<C2D_RECT> bands = drawOne(dst, full, 0);
+
+    // Full width bands from the top, the last one cut at the bottom
+    const int numBands = (WIDE_HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    ASSERT_EQ((size_t)numBands, bands.size());
+    for (int i = 0; i < numBands; i++) {
+        int top = i * TILE_HEIGHT;
+        int height = WIDE_HEIGHT - top < TILE_HEIGHT ?
+                WIDE_HEIGHT - top : TILE_HEIGHT;
+        EXPECT_EQ(0, bands[i].x);
+        EXPECT_EQ(top, bands[i].y);
+        EXPECT_EQ(WIDE_WIDTH, bands[i].width);
+        EXPECT_EQ(height, bands[i].height);
+    }
+}
+
+TEST_F(CopybitC2dTest, SkipsBandsWithoutObjects) {
+    Buffer dst(WIDE_WIDTH, WIDE_HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888);
+    // Within the second band
+    copybit_rect_t strip = {100, TILE_HEIGHT + 44, 2400, TILE_HEIGHT + 164};
+    std::vector<C2D_RECT> bands = drawOne(dst, strip, 0);
+    ASSERT_EQ(1u, bands.size());
+    EXPECT_EQ(0, bands[0].x);
+    EXPECT_EQ(TILE_HEIGHT, bands[0].y);
+    EXPECT_EQ(WIDE_WIDTH, bands[0].width);
+    EXPECT_EQ(TILE_HEIGHT, bands[0].height);
+
+    // Across the second and third
+    copybit_rect_t across = {0, TILE_HEIGHT + 200, 512, 2 * TILE_HEIGHT + 10};
+    bands = drawOne(dst, across, 0);
+    ASSERT_EQ(2u, bands.size());
+    EXPECT_EQ(TILE_HEIGHT, bands[0].y);
+    EXPECT_EQ(2 * TILE_HEIGHT, bands[1].y);
+}
+
+TEST_F(CopybitC2dTest, DrawsOtherTargetsWhole) {
+    // Not wider than the limit
+    Buffer narrow(TILE_MIN_WIDTH, WIDE_HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888);
+    copybit_rect_t full = {0, 0, TILE_MIN_WIDTH, WIDE_HEIGHT};
+    std::vector<C2D_RECT> draws = drawOne(narrow, full, 0);
+    ASSERT_EQ(1u, draws.size());
+    EXPECT_EQ(0, draws[0].width);
+    EXPECT_EQ(0, draws[0].height);
+
+    // Rotated, where the scissor wouldn't be in target space
+    Buffer wide(WIDE_WIDTH, WIDE_HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888);
+    copybit_rect_t square = {0, 0, WIDE_HEIGHT, WIDE_HEIGHT};
+    draws = drawOne(wide, square, COPYBIT_TRANSFORM_ROT_90);
+    ASSERT_EQ(1u, draws.size());
+    EXPECT_EQ(0, draws[0].width);
+    EXPECT_EQ(0, draws[0].height);
+}
+
+TEST_F(CopybitC2dTest, BenchBandedDraw) {
+    enum { NUM_BENCH_FRAMES = 200 };
+    Buffer dst(WIDE_WIDTH, WIDE_HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888);
+    Buffer layers[NUM_LAYERS] = {
+        Buffer(WIDE_WIDTH, WIDE_HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888),
+        Buffer(WIDE_WIDTH, WIDE_HEIGHT / 2, HAL_PIXEL_FORMAT_RGBX_8888),
+        Buffer(WIDE_WIDTH / 2, WIDE_HEIGHT / 2, HAL_PIXEL_FORMAT_RGB_565),
+    };
+    // Time copybit takes to hand the banded frame to the engine, per draw
+    c2dstub::reset(0);
+    nsecs_t drawTime = 0;
+    for (int i = 0; i < NUM_BENCH_FRAMES; i++) {
+        compose(dst, layers, NUM_LAYERS);
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        EXPECT_EQ(0, mDev->finish(mDev));
+        drawTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    }
+    const uint32_t draws = c2dstub::getStats().draws;
+    EXPECT_EQ((uint32_t)(NUM_BENCH_FRAMES *
+              ((WIDE_HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT)), draws);
+    const double perDraw = (double)drawTime / draws;
+    printf("%u banded draws, %.2f us per draw\n", draws, perDraw / 1000);
+    EXPECT_LT(perDraw, (double)us2ns(100));
+}
+
+} //namespace
@@ -0,0 +1,208 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <utils/Timers.h>
+#include "hwc_utils.h"
+
+using namespace qhwc;
+
+namespace {
+
+enum { NUM_READERS = 3, RUN_MS = 300 };
+
+/* A publisher standing in for prepare, which rewrites the display state,
+ * one for QClient setViewFrame, which rewrites the view frames, and
+ * readers taking the QClient read path. Each writer derives all of the
+ * fields it writes from one counter, so a reader can tell a snapshot that
+ * mixes two publishes. */
+class DisplaySnapshotTest : public ::testing::Test {
+protected:
+    DisplaySnapshotTest() : mCtx(new hwc_context_t()), mStop(false),
+            mTorn(0), mBackwards(0), mReads(0), mPublishes(0) {
+        mCtx->mSnapshot = new DisplaySnapshotLock();
+    }
+    ~DisplaySnapshotTest() {
+        delete mCtx->mSnapshot;
+        delete mCtx;
+    }
+
+    static void setRect(hwc_rect_t& rect, const int& base) {
+        rect.left = base;
+        rect.top = base + 1;
+        rect.right = base + 2;
+        rect.bottom = base + 3;
+    }
+    static bool isRect(const hwc_rect_t& rect, const int& base) {
+        return rect.left == base && rect.top == base + 1 &&
+                rect.right == base + 2 && rect.bottom == base + 3;
+    }
+
+    void prepare(const int& k) {
+        Locker::Autolock _l(mCtx->mDrawLock);
+        for(int dpy = 0; dpy < HWC_NUM_DISPLAY_TYPES; dpy++) {
+            mCtx->dpyAttr[dpy].xres = k;
+            mCtx->dpyAttr[dpy].yres = k + dpy;
+            mCtx->dpyAttr[dpy].vsync_period = k * 3;
+            mCtx->dpyAttr[dpy].connected = k & 1;
+            setRect(mCtx->dpyAttr[dpy].mDstRect, k + dpy);
+        }
+        mCtx->deviceOrientation = k % 4;
+        mCtx->mExtOrientation = (k >> 1) % 4;
+        mCtx->mBufferMirrorMode = (k >> 3) & 1;
+        mCtx->mSnapshot->publish(mCtx);
+    }
+
+    void setViewFrame(const int& v) {
+        Locker::Autolock _l(mCtx->mDrawLock);
+        for(int dpy = 0; dpy < HWC_NUM_DISPLAY_TYPES; dpy++)
+            setRect(mCtx->mViewFrame[dpy], -v - dpy);
+        mCtx->mSnapshot->publish(mCtx);
+    }
+
+    //True if all of the fields come from the same publishes
+    static bool isConsistent(const DisplaySnapshot& s) {
+        int k = s.dpyAttr[0].xres;
+        int v = -s.viewFrame[0].left;
+        if(s.deviceOrientation != k % 4 || s.extOrientation != (k >> 1) % 4 ||
+                s.bufferMirrorMode != (bool)((k >> 3) & 1))
+            return false;
+        for(int dpy = 0; dpy < HWC_NUM_DISPLAY_TYPES; dpy++) {
+            const DisplayAttributes& attr = s.dpyAttr[dpy];
+            if(attr.xres != (uint32_t)k || attr.yres != (uint32_t)(k + dpy) ||
+                    attr.vsync_period != (uint32_t)(k * 3) ||
+                    attr.connected != (bool)(k & 1) ||
+                    !isRect(attr.mDstRect, k + dpy) ||
+                    !isRect(s.viewFrame[dpy], -v - dpy))
+                return false;
+            //What getDisplayVisibleRegion writes out
+            hwc_rect_t visible = s.getVisibleRegion(dpy);
+            bool dst = dpy && (s.extOrientation || s.bufferMirrorMode);
+            if(!isRect(visible, dst ? k + dpy : -v - dpy))
+                return false;
+        }
+        return true;
+    }
+
+    static void* prepareThread(void *data) {
+        DisplaySnapshotTest *self = (DisplaySnapshotTest *)data;
+        for(int k = 1; !__atomic_load_n(&self->mStop, __ATOMIC_RELAXED); k++) {
+            self->prepare(k);
+            __atomic_fetch_add(&self->mPublishes, 1, __ATOMIC_RELAXED);
+        }
+        return NULL;
+    }
+
+    static void* viewFrameThread(void *data) {
+        DisplaySnapshotTest *self = (DisplaySnapshotTest *)data;
+        for(int v = 1; !__atomic_load_n(&self->mStop, __ATOMIC_RELAXED); v++) {
+            self->setViewFrame(v);
+            __atomic_fetch_add(&self->mPublishes, 1, __ATOMIC_RELAXED);
+            if(!(v % 16))
+                sched_yield();
+        }
+        return NULL;
+    }
+
+    static void* readThread(void *data) {
+        DisplaySnapshotTest *self = (DisplaySnapshotTest *)data;
+        uint32_t lastVersion = 0;
+        while(!__atomic_load_n(&self->mStop, __ATOMIC_RELAXED)) {
+            DisplaySnapshot snapshot;
+            self->mCtx->mSnapshot->read(snapshot);
+            if(!isConsistent(snapshot))
+                __atomic_fetch_add(&self->mTorn, 1, __ATOMIC_RELAXED);
+            if(snapshot.version < lastVersion)
+                __atomic_fetch_add(&self->mBackwards, 1, __ATOMIC_RELAXED);
+            lastVersion = snapshot.version;
+            __atomic_fetch_add(&self->mReads, 1, __ATOMIC_RELAXED);
+        }
+        return NULL;
+    }
+
+    hwc_context_t *mCtx;
+    bool mStop;
+    int mTorn;
+    int mBackwards;
+    int mReads;
+    int mPublishes;
+};
+
+TEST_F(DisplaySnapshotTest, ReadsFollowPublishes) {
+    DisplaySnapshot snapshot;
+    mCtx->mSnapshot->read(snapshot);
+    EXPECT_EQ(0u, snapshot.version);
+
+    prepare(5);
+    setViewFrame(7);
+    mCtx->mSnapshot->read(snapshot);
+    EXPECT_EQ(2u, snapshot.version);
+    EXPECT_TRUE(isConsistent(snapshot));
+    EXPECT_EQ(5u, snapshot.dpyAttr[HWC_DISPLAY_EXTERNAL].xres);
+    //Orientation 2 on external, its destination rect is visible
+    EXPECT_TRUE(isRect(snapshot.getVisibleRegion(HWC_DISPLAY_EXTERNAL), 6));
+    EXPECT_TRUE(isRect(snapshot.getVisibleRegion(HWC_DISPLAY_PRIMARY), -7));
+
+    //Without orientation or mirroring the view frame is
+    prepare(1);
+    mCtx->mSnapshot->read(snapshot);
+    EXPECT_TRUE(isRect(snapshot.getVisibleRegion(HWC_DISPLAY_EXTERNAL), -8));
+}
+
+TEST_F(DisplaySnapshotTest, ConcurrentReadsAreNeverTorn) {
+    prepare(0);
+    setViewFrame(0);
+
+    pthread_t writers[2];
+    pthread_t readers[NUM_READERS];
+    ASSERT_EQ(0, pthread_create(&writers[0], NULL, prepareThread, this));
+    ASSERT_EQ(0, pthread_create(&writers[1], NULL, viewFrameThread, this));
+    for(int i = 0; i < NUM_READERS; i++)
+        ASSERT_EQ(0, pthread_create(&readers[i], NULL, readThread, this));
+
+    usleep(RUN_MS * 1000);
+    __atomic_store_n(&mStop, true, __ATOMIC_RELAXED);
+    for(int i = 0; i < 2; i++)
+        pthread_join(writers[i], NULL);
+    for(int i = 0; i < NUM_READERS; i++)
+        pthread_join(readers[i], NULL);
+
+    EXPECT_EQ(0, mTorn);
+    EXPECT_EQ(0, mBackwards);
+    EXPECT_GT(mPublishes, 1000);
+    EXPECT_GT(mReads, 1000);
+
+    DisplaySnapshot snapshot;
+    mCtx->mSnapshot->read(snapshot);
+    EXPECT_EQ((uint32_t)mPublishes + 2, snapshot.version);
+    EXPECT_TRUE(isConsistent(snapshot));
+}
+
+}; //namespace
@@ -0,0 +1,440 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <utils/Timers.h>
+#include "hwc_dump_layers.h"
+#include "qcap_reader.h"
+
+namespace qhwc {
+
+//A gralloc buffer to dump. private_handle_t keeps the base as an int, so
+//the memory is mapped rather than taken from the heap.
+struct DumpBuffer {
+    DumpBuffer(const int& size, const uint8_t& fill) :
+        mHnd(-1, size, 0, 0, HAL_PIXEL_FORMAT_RGBA_8888, size / 4, 1),
+        mLen(size) {
+        mMem = mmap(NULL, mLen, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        mHnd.base = (mMem == MAP_FAILED) ? 0 : (int)(intptr_t)mMem;
+        if(valid())
+            memset(mMem, fill, mLen);
+    }
+    ~DumpBuffer() {
+        if(mMem != MAP_FAILED)
+            munmap(mMem, mLen);
+    }
+    bool valid() const { return mHnd.base != 0; }
+
+    private_handle_t mHnd;
+    void *mMem;
+    size_t mLen;
+};
+
+/* A writer that isn't run: the test drains the queue in place of the
+ * writer thread, so the slots and counters only change when it says. */
+class DumpWriterTest : public ::testing::Test {
+protected:
+    enum {
+        SMALL = 4096,
+        BIG = 65536,
+        MAX_JOBS = DumpWriter::MAX_JOBS,
+        MAX_POOL_BYTES = DumpWriter::MAX_POOL_BYTES,
+    };
+
+    DumpWriterTest() : mWriter(new DumpWriter()), mDumps(0) {
+        const char *dir = getenv("TMPDIR");
+        snprintf(mDir, sizeof(mDir), "%s", dir ? dir : "/data/local/tmp");
+    }
+    ~DumpWriterTest() {
+        drain();
+        mWriter->trim();
+        for(int i = 0; i < mDumps; i++) {
+            char fileName[PATH_MAX];
+            getFileName(i, fileName);
+            unlink(fileName);
+        }
+    }
+
+    void getFileName(const int& i, char fileName[PATH_MAX]) {
+        snprintf(fileName, PATH_MAX, "%s/dump_writer_test.%d.%d.raw", mDir,
+                getpid(), i);
+    }
+    bool queue(const DumpBuffer& buf) {
+        char fileName[PATH_MAX];
+        getFileName(mDumps++, fileName);
+        return mWriter->queue(&buf.mHnd, DumpWriter::DUMP_RAW, fileName,
+                "dump_writer_test");
+    }
+    void drain() {
+        while(mWriter->mCount)
+            mWriter->threadLoop();
+    }
+    void setRate(const int64_t& rate) {
+        mWriter->mBudget = CopyBudget(rate);
+    }
+    //Bytes of the file of the i-th queued dump, -1 if there is none
+    long fileSize(const int& i) {
+        char fileName[PATH_MAX];
+        getFileName(i, fileName);
+        FILE *fp = fopen(fileName, "r");
+        if(!fp)
+            return -1;
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fclose(fp);
+        return size;
+    }
+    uint32_t queued() const { return mWriter->mQueued; }
+    uint32_t written() const { return mWriter->mWritten; }
+    uint32_t failed() const { return mWriter->mFailed; }
+    uint32_t droppedFull() const { return mWriter->mDroppedFull; }
+    uint32_t droppedRate() const { return mWriter->mDroppedRate; }
+    size_t poolBytes() const { return mWriter->mPoolBytes; }
+    size_t slotCapacity(const int& i) const {
+        return mWriter->mJobs[i].mCapacity;
+    }
+
+    android::sp<DumpWriter> mWriter;
+    char mDir[PATH_MAX];
+    int mDumps;
+};
+
+TEST(CopyBudgetTest, RefillsAtRateUpToTheBurst) {
+    CopyBudget budget(1000);
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    EXPECT_TRUE(budget.take(1000, now));
+    EXPECT_FALSE(budget.take(1, now));
+    //Half a second buys half the rate
+    now += ms2ns(500);
+    EXPECT_FALSE(budget.take(501, now));
+    EXPECT_TRUE(budget.take(500, now));
+    EXPECT_EQ(0, budget.getBudget());
+    //A long idle stretch refills only up to the burst
+    now += s2ns(10);
+    EXPECT_TRUE(budget.take(1, now));
+    EXPECT_EQ(999, budget.getBudget());
+}
+
+TEST_F(DumpWriterTest, CountsRateDrops) {
+    DumpBuffer buf(SMALL, 0x5a);
+    ASSERT_TRUE(buf.valid());
+    //Budget for one copy, refilled in a second
+    setRate(SMALL);
+    EXPECT_TRUE(queue(buf));
+    EXPECT_FALSE(queue(buf));
+    EXPECT_FALSE(queue(buf));
+    EXPECT_EQ(1u, queued());
+    EXPECT_EQ(2u, droppedRate());
+    EXPECT_EQ(0u, droppedFull());
+
+    //Only the queued dump is written
+    drain();
+    EXPECT_EQ(1u, written());
+    EXPECT_EQ(0u, failed());
+    EXPECT_EQ(SMALL, fileSize(0));
+    EXPECT_EQ(-1, fileSize(1));
+    EXPECT_EQ(-1, fileSize(2));
+}
+
+TEST_F(DumpWriterTest, CountsFullDrops) {
+    DumpBuffer buf(SMALL, 0x11);
+    ASSERT_TRUE(buf.valid());
+    for(int i = 0; i < MAX_JOBS; i++)
+        EXPECT_TRUE(queue(buf));
+    //Every slot waits on the writer
+    EXPECT_FALSE(queue(buf));
+    EXPECT_EQ(1u, droppedFull());
+
+    //Nor does a dump bigger than the pool get a slot
+    DumpBuffer huge(MAX_POOL_BYTES + SMALL, 0);
+    ASSERT_TRUE(huge.valid());
+    drain();
+    EXPECT_FALSE(queue(huge));
+    EXPECT_EQ(2u, droppedFull());
+    EXPECT_EQ(0u, droppedRate());
+    EXPECT_EQ((uint32_t)MAX_JOBS, written());
+    EXPECT_TRUE(queue(buf));
+}
+
+TEST_F(DumpWriterTest, ReusesSlots) {
+    DumpBuffer small(SMALL, 0x22), big(BIG, 0x33);
+    ASSERT_TRUE(small.valid() && big.valid());
+    //The small dump still holds slot 0 when the big one comes
+    EXPECT_TRUE(queue(small));
+    EXPECT_TRUE(queue(big));
+    drain();
+    EXPECT_EQ((size_t)SMALL, slotCapacity(0));
+    EXPECT_EQ((size_t)BIG, slotCapacity(1));
+    EXPECT_EQ((size_t)(SMALL + BIG), poolBytes());
+
+    //Idle slots are reused, the big dump going to the slot that fits it
+    //rather than growing the first idle one
+    for(int i = 0; i < 3; i++) {
+        EXPECT_TRUE(queue(big));
+        EXPECT_TRUE(queue(small));
+        drain();
+    }
+    EXPECT_EQ((size_t)SMALL, slotCapacity(0));
+    EXPECT_EQ((size_t)BIG, slotCapacity(1));
+    EXPECT_EQ((size_t)(SMALL + BIG), poolBytes());
+    EXPECT_EQ(8u, written());
+    EXPECT_EQ(BIG, fileSize(6));
+    EXPECT_EQ(SMALL, fileSize(7));
+
+    mWriter->trim();
+    EXPECT_EQ(0u, poolBytes());
+    EXPECT_EQ(0u, slotCapacity(0));
+}
+
+//A layer list as HwcDebug hands it to the capture
+struct CaptureList {
+    CaptureList(const int& numLayers) {
+        mList = (hwc_display_contents_1_t *)calloc(1, sizeof(*mList) +
+                numLayers * sizeof(hwc_layer_1_t));
+        mList->numHwLayers = numLayers;
+    }
+    ~CaptureList() { free(mList); }
+    //Layer i shows buf, or nothing, at a position derived from i
+    void setLayer(const int& i, const DumpBuffer *buf) {
+        hwc_layer_1_t& layer = mList->hwLayers[i];
+        layer.handle = buf ? (buffer_handle_t)&buf->mHnd : NULL;
+        layer.compositionType = HWC_OVERLAY;
+        layer.blending = HWC_BLENDING_PREMULT;
+        layer.transform = i;
+        layer.planeAlpha = 0xff - i;
+        layer.sourceCropf.left = i;
+        layer.sourceCropf.top = 0;
+        layer.sourceCropf.right = i + 16;
+        layer.sourceCropf.bottom = 8;
+        layer.displayFrame.left = 100 * i;
+        layer.displayFrame.top = 10 * i;
+        layer.displayFrame.right = 100 * i + 64;
+        layer.displayFrame.bottom = 10 * i + 32;
+    }
+
+    hwc_display_contents_1_t *mList;
+};
+
+/* A capture writer that isn't run, drained by the test like DumpWriter.
+ * The capture goes to a file the reader of qcap_extract reads back. */
+class CaptureWriterTest : public ::testing::Test {
+protected:
+    enum {
+        SIZE = 4096,
+        DPY = HWC_DISPLAY_EXTERNAL,
+        MAX_FRAMES = CaptureWriter::MAX_FRAMES,
+        MAX_POOL_BYTES = CaptureWriter::MAX_POOL_BYTES,
+    };
+
+    CaptureWriterTest() : mWriter(new CaptureWriter()) {
+        const char *dir = getenv("TMPDIR");
+        snprintf(mFileName, sizeof(mFileName), "%s/capture_writer_test.%d.qcap",
+                dir ? dir : "/data/local/tmp", getpid());
+        for(int i = 0; i < CaptureWriter::MAX_LAYERS; i++)
+            setSource(i, CaptureWriter::SRC_NONE);
+    }
+    ~CaptureWriterTest() {
+        drain();
+        mWriter->end(DPY);
+        drain();
+        unlink(mFileName);
+    }
+
+    bool begin() { return mWriter->begin(DPY, mFileName); }
+    bool end() { return mWriter->end(DPY); }
+    bool queue(const uint32_t& frameNo, CaptureList& list) {
+        return mWriter->queueFrame(DPY, frameNo, list.mList, mSources);
+    }
+    void setSource(const int& i, const int& source,
+            const int& prevIndex = 0) {
+        mSources[i].mSource = source;
+        mSources[i].mPrevIndex = prevIndex;
+    }
+    void drain() {
+        while(mWriter->mCount)
+            mWriter->threadLoop();
+    }
+    void setRate(const int64_t& rate) {
+        mWriter->mBudget = CopyBudget(rate);
+    }
+    uint32_t queued() const { return mWriter->mQueued; }
+    uint32_t failed() const { return mWriter->mFailed; }
+    uint32_t droppedFull() const { return mWriter->mDroppedFull; }
+    uint32_t droppedRate() const { return mWriter->mDroppedRate; }
+    size_t poolBytes() const { return mWriter->mPoolBytes; }
+
+    android::sp<CaptureWriter> mWriter;
+    CaptureWriter::LayerSource mSources[CaptureWriter::MAX_LAYERS];
+    char mFileName[PATH_MAX];
+};
+
+TEST_F(CaptureWriterTest, RoundTripsThroughTheReader) {
+    DumpBuffer a(SIZE, 0x44), b(SIZE, 0x55), sameAsA(SIZE, 0x44);
+    ASSERT_TRUE(a.valid() && b.valid() && sameAsA.valid());
+    ASSERT_TRUE(begin());
+
+    //Two new buffers and a bufferless layer
+    CaptureList list(3);
+    list.setLayer(0, &a);
+    list.setLayer(1, &b);
+    list.setLayer(2, NULL);
+    list.mList->flags = HWC_GEOMETRY_CHANGED;
+    setSource(0, CaptureWriter::SRC_COPY);
+    setSource(1, CaptureWriter::SRC_COPY);
+    EXPECT_TRUE(queue(10, list));
+    //The first buffer again, and a new handle with the contents of it
+    list.setLayer(1, &sameAsA);
+    list.mList->flags = 0;
+    setSource(0, CaptureWriter::SRC_PREV, 0);
+    EXPECT_TRUE(queue(11, list));
+    //Nothing changed
+    setSource(1, CaptureWriter::SRC_PREV, 1);
+    EXPECT_TRUE(queue(12, list));
+    EXPECT_TRUE(end());
+    drain();
+    EXPECT_EQ(3u, queued());
+    EXPECT_EQ(0u, failed());
+
+    QcapReader reader;
+    ASSERT_TRUE(reader.open(mFileName)) << reader.getError();
+    EXPECT_EQ((uint32_t)DPY, reader.getHeader().mDpy);
+
+    //Each contents once, ahead of the first frame showing it
+    const uint32_t ids[3][3] = { {1, 2, 0}, {1, 1, 0}, {1, 1, 0} };
+    const DumpBuffer *payloads[] = { &a, &b };
+    int numPayloads = 0, numFrames = 0;
+    while(reader.next()) {
+        if(reader.getType() == QCAP_CHUNK_PAYLOAD) {
+            const QcapPayload& payload = reader.getPayload();
+            ASSERT_LT(numPayloads, 2);
+            ASSERT_EQ(0, numFrames);
+            const DumpBuffer *buf = payloads[numPayloads++];
+            EXPECT_EQ((uint32_t)numPayloads, payload.mId);
+            EXPECT_EQ((uint32_t)SIZE, payload.mSize);
+            EXPECT_EQ(HAL_PIXEL_FORMAT_RGBA_8888, payload.mFormat);
+            EXPECT_EQ(SIZE / 4, payload.mWidth);
+            EXPECT_EQ(0, memcmp(buf->mMem, reader.getPayloadData(), SIZE));
+            continue;
+        }
+        ASSERT_EQ((uint32_t)QCAP_CHUNK_FRAME, reader.getType());
+        ASSERT_LT(numFrames, 3);
+        const QcapFrame& frame = reader.getFrame();
+        EXPECT_EQ((uint32_t)(10 + numFrames), frame.mFrame);
+        EXPECT_EQ(numFrames ? 0u : (uint32_t)QCAP_FRAME_GEOMETRY_CHANGED,
+                frame.mFlags);
+        ASSERT_EQ(3u, frame.mNumLayers);
+        for(int i = 0; i < 3; i++) {
+            const QcapLayer& layer = reader.getLayers()[i];
+            const hwc_layer_1_t& src = list.mList->hwLayers[i];
+            EXPECT_EQ(ids[numFrames][i], layer.mPayloadId);
+            EXPECT_EQ(src.sourceCropf.left, layer.mSourceCrop[0]);
+            EXPECT_EQ(src.sourceCropf.right, layer.mSourceCrop[2]);
+            EXPECT_EQ(src.displayFrame.left, layer.mDisplayFrame[0]);
+            EXPECT_EQ(src.displayFrame.bottom, layer.mDisplayFrame[3]);
+            EXPECT_EQ(src.transform, layer.mTransform);
+            EXPECT_EQ(src.planeAlpha, layer.mPlaneAlpha);
+            EXPECT_EQ(i < 2 ? SIZE / 4 : 0, layer.mWidth);
+        }
+        numFrames++;
+    }
+    EXPECT_TRUE(reader.getError() == NULL) << reader.getError();
+    EXPECT_FALSE(reader.isTruncated());
+    EXPECT_EQ(2, numPayloads);
+    EXPECT_EQ(3, numFrames);
+}
+
+TEST_F(CaptureWriterTest, CountsDrops) {
+    DumpBuffer buf(SIZE, 0x66);
+    ASSERT_TRUE(buf.valid());
+    ASSERT_TRUE(begin());
+    CaptureList list(1);
+    list.setLayer(0, &buf);
+
+    //Budget for one copy, refilled in a second
+    setRate(SIZE);
+    setSource(0, CaptureWriter::SRC_COPY);
+    EXPECT_TRUE(queue(0, list));
+    EXPECT_FALSE(queue(1, list));
+    EXPECT_EQ(1u, droppedRate());
+    //Frames that copy nothing don't need budget, until the slots run out
+    setSource(0, CaptureWriter::SRC_PREV, 0);
+    for(int i = 1; i < MAX_FRAMES; i++)
+        EXPECT_TRUE(queue(1 + i, list));
+    EXPECT_FALSE(queue(MAX_FRAMES + 1, list));
+    EXPECT_EQ(1u, droppedFull());
+
+    //Nor does a buffer bigger than the pool fit once they are free
+    drain();
+    DumpBuffer huge(MAX_POOL_BYTES + SIZE, 0);
+    ASSERT_TRUE(huge.valid());
+    list.setLayer(0, &huge);
+    setSource(0, CaptureWriter::SRC_COPY);
+    EXPECT_FALSE(queue(MAX_FRAMES + 2, list));
+    EXPECT_EQ(2u, droppedFull());
+    EXPECT_EQ(1u, droppedRate());
+    EXPECT_EQ((uint32_t)MAX_FRAMES, queued());
+    EXPECT_EQ(0u, failed());
+}
+
+TEST_F(CaptureWriterTest, ReusesFrameSlots) {
+    DumpBuffer small(SIZE, 0x77), big(4 * SIZE, 0x88);
+    ASSERT_TRUE(small.valid() && big.valid());
+    ASSERT_TRUE(begin());
+    CaptureList list(2);
+    list.setLayer(0, &small);
+    list.setLayer(1, &small);
+    setSource(0, CaptureWriter::SRC_COPY);
+    setSource(1, CaptureWriter::SRC_COPY);
+
+    //A drained writer takes every frame in the same slot
+    for(int i = 0; i < 8; i++) {
+        EXPECT_TRUE(queue(i, list));
+        drain();
+        EXPECT_EQ((size_t)(2 * SIZE), poolBytes());
+    }
+    //Only the layer that outgrew its buffer grows
+    list.setLayer(1, &big);
+    EXPECT_TRUE(queue(8, list));
+    drain();
+    EXPECT_EQ((size_t)(5 * SIZE), poolBytes());
+
+    //The end of the capture gives the staging memory back
+    EXPECT_TRUE(end());
+    drain();
+    EXPECT_EQ(0u, poolBytes());
+    EXPECT_EQ(9u, queued());
+    EXPECT_EQ(0u, failed());
+}
+
+} // namespace qhwc
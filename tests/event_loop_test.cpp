@@ -0,0 +1,150 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <utils/Timers.h>
+#include "event_loop.h"
+
+using namespace qdutils;
+
+namespace {
+
+//Pipes stand in for the vsync, uevent and hotplug fds
+struct Pipe {
+    int fds[2];
+    Pipe() { if(pipe(fds) < 0) fds[0] = fds[1] = -1; }
+    ~Pipe() { close(fds[0]); close(fds[1]); }
+    int readFd() const { return fds[0]; }
+    void post() { char c = 0; ASSERT_EQ(1, (int)write(fds[1], &c, 1)); }
+    void consume() { char c; ASSERT_EQ(1, (int)read(fds[0], &c, 1)); }
+};
+
+struct Calls {
+    int count;
+    int fd;
+    uint32_t events;
+    Calls() : count(0), fd(-1), events(0) {}
+};
+
+void onEvent(void *data, int fd, uint32_t events) {
+    Calls *calls = (Calls *)data;
+    calls->count++;
+    calls->fd = fd;
+    calls->events = events;
+    char c;
+    read(fd, &c, 1);
+}
+
+TEST(EventLoopTest, RunsTheHandlerOfAReadySource) {
+    EventLoop loop;
+    Pipe vsync, uevent;
+    Calls vsyncCalls, ueventCalls;
+    ASSERT_EQ(0, loop.addSource("vsync", vsync.readFd(), EPOLLIN, onEvent,
+            &vsyncCalls));
+    ASSERT_EQ(0, loop.addSource("uevent", uevent.readFd(), EPOLLIN, onEvent,
+            &ueventCalls));
+
+    EXPECT_EQ(0, loop.runOnce(0));
+    vsync.post();
+    EXPECT_EQ(1, loop.runOnce(100));
+    EXPECT_EQ(1, vsyncCalls.count);
+    EXPECT_EQ(vsync.readFd(), vsyncCalls.fd);
+    EXPECT_TRUE(vsyncCalls.events & EPOLLIN);
+    EXPECT_EQ(0, ueventCalls.count);
+
+    vsync.post();
+    uevent.post();
+    EXPECT_EQ(2, loop.runOnce(100));
+    EXPECT_EQ(2, vsyncCalls.count);
+    EXPECT_EQ(1, ueventCalls.count);
+}
+
+TEST(EventLoopTest, WakeReturnsWithoutRunningHandlers) {
+    EventLoop loop;
+    Pipe vsync;
+    Calls calls;
+    ASSERT_EQ(0, loop.addSource("vsync", vsync.readFd(), EPOLLIN, onEvent,
+            &calls));
+    loop.wake();
+    EXPECT_EQ(0, loop.runOnce(-1));
+    EXPECT_EQ(0, calls.count);
+    //The wakeup was consumed
+    EXPECT_EQ(0, loop.runOnce(0));
+}
+
+TEST(EventLoopTest, RemovedSourceIsNotRun) {
+    EventLoop loop;
+    Pipe vsync;
+    Calls calls;
+    ASSERT_EQ(0, loop.addSource("vsync", vsync.readFd(), EPOLLIN, onEvent,
+            &calls));
+    vsync.post();
+    EXPECT_EQ(0, loop.removeSource(vsync.readFd()));
+    EXPECT_EQ(-ENOENT, loop.removeSource(vsync.readFd()));
+    EXPECT_EQ(0, loop.runOnce(0));
+    EXPECT_EQ(0, calls.count);
+}
+
+TEST(EventLoopTest, RejectsDuplicateSourcesAndOverflow) {
+    EventLoop loop;
+    Pipe pipes[EventLoop::MAX_SOURCES + 1];
+    Calls calls;
+    for(int i = 0; i < EventLoop::MAX_SOURCES; i++) {
+        ASSERT_EQ(0, loop.addSource("src", pipes[i].readFd(), EPOLLIN,
+                onEvent, &calls));
+    }
+    EXPECT_EQ(-EEXIST, loop.addSource("src", pipes[0].readFd(), EPOLLIN,
+            onEvent, &calls));
+    EXPECT_EQ(-ENOSPC, loop.addSource("src",
+            pipes[EventLoop::MAX_SOURCES].readFd(), EPOLLIN, onEvent,
+            &calls));
+    EXPECT_EQ(-EINVAL, loop.addSource("src", -1, EPOLLIN, onEvent, &calls));
+}
+
+TEST(EventLoopTest, DumpCountsEvents) {
+    EventLoop loop;
+    Pipe vsync;
+    Calls calls;
+    ASSERT_EQ(0, loop.addSource("vsync", vsync.readFd(), EPOLLIN, onEvent,
+            &calls));
+    for(int i = 0; i < 3; i++) {
+        vsync.post();
+        ASSERT_EQ(1, loop.runOnce(100));
+    }
+    char buf[1024] = {'\0'};
+    loop.getDump(buf, sizeof(buf));
+    EXPECT_TRUE(strstr(buf, "wakeups: 3") != NULL) << buf;
+    EXPECT_TRUE(strstr(buf, "vsync") != NULL) << buf;
+    EXPECT_TRUE(strstr(buf, "events=3") != NULL) << buf;
+}
+
+}; //namespace
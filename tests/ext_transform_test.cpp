@@ -0,0 +1,443 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/Timers.h>
+#include "hwc_utils.h"
+
+using namespace qhwc;
+using namespace overlay::utils;
+
+namespace {
+
+/* calcExtDisplayPosition() as it was before the ExtTransform, which
+ * recomputed every ratio in float for each layer. The display state it read
+ * from the context is taken from the key instead. */
+void oldAspectRatioPosition(const ExtTransform::Key& key, bool portrait,
+        hwc_rect_t& inRect, hwc_rect_t& outRect) {
+    float fbWidth  = key.xres;
+    float fbHeight = key.yres;
+    int xPos = 0;
+    int yPos = 0;
+    float width = fbWidth;
+    float height = fbHeight;
+    float actualWidth = fbWidth;
+    float actualHeight = fbHeight;
+    float wRatio = 1.0;
+    float hRatio = 1.0;
+    float xRatio = 1.0;
+    float yRatio = 1.0;
+    hwc_rect_t rect = {0, 0, (int)fbWidth, (int)fbHeight};
+
+    Dim inPos(inRect.left, inRect.top, inRect.right - inRect.left,
+                inRect.bottom - inRect.top);
+    Dim outPos(outRect.left, outRect.top, outRect.right - outRect.left,
+                outRect.bottom - outRect.top);
+    Whf whf(fbWidth, fbHeight, 0);
+    preRotateSource(static_cast<eTransform>(key.extOrient), whf, inPos);
+
+    if(key.extOrient & HAL_TRANSFORM_ROT_90) {
+        swapWidthHeight(actualWidth, actualHeight);
+        getAspectRatioPosition(fbWidth, fbHeight, (int)actualWidth,
+                               (int)actualHeight, rect);
+        xPos = rect.left;
+        yPos = rect.top;
+        width = rect.right - rect.left;
+        height = rect.bottom - rect.top;
+    }
+
+    xRatio = inPos.x/actualWidth;
+    yRatio = inPos.y/actualHeight;
+    wRatio = inPos.w/actualWidth;
+    hRatio = inPos.h/actualHeight;
+
+    outPos.x = (xRatio * width) + xPos;
+    outPos.y = (yRatio * height) + yPos;
+    outPos.w = wRatio * width;
+    outPos.h = hRatio * height;
+
+    if((key.extOrient & HWC_TRANSFORM_ROT_90) && portrait) {
+        hwc_rect_t r;
+        xRatio = (outPos.x - xPos)/width;
+        getAspectRatioPosition(width, height, width, height, r);
+        xPos = r.left;
+        yPos = r.top;
+        float tempHeight = r.bottom - r.top;
+        yRatio = yPos/height;
+        wRatio = outPos.w/width;
+        hRatio = tempHeight/height;
+
+        outPos.x = (xRatio * fbWidth);
+        outPos.y = (yRatio * fbHeight);
+        outPos.w = wRatio * fbWidth;
+        outPos.h = hRatio * fbHeight;
+    }
+    if(key.downScale) {
+        xRatio = outPos.x/fbWidth;
+        yRatio = outPos.y/fbHeight;
+        wRatio = outPos.w/fbWidth;
+        hRatio = outPos.h/fbHeight;
+
+        outPos.x = xRatio * key.extW;
+        outPos.y = yRatio * key.extH;
+        outPos.w = wRatio * key.extW;
+        outPos.h = hRatio * key.extH;
+    }
+    outRect.left = outPos.x;
+    outRect.top = outPos.y;
+    outRect.right = outPos.x + outPos.w;
+    outRect.bottom = outPos.y + outPos.h;
+}
+
+void oldActionSafePosition(const ExtTransform::Key& key, hwc_rect_t& rect) {
+    int x = rect.left, y = rect.top;
+    int w = rect.right - rect.left;
+    int h = rect.bottom - rect.top;
+    if(key.underscan || (!key.asWidthRatio && !key.asHeightRatio))
+        return;
+
+    //The key has the action safe size rotated already
+    int fbWidth = key.asWidth;
+    int fbHeight = key.asHeight;
+    float asW = fbWidth * (1.0f -  key.asWidthRatio / 100.0f);
+    float asH = fbHeight * (1.0f -  key.asHeightRatio / 100.0f);
+    float asX = (fbWidth - asW) / 2;
+    float asY = (fbHeight - asH) / 2;
+
+    float xRatio = (float)x/fbWidth;
+    float yRatio = (float)y/fbHeight;
+    float wRatio = (float)w/fbWidth;
+    float hRatio = (float)h/fbHeight;
+
+    x = (xRatio * asW) + asX;
+    y = (yRatio * asH) + asY;
+    w = (wRatio * asW);
+    h = (hRatio * asH);
+
+    rect.left = x;
+    rect.top = y;
+    rect.right = w + rect.left;
+    rect.bottom = h + rect.top;
+}
+
+//Not inlined, it lived in hwc_utils.cpp like applyExtTransform does now
+__attribute__((noinline))
+void oldCalcExtDisplayPosition(const ExtTransform::Key& key, bool yuv,
+        hwc_rect_t& sourceCrop, hwc_rect_t& displayFrame, int& transform,
+        eTransform& orient) {
+    bool primaryPortrait = key.primaryXres < key.primaryYres;
+    bool portrait = primaryPortrait ? !(key.deviceOrientation & 0x1) :
+            (key.deviceOrientation & 0x1);
+    int extOrient = key.extOrient;
+    if(!yuv) {
+        if(extOrient & HWC_TRANSFORM_ROT_90) {
+            int dstWidth = key.xres;
+            int dstHeight = key.yres;
+            int srcWidth = key.primaryXres;
+            int srcHeight = key.primaryYres;
+            if(!primaryPortrait)
+                std::swap(srcWidth, srcHeight);
+            getAspectRatioPosition(dstWidth, dstHeight, srcWidth,
+                                   srcHeight, displayFrame);
+            if(portrait) {
+                sourceCrop = displayFrame;
+                displayFrame.left = 0;
+                displayFrame.top = 0;
+                displayFrame.right = dstWidth;
+                displayFrame.bottom = dstHeight;
+            }
+        }
+        if(key.downScale) {
+            float fbWidth  = key.xres;
+            float fbHeight = key.yres;
+            float wRatio = ((float)key.extW)/fbWidth;
+            float hRatio = ((float)key.extH)/fbHeight;
+            displayFrame.left *= wRatio;
+            displayFrame.top *= hRatio;
+            displayFrame.right *= wRatio;
+            displayFrame.bottom *= hRatio;
+        }
+    } else if(extOrient || key.downScale) {
+        oldAspectRatioPosition(key, portrait, displayFrame, displayFrame);
+    }
+    if(extOrient) {
+        transform = extOrient;
+        orient = static_cast<eTransform>(extOrient);
+    }
+    oldActionSafePosition(key, displayFrame);
+}
+
+struct Mode {
+    int xres;
+    int yres;
+    //MDP configured size in downscale mode, 0 if off
+    int extW;
+    int extH;
+};
+
+ExtTransform::Key makeKey(const Mode& primary, const Mode& ext,
+        const int& extOrient, const int& deviceOrientation,
+        const int& asRatio, const bool& underscan) {
+    ExtTransform::Key key;
+    memset(&key, 0, sizeof(key));
+    key.extOrient = extOrient;
+    key.deviceOrientation = deviceOrientation;
+    key.xres = ext.xres;
+    key.yres = ext.yres;
+    key.primaryXres = primary.xres;
+    key.primaryYres = primary.yres;
+    key.downScale = ext.extW > 0;
+    key.extW = ext.extW;
+    key.extH = ext.extH;
+    key.underscan = underscan;
+    key.asWidthRatio = asRatio;
+    key.asHeightRatio = asRatio / 2;
+    key.asWidth = key.downScale ? ext.extW : ext.xres;
+    key.asHeight = key.downScale ? ext.extH : ext.yres;
+    if(extOrient & HWC_TRANSFORM_ROT_90)
+        std::swap(key.asWidth, key.asHeight);
+    return key;
+}
+
+bool near(const hwc_rect_t& a, const hwc_rect_t& b, const int& slack) {
+    return abs(a.left - b.left) <= slack && abs(a.top - b.top) <= slack &&
+            abs(a.right - b.right) <= slack &&
+            abs(a.bottom - b.bottom) <= slack;
+}
+
+::testing::AssertionResult sameRect(const hwc_rect_t& a,
+        const hwc_rect_t& b, const int& slack) {
+    if(near(a, b, slack))
+        return ::testing::AssertionSuccess();
+    return ::testing::AssertionFailure() << "[" << a.left << " " << a.top <<
+            " " << a.right << " " << a.bottom << "] vs [" << b.left << " " <<
+            b.top << " " << b.right << " " << b.bottom << "]";
+}
+
+const Mode sPrimaries[] = {
+    {1080, 1920, 0, 0},
+    {720, 1280, 0, 0},
+    {1920, 1080, 0, 0},
+    {800, 480, 0, 0},
+};
+
+//Plain modes, then downscale ones, same and other aspect ratio
+const Mode sExternals[] = {
+    {1920, 1080, 0, 0},
+    {1280, 720, 0, 0},
+    {720, 480, 0, 0},
+    {1024, 768, 0, 0},
+    {1920, 1080, 1280, 720},
+    {3840, 2160, 1920, 1080},
+    {2560, 1600, 1920, 1080},
+    {1920, 1080, 720, 480},
+};
+
+const int sOrients[] = {
+    0,
+    HWC_TRANSFORM_ROT_90,
+    HWC_TRANSFORM_ROT_180,
+    HWC_TRANSFORM_ROT_270,
+    HWC_TRANSFORM_FLIP_H,
+};
+
+/* Runs every combination of modes, orientations and action safe settings
+ * over a few layer frames, through the old and the new computation. An
+ * edge may be a pixel off where the float math rounded a whole value
+ * down */
+TEST(ExtTransformTest, MatchesTheFloatComputation) {
+    const int asRatios[] = {0, 5, 10};
+    int cases = 0;
+    int exact = 0;
+    for(size_t p = 0; p < sizeof(sPrimaries) / sizeof(sPrimaries[0]); p++)
+    for(size_t e = 0; e < sizeof(sExternals) / sizeof(sExternals[0]); e++)
+    for(size_t o = 0; o < sizeof(sOrients) / sizeof(sOrients[0]); o++)
+    for(int dev = 0; dev < 4; dev++)
+    for(size_t a = 0; a < sizeof(asRatios) / sizeof(asRatios[0]); a++)
+    for(int underscan = 0; underscan < 2; underscan++) {
+        const Mode& ext = sExternals[e];
+        ExtTransform::Key key = makeKey(sPrimaries[p], ext, sOrients[o], dev,
+                asRatios[a], underscan);
+        ExtTransform xf;
+        buildExtTransform(xf, key);
+        ASSERT_TRUE(xf.valid);
+
+        const hwc_rect_t frames[] = {
+            {0, 0, ext.xres, ext.yres},
+            {ext.xres / 8, ext.yres / 4, ext.xres * 7 / 8, ext.yres * 3 / 4},
+            {3, 5, 3 + ext.xres / 3, 5 + ext.yres / 5},
+            {ext.xres / 2, 0, ext.xres, ext.yres / 2},
+        };
+        for(size_t f = 0; f < sizeof(frames) / sizeof(frames[0]); f++)
+        for(int yuv = 0; yuv < 2; yuv++) {
+            hwc_rect_t oldCrop = {1, 2, 3, 4}, newCrop = oldCrop;
+            hwc_rect_t oldFrame = frames[f], newFrame = frames[f];
+            int oldTransform = 0, newTransform = 0;
+            eTransform oldOrient = OVERLAY_TRANSFORM_0;
+            eTransform newOrient = OVERLAY_TRANSFORM_0;
+            oldCalcExtDisplayPosition(key, yuv, oldCrop, oldFrame,
+                    oldTransform, oldOrient);
+            applyExtTransform(xf, yuv, newCrop, newFrame, newTransform,
+                    newOrient);
+
+            SCOPED_TRACE(::testing::Message() << "primary " << p <<
+                    " ext " << e << " orient " << sOrients[o] <<
+                    " device " << dev << " action safe " << asRatios[a] <<
+                    " underscan " << underscan << " frame " << f <<
+                    " yuv " << yuv);
+            ASSERT_TRUE(sameRect(oldFrame, newFrame, 1));
+            ASSERT_TRUE(sameRect(oldCrop, newCrop, 0));
+            ASSERT_EQ(oldTransform, newTransform);
+            ASSERT_EQ(oldOrient, newOrient);
+            cases++;
+            if(near(oldFrame, newFrame, 0))
+                exact++;
+        }
+    }
+    //Off by one only where the float math had an error of its own
+    EXPECT_GT(exact, cases * 99 / 100) << exact << " of " << cases;
+}
+
+/* Whole frames land on the same pixels, there is no rounding slack to hide
+ * an error in */
+TEST(ExtTransformTest, FullFramesMatchExactly) {
+    for(size_t e = 0; e < sizeof(sExternals) / sizeof(sExternals[0]); e++)
+    for(size_t o = 0; o < sizeof(sOrients) / sizeof(sOrients[0]); o++) {
+        const Mode& ext = sExternals[e];
+        ExtTransform::Key key = makeKey(sPrimaries[0], ext, sOrients[o], 1,
+                0, false);
+        ExtTransform xf;
+        buildExtTransform(xf, key);
+        for(int yuv = 0; yuv < 2; yuv++) {
+            hwc_rect_t oldCrop = {0, 0, 0, 0}, newCrop = oldCrop;
+            hwc_rect_t oldFrame = {0, 0, ext.xres, ext.yres};
+            hwc_rect_t newFrame = oldFrame;
+            int transform = 0;
+            eTransform orient = OVERLAY_TRANSFORM_0;
+            oldCalcExtDisplayPosition(key, yuv, oldCrop, oldFrame, transform,
+                    orient);
+            applyExtTransform(xf, yuv, newCrop, newFrame, transform, orient);
+            SCOPED_TRACE(::testing::Message() << "ext " << e << " orient " <<
+                    sOrients[o] << " yuv " << yuv);
+            EXPECT_TRUE(sameRect(oldFrame, newFrame, 0));
+        }
+    }
+}
+
+TEST(ExtTransformTest, UnconfiguredDisplayLeavesLayersAsIs) {
+    const Mode ext = {0, 0, 0, 0};
+    ExtTransform::Key key = makeKey(sPrimaries[0], ext, HWC_TRANSFORM_ROT_90,
+            0, 5, false);
+    ExtTransform xf;
+    buildExtTransform(xf, key);
+    EXPECT_FALSE(xf.valid);
+
+    hwc_rect_t crop = {1, 2, 3, 4};
+    hwc_rect_t frame = {5, 6, 7, 8};
+    int transform = 0;
+    eTransform orient = OVERLAY_TRANSFORM_0;
+    applyExtTransform(xf, false, crop, frame, transform, orient);
+    EXPECT_TRUE(sameRect(crop, (hwc_rect_t){1, 2, 3, 4}, 0));
+    EXPECT_TRUE(sameRect(frame, (hwc_rect_t){5, 6, 7, 8}, 0));
+    EXPECT_EQ(0, transform);
+}
+
+/* Times a mirrored frame of layers through the float math of each layer
+ * and through the transform built once for the display state. The two
+ * property_get() calls the old code also made per layer are left out, so
+ * this is the math alone */
+TEST(ExtTransformTest, BenchMirroredLayerList) {
+    enum { NUM_LAYERS = 8, NUM_FRAMES = 20000, NUM_ROUNDS = 5 };
+    const Mode& ext = sExternals[4]; //1080p downscaled to 720p
+    ExtTransform::Key key = makeKey(sPrimaries[0], ext, HWC_TRANSFORM_ROT_90,
+            0, 5, false);
+    ExtTransform xf;
+    buildExtTransform(xf, key);
+    ASSERT_TRUE(xf.valid);
+
+    //A video under the UI, status and navigation bars and small popups
+    hwc_rect_t frames[NUM_LAYERS];
+    bool yuv[NUM_LAYERS];
+    for(int i = 0; i < NUM_LAYERS; i++) {
+        int inset = i * 37;
+        frames[i].left = inset;
+        frames[i].top = inset * 2;
+        frames[i].right = ext.xres - inset;
+        frames[i].bottom = ext.yres - inset;
+        yuv[i] = (i == 0);
+    }
+
+    //Best of a few rounds, interleaved so that both see the same load.
+    //The sums keep the work from being optimized away
+    volatile int sink = 0;
+    nsecs_t oldTime = LLONG_MAX, newTime = LLONG_MAX;
+    for(int round = 0; round < NUM_ROUNDS; round++) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for(int n = 0; n < NUM_FRAMES; n++) {
+            for(int i = 0; i < NUM_LAYERS; i++) {
+                hwc_rect_t crop = frames[i], frame = frames[i];
+                int transform = 0;
+                eTransform orient = OVERLAY_TRANSFORM_0;
+                oldCalcExtDisplayPosition(key, yuv[i], crop, frame,
+                        transform, orient);
+                sink += frame.left + frame.bottom + crop.right + transform;
+            }
+        }
+        oldTime = std::min(oldTime, systemTime(SYSTEM_TIME_MONOTONIC) -
+                start);
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for(int n = 0; n < NUM_FRAMES; n++) {
+            for(int i = 0; i < NUM_LAYERS; i++) {
+                hwc_rect_t crop = frames[i], frame = frames[i];
+                int transform = 0;
+                eTransform orient = OVERLAY_TRANSFORM_0;
+                applyExtTransform(xf, yuv[i], crop, frame, transform,
+                        orient);
+                sink += frame.left + frame.bottom + crop.right + transform;
+            }
+        }
+        newTime = std::min(newTime, systemTime(SYSTEM_TIME_MONOTONIC) -
+                start);
+    }
+
+    const double layers = (double)NUM_FRAMES * NUM_LAYERS;
+    printf("%d layer mirrored frame: float %.1fns/layer, ExtTransform "
+            "%.1fns/layer\n", (int)NUM_LAYERS, oldTime / layers,
+            newTime / layers);
+    //Where float is cheap (hosts, FPU cores) the two are close, so this only
+    //guards against the integer path regressing past the float one
+    EXPECT_LT(newTime, oldTime * 3 / 2);
+}
+
+}; //namespace
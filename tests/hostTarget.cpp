@@ -0,0 +1,165 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Stand-ins for the target libraries liboverlay needs, for the host build
+ * of the tests only. The MDP version and pipes are the ones of the target
+ * MdpModel::getDefaultCaps() models, so fb0 is never asked for them.
+ * Buffers are anonymous memory, properties are never set and fences are
+ * always signaled.
+ */
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/system_properties.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "alloc_controller.h"
+#include "memalloc.h"
+#include "gr.h"
+#include "mdp_version.h"
+#include "overlayMdpModel.h"
+
+ANDROID_SINGLETON_STATIC_INSTANCE(qdutils::MDPVersion);
+
+namespace qdutils {
+
+MDPVersion::MDPVersion()
+{
+    overlay::MdpModel::Caps caps = overlay::MdpModel::getDefaultCaps();
+    mMDPVersion = MDSS_V5;
+    mMdpRev = 0;
+    mVGPipes = caps.mNumPipes[overlay::MdpModel::PIPE_VG];
+    mRGBPipes = caps.mNumPipes[overlay::MdpModel::PIPE_RGB];
+    mDMAPipes = caps.mNumPipes[overlay::MdpModel::PIPE_DMA];
+    mFeatures = 0;
+    mHasOverlay = true;
+    mPanelType = MIPI_VIDEO_PANEL;
+}
+
+bool MDPVersion::is8x26() {
+    return false;
+}
+
+int MDPVersion::getMaxMDPDownscale() {
+    return overlay::MdpModel::getDefaultCaps().mMaxDownscale;
+}
+
+bool MDPVersion::supportsDecimation() {
+    return false;
+}
+
+}; //namespace qdutils
+
+namespace gralloc {
+
+class HostAlloc : public IMemAlloc {
+public:
+    virtual int alloc_buffer(alloc_data& data) {
+        data.base = mmap(0, data.size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(data.base == MAP_FAILED) {
+            data.base = 0;
+            return -errno;
+        }
+        //An fd for the buffer to own and close
+        data.fd = open("/dev/null", O_RDONLY);
+        data.allocType = 0;
+        return 0;
+    }
+    virtual int free_buffer(void *base, size_t size, int /*offset*/,
+            int fd) {
+        munmap(base, size);
+        close(fd);
+        return 0;
+    }
+    virtual int map_buffer(void ** /*pBase*/, size_t /*size*/,
+            int /*offset*/, int /*fd*/) {
+        return 0;
+    }
+    virtual int unmap_buffer(void * /*base*/, size_t /*size*/,
+            int /*offset*/) {
+        return 0;
+    }
+    virtual int clean_buffer(void * /*base*/, size_t /*size*/,
+            int /*offset*/, int /*fd*/, int /*op*/) {
+        return 0;
+    }
+};
+
+class HostController : public IAllocController {
+public:
+    virtual int allocate(alloc_data& data, int /*usage*/) {
+        return mAlloc.alloc_buffer(data);
+    }
+    virtual IMemAlloc* getAllocator(int /*flags*/) {
+        return &mAlloc;
+    }
+private:
+    HostAlloc mAlloc;
+};
+
+IAllocController* IAllocController::sController = NULL;
+IAllocController* IAllocController::getInstance(void)
+{
+    if(sController == NULL) {
+        sController = new HostController();
+    }
+    return sController;
+}
+
+} //namespace gralloc
+
+//Room for any format at 4 bytes a pixel, at the gralloc alignments
+size_t getBufferSizeAndDimensions(int width, int height, int /*format*/,
+        int& alignedw, int &alignedh)
+{
+    alignedw = (width + 31) & ~31;
+    alignedh = (height + 31) & ~31;
+    return (size_t)alignedw * alignedh * 4;
+}
+
+//No property is ever set on a host, PropCache keeps its defaults
+const prop_info *__system_property_find(const char * /*name*/) {
+    return NULL;
+}
+
+unsigned int __system_property_serial(const prop_info * /*pi*/) {
+    return 0;
+}
+
+int __system_property_read(const prop_info * /*pi*/, char *name,
+        char *value) {
+    name[0] = value[0] = 0;
+    return 0;
+}
+
+extern "C" int sync_wait(int /*fd*/, int /*timeout*/) {
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <utils/Timers.h>
+#include "event_loop.h"
+#include "idle_invalidator.h"
+
+using namespace qdutils;
+
+namespace {
+
+//A pipe stands in for the vsync fd
+struct Pipe {
+    int fds[2];
+    Pipe() { if(pipe(fds) < 0) fds[0] = fds[1] = -1; }
+    ~Pipe() { close(fds[0]); close(fds[1]); }
+    int readFd() const { return fds[0]; }
+    void post() { char c = 0; ASSERT_EQ(1, (int)write(fds[1], &c, 1)); }
+};
+
+struct Calls {
+    int count;
+    Calls() : count(0) {}
+};
+
+void onEvent(void *data, int fd, uint32_t /*events*/) {
+    Calls *calls = (Calls *)data;
+    calls->count++;
+    char c;
+    read(fd, &c, 1);
+}
+
+//Stands in for MDPComp::timeout_handler, with drawLock as the HWC draw
+//lock that a composition holds
+struct Idle {
+    Locker drawLock;
+    int calls;
+    int handled;
+    Idle() : calls(0), handled(0) {}
+};
+
+bool onIdle(void *data, int dpy) {
+    Idle *idle = (Idle *)data;
+    idle->calls++;
+    if(!idle->drawLock.tryLock())
+        return false;
+    idle->handled++;
+    idle->drawLock.unlock();
+    return true;
+}
+
+//Runs the loop until the idle handler is called or maxMs passes
+int runUntilCalled(EventLoop& loop, const Idle& idle, int calls, int maxMs) {
+    nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC) + ms2ns(maxMs);
+    while(idle.calls < calls && systemTime(SYSTEM_TIME_MONOTONIC) < end)
+        loop.runOnce(10);
+    return idle.calls;
+}
+
+TEST(IdleInvalidatorTest, IdleTimeoutFiresOncePerIdlePeriod) {
+    EventLoop loop;
+    Idle idle;
+    android::sp<IdleInvalidator> inv = new IdleInvalidator();
+    ASSERT_EQ(0, inv->init(onIdle, &idle, 10, &loop));
+
+    inv->markForSleep(0);
+    EXPECT_EQ(1, runUntilCalled(loop, idle, 1, 500));
+    EXPECT_EQ(1, idle.handled);
+    //Nothing more until the next update
+    EXPECT_EQ(0, loop.runOnce(30));
+    EXPECT_EQ(1, idle.calls);
+}
+
+TEST(IdleInvalidatorTest, BusyIdleHandlerDoesNotBlockTheLoop) {
+    EventLoop loop;
+    Idle idle;
+    Pipe vsync;
+    Calls vsyncCalls;
+    android::sp<IdleInvalidator> inv = new IdleInvalidator();
+    ASSERT_EQ(0, inv->init(onIdle, &idle, 10, &loop));
+    ASSERT_EQ(0, loop.addSource("vsync", vsync.readFd(), EPOLLIN, onEvent,
+            &vsyncCalls));
+
+    //A composition holds the draw lock across the idle timeout
+    idle.drawLock.lock();
+    inv->markForSleep(0);
+    EXPECT_EQ(1, runUntilCalled(loop, idle, 1, 500));
+    EXPECT_EQ(0, idle.handled);
+
+    //The loop still serves the other sources
+    vsync.post();
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    while(!vsyncCalls.count)
+        ASSERT_GE(loop.runOnce(100), 0);
+    EXPECT_LT(systemTime(SYSTEM_TIME_MONOTONIC) - start, ms2ns(100));
+
+    //Retried once the composition is done
+    idle.drawLock.unlock();
+    int busyCalls = idle.calls;
+    EXPECT_EQ(busyCalls + 1, runUntilCalled(loop, idle, busyCalls + 1, 500));
+    EXPECT_EQ(1, idle.handled);
+    EXPECT_EQ(0, loop.runOnce(30));
+    EXPECT_EQ(1, idle.handled);
+}
+
+TEST(IdleInvalidatorTest, UpdateDuringRetryRestartsTheIdleTime) {
+    EventLoop loop;
+    Idle idle;
+    android::sp<IdleInvalidator> inv = new IdleInvalidator();
+    ASSERT_EQ(0, inv->init(onIdle, &idle, 50, &loop));
+
+    idle.drawLock.lock();
+    inv->markForSleep(0);
+    EXPECT_EQ(1, runUntilCalled(loop, idle, 1, 500));
+    //The composition holding the lock updates the display
+    inv->markForSleep(0);
+    idle.drawLock.unlock();
+    nsecs_t updated = systemTime(SYSTEM_TIME_MONOTONIC);
+    EXPECT_EQ(2, runUntilCalled(loop, idle, 2, 500));
+    EXPECT_GE(systemTime(SYSTEM_TIME_MONOTONIC) - updated, ms2ns(45));
+    EXPECT_EQ(1, idle.handled);
+}
+
+}; //namespace
@@ -0,0 +1,170 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "overlayMdpModel.h"
+
+using namespace overlay;
+
+namespace {
+
+class MdpModelTest : public ::testing::Test {
+protected:
+    MdpModelTest() : mModel(MdpModel::getDefaultCaps()), mFd(-1) {}
+
+    virtual void SetUp() {
+        mdp_wrapper::setDriver(&mModel);
+        mFd = mdp_wrapper::openDevice("/dev/graphics/fb0", O_RDWR);
+        ASSERT_GE(mFd, 0);
+    }
+    virtual void TearDown() {
+        mdp_wrapper::closeDevice(mFd);
+        mdp_wrapper::setDriver(NULL);
+    }
+
+    static mdp_overlay makeOv(uint32_t format, uint32_t z) {
+        mdp_overlay ov;
+        memset(&ov, 0, sizeof(ov));
+        ov.id = MSMFB_NEW_REQUEST;
+        ov.src.width = 256;
+        ov.src.height = 256;
+        ov.src.format = format;
+        ov.src_rect.w = 256;
+        ov.src_rect.h = 256;
+        ov.dst_rect.w = 256;
+        ov.dst_rect.h = 256;
+        ov.z_order = z;
+        return ov;
+    }
+
+    MdpModel mModel;
+    int mFd;
+};
+
+TEST_F(MdpModelTest, RgbSpillsToVgThenRunsOut) {
+    //3 RGB and 3 VG pipes, z-orders are spread over two mixers
+    int second = mdp_wrapper::openDevice("/dev/graphics/fb1", O_RDWR);
+    ASSERT_GE(second, 0);
+    for(int i = 0; i < 6; i++) {
+        mdp_overlay ov = makeOv(MDP_RGBA_8888, i % 3);
+        EXPECT_TRUE(mdp_wrapper::setOverlay(i < 3 ? mFd : second,
+                ov)) << "layer " << i;
+    }
+    mdp_overlay ov = makeOv(MDP_RGBA_8888, 3);
+    EXPECT_FALSE(mdp_wrapper::setOverlay(mFd, ov));
+    EXPECT_EQ(6u, mModel.getPipeCount());
+    EXPECT_EQ(1u, mModel.getRejectCount());
+    mdp_wrapper::closeDevice(second);
+}
+
+TEST_F(MdpModelTest, YuvNeedsVg) {
+    for(int i = 0; i < 3; i++) {
+        mdp_overlay ov = makeOv(MDP_Y_CBCR_H2V2, i);
+        EXPECT_TRUE(mdp_wrapper::setOverlay(mFd, ov));
+    }
+    //RGB pipes are free, but cannot fetch YUV
+    mdp_overlay ov = makeOv(MDP_Y_CBCR_H2V2, 3);
+    EXPECT_FALSE(mdp_wrapper::setOverlay(mFd, ov));
+}
+
+TEST_F(MdpModelTest, ForcedDmaUsesDmaPipes) {
+    for(int i = 0; i < 2; i++) {
+        mdp_overlay ov = makeOv(MDP_RGBA_8888, i);
+        ov.flags |= MDP_OV_PIPE_FORCE_DMA;
+        EXPECT_TRUE(mdp_wrapper::setOverlay(mFd, ov));
+    }
+    mdp_overlay ov = makeOv(MDP_RGBA_8888, 2);
+    ov.flags |= MDP_OV_PIPE_FORCE_DMA;
+    EXPECT_FALSE(mdp_wrapper::setOverlay(mFd, ov));
+}
+
+TEST_F(MdpModelTest, RejectsSharedAndOutOfRangeZ) {
+    mdp_overlay a = makeOv(MDP_RGBA_8888, 1);
+    mdp_overlay b = makeOv(MDP_RGBA_8888, 1);
+    mdp_overlay c = makeOv(MDP_RGBA_8888, 4);
+    EXPECT_TRUE(mdp_wrapper::setOverlay(mFd, a));
+    EXPECT_FALSE(mdp_wrapper::setOverlay(mFd, b));
+    EXPECT_FALSE(mdp_wrapper::setOverlay(mFd, c));
+}
+
+TEST_F(MdpModelTest, RejectsScaleBeyondLimits) {
+    mdp_overlay ov = makeOv(MDP_RGBA_8888, 0);
+    ov.dst_rect.w = 256 / 5;
+    EXPECT_FALSE(mdp_wrapper::setOverlay(mFd, ov));
+    ov.dst_rect.w = 256 / 4;
+    EXPECT_TRUE(mdp_wrapper::setOverlay(mFd, ov));
+}
+
+#ifdef MSMFB_OVERLAY_PREPARE
+TEST_F(MdpModelTest, PrepareIsAllOrNothing) {
+    mdp_overlay ovs[4];
+    mdp_overlay *list[4];
+    for(int i = 0; i < 4; i++) {
+        ovs[i] = makeOv(MDP_Y_CBCR_H2V2, i);
+        list[i] = &ovs[i];
+    }
+    mdp_overlay_list req;
+    memset(&req, 0, sizeof(req));
+    req.num_overlays = 4;
+    req.overlay_list = list;
+    //Only 3 VG pipes for 4 YUV layers
+    EXPECT_FALSE(mdp_wrapper::validateAndSet(mFd, req));
+    EXPECT_EQ(0u, mModel.getPipeCount());
+
+    req.num_overlays = 3;
+    EXPECT_TRUE(mdp_wrapper::validateAndSet(mFd, req));
+    EXPECT_EQ(3u, mModel.getPipeCount());
+    EXPECT_EQ(2u, mModel.getRequestCount(MdpModel::REQ_PREPARE));
+}
+#endif
+
+TEST_F(MdpModelTest, ChargesOverlayTimeNotModelTime) {
+    mdp_overlay ov = makeOv(MDP_RGBA_8888, 0);
+    //Requests outside a marked call are counted but not charged
+    EXPECT_TRUE(mdp_wrapper::setOverlay(mFd, ov));
+    EXPECT_EQ(0, mModel.getOverlayTime(MdpModel::REQ_SET));
+
+    mModel.markCall();
+    usleep(2000); //Stands for overlay code working out a config
+    EXPECT_TRUE(mdp_wrapper::setOverlay(mFd, ov));
+    nsecs_t time = mModel.getOverlayTime(MdpModel::REQ_SET);
+    EXPECT_GE(time, ms2ns(2));
+    EXPECT_EQ(2u, mModel.getRequestCount(MdpModel::REQ_SET));
+
+    //Back to back requests charge only the time in between
+    msmfb_overlay_data od;
+    memset(&od, 0, sizeof(od));
+    od.id = ov.id;
+    EXPECT_TRUE(mdp_wrapper::play(mFd, od));
+    EXPECT_LT(mModel.getOverlayTime(MdpModel::REQ_PLAY), ms2ns(2));
+}
+
+} // namespace
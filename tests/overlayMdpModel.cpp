@@ -0,0 +1,605 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "overlayMdpModel.h"
+
+#ifndef MDSS_MDP_ROT_ONLY
+#define MDSS_MDP_ROT_ONLY 0x80
+#endif
+
+namespace overlay {
+
+//Far above the fds the process gets from the kernel, so that a stray
+//::close() of a model fd cannot close a real one
+static const int FD_BASE = 0x40000;
+//Nodes: fb<n> is n, the MDP rotator comes after the fbs
+static const int NODE_ROTATOR = 32;
+
+static const char* const sReqNames[MdpModel::REQ_MAX] = {
+    "set", "unset", "get", "play", "prepare", "commit",
+    "rotStart", "rotate", "rotFinish", "other"
+};
+
+MdpModel::MdpModel(const Caps& caps) : mCaps(caps) {
+    for(int i = 0; i < MAX_FDS; i++)
+        mFdNodes[i] = -1;
+    reset();
+}
+
+MdpModel::Caps MdpModel::getDefaultCaps() {
+    Caps caps;
+    caps.mNumPipes[PIPE_VG] = 3;
+    caps.mNumPipes[PIPE_RGB] = 3;
+    caps.mNumPipes[PIPE_DMA] = 2;
+    caps.mMaxStages = 4;
+    caps.mMaxDownscale = 4;
+    caps.mMaxUpscale = 20;
+    caps.mMaxRotDownscale = 3;
+    caps.mMaxPipeWidth = 2048;
+    caps.mXres = 1080;
+    caps.mYres = 1920;
+    return caps;
+}
+
+MdpModel::Caps MdpModel::getMdp4Caps() {
+    Caps caps;
+    caps.mNumPipes[PIPE_VG] = 2;
+    caps.mNumPipes[PIPE_RGB] = 2;
+    caps.mNumPipes[PIPE_DMA] = 0;
+    caps.mMaxStages = 4;
+    caps.mMaxDownscale = 4;
+    caps.mMaxUpscale = 8;
+    caps.mMaxRotDownscale = 2;
+    caps.mMaxPipeWidth = 2048;
+    caps.mXres = 720;
+    caps.mYres = 1280;
+    return caps;
+}
+
+MdpModel::Caps MdpModel::getMdp3Caps() {
+    Caps caps;
+    caps.mNumPipes[PIPE_VG] = 1;
+    caps.mNumPipes[PIPE_RGB] = 1;
+    caps.mNumPipes[PIPE_DMA] = 0;
+    caps.mMaxStages = 2;
+    caps.mMaxDownscale = 4;
+    caps.mMaxUpscale = 8;
+    caps.mMaxRotDownscale = 0;
+    caps.mMaxPipeWidth = 1024;
+    caps.mXres = 480;
+    caps.mYres = 854;
+    return caps;
+}
+
+void MdpModel::reset() {
+    Locker::Autolock _l(mLock);
+    memset(mPipes, 0, sizeof(mPipes));
+    memset(mRotSess, 0, sizeof(mRotSess));
+    memset(mStats, 0, sizeof(mStats));
+    mRejects = 0;
+    mCommits = 0;
+    mCallStart = 0;
+}
+
+void MdpModel::markCall() {
+    Locker::Autolock _l(mLock);
+    mCallStart = systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+int MdpModel::open(const char* const dev, int /*flags*/) {
+    Locker::Autolock _l(mLock);
+    unsigned int fbnum = 0;
+    char tail = 0;
+    int node = -1;
+    if(sscanf(dev, "/dev/graphics/fb%u%c", &fbnum, &tail) == 1 &&
+            fbnum < (unsigned int)NODE_ROTATOR) {
+        node = fbnum;
+    } else if(strcmp(dev, "/dev/msm_rotator") == 0) {
+        node = NODE_ROTATOR;
+    }
+    if(node < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    for(int i = 0; i < MAX_FDS; i++) {
+        if(mFdNodes[i] < 0) {
+            mFdNodes[i] = node;
+            return FD_BASE + i;
+        }
+    }
+    errno = EMFILE;
+    return -1;
+}
+
+int MdpModel::close(int fd) {
+    Locker::Autolock _l(mLock);
+    if(getNode(fd) < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    mFdNodes[fd - FD_BASE] = -1;
+    return 0;
+}
+
+int MdpModel::ioctl(int fd, unsigned long request, void *arg) {
+    Locker::Autolock _l(mLock);
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    int req = REQ_OTHER;
+    int err = (getNode(fd) < 0) ? EBADF : handle(fd, request, arg, req);
+
+    ReqStats& stats = mStats[req];
+    stats.mCount++;
+    if(mCallStart) {
+        //Overlay code that led to this request, the model's own time is
+        //left out
+        nsecs_t time = start - mCallStart;
+        stats.mCharged++;
+        stats.mTotalTime += time;
+        if(time > stats.mMaxTime)
+            stats.mMaxTime = time;
+        mCallStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+    if(err) {
+        stats.mFailed++;
+        mRejects++;
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int MdpModel::handle(int fd, unsigned long request, void *arg, int& req) {
+    switch(request) {
+    case MSMFB_OVERLAY_SET:
+        req = REQ_SET;
+        return setOverlay(fd, *static_cast<mdp_overlay*>(arg), true);
+    case MSMFB_OVERLAY_UNSET:
+        req = REQ_UNSET;
+        return unsetOverlay(*static_cast<int*>(arg));
+    case MSMFB_OVERLAY_GET:
+        req = REQ_GET;
+        return getOverlay(*static_cast<mdp_overlay*>(arg));
+    case MSMFB_OVERLAY_PLAY:
+        req = REQ_PLAY;
+        return play(*static_cast<msmfb_overlay_data*>(arg));
+#ifdef MSMFB_OVERLAY_PREPARE
+    case MSMFB_OVERLAY_PREPARE:
+        req = REQ_PREPARE;
+        return prepare(fd, *static_cast<mdp_overlay_list*>(arg));
+#endif
+    case MSMFB_DISPLAY_COMMIT:
+        req = REQ_COMMIT;
+        mCommits++;
+        return 0;
+    case MSM_ROTATOR_IOCTL_START:
+        req = REQ_ROT_START;
+        return startRotator(*static_cast<msm_rotator_img_info*>(arg));
+    case MSM_ROTATOR_IOCTL_ROTATE:
+        req = REQ_ROTATE;
+        return rotate(*static_cast<msm_rotator_data_info*>(arg));
+    case MSM_ROTATOR_IOCTL_FINISH:
+        req = REQ_ROT_FINISH;
+        return endRotator(*static_cast<uint32_t*>(arg));
+    case MSMFB_MIXER_INFO:
+        return getMixerInfo(fd, *static_cast<msmfb_mixer_info_req*>(arg));
+    case MSMFB_OVERLAY_3D:
+        return 0;
+    case FBIOGET_VSCREENINFO: {
+        fb_var_screeninfo *vinfo = static_cast<fb_var_screeninfo*>(arg);
+        memset(vinfo, 0, sizeof(fb_var_screeninfo));
+        vinfo->xres = vinfo->xres_virtual = mCaps.mXres;
+        vinfo->yres = vinfo->yres_virtual = mCaps.mYres;
+        vinfo->bits_per_pixel = 32;
+        return 0;
+    }
+    case FBIOPUT_VSCREENINFO:
+        return 0;
+    case FBIOGET_FSCREENINFO: {
+        fb_fix_screeninfo *finfo = static_cast<fb_fix_screeninfo*>(arg);
+        memset(finfo, 0, sizeof(fb_fix_screeninfo));
+        finfo->line_length = mCaps.mXres * 4;
+        return 0;
+    }
+    default:
+        ALOGE("%s: unsupported request 0x%lx", __FUNCTION__, request);
+        return ENOTTY;
+    }
+}
+
+int MdpModel::getNode(int fd) const {
+    if(fd < FD_BASE || fd >= FD_BASE + MAX_FDS)
+        return -1;
+    return mFdNodes[fd - FD_BASE];
+}
+
+uint64_t MdpModel::getMixer(int fd, const uint32_t& flags) const {
+    uint64_t mixer = (uint64_t)getNode(fd);
+    return (mixer << 1) | ((flags & MDSS_MDP_RIGHT_MIXER) ? 1 : 0);
+}
+
+int MdpModel::findPipe(uint32_t id) const {
+    for(int i = 0; i < MAX_PIPES; i++) {
+        if(mPipes[i].mInUse && (uint32_t)(1 << i) == id)
+            return i;
+    }
+    return -1;
+}
+
+int MdpModel::allocPipe(const mdp_overlay& ov) {
+    int types[2] = { PIPE_RGB, PIPE_VG };
+    int numTypes = 2;
+    if(ov.flags & MDSS_MDP_ROT_ONLY) {
+        types[0] = PIPE_ROT;
+        numTypes = 1;
+    } else if(ov.flags & MDP_OV_PIPE_FORCE_DMA) {
+        types[0] = PIPE_DMA;
+        numTypes = 1;
+    } else if(utils::isYuv(ov.src.format)) {
+        types[0] = PIPE_VG;
+        numTypes = 1;
+    }
+
+    for(int t = 0; t < numTypes; t++) {
+        uint32_t used = 0;
+        for(int i = 0; i < MAX_PIPES; i++) {
+            if(mPipes[i].mInUse && mPipes[i].mType == types[t])
+                used++;
+        }
+        //Rotator sessions are limited only by the table
+        if(types[t] != PIPE_ROT && used >= mCaps.mNumPipes[types[t]])
+            continue;
+        for(int i = 0; i < MAX_PIPES; i++) {
+            if(!mPipes[i].mInUse) {
+                mPipes[i].mType = types[t];
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+int MdpModel::validate(const mdp_overlay& ov, const uint64_t& mixer,
+        int self, bool checkZ) {
+    const mdp_rect& src = ov.src_rect;
+    const mdp_rect& dst = ov.dst_rect;
+    if(!src.w || !src.h || !dst.w || !dst.h) {
+        ALOGE("%s: empty rect", __FUNCTION__);
+        return EINVAL;
+    }
+    if(src.x + src.w > ov.src.width || src.y + src.h > ov.src.height) {
+        ALOGE("%s: crop %d,%d %dx%d outside %dx%d source", __FUNCTION__,
+                src.x, src.y, src.w, src.h, ov.src.width, ov.src.height);
+        return EINVAL;
+    }
+    if(ov.flags & MDSS_MDP_ROT_ONLY)
+        return 0;
+
+    //The scaler sees the crop after decimation
+    uint32_t srcW = src.w;
+    uint32_t srcH = src.h;
+#ifdef MDP_DECIMATION_EN
+    srcW >>= ov.horz_deci;
+    srcH >>= ov.vert_deci;
+#endif
+    if(!srcW || !srcH || srcW > mCaps.mMaxPipeWidth) {
+        ALOGE("%s: crop width %d beyond a pipe", __FUNCTION__, srcW);
+        return EINVAL;
+    }
+    if(srcW > dst.w * mCaps.mMaxDownscale ||
+            srcH > dst.h * mCaps.mMaxDownscale ||
+            dst.w > srcW * mCaps.mMaxUpscale ||
+            dst.h > srcH * mCaps.mMaxUpscale) {
+        ALOGE("%s: scale %dx%d -> %dx%d out of range", __FUNCTION__,
+                srcW, srcH, dst.w, dst.h);
+        return EINVAL;
+    }
+    if(ov.z_order >= mCaps.mMaxStages) {
+        ALOGE("%s: z_order %d beyond %d stages", __FUNCTION__, ov.z_order,
+                mCaps.mMaxStages);
+        return EINVAL;
+    }
+    for(int i = 0; checkZ && i < MAX_PIPES; i++) {
+        if(i == self || !mPipes[i].mInUse || mPipes[i].mMixer != mixer ||
+                mPipes[i].mType == PIPE_ROT)
+            continue;
+        if(mPipes[i].mOv.z_order == ov.z_order) {
+            ALOGE("%s: z_order %d already taken by pipe 0x%x", __FUNCTION__,
+                    ov.z_order, mPipes[i].mOv.id);
+            return EINVAL;
+        }
+    }
+    return 0;
+}
+
+int MdpModel::setOverlay(int fd, mdp_overlay& ov, bool checkZ) {
+    uint64_t mixer = getMixer(fd, ov.flags);
+    int index = -1;
+    if(static_cast<int>(ov.id) != MSMFB_NEW_REQUEST) {
+        index = findPipe(ov.id);
+        if(index < 0) {
+            ALOGE("%s: unknown pipe 0x%x", __FUNCTION__, ov.id);
+            return EINVAL;
+        }
+    }
+
+    int err = validate(ov, mixer, index, checkZ);
+    if(err)
+        return err;
+
+    if(index < 0) {
+        index = allocPipe(ov);
+        if(index < 0) {
+            ALOGE("%s: out of pipes", __FUNCTION__);
+            return ENOMEM;
+        }
+        mPipes[index].mInUse = true;
+        mPipes[index].mPlays = 0;
+        ov.id = 1 << index;
+    }
+    mPipes[index].mMixer = mixer;
+    mPipes[index].mOv = ov;
+    return 0;
+}
+
+int MdpModel::unsetOverlay(int id) {
+    int index = findPipe(id);
+    if(index < 0) {
+        ALOGE("%s: unknown pipe 0x%x", __FUNCTION__, id);
+        return EINVAL;
+    }
+    mPipes[index].mInUse = false;
+    return 0;
+}
+
+int MdpModel::getOverlay(mdp_overlay& ov) {
+    int index = findPipe(ov.id);
+    if(index < 0)
+        return EINVAL;
+    ov = mPipes[index].mOv;
+    return 0;
+}
+
+int MdpModel::play(msmfb_overlay_data& od) {
+    int index = findPipe(od.id);
+    if(index < 0) {
+        ALOGE("%s: play on unknown pipe 0x%x", __FUNCTION__, od.id);
+        return EINVAL;
+    }
+    mPipes[index].mPlays++;
+    mPipes[index].mMemId = od.data.memory_id;
+    mPipes[index].mOffset = od.data.offset;
+    return 0;
+}
+
+#ifdef MSMFB_OVERLAY_PREPARE
+int MdpModel::prepare(int fd, mdp_overlay_list& list) {
+    //Either the whole list goes in or none of it, ids handed out to new
+    //requests are taken back too
+    Pipe backup[MAX_PIPES];
+    uint32_t ids[MAX_PIPES];
+    if(list.num_overlays > MAX_PIPES)
+        return E2BIG;
+    memcpy(backup, mPipes, sizeof(mPipes));
+    for(uint32_t i = 0; i < list.num_overlays; i++)
+        ids[i] = list.overlay_list[i]->id;
+    list.processed_overlays = 0;
+    int err = 0;
+    //z-order is checked once all are in, the list may swap stages
+    for(uint32_t i = 0; !err && i < list.num_overlays; i++) {
+        err = setOverlay(fd, *list.overlay_list[i], false);
+        if(!err)
+            list.processed_overlays++;
+    }
+    for(uint32_t i = 0; !err && i < list.num_overlays; i++) {
+        int index = findPipe(list.overlay_list[i]->id);
+        err = validate(mPipes[index].mOv, mPipes[index].mMixer, index, true);
+        if(err)
+            list.processed_overlays = i;
+    }
+    if(err) {
+        memcpy(mPipes, backup, sizeof(mPipes));
+        for(uint32_t i = 0; i < list.num_overlays; i++)
+            list.overlay_list[i]->id = ids[i];
+    }
+    return err;
+}
+#endif
+
+int MdpModel::getMixerInfo(int fd, msmfb_mixer_info_req& req) {
+    uint64_t mixer = getMixer(fd, 0);
+    req.cnt = 0;
+    for(int i = 0; i < MAX_PIPES && req.cnt < MAX_PIPE_PER_MIXER; i++) {
+        if(!mPipes[i].mInUse || mPipes[i].mType == PIPE_ROT ||
+                (mPipes[i].mMixer & ~1ULL) != mixer)
+            continue;
+        mdp_mixer_info& info = req.info[req.cnt++];
+        info.pndx = mPipes[i].mOv.id;
+        info.pnum = i;
+        info.ptype = mPipes[i].mType;
+        info.mixer_num = req.mixer_num;
+        info.z_order = mPipes[i].mOv.z_order;
+    }
+    return 0;
+}
+
+int MdpModel::startRotator(msm_rotator_img_info& info) {
+    if(!info.src.width || !info.src.height ||
+            !info.src_rect.w || !info.src_rect.h) {
+        ALOGE("%s: empty source", __FUNCTION__);
+        return EINVAL;
+    }
+    if(info.downscale_ratio > mCaps.mMaxRotDownscale) {
+        ALOGE("%s: downscale %d beyond %d", __FUNCTION__,
+                info.downscale_ratio, mCaps.mMaxRotDownscale);
+        return EINVAL;
+    }
+    //A known session id reconfigures that session
+    for(int i = 0; i < MAX_ROT_SESS; i++) {
+        if(mRotSess[i].mInUse && info.session_id == (uint32_t)(i + 1)) {
+            mRotSess[i].mInfo = info;
+            return 0;
+        }
+    }
+    for(int i = 0; i < MAX_ROT_SESS; i++) {
+        if(!mRotSess[i].mInUse) {
+            mRotSess[i].mInUse = true;
+            mRotSess[i].mRotations = 0;
+            info.session_id = i + 1;
+            mRotSess[i].mInfo = info;
+            return 0;
+        }
+    }
+    ALOGE("%s: out of rotator sessions", __FUNCTION__);
+    return EBUSY;
+}
+
+int MdpModel::rotate(msm_rotator_data_info& data) {
+    uint32_t id = data.session_id;
+    if(!id || id > MAX_ROT_SESS || !mRotSess[id - 1].mInUse) {
+        ALOGE("%s: unknown session %u", __FUNCTION__, id);
+        return EINVAL;
+    }
+    mRotSess[id - 1].mRotations++;
+    return 0;
+}
+
+int MdpModel::endRotator(uint32_t sessId) {
+    if(!sessId || sessId > MAX_ROT_SESS || !mRotSess[sessId - 1].mInUse) {
+        ALOGE("%s: unknown session %u", __FUNCTION__, sessId);
+        return EINVAL;
+    }
+    mRotSess[sessId - 1].mInUse = false;
+    return 0;
+}
+
+bool MdpModel::render(int fbFd, RefCompositor& comp,
+        RefCompositor::Image& out, const uint32_t& bgColor) {
+    Locker::Autolock _l(mLock);
+    RefCompositor::Layer layers[MAX_PIPES];
+    void *maps[MAX_PIPES];
+    size_t mapLens[MAX_PIPES];
+    int count = 0;
+    bool ret = true;
+    uint64_t mixer = getMixer(fbFd, 0);
+    const size_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+
+    for(int i = 0; i < MAX_PIPES; i++) {
+        const Pipe& pipe = mPipes[i];
+        if(!pipe.mInUse || pipe.mType == PIPE_ROT || !pipe.mPlays ||
+                (pipe.mMixer & ~1ULL) != mixer)
+            continue;
+        uint32_t size = RefCompositor::getBufferSize(pipe.mOv.src);
+        if(!size) {
+            ALOGE("%s: pipe 0x%x format %d not renderable", __FUNCTION__,
+                    pipe.mOv.id, pipe.mOv.src.format);
+            ret = false;
+            continue;
+        }
+        size_t pageOffset = pipe.mOffset & ~pageMask;
+        size_t delta = pipe.mOffset - pageOffset;
+        void *base = mmap(NULL, size + delta, PROT_READ, MAP_SHARED,
+                pipe.mMemId, pageOffset);
+        if(base == MAP_FAILED) {
+            ALOGE("%s: failed to map memory %d of pipe 0x%x err=%s",
+                    __FUNCTION__, pipe.mMemId, pipe.mOv.id, strerror(errno));
+            ret = false;
+            continue;
+        }
+        maps[count] = base;
+        mapLens[count] = size + delta;
+        layers[count].mOv = pipe.mOv;
+        layers[count].mBuf = static_cast<const uint8_t*>(base) + delta;
+        //Right mixer positions are relative to its half
+        if(pipe.mMixer & 1)
+            layers[count].mOv.dst_rect.x += out.mWidth / 2;
+        count++;
+    }
+
+    if(!comp.compose(layers, count, out, bgColor))
+        ret = false;
+
+    for(int i = 0; i < count; i++) {
+        munmap(maps[i], mapLens[i]);
+    }
+    return ret;
+}
+
+uint32_t MdpModel::getPipeCount() {
+    Locker::Autolock _l(mLock);
+    uint32_t count = 0;
+    for(int i = 0; i < MAX_PIPES; i++) {
+        if(mPipes[i].mInUse && mPipes[i].mType != PIPE_ROT)
+            count++;
+    }
+    return count;
+}
+
+uint32_t MdpModel::getRequestCount(eRequest req) {
+    Locker::Autolock _l(mLock);
+    return mStats[req].mCount;
+}
+
+nsecs_t MdpModel::getOverlayTime(eRequest req) {
+    Locker::Autolock _l(mLock);
+    return mStats[req].mTotalTime;
+}
+
+uint32_t MdpModel::getRejectCount() {
+    Locker::Autolock _l(mLock);
+    return mRejects;
+}
+
+void MdpModel::getDump(char *buf, size_t len) {
+    Locker::Autolock _l(mLock);
+    char str[256] = {'\0'};
+    uint32_t pipes = 0;
+    for(int i = 0; i < MAX_PIPES; i++) {
+        if(mPipes[i].mInUse)
+            pipes++;
+    }
+    snprintf(str, 256, "MdpModel pipes=%u commits=%u rejects=%u\n",
+            pipes, mCommits, mRejects);
+    strncat(buf, str, strlen(str));
+    for(int i = 0; i < REQ_MAX; i++) {
+        const ReqStats& stats = mStats[i];
+        if(!stats.mCount)
+            continue;
+        snprintf(str, 256, "\t%-9s count=%u failed=%u overlay avg=%lldns "
+                "max=%lldns\n", sReqNames[i], stats.mCount, stats.mFailed,
+                (long long)(stats.mCharged ?
+                stats.mTotalTime / stats.mCharged : 0),
+                (long long)stats.mMaxTime);
+        strncat(buf, str, strlen(str));
+    }
+}
+
+} // overlay
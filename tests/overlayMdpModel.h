@@ -0,0 +1,185 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef OVERLAY_MDP_MODEL_H
+#define OVERLAY_MDP_MODEL_H
+
+#include <utils/Timers.h>
+#include "mdpWrapper.h"
+#include "overlayRefCompositor.h"
+#include "gr.h"
+
+namespace overlay {
+
+/*
+ * Software model of the MDP driver. Installed with mdp_wrapper::setDriver()
+ * it takes the requests liboverlay would send to the kernel, keeps the
+ * pipes, mixers and rotator sessions they configure, and rejects the
+ * configs hardware would: out of pipes of a type, scaling beyond range,
+ * z-order out of range or shared on a mixer.
+ * The time overlay code spends before each kind of request is recorded,
+ * so the cost of the overlay code itself can be profiled on a host.
+ * The model serves the device nodes liboverlay opens as well, so no real
+ * node is touched. Mixers are told apart by the fb node behind the fd, and
+ * by the MDSS right mixer flag.
+ */
+class MdpModel : public mdp_wrapper::Driver {
+public:
+    enum { MAX_PIPES = 16, MAX_ROT_SESS = 8, MAX_FDS = 32 };
+    enum ePipeType { PIPE_VG, PIPE_RGB, PIPE_DMA, PIPE_ROT, PIPE_TYPE_MAX };
+    enum eRequest {
+        REQ_SET,
+        REQ_UNSET,
+        REQ_GET,
+        REQ_PLAY,
+        REQ_PREPARE,
+        REQ_COMMIT,
+        REQ_ROT_START,
+        REQ_ROTATE,
+        REQ_ROT_FINISH,
+        REQ_OTHER,
+        REQ_MAX
+    };
+
+    /* What the modelled hardware supports */
+    struct Caps {
+        uint32_t mNumPipes[PIPE_ROT]; //VG, RGB, DMA
+        uint32_t mMaxStages; //Blend stages per mixer
+        uint32_t mMaxDownscale; //src / dst
+        uint32_t mMaxUpscale; //dst / src
+        uint32_t mMaxRotDownscale; //log2 of the rotator downscale
+        uint32_t mMaxPipeWidth; //Widest crop a pipe fetches, decimated
+        uint32_t mXres;
+        uint32_t mYres;
+    };
+
+    explicit MdpModel(const Caps& caps);
+    virtual ~MdpModel() {}
+    virtual int ioctl(int fd, unsigned long request, void *arg);
+    /* Opens /dev/graphics/fb<n> and /dev/msm_rotator, any other node fails
+     * with ENOENT, as if the target had no such device */
+    virtual int open(const char* const dev, int flags);
+    virtual int close(int fd);
+
+    /* Caps of a typical MDSS target */
+    static Caps getDefaultCaps();
+    /* An MDP4 target: two VG and two RGB pipes, no DMA for overlays */
+    static Caps getMdp4Caps();
+    /* An MDP3 target: one VG and one RGB pipe over two blend stages */
+    static Caps getMdp3Caps();
+    /* Pipes currently set, rotator-only sessions excluded */
+    uint32_t getPipeCount();
+    /* Requests rejected so far */
+    uint32_t getRejectCount();
+    /* Forgets all pipes, sessions and stats, open fds stay open */
+    void reset();
+    /* Marks the start of a call into overlay code. The time from here, or
+     * from the return of the previous request, to the next request is
+     * charged to that request. Mark again before the next call, so that the
+     * time between calls is not charged */
+    void markCall();
+    /* Requests of a kind received so far, rejected ones included */
+    uint32_t getRequestCount(eRequest req);
+    /* Overlay code time charged to requests of a kind so far */
+    nsecs_t getOverlayTime(eRequest req);
+    /* Renders what the mixers behind fbFd show with the last played
+     * buffers. Played memory is mapped, so it has to be valid still */
+    bool render(int fbFd, RefCompositor& comp, RefCompositor::Image& out,
+            const uint32_t& bgColor);
+    /* Returns the model dump.
+     * Expects a NULL terminated buffer of big enough size.
+     */
+    void getDump(char *buf, size_t len);
+
+private:
+    struct Pipe {
+        bool mInUse;
+        int mType;
+        uint64_t mMixer;
+        mdp_overlay mOv;
+        uint32_t mPlays;
+        //Last played buffer
+        int mMemId;
+        uint32_t mOffset;
+    };
+    struct RotSess {
+        bool mInUse;
+        msm_rotator_img_info mInfo;
+        uint32_t mRotations;
+    };
+    struct ReqStats {
+        uint32_t mCount;
+        uint32_t mFailed;
+        //Overlay code time charged, over mCharged requests
+        uint32_t mCharged;
+        nsecs_t mTotalTime;
+        nsecs_t mMaxTime;
+    };
+
+    /* Returns 0 or an errno for each request */
+    int setOverlay(int fd, mdp_overlay& ov, bool checkZ);
+    int unsetOverlay(int id);
+    int getOverlay(mdp_overlay& ov);
+    int play(msmfb_overlay_data& od);
+#ifdef MSMFB_OVERLAY_PREPARE
+    int prepare(int fd, mdp_overlay_list& list);
+#endif
+    int getMixerInfo(int fd, msmfb_mixer_info_req& req);
+    int startRotator(msm_rotator_img_info& info);
+    int rotate(msm_rotator_data_info& data);
+    int endRotator(uint32_t sessId);
+    int handle(int fd, unsigned long request, void *arg, int& req);
+
+    /* Checks ov against the limits and, if checkZ, against the stages of
+     * the other pipes of its mixer */
+    int validate(const mdp_overlay& ov, const uint64_t& mixer, int self,
+            bool checkZ);
+    /* Picks a free pipe of a type that can fetch ov, -1 if none */
+    int allocPipe(const mdp_overlay& ov);
+    int findPipe(uint32_t id) const;
+    /* Node an fd of the model was opened on, -1 if not one of ours */
+    int getNode(int fd) const;
+    uint64_t getMixer(int fd, const uint32_t& flags) const;
+
+    Caps mCaps;
+    Pipe mPipes[MAX_PIPES];
+    RotSess mRotSess[MAX_ROT_SESS];
+    ReqStats mStats[REQ_MAX];
+    //Node of each fd handed out, -1 if free
+    int mFdNodes[MAX_FDS];
+    uint32_t mRejects;
+    uint32_t mCommits;
+    //Start of the overlay code time to charge, 0 if none
+    nsecs_t mCallStart;
+    Locker mLock;
+};
+
+} // overlay
+
+#endif // OVERLAY_MDP_MODEL_H
@@ -0,0 +1,572 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "overlayRefCompositor.h"
+
+namespace overlay {
+
+//Venus NV12 plane alignments
+#define VENUS_Y_STRIDE_ALIGN 128
+#define VENUS_Y_SCANLINE_ALIGN 32
+#define VENUS_UV_SCANLINE_ALIGN 16
+
+static inline uint32_t div255(const uint32_t& x) {
+    return (x + 128 + ((x + 128) >> 8)) >> 8;
+}
+
+//Eight 16 bit lanes over four pixels. A pixel's R and B land in its even
+//and odd lane of the low bytes, G and A in the high bytes, so that channel
+//times weight products fit a lane
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+static inline v8u16 splat(const uint16_t& x) {
+    v8u16 v = { x, x, x, x, x, x, x, x };
+    return v;
+}
+
+//For x up to 65025, so that no step wraps
+static inline v8u16 div255(const v8u16& x) {
+    v8u16 t = x + splat(128);
+    return (t + (t >> 8)) >> 8;
+}
+
+//Odd lane of each pixel in both of its lanes
+static inline v8u16 oddToBoth(const v8u16& x) {
+    v4u32 w = (v4u32)x;
+    return (v8u16)((w >> 16) | (w & (v4u32){ 0xffff0000, 0xffff0000,
+            0xffff0000, 0xffff0000 }));
+}
+
+//div255(a * sw + b * dw) clamped to 255. Only when sw + dw can pass 255
+//the sum can pass 16 bits, but then any sum from 64898 on ends up clamped,
+//so a carry or a large sum gives 255
+template <bool CLAMP>
+static inline v8u16 blend255(const v8u16& a, const v8u16& sw,
+        const v8u16& b, const v8u16& dw) {
+    v8u16 p = a * sw;
+    v8u16 x = p + b * dw;
+    if(!CLAMP)
+        return div255(x);
+    v8u16 over = (v8u16)(x < p) | (v8u16)(x >= splat(64898));
+    return (div255(x) | over) & splat(0xff);
+}
+
+//Blends the pixels in whole quads with one of the blend ops, the source
+//weight, destination weight and source alpha are the ones blendRow's
+//scalar tail computes. Returns the count of pixels blended
+template <uint32_t OP>
+static uint32_t blendQuads(const uint32_t *src, uint32_t *dst,
+        const uint32_t& count, const uint32_t& pa) {
+    const v8u16 k255 = splat(255);
+    const v8u16 kPa = splat(pa);
+    const v4u32 kLow = { 0xffff, 0xffff, 0xffff, 0xffff };
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        v8u16 s, d;
+        memcpy(&s, src + i, sizeof(s));
+        memcpy(&d, dst + i, sizeof(d));
+        v8u16 sRb = s & k255, sGa = s >> 8;
+        v8u16 dRb = d & k255, dGa = d >> 8;
+        v8u16 sw, dw, sa;
+        if(OP == BLEND_OP_OPAQUE) {
+            sw = kPa;
+            dw = k255 - kPa;
+            sa = kPa;
+        } else if(OP == BLEND_OP_PREMULTIPLIED) {
+            sa = div255(oddToBoth(sGa) * kPa);
+            sw = kPa;
+            dw = k255 - sa;
+        } else {
+            sa = div255(oddToBoth(sGa) * kPa);
+            sw = sa;
+            dw = k255 - sa;
+        }
+        const bool clamp = (OP == BLEND_OP_PREMULTIPLIED);
+        v8u16 rb = blend255<clamp>(sRb, sw, dRb, dw);
+        v8u16 g = blend255<clamp>(sGa, sw, dGa, dw);
+        v8u16 oa = sa + div255(oddToBoth(dGa) * (k255 - sa));
+        v8u16 ga = (v8u16)(((v4u32)g & kLow) | ((v4u32)oa & ~kLow));
+        v8u16 o = rb | (ga << 8);
+        memcpy(dst + i, &o, sizeof(o));
+    }
+    return i;
+}
+
+static inline uint32_t clamp8(const int& x) {
+    return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
+
+static inline uint32_t pack(const uint32_t& r, const uint32_t& g,
+        const uint32_t& b, const uint32_t& a) {
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+//BT.601 limited range, R = (298 * (Y - 16) + 409 * (V - 128) + 128) >> 8 and
+//so on, as terms per component value plus a clamp of the sum
+struct Bt601Tables {
+    enum { CLAMP_BIAS = 384 };
+    int y[256];
+    int rv[256];
+    int gu[256];
+    int gv[256];
+    int bu[256];
+    uint8_t clamp[1024];
+
+    Bt601Tables() {
+        for(int i = 0; i < 256; i++) {
+            y[i] = 298 * (i - 16) + 128;
+            rv[i] = 409 * (i - 128);
+            gu[i] = -100 * (i - 128);
+            gv[i] = -208 * (i - 128);
+            bu[i] = 516 * (i - 128);
+        }
+        for(int i = 0; i < 1024; i++)
+            clamp[i] = clamp8(i - CLAMP_BIAS);
+    }
+};
+
+static const Bt601Tables sBt601;
+
+//Chroma terms, shared by the pixels of a chroma sample
+struct Bt601Chroma {
+    int r;
+    int g;
+    int b;
+};
+
+static inline Bt601Chroma yuvChroma(const int& u, const int& v) {
+    Bt601Chroma c = { sBt601.rv[v], sBt601.gu[u] + sBt601.gv[v],
+            sBt601.bu[u] };
+    return c;
+}
+
+static inline uint32_t yuvToRgba(const int& y, const Bt601Chroma& c) {
+    const uint8_t *clamp = sBt601.clamp + Bt601Tables::CLAMP_BIAS;
+    int l = sBt601.y[y];
+    return pack(clamp[(l + c.r) >> 8], clamp[(l + c.g) >> 8],
+            clamp[(l + c.b) >> 8], 0xff);
+}
+
+RefCompositor::RefCompositor(const uint32_t& numThreads) :
+        mNumThreads(numThreads), mGeneration(0), mNumBands(0), mPending(0),
+        mExit(false), mCount(0), mBgColor(0) {
+    if(mNumThreads < 1)
+        mNumThreads = 1;
+    if(mNumThreads > MAX_THREADS)
+        mNumThreads = MAX_THREADS;
+    memset(&mOut, 0, sizeof(mOut));
+    memset(mWorkers, 0, sizeof(mWorkers));
+    memset(mXmap, 0, sizeof(mXmap));
+    memset(mXmapLen, 0, sizeof(mXmapLen));
+    memset(mLinear, 0, sizeof(mLinear));
+    pthread_mutex_init(&mPoolLock, NULL);
+    pthread_cond_init(&mWorkCond, NULL);
+    pthread_cond_init(&mDoneCond, NULL);
+    for(uint32_t i = 0; i < mNumThreads; i++) {
+        mWorkers[i].mComp = this;
+        //Bands of workers that fail to start run on the caller
+        if(i > 0) {
+            mWorkers[i].mStarted = (pthread_create(&mWorkers[i].mThread,
+                    NULL, workerLoop, &mWorkers[i]) == 0);
+        }
+    }
+}
+
+RefCompositor::~RefCompositor() {
+    pthread_mutex_lock(&mPoolLock);
+    mExit = true;
+    pthread_cond_broadcast(&mWorkCond);
+    pthread_mutex_unlock(&mPoolLock);
+    for(uint32_t i = 0; i < mNumThreads; i++) {
+        if(mWorkers[i].mStarted)
+            pthread_join(mWorkers[i].mThread, NULL);
+        delete [] mWorkers[i].mScratch;
+    }
+    for(int i = 0; i < MAX_LAYERS; i++)
+        delete [] mXmap[i];
+    pthread_cond_destroy(&mDoneCond);
+    pthread_cond_destroy(&mWorkCond);
+    pthread_mutex_destroy(&mPoolLock);
+}
+
+bool RefCompositor::isSupported(const uint32_t& format) {
+    switch(format) {
+        case MDP_RGBA_8888:
+        case MDP_RGBX_8888:
+        case MDP_BGRA_8888:
+        case MDP_RGB_565:
+        case MDP_BGR_565:
+        case MDP_RGB_888:
+        case MDP_Y_CBCR_H2V2:
+        case MDP_Y_CRCB_H2V2:
+        case MDP_Y_CBCR_H2V2_VENUS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint32_t RefCompositor::getBufferSize(const msmfb_img& src) {
+    switch(src.format) {
+        case MDP_RGBA_8888:
+        case MDP_RGBX_8888:
+        case MDP_BGRA_8888:
+            return src.width * src.height * 4;
+        case MDP_RGB_565:
+        case MDP_BGR_565:
+            return src.width * src.height * 2;
+        case MDP_RGB_888:
+            return src.width * src.height * 3;
+        case MDP_Y_CBCR_H2V2:
+        case MDP_Y_CRCB_H2V2:
+            return src.width * src.height * 3 / 2;
+        case MDP_Y_CBCR_H2V2_VENUS: {
+            uint32_t stride = utils::alignup(src.width, VENUS_Y_STRIDE_ALIGN);
+            return stride *
+                (utils::alignup(src.height, VENUS_Y_SCANLINE_ALIGN) +
+                 utils::alignup(src.height / 2, VENUS_UV_SCANLINE_ALIGN));
+        }
+        default:
+            return 0;
+    }
+}
+
+bool RefCompositor::compose(const Layer layers[], const int& count,
+        Image& out, const uint32_t& bgColor) {
+    bool ret = true;
+    mCount = 0;
+    //Sort by z_order, stable for equal stages
+    for(int i = 0; i < count && mCount < MAX_LAYERS; i++) {
+        const mdp_overlay& ov = layers[i].mOv;
+        if(!isSupported(ov.src.format) || !layers[i].mBuf) {
+            ALOGE("%s: skipping layer %d format %d", __FUNCTION__, i,
+                    ov.src.format);
+            ret = false;
+            continue;
+        }
+        if(!ov.src_rect.w || !ov.src_rect.h || !ov.dst_rect.w ||
+                !ov.dst_rect.h)
+            continue;
+        int j = mCount++;
+        while(j > 0 && mSorted[j - 1]->mOv.z_order > ov.z_order) {
+            mSorted[j] = mSorted[j - 1];
+            j--;
+        }
+        mSorted[j] = &layers[i];
+    }
+
+    //Source column of each destination column, nearest sample at centers
+    for(int i = 0; i < mCount; i++) {
+        const mdp_overlay& ov = mSorted[i]->mOv;
+        if(mXmapLen[i] < ov.dst_rect.w) {
+            delete [] mXmap[i];
+            mXmap[i] = new uint32_t[ov.dst_rect.w];
+            mXmapLen[i] = ov.dst_rect.w;
+        }
+        mLinear[i] = (ov.src_rect.w == ov.dst_rect.w) &&
+                !(ov.flags & MDP_FLIP_LR);
+        for(uint32_t k = 0; k < ov.dst_rect.w; k++) {
+            uint32_t sx = (uint32_t)(((uint64_t)k * 2 + 1) * ov.src_rect.w /
+                    (2 * (uint64_t)ov.dst_rect.w));
+            if(ov.flags & MDP_FLIP_LR)
+                sx = ov.src_rect.w - 1 - sx;
+            mXmap[i][k] = ov.src_rect.x + sx;
+        }
+    }
+
+    mOut = out;
+    mBgColor = bgColor;
+
+    uint32_t numBands = out.mHeight / MIN_ROWS_PER_BAND;
+    if(numBands > mNumThreads)
+        numBands = mNumThreads;
+    if(numBands < 1)
+        numBands = 1;
+    uint32_t band = (out.mHeight + numBands - 1) / numBands;
+    uint32_t pending = 0;
+    for(uint32_t i = 0; i < numBands; i++) {
+        mWorkers[i].mTop = i * band;
+        mWorkers[i].mBottom = (i + 1) * band;
+        if(mWorkers[i].mBottom > out.mHeight)
+            mWorkers[i].mBottom = out.mHeight;
+        if(mWorkers[i].mStarted)
+            pending++;
+    }
+
+    if(pending) {
+        pthread_mutex_lock(&mPoolLock);
+        mNumBands = numBands;
+        mPending = pending;
+        mGeneration++;
+        pthread_cond_broadcast(&mWorkCond);
+        pthread_mutex_unlock(&mPoolLock);
+    }
+    for(uint32_t i = 0; i < numBands; i++) {
+        if(!mWorkers[i].mStarted)
+            composeRows(mWorkers[i]);
+    }
+    if(pending) {
+        pthread_mutex_lock(&mPoolLock);
+        while(mPending)
+            pthread_cond_wait(&mDoneCond, &mPoolLock);
+        pthread_mutex_unlock(&mPoolLock);
+    }
+    return ret;
+}
+
+void *RefCompositor::workerLoop(void *arg) {
+    Worker *worker = static_cast<Worker*>(arg);
+    RefCompositor *comp = worker->mComp;
+    const uint32_t index = worker - comp->mWorkers;
+    uint32_t seen = 0;
+
+    pthread_mutex_lock(&comp->mPoolLock);
+    while(true) {
+        while(!comp->mExit && comp->mGeneration == seen)
+            pthread_cond_wait(&comp->mWorkCond, &comp->mPoolLock);
+        if(comp->mExit)
+            break;
+        seen = comp->mGeneration;
+        if(index >= comp->mNumBands)
+            continue;
+        pthread_mutex_unlock(&comp->mPoolLock);
+        comp->composeRows(*worker);
+        pthread_mutex_lock(&comp->mPoolLock);
+        if(--comp->mPending == 0)
+            pthread_cond_signal(&comp->mDoneCond);
+    }
+    pthread_mutex_unlock(&comp->mPoolLock);
+    return NULL;
+}
+
+void RefCompositor::composeRows(Worker& worker) {
+    if(worker.mScratchLen < mOut.mWidth) {
+        delete [] worker.mScratch;
+        worker.mScratch = new uint32_t[mOut.mWidth];
+        worker.mScratchLen = mOut.mWidth;
+    }
+    uint32_t *scratch = worker.mScratch;
+    //An opaque bottom layer as wide as the output hides the background
+    const mdp_overlay *base = mCount ? &mSorted[0]->mOv : NULL;
+    if(base && !(isOpaque(*base) && base->dst_rect.x == 0 &&
+            base->dst_rect.w >= mOut.mWidth))
+        base = NULL;
+    for(uint32_t y = worker.mTop; y < worker.mBottom; y++) {
+        uint32_t *row = mOut.mPixels + (size_t)y * mOut.mStride;
+        if(!base || y < base->dst_rect.y ||
+                y >= base->dst_rect.y + base->dst_rect.h) {
+            for(uint32_t x = 0; x < mOut.mWidth; x++)
+                row[x] = mBgColor;
+        }
+
+        for(int i = 0; i < mCount; i++) {
+            const mdp_overlay& ov = mSorted[i]->mOv;
+            const mdp_rect& dst = ov.dst_rect;
+            if(y < dst.y || y >= dst.y + dst.h || dst.x >= mOut.mWidth)
+                continue;
+            uint32_t ky = y - dst.y;
+            uint32_t sy = (uint32_t)(((uint64_t)ky * 2 + 1) *
+                    ov.src_rect.h / (2 * (uint64_t)dst.h));
+            if(ov.flags & MDP_FLIP_UD)
+                sy = ov.src_rect.h - 1 - sy;
+            sy += ov.src_rect.y;
+
+            uint32_t x1 = dst.x + dst.w;
+            if(x1 > mOut.mWidth)
+                x1 = mOut.mWidth;
+            uint32_t count = x1 - dst.x;
+            //Opaque layers replace the row, so they are fetched into it
+            uint32_t *fetch = isOpaque(ov) ? row + dst.x : scratch;
+            const uint32_t *src = fetchRow(*mSorted[i], sy, mXmap[i],
+                    mLinear[i], count, fetch);
+            blendRow(ov, src, row + dst.x, count);
+        }
+    }
+}
+
+bool RefCompositor::isOpaque(const mdp_overlay& ov) {
+    return ov.blend_op == BLEND_OP_OPAQUE && (ov.alpha & 0xff) == 0xff;
+}
+
+const uint32_t *RefCompositor::fetchRow(const Layer& layer,
+        const uint32_t& sy, const uint32_t *xmap, const bool& linear,
+        const uint32_t& count, uint32_t *dst) {
+    const msmfb_img& src = layer.mOv.src;
+    const uint8_t *buf = layer.mBuf;
+    switch(src.format) {
+        case MDP_RGBA_8888:
+        case MDP_RGBX_8888:
+        case MDP_BGRA_8888: {
+            //Pixels are little endian words in RGBA8888 byte order
+            const uint32_t *line = reinterpret_cast<const uint32_t*>(buf +
+                    (size_t)sy * src.width * 4);
+            if(linear && src.format == MDP_RGBA_8888)
+                return line + xmap[0];
+            for(uint32_t i = 0; i < count; i++)
+                dst[i] = line[xmap[i]];
+            if(src.format == MDP_RGBX_8888) {
+                for(uint32_t i = 0; i < count; i++)
+                    dst[i] |= 0xff000000;
+            } else if(src.format == MDP_BGRA_8888) {
+                for(uint32_t i = 0; i < count; i++) {
+                    uint32_t p = dst[i];
+                    dst[i] = (p & 0xff00ff00) | ((p >> 16) & 0xff) |
+                            ((p & 0xff) << 16);
+                }
+            }
+            break;
+        }
+        case MDP_RGB_565:
+        case MDP_BGR_565: {
+            const uint8_t *line = buf + (size_t)sy * src.width * 2;
+            for(uint32_t i = 0; i < count; i++) {
+                const uint8_t *b = line + xmap[i] * 2;
+                uint32_t p = b[0] | (b[1] << 8);
+                uint32_t hi = (p >> 11) & 0x1f;
+                uint32_t g = (p >> 5) & 0x3f;
+                uint32_t lo = p & 0x1f;
+                hi = (hi << 3) | (hi >> 2);
+                g = (g << 2) | (g >> 4);
+                lo = (lo << 3) | (lo >> 2);
+                dst[i] = (src.format == MDP_RGB_565) ?
+                        pack(hi, g, lo, 0xff) : pack(lo, g, hi, 0xff);
+            }
+            break;
+        }
+        case MDP_RGB_888: {
+            const uint8_t *line = buf + (size_t)sy * src.width * 3;
+            for(uint32_t i = 0; i < count; i++) {
+                const uint8_t *p = line + xmap[i] * 3;
+                dst[i] = pack(p[0], p[1], p[2], 0xff);
+            }
+            break;
+        }
+        case MDP_Y_CBCR_H2V2:
+        case MDP_Y_CRCB_H2V2:
+        case MDP_Y_CBCR_H2V2_VENUS: {
+            uint32_t stride = src.width;
+            uint32_t scanlines = src.height;
+            if(src.format == MDP_Y_CBCR_H2V2_VENUS) {
+                stride = utils::alignup(src.width, VENUS_Y_STRIDE_ALIGN);
+                scanlines = utils::alignup(src.height,
+                        VENUS_Y_SCANLINE_ALIGN);
+            }
+            const uint8_t *yLine = buf + (size_t)sy * stride;
+            const uint8_t *cLine = buf + (size_t)stride * scanlines +
+                    (size_t)(sy >> 1) * stride;
+            //CbCr for NV12, CrCb for NV21
+            int uIdx = (src.format == MDP_Y_CRCB_H2V2) ? 1 : 0;
+            uint32_t i = 0;
+            if(linear) {
+                //Pixel pairs from an even column share their chroma
+                uint32_t x = xmap[0];
+                if((x & 1) && count) {
+                    const uint8_t *c = cLine + (x & ~1);
+                    dst[i++] = yuvToRgba(yLine[x], yuvChroma(c[uIdx],
+                            c[1 - uIdx]));
+                }
+                for(; i + 2 <= count; i += 2) {
+                    x = xmap[i];
+                    const uint8_t *c = cLine + x;
+                    Bt601Chroma chroma = yuvChroma(c[uIdx], c[1 - uIdx]);
+                    dst[i] = yuvToRgba(yLine[x], chroma);
+                    dst[i + 1] = yuvToRgba(yLine[x + 1], chroma);
+                }
+            }
+            for(; i < count; i++) {
+                uint32_t x = xmap[i];
+                const uint8_t *c = cLine + (x & ~1);
+                dst[i] = yuvToRgba(yLine[x], yuvChroma(c[uIdx], c[1 - uIdx]));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return dst;
+}
+
+void RefCompositor::blendRow(const mdp_overlay& ov, const uint32_t *src,
+        uint32_t *dst, const uint32_t& count) {
+    uint32_t op = ov.blend_op;
+    //MDSS takes the blend op from the flags
+    if(op == BLEND_OP_NOT_DEFINED) {
+        op = (ov.flags & MDP_BLEND_FG_PREMULT) ?
+                BLEND_OP_PREMULTIPLIED : BLEND_OP_COVERAGE;
+    }
+    const uint32_t pa = ov.alpha & 0xff;
+
+    if(op == BLEND_OP_OPAQUE && pa == 0xff) {
+        if(src != dst)
+            memcpy(dst, src, count * sizeof(uint32_t));
+        //Only these fetch an alpha other than 0xff
+        if(ov.src.format == MDP_RGBA_8888 || ov.src.format == MDP_BGRA_8888) {
+            for(uint32_t i = 0; i < count; i++)
+                dst[i] |= 0xff000000;
+        }
+        return;
+    }
+
+    //Four pixels at a time, the scalar tail below does the rest
+    uint32_t i;
+    if(op == BLEND_OP_OPAQUE)
+        i = blendQuads<BLEND_OP_OPAQUE>(src, dst, count, pa);
+    else if(op == BLEND_OP_PREMULTIPLIED)
+        i = blendQuads<BLEND_OP_PREMULTIPLIED>(src, dst, count, pa);
+    else
+        i = blendQuads<BLEND_OP_COVERAGE>(src, dst, count, pa);
+
+    for(; i < count; i++) {
+        uint32_t s = src[i];
+        uint32_t d = dst[i];
+        uint32_t a = s >> 24;
+        uint32_t sw, dw;
+        if(op == BLEND_OP_OPAQUE) {
+            sw = pa;
+            dw = 255 - pa;
+        } else if(op == BLEND_OP_PREMULTIPLIED) {
+            sw = pa;
+            dw = 255 - div255(a * pa);
+        } else {
+            sw = div255(a * pa);
+            dw = 255 - sw;
+        }
+        uint32_t sa = (op == BLEND_OP_OPAQUE) ? pa : div255(a * pa);
+        uint32_t r = div255((s & 0xff) * sw + (d & 0xff) * dw);
+        uint32_t g = div255(((s >> 8) & 0xff) * sw + ((d >> 8) & 0xff) * dw);
+        uint32_t b = div255(((s >> 16) & 0xff) * sw +
+                ((d >> 16) & 0xff) * dw);
+        uint32_t oa = sa + div255((d >> 24) * (255 - sa));
+        dst[i] = pack(r > 255 ? 255 : r, g > 255 ? 255 : g,
+                b > 255 ? 255 : b, oa);
+    }
+}
+
+} // overlay
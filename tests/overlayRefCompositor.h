@@ -0,0 +1,137 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef OVERLAY_REF_COMPOSITOR_H
+#define OVERLAY_REF_COMPOSITOR_H
+
+#include <linux/msm_mdp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include "overlayUtils.h"
+
+namespace overlay {
+
+/*
+ * Software reference of the MDP layer mixer. Composes the buffers of a
+ * frame, as configured by their mdp_overlay, into an RGBA8888 image:
+ * crop, nearest sample scaling, H/V flips, z-order, plane alpha and the
+ * opaque / premultiplied / coverage blend ops.
+ * Rotation is expected to be done by the rotator, like on hardware, so
+ * sources flagged MDP_SOURCE_ROTATED_90 are fetched as they are.
+ * Rows are split in bands over a pool of worker threads that lives as long
+ * as the compositor; outputs too short to be worth a wake-up are composed
+ * on the caller. Column maps and row scratch are kept across frames.
+ * Blending takes four pixels at a time in 16 bit lanes with GCC vector
+ * extensions, which map to NEON on ARM and SSE2 on x86. YUV is converted
+ * with lookup tables, opaque layers are fetched straight into the output
+ * and unscaled RGBA8888 rows are blended from the source.
+ * Used with MdpModel to render recorded traces into golden images.
+ */
+class RefCompositor : utils::NoCopy {
+public:
+    enum { MAX_LAYERS = utils::OV_MAX, MAX_THREADS = 8 };
+
+    /* A pipe of the frame. mBuf points to the frame the pipe would
+     * fetch, i.e. the played memory at the played offset */
+    struct Layer {
+        mdp_overlay mOv;
+        const uint8_t *mBuf;
+    };
+    /* Output, pixels in RGBA8888 byte order, stride in pixels */
+    struct Image {
+        uint32_t *mPixels;
+        uint32_t mWidth;
+        uint32_t mHeight;
+        uint32_t mStride;
+    };
+
+    /* numThreads is clamped to 1..MAX_THREADS, the caller counts as one */
+    explicit RefCompositor(const uint32_t& numThreads);
+    ~RefCompositor();
+
+    /* Fills out with bgColor, then blends the layers over it in z-order.
+     * Layers of formats not supported are skipped. Returns false if a
+     * layer was skipped */
+    bool compose(const Layer layers[], const int& count, Image& out,
+            const uint32_t& bgColor);
+
+    /* Whether the format can be fetched */
+    static bool isSupported(const uint32_t& format);
+    /* Bytes a frame of the source occupies */
+    static uint32_t getBufferSize(const msmfb_img& src);
+
+private:
+    /* Rows a band needs before it is handed to another thread */
+    enum { MIN_ROWS_PER_BAND = 64 };
+
+    /* A band of rows and the thread composing it. Worker 0 is the caller */
+    struct Worker {
+        RefCompositor *mComp;
+        pthread_t mThread;
+        bool mStarted;
+        uint32_t mTop;
+        uint32_t mBottom;
+        uint32_t *mScratch;
+        uint32_t mScratchLen;
+    };
+    static void *workerLoop(void *arg);
+    void composeRows(Worker& worker);
+    /* Fetches count pixels of source row sy at the columns in xmap into
+     * dst. RGBA8888 rows fetched 1:1 are returned in place instead */
+    static const uint32_t *fetchRow(const Layer& layer, const uint32_t& sy,
+            const uint32_t *xmap, const bool& linear, const uint32_t& count,
+            uint32_t *dst);
+    static bool isOpaque(const mdp_overlay& ov);
+    static void blendRow(const mdp_overlay& ov, const uint32_t *src,
+            uint32_t *dst, const uint32_t& count);
+
+    uint32_t mNumThreads;
+    Worker mWorkers[MAX_THREADS];
+    //Pool state, under mPoolLock. A new mGeneration starts the bands
+    pthread_mutex_t mPoolLock;
+    pthread_cond_t mWorkCond;
+    pthread_cond_t mDoneCond;
+    uint32_t mGeneration;
+    uint32_t mNumBands;
+    uint32_t mPending;
+    bool mExit;
+    //Per compose state, read-only while the bands run
+    const Layer *mSorted[MAX_LAYERS];
+    uint32_t *mXmap[MAX_LAYERS];
+    uint32_t mXmapLen[MAX_LAYERS];
+    //Whether the columns map 1:1, unscaled and unflipped
+    bool mLinear[MAX_LAYERS];
+    int mCount;
+    Image mOut;
+    uint32_t mBgColor;
+};
+
+} // overlay
+
+#endif // OVERLAY_REF_COMPOSITOR_H
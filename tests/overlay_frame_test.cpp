@@ -0,0 +1,193 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include "overlay.h"
+#include "overlayMdpModel.h"
+
+using namespace overlay;
+using namespace overlay::utils;
+
+namespace {
+
+//Counts the requests a display's pipes cost, with the model in place of the
+//driver. The model takes the pipes of all the fb nodes.
+class OverlayFrameTest : public ::testing::Test {
+protected:
+    OverlayFrameTest() : mModel(MdpModel::getDefaultCaps()), mOv(NULL),
+        mNumDest(0) {}
+
+    virtual void SetUp() {
+        mdp_wrapper::setDriver(&mModel);
+        Overlay::initOverlay();
+        mOv = Overlay::getInstance();
+        mOv->configBegin();
+        for(int i = 0; i < NUM_LAYERS; i++) {
+            mDest[i] = mOv->nextPipe(OV_MDP_PIPE_ANY, Overlay::DPY_PRIMARY,
+                    i + 1);
+            if(mDest[i] != OV_INVALID)
+                mNumDest++;
+        }
+    }
+    virtual void TearDown() {
+        //Closes the round, then unsets all the pipes while the model that
+        //knows them is still installed
+        mOv->configDone();
+        mOv->configBegin();
+        mOv->configDone();
+        mdp_wrapper::setDriver(NULL);
+    }
+
+    bool configure(const int& layer, const int& x) {
+        PipeArgs parg(OV_MDP_FLAGS_NONE, Whf(256, 256, MDP_RGBA_8888),
+                static_cast<eZorder>(layer), IS_FG_OFF, ROT_FLAGS_NONE,
+                DEFAULT_PLANE_ALPHA, OVERLAY_BLENDING_PREMULT);
+        mOv->setSource(parg, mDest[layer]);
+        mOv->setTransform(0, mDest[layer]);
+        mOv->setCrop(Dim(0, 0, 256, 256), mDest[layer]);
+        mOv->setPosition(Dim(x, 256 * layer, 256, 256), mDest[layer]);
+        return mOv->commit(mDest[layer]);
+    }
+    bool configureAll(const int& x) {
+        bool ret = true;
+        for(int i = 0; i < NUM_LAYERS; i++)
+            ret = configure(i, x) && ret;
+        return ret;
+    }
+    uint32_t sets() { return mModel.getRequestCount(MdpModel::REQ_SET); }
+    uint32_t prepares() {
+        return mModel.getRequestCount(MdpModel::REQ_PREPARE);
+    }
+
+    enum { NUM_LAYERS = 3 };
+    MdpModel mModel;
+    Overlay *mOv;
+    eDest mDest[NUM_LAYERS];
+    int mNumDest;
+};
+
+TEST_F(OverlayFrameTest, ImmediateCommitsSetEachPipe) {
+    ASSERT_EQ(NUM_LAYERS, mNumDest);
+    EXPECT_TRUE(configureAll(0));
+    EXPECT_EQ((uint32_t)NUM_LAYERS, sets());
+    EXPECT_EQ(0u, prepares());
+    EXPECT_EQ((uint32_t)NUM_LAYERS, mModel.getPipeCount());
+}
+
+TEST_F(OverlayFrameTest, FrameSetsAllPipesInOneRequest) {
+    ASSERT_EQ(NUM_LAYERS, mNumDest);
+    mOv->beginFrame(Overlay::DPY_PRIMARY);
+    EXPECT_TRUE(configureAll(0));
+    //Only recorded so far
+    EXPECT_EQ(0u, sets() + prepares());
+
+    bool status[OV_MAX];
+    EXPECT_TRUE(mOv->commitFrame(Overlay::DPY_PRIMARY, status));
+#ifdef MSMFB_OVERLAY_PREPARE
+    EXPECT_EQ(1u, prepares());
+    EXPECT_EQ(0u, sets());
+#else
+    EXPECT_EQ((uint32_t)NUM_LAYERS, sets());
+#endif
+    EXPECT_EQ((uint32_t)NUM_LAYERS, mModel.getPipeCount());
+    for(int i = 0; i < NUM_LAYERS; i++)
+        EXPECT_TRUE(status[mDest[i]]);
+    printf("%d pipes: %u requests immediate, %u in a frame\n", NUM_LAYERS,
+            (uint32_t)NUM_LAYERS, sets() + prepares());
+}
+
+TEST_F(OverlayFrameTest, UnchangedFrameIssuesNothing) {
+    ASSERT_EQ(NUM_LAYERS, mNumDest);
+    mOv->beginFrame(Overlay::DPY_PRIMARY);
+    EXPECT_TRUE(configureAll(0));
+    EXPECT_TRUE(mOv->commitFrame(Overlay::DPY_PRIMARY));
+    uint32_t before = sets() + prepares();
+
+    mOv->beginFrame(Overlay::DPY_PRIMARY);
+    EXPECT_TRUE(configureAll(0));
+    EXPECT_TRUE(mOv->commitFrame(Overlay::DPY_PRIMARY));
+    EXPECT_EQ(before, sets() + prepares());
+
+    //One moved layer is set on its own
+    mOv->beginFrame(Overlay::DPY_PRIMARY);
+    EXPECT_TRUE(configure(0, 8));
+    EXPECT_TRUE(configure(1, 0));
+    EXPECT_TRUE(configure(2, 0));
+    EXPECT_TRUE(mOv->commitFrame(Overlay::DPY_PRIMARY));
+    EXPECT_EQ(before + 1, sets() + prepares());
+}
+
+TEST_F(OverlayFrameTest, ClearAbandonsTheFrame) {
+    ASSERT_EQ(NUM_LAYERS, mNumDest);
+    mOv->beginFrame(Overlay::DPY_PRIMARY);
+    EXPECT_TRUE(configureAll(0));
+    //A layer failed to configure, the display falls back to GPU
+    mOv->clear(Overlay::DPY_PRIMARY);
+    EXPECT_EQ(0u, sets() + prepares());
+
+    //The FB that replaces it is set right away
+    mOv->configBegin();
+    mDest[0] = mOv->nextPipe(OV_MDP_PIPE_ANY, Overlay::DPY_PRIMARY, 1);
+    ASSERT_NE(OV_INVALID, mDest[0]);
+    EXPECT_TRUE(configure(0, 0));
+    EXPECT_EQ(1u, sets());
+}
+
+TEST_F(OverlayFrameTest, LayersKeepTheirPipesAcrossRounds) {
+    ASSERT_EQ(NUM_LAYERS, mNumDest);
+    EXPECT_TRUE(configureAll(0));
+    mOv->configDone();
+    uint32_t before = sets();
+
+    //Asked for in the other order, each layer gets its pipe back and the
+    //unchanged pipes aren't set again
+    mOv->configBegin();
+    for(int i = NUM_LAYERS - 1; i >= 0; i--) {
+        EXPECT_EQ(mDest[i], mOv->nextPipe(OV_MDP_PIPE_ANY,
+                Overlay::DPY_PRIMARY, i + 1));
+    }
+    EXPECT_TRUE(configureAll(0));
+    mOv->configDone();
+    EXPECT_EQ(before, sets());
+
+    //A new layer asking first takes an unused pipe rather than one of a
+    //layer still to come
+    mOv->configBegin();
+    eDest dest = mOv->nextPipe(OV_MDP_PIPE_ANY, Overlay::DPY_PRIMARY,
+            NUM_LAYERS + 1);
+    ASSERT_NE(OV_INVALID, dest);
+    for(int i = 0; i < NUM_LAYERS; i++) {
+        EXPECT_NE(mDest[i], dest);
+        EXPECT_EQ(mDest[i], mOv->nextPipe(OV_MDP_PIPE_ANY,
+                Overlay::DPY_PRIMARY, i + 1));
+    }
+}
+
+} // namespace
@@ -0,0 +1,418 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "hwc_pipe_solver.h"
+#include "overlayMdpModel.h"
+
+using namespace overlay;
+using namespace overlay::utils;
+using namespace qhwc;
+
+namespace {
+
+const int ALL = (1 << OV_MDP_PIPE_RGB) | (1 << OV_MDP_PIPE_VG) |
+        (1 << OV_MDP_PIPE_DMA);
+const int SCALES = (1 << OV_MDP_PIPE_RGB) | (1 << OV_MDP_PIPE_VG);
+const int YUV = (1 << OV_MDP_PIPE_VG);
+
+PipeDemand demand(int caps, int pipes = 1, int place = PLACE_MDP) {
+    PipeDemand d;
+    d.caps = caps;
+    d.pipes = pipes;
+    d.stages = pipes;
+    d.place = place;
+    d.type = OV_MDP_PIPE_ANY;
+    return d;
+}
+
+/* Pipe inventory of a class of target */
+struct Inventory {
+    const char *mName;
+    MdpModel::Caps mCaps;
+};
+
+void PrintTo(const Inventory& inventory, ::std::ostream* os) {
+    *os << inventory.mName;
+}
+
+/* The pipes left to the layers once the FB took its own, RGB then VG */
+void getLayerPipes(const PipeBudget& budget, const bool& needsFB,
+        int avail[OV_MDP_PIPE_ANY]) {
+    for(int type = 0; type < OV_MDP_PIPE_ANY; type++)
+        avail[type] = budget.avail[type];
+    for(int i = 0; needsFB && i < budget.fbPipes; i++) {
+        if(avail[OV_MDP_PIPE_RGB])
+            avail[OV_MDP_PIPE_RGB]--;
+        else
+            avail[OV_MDP_PIPE_VG]--;
+    }
+}
+
+/* What fitPipeTypes decides, found by trying every type for every demand */
+bool fitsAnyTypes(const PipeDemand *demands, const int& count,
+        const PipeBudget& budget, const bool& needsFB) {
+    int stages = needsFB ? 1 : 0;
+    for(int i = 0; i < count; i++)
+        stages += demands[i].stages;
+    if(stages > budget.maxStages)
+        return false;
+    if(budget.maxLayers >= 0 && count > budget.maxLayers)
+        return false;
+    int avail[OV_MDP_PIPE_ANY];
+    getLayerPipes(budget, needsFB, avail);
+    if(avail[OV_MDP_PIPE_VG] < 0)
+        return false;
+
+    int combos = 1;
+    for(int i = 0; i < count; i++)
+        combos *= OV_MDP_PIPE_ANY;
+    for(int combo = 0; combo < combos; combo++) {
+        int used[OV_MDP_PIPE_ANY] = {0};
+        bool fits = true;
+        for(int i = 0, c = combo; fits && i < count; i++,
+                c /= OV_MDP_PIPE_ANY) {
+            int type = c % OV_MDP_PIPE_ANY;
+            used[type] += demands[i].pipes;
+            fits = (demands[i].caps & (1 << type)) &&
+                    used[type] <= avail[type];
+        }
+        if(fits)
+            return true;
+    }
+    return false;
+}
+
+/* Whether a demand was put on VG while a type it can use had room left */
+bool wastesVg(const PipeDemand *demands, const int& count,
+        const PipeBudget& budget, const bool& needsFB) {
+    int avail[OV_MDP_PIPE_ANY];
+    getLayerPipes(budget, needsFB, avail);
+    for(int i = 0; i < count; i++)
+        avail[demands[i].type] -= demands[i].pipes;
+    for(int i = 0; i < count; i++) {
+        if(demands[i].type != OV_MDP_PIPE_VG)
+            continue;
+        for(int type = 0; type < OV_MDP_PIPE_ANY; type++) {
+            if(type != OV_MDP_PIPE_VG && (demands[i].caps & (1 << type)) &&
+                    avail[type] >= demands[i].pipes)
+                return true;
+        }
+    }
+    return false;
+}
+
+/* Checks solver output against the MDP model of each class of target: the
+ * FB and every layer are set on the type they were given, at the stage
+ * they would blend at */
+class PipeSolverTest : public ::testing::TestWithParam<Inventory> {
+protected:
+    PipeSolverTest() : mModel(GetParam().mCaps), mFd(-1) {}
+
+    virtual void SetUp() {
+        mdp_wrapper::setDriver(&mModel);
+        mFd = mdp_wrapper::openDevice("/dev/graphics/fb0", O_RDWR);
+        ASSERT_GE(mFd, 0);
+    }
+    virtual void TearDown() {
+        mdp_wrapper::closeDevice(mFd);
+        mdp_wrapper::setDriver(NULL);
+    }
+
+    PipeBudget getBudget() {
+        const MdpModel::Caps& caps = GetParam().mCaps;
+        PipeBudget budget;
+        budget.avail[OV_MDP_PIPE_VG] = caps.mNumPipes[MdpModel::PIPE_VG];
+        budget.avail[OV_MDP_PIPE_RGB] = caps.mNumPipes[MdpModel::PIPE_RGB];
+        budget.avail[OV_MDP_PIPE_DMA] = caps.mNumPipes[MdpModel::PIPE_DMA];
+        budget.maxStages = caps.mMaxStages;
+        budget.maxLayers = -1;
+        budget.fbPipes = 1;
+        return budget;
+    }
+    int getPipes(const int& type) {
+        return getBudget().avail[type];
+    }
+
+    bool setPipe(int type, uint32_t z) {
+        mdp_overlay ov;
+        memset(&ov, 0, sizeof(ov));
+        ov.id = MSMFB_NEW_REQUEST;
+        ov.src.width = ov.src_rect.w = ov.dst_rect.w = 64;
+        ov.src.height = ov.src_rect.h = ov.dst_rect.h = 64;
+        //The model puts YUV on VG only and RGB on RGB, then VG
+        ov.src.format = (type == OV_MDP_PIPE_VG) ? MDP_Y_CBCR_H2V2 :
+                MDP_RGBA_8888;
+        if(type == OV_MDP_PIPE_DMA)
+            ov.flags |= MDP_OV_PIPE_FORCE_DMA;
+        ov.z_order = z;
+        return mdp_wrapper::setOverlay(mFd, ov);
+    }
+
+    /* Sets the frame on the model. Layers outside [fbStart, fbStart +
+     * fbCount) are on MDP, fbStart == count puts the FB on top. The FB goes
+     * first, RGB then VG like
+     * getPipeForFb, then the layers by type so that a type overcommitted
+     * by the solver is caught */
+    bool apply(const PipeDemand *demands, int count, int fbStart,
+            int fbCount) {
+        uint32_t z[32];
+        uint32_t fbZ = 0;
+        uint32_t stage = 0;
+        for(int i = 0; i < count; i++) {
+            if(fbCount && i == fbStart) {
+                fbZ = stage++;
+                i += fbCount - 1;
+                continue;
+            }
+            z[i] = stage;
+            stage += demands[i].stages;
+        }
+        if(fbCount && fbStart >= count)
+            fbZ = stage;
+        if(fbCount && !setPipe(OV_MDP_PIPE_RGB, fbZ))
+            return false;
+        static const int order[] = { OV_MDP_PIPE_RGB, OV_MDP_PIPE_DMA,
+                OV_MDP_PIPE_VG };
+        for(int t = 0; t < 3; t++) {
+            for(int i = 0; i < count; i++) {
+                if(fbCount && i >= fbStart && i < fbStart + fbCount)
+                    continue;
+                if(demands[i].type != order[t])
+                    continue;
+                if(!(demands[i].caps & (1 << demands[i].type)))
+                    return false;
+                for(int p = 0; p < demands[i].pipes; p++) {
+                    if(!setPipe(order[t], z[i] + p))
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    MdpModel mModel;
+    int mFd;
+};
+
+TEST_P(PipeSolverTest, FullFrameWithFbFits) {
+    //As much of the frame as the stages take
+    PipeDemand d[3] = { demand(ALL), demand(SCALES), demand(YUV) };
+    int count = getBudget().maxStages - 1;
+    if(count > 3)
+        count = 3;
+    ASSERT_TRUE(fitPipeTypes(d, count, getBudget(), true));
+    EXPECT_FALSE(wastesVg(d, count, getBudget(), true));
+    EXPECT_TRUE(apply(d, count, count, 1));
+}
+
+TEST_P(PipeSolverTest, FbTakesRgbBeforeLayers) {
+    //One RGB and one VG left: the FB takes the RGB pipe, so the layer that
+    //scales has to go on VG. The FB is counted once
+    PipeBudget budget = getBudget();
+    budget.avail[OV_MDP_PIPE_RGB] = 1;
+    budget.avail[OV_MDP_PIPE_VG] = 1;
+    budget.avail[OV_MDP_PIPE_DMA] = 0;
+    PipeDemand d[2] = { demand(SCALES), demand(SCALES) };
+    ASSERT_TRUE(fitPipeTypes(d, 1, budget, true));
+    EXPECT_EQ(OV_MDP_PIPE_VG, d[0].type);
+    EXPECT_FALSE(fitPipeTypes(d, 2, budget, true));
+    EXPECT_EQ(budget.maxStages >= 2, fitPipeTypes(d, 2, budget, false));
+
+    //The model with the other pipes in use elsewhere
+    uint32_t z = 0;
+    for(int i = 1; i < getPipes(OV_MDP_PIPE_RGB); i++)
+        ASSERT_TRUE(setPipe(OV_MDP_PIPE_RGB, z++));
+    for(int i = 1; i < getPipes(OV_MDP_PIPE_VG); i++)
+        ASSERT_TRUE(setPipe(OV_MDP_PIPE_VG, z++));
+    int other = mFd;
+    mFd = mdp_wrapper::openDevice("/dev/graphics/fb1", O_RDWR);
+    ASSERT_TRUE(fitPipeTypes(d, 1, budget, true));
+    EXPECT_TRUE(apply(d, 1, 1, 1));
+    mdp_wrapper::closeDevice(other);
+}
+
+TEST_P(PipeSolverTest, ExactlyFillsEveryType) {
+    //A layer for every pipe, YUV on VG, scaling on RGB and the rest on DMA,
+    //given the stages
+    PipeBudget budget = getBudget();
+    PipeDemand d[32];
+    int count = 0;
+    for(int i = 0; i < budget.avail[OV_MDP_PIPE_VG]; i++)
+        d[count++] = demand(YUV);
+    for(int i = 0; i < budget.avail[OV_MDP_PIPE_RGB]; i++)
+        d[count++] = demand(SCALES);
+    for(int i = 0; i < budget.avail[OV_MDP_PIPE_DMA]; i++)
+        d[count++] = demand(ALL);
+    budget.maxStages = count + 1;
+    ASSERT_TRUE(fitPipeTypes(d, count, budget, false));
+    EXPECT_FALSE(wastesVg(d, count, budget, false));
+    //No pipe is left for the FB
+    EXPECT_FALSE(fitPipeTypes(d, count, budget, true));
+    //As many pipes still, but one YUV more than there are VG
+    d[count - 1] = demand(YUV);
+    EXPECT_FALSE(fitPipeTypes(d, count, budget, false));
+}
+
+TEST_P(PipeSolverTest, YuvNeedsVg) {
+    const int numVg = getPipes(OV_MDP_PIPE_VG);
+    PipeDemand d[32];
+    for(int i = 0; i <= numVg; i++)
+        d[i] = demand(YUV);
+    PipeBudget budget = getBudget();
+    budget.maxStages = numVg + 2;
+    EXPECT_FALSE(fitPipeTypes(d, numVg + 1, budget, false));
+    ASSERT_TRUE(fitPipeTypes(d, numVg, budget, true));
+    EXPECT_TRUE(apply(d, numVg, numVg, 1));
+}
+
+TEST_P(PipeSolverTest, SplitLayersCountStages) {
+    //Source split layers fill the stages, no room for the FB. Each takes
+    //two pipes of a type that scales
+    const int count = getBudget().maxStages / 2;
+    PipeDemand d[2] = { demand(SCALES, 2), demand(SCALES, 2) };
+    ASSERT_LE(count, 2);
+    const bool fits = getPipes(OV_MDP_PIPE_VG) / 2 +
+            getPipes(OV_MDP_PIPE_RGB) / 2 >= count;
+    EXPECT_FALSE(fitPipeTypes(d, count, getBudget(), true));
+    ASSERT_EQ(fits, fitPipeTypes(d, count, getBudget(), false));
+    if(fits) {
+        EXPECT_TRUE(apply(d, count, -1, 0));
+        EXPECT_EQ((uint32_t)(2 * count), mModel.getPipeCount());
+    }
+}
+
+TEST_P(PipeSolverTest, SecondaryLayerLimit) {
+    PipeBudget budget = getBudget();
+    budget.maxLayers = 1;
+    PipeDemand d[2] = { demand(ALL), demand(ALL) };
+    EXPECT_TRUE(fitPipeTypes(d, 1, budget, true));
+    EXPECT_FALSE(fitPipeTypes(d, 2, budget, true));
+}
+
+TEST_P(PipeSolverTest, AgreesWithExhaustiveSearch) {
+    static const int caps[] = { ALL, SCALES, YUV, 1 << OV_MDP_PIPE_RGB,
+            (1 << OV_MDP_PIPE_RGB) | (1 << OV_MDP_PIPE_DMA) };
+    srand(1);
+    int numFits = 0;
+    for(int frame = 0; frame < 2000; frame++) {
+        PipeDemand d[6];
+        int count = 1 + rand() % 6;
+        for(int i = 0; i < count; i++)
+            d[i] = demand(caps[rand() % 5], 1 + (rand() % 4 == 0));
+        bool needsFB = rand() % 2;
+        PipeBudget budget = getBudget();
+        //Stages beyond the mixer's as well, for the pipes to run out first
+        budget.maxStages += rand() % 4;
+
+        bool fits = fitPipeTypes(d, count, budget, needsFB);
+        ASSERT_EQ(fitsAnyTypes(d, count, budget, needsFB), fits)
+                << "frame " << frame;
+        if(!fits)
+            continue;
+        numFits++;
+        EXPECT_FALSE(wastesVg(d, count, budget, needsFB)) << "frame "
+                << frame;
+        if(budget.maxStages == getBudget().maxStages) {
+            mModel.reset();
+            EXPECT_TRUE(apply(d, count, needsFB ? count : -1, needsFB))
+                    << "frame " << frame;
+        }
+    }
+    printf("%s: %d of 2000 frames fit\n", GetParam().mName, numFits);
+    EXPECT_GT(numFits, 0);
+}
+
+TEST_P(PipeSolverTest, MixedModePutsMostLayersOnMdp) {
+    PipeDemand d[5] = { demand(SCALES, 1, PLACE_ANY),
+            demand(SCALES, 1, PLACE_ANY), demand(SCALES, 1, PLACE_ANY),
+            demand(SCALES, 1, PLACE_MDP), demand(SCALES, 1, PLACE_ANY) };
+    //Layers the FB leaves room for on MDP
+    int onMdp = getBudget().maxStages - 1;
+    int scaling = getPipes(OV_MDP_PIPE_VG) + getPipes(OV_MDP_PIPE_RGB) - 1;
+    if(onMdp > scaling)
+        onMdp = scaling;
+    int fbStart = -1, fbCount = 0;
+    bool fits = fitMostPipeTypes(d, 5, getBudget(), fbStart, fbCount);
+    if(onMdp < 2) {
+        //Any batch leaving layer 3 out leaves another one out too
+        EXPECT_FALSE(fits);
+        return;
+    }
+    //Taking the longest cached run, 0-2, would leave 2 layers on MDP.
+    //The shortest batch that fits leaves as many as there is room for
+    ASSERT_TRUE(fits);
+    EXPECT_EQ(5 - onMdp, fbCount);
+    EXPECT_EQ(0, fbStart);
+    EXPECT_TRUE(apply(d, 5, fbStart, fbCount));
+    EXPECT_EQ((uint32_t)(onMdp + 1), mModel.getPipeCount());
+}
+
+TEST_P(PipeSolverTest, MixedModeBatchCoversFbLayers) {
+    PipeDemand d[5] = { demand(SCALES, 1, PLACE_ANY),
+            demand(SCALES, 1, PLACE_MDP), demand(SCALES, 1, PLACE_FB),
+            demand(SCALES, 1, PLACE_ANY), demand(SCALES, 1, PLACE_ANY) };
+    int fbStart = -1, fbCount = 0;
+    bool fits = fitMostPipeTypes(d, 5, getBudget(), fbStart, fbCount);
+    //Layers 0 and 1 stay out of any batch, which covers 2
+    if(getBudget().maxStages < 4) {
+        EXPECT_FALSE(fits);
+        return;
+    }
+    ASSERT_TRUE(fits);
+    EXPECT_EQ(2, fbStart);
+    EXPECT_EQ(2, fbCount);
+    EXPECT_TRUE(apply(d, 5, fbStart, fbCount));
+}
+
+TEST_P(PipeSolverTest, MixedModeFailsWithoutBatch) {
+    PipeDemand d[5];
+    for(int i = 0; i < 5; i++)
+        d[i] = demand(SCALES, 1, PLACE_MDP);
+    int fbStart = -1, fbCount = 0;
+    EXPECT_FALSE(fitMostPipeTypes(d, 5, getBudget(), fbStart, fbCount));
+    //An updating layer between the cached ones splits the run
+    d[0].place = d[2].place = PLACE_ANY;
+    d[1].place = PLACE_MDP;
+    d[3].place = d[4].place = PLACE_MDP;
+    EXPECT_FALSE(fitMostPipeTypes(d, 5, getBudget(), fbStart, fbCount));
+}
+
+const Inventory sInventories[] = {
+    { "MDP3", MdpModel::getMdp3Caps() },
+    { "MDP4", MdpModel::getMdp4Caps() },
+    { "MDSS", MdpModel::getDefaultCaps() },
+};
+
+INSTANTIATE_TEST_CASE_P(Targets, PipeSolverTest,
+        ::testing::ValuesIn(sInventories));
+
+} // namespace
@@ -0,0 +1,94 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <utils/Timers.h>
+#include "prop_cache.h"
+
+using namespace qdutils;
+
+namespace {
+
+enum { NUM_FRAMES = 1000 };
+
+/* What the composition thread did before the cache: a property_get of
+ * each display property, every frame */
+int getAll(int values[PROP_COUNT]) {
+    int sum = 0;
+    char value[PROPERTY_VALUE_MAX];
+    for(int i = 0; i < PROP_COUNT; i++) {
+        values[i] = property_get(PropCache::getName((ePropId)i), value,
+                NULL) > 0 ? atoi(value) : -1;
+        sum += values[i];
+    }
+    return sum;
+}
+
+/* The same values through the cache, refreshed once a frame */
+int refreshAll(PropCache& cache, int values[PROP_COUNT]) {
+    int sum = 0;
+    cache.refresh();
+    for(int i = 0; i < PROP_COUNT; i++) {
+        values[i] = cache.getInt((ePropId)i, -1);
+        sum += values[i];
+    }
+    return sum;
+}
+
+TEST(PropCacheTest, RefreshOutrunsPropertyGet) {
+    PropCache& cache = PropCache::getInstance();
+    int direct[PROP_COUNT];
+    int cached[PROP_COUNT];
+    getAll(direct);
+    refreshAll(cache, cached);
+    for(int i = 0; i < PROP_COUNT; i++) {
+        EXPECT_EQ(direct[i], cached[i]) << PropCache::getName((ePropId)i);
+    }
+
+    //The sums keep the reads from being optimized away
+    volatile int sink = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for(int f = 0; f < NUM_FRAMES; f++)
+        sink += getAll(direct);
+    nsecs_t getTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for(int f = 0; f < NUM_FRAMES; f++)
+        sink += refreshAll(cache, cached);
+    nsecs_t cacheTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    printf("%d properties a frame: property_get %lldns, refresh+getInt "
+            "%lldns\n", (int)PROP_COUNT, (long long)(getTime / NUM_FRAMES),
+            (long long)(cacheTime / NUM_FRAMES));
+    EXPECT_LT(cacheTime, getTime);
+}
+
+} // namespace
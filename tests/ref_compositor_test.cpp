@@ -0,0 +1,328 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <utils/Timers.h>
+#include "overlayRefCompositor.h"
+
+using namespace overlay;
+
+namespace {
+
+uint32_t rgba(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+//x / 255 rounded, straight from the blend equations
+uint32_t mul255(uint32_t x) {
+    return (x * 2 + 255) / 510;
+}
+
+uint32_t refBlend(uint32_t s, uint32_t d, uint32_t op, uint32_t pa) {
+    uint32_t a = s >> 24;
+    uint32_t sa = (op == BLEND_OP_OPAQUE) ? pa : mul255(a * pa);
+    uint32_t sw = (op == BLEND_OP_COVERAGE) ? sa : pa;
+    uint32_t dw = 255 - sa;
+    uint32_t out = 0;
+    for(int c = 0; c < 24; c += 8) {
+        uint32_t v = mul255(((s >> c) & 0xff) * sw + ((d >> c) & 0xff) * dw);
+        out |= (v > 255 ? 255 : v) << c;
+    }
+    return out | ((sa + mul255((d >> 24) * (255 - sa))) << 24);
+}
+
+mdp_overlay makeOv(uint32_t format, uint32_t w, uint32_t h) {
+    mdp_overlay ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.src.width = w;
+    ov.src.height = h;
+    ov.src.format = format;
+    ov.src_rect.w = w;
+    ov.src_rect.h = h;
+    ov.dst_rect.w = w;
+    ov.dst_rect.h = h;
+    ov.alpha = 0xff;
+    ov.blend_op = BLEND_OP_OPAQUE;
+    return ov;
+}
+
+//Same sequence on every libc, for the golden checksum
+uint32_t sSeed;
+uint32_t nextRand() {
+    sSeed = sSeed * 1664525u + 1013904223u;
+    return sSeed;
+}
+
+uint32_t fnv1a(const uint32_t *px, size_t count) {
+    uint32_t h = 2166136261u;
+    const uint8_t *b = reinterpret_cast<const uint8_t*>(px);
+    for(size_t i = 0; i < count * 4; i++)
+        h = (h ^ b[i]) * 16777619u;
+    return h;
+}
+
+TEST(RefCompositorTest, FlipAndUpscaleSampleNearest) {
+    //Red ramp 0, 16, 32, 48 upscaled 2x and mirrored, at 1,1
+    uint32_t src[4];
+    for(int i = 0; i < 4; i++)
+        src[i] = rgba(i * 16, 0, 0, 255);
+    RefCompositor::Layer l;
+    l.mOv = makeOv(MDP_RGBA_8888, 4, 1);
+    l.mOv.dst_rect.x = 1;
+    l.mOv.dst_rect.y = 1;
+    l.mOv.dst_rect.w = 8;
+    l.mOv.dst_rect.h = 2;
+    l.mOv.flags = MDP_FLIP_LR;
+    l.mBuf = reinterpret_cast<const uint8_t*>(src);
+
+    uint32_t px[10 * 4];
+    RefCompositor::Image out = { px, 10, 4, 10 };
+    RefCompositor comp(1);
+    ASSERT_TRUE(comp.compose(&l, 1, out, rgba(0, 0, 0, 255)));
+    const uint32_t expected[10] = { 0, 48, 48, 32, 32, 16, 16, 0, 0, 0 };
+    for(int y = 0; y < 4; y++) {
+        for(int x = 0; x < 10; x++) {
+            uint32_t r = (y == 1 || y == 2) ? expected[x] : 0;
+            EXPECT_EQ(rgba(r, 0, 0, 255), px[y * 10 + x])
+                    << "at " << x << "," << y;
+        }
+    }
+}
+
+TEST(RefCompositorTest, CoverageBlendGolden) {
+    //7 wide covers both the four pixel and the single pixel paths
+    uint32_t src[7];
+    for(int i = 0; i < 7; i++)
+        src[i] = rgba(200, 0, 0, 128);
+    RefCompositor::Layer l;
+    l.mOv = makeOv(MDP_RGBA_8888, 7, 1);
+    l.mOv.blend_op = BLEND_OP_COVERAGE;
+    l.mBuf = reinterpret_cast<const uint8_t*>(src);
+
+    uint32_t px[7];
+    RefCompositor::Image out = { px, 7, 1, 7 };
+    RefCompositor comp(1);
+    ASSERT_TRUE(comp.compose(&l, 1, out, rgba(0, 0, 100, 255)));
+    //200 * 128/255 over 100 * 127/255, worked by hand
+    for(int i = 0; i < 7; i++)
+        EXPECT_EQ(rgba(100, 0, 50, 255), px[i]) << "at " << i;
+}
+
+TEST(RefCompositorTest, BlendOpsMatchEquations) {
+    const uint32_t w = 67;
+    const uint32_t ops[] = { BLEND_OP_OPAQUE, BLEND_OP_PREMULTIPLIED,
+            BLEND_OP_COVERAGE };
+    const uint32_t alphas[] = { 0, 77, 255 };
+    uint32_t src[w];
+    uint32_t bg[w];
+    sSeed = 7;
+    for(uint32_t i = 0; i < w; i++) {
+        src[i] = nextRand();
+        bg[i] = nextRand();
+    }
+    RefCompositor comp(1);
+    for(size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+        for(size_t a = 0; a < sizeof(alphas) / sizeof(alphas[0]); a++) {
+            //The background goes in as an opaque bottom layer
+            RefCompositor::Layer l[2];
+            l[0].mOv = makeOv(MDP_RGBA_8888, w, 1);
+            l[0].mBuf = reinterpret_cast<const uint8_t*>(bg);
+            l[1].mOv = makeOv(MDP_RGBA_8888, w, 1);
+            l[1].mOv.z_order = 1;
+            l[1].mOv.blend_op = ops[o];
+            l[1].mOv.alpha = alphas[a];
+            l[1].mBuf = reinterpret_cast<const uint8_t*>(src);
+            uint32_t px[w];
+            RefCompositor::Image out = { px, w, 1, w };
+            ASSERT_TRUE(comp.compose(l, 2, out, 0));
+            for(uint32_t i = 0; i < w; i++) {
+                EXPECT_EQ(refBlend(src[i], bg[i] | 0xff000000, ops[o],
+                        alphas[a]), px[i]) << "op " << ops[o] << " alpha "
+                        << alphas[a] << " at " << i;
+            }
+        }
+    }
+}
+
+TEST(RefCompositorTest, Nv12ConvertsBt601) {
+    //2x2 luma 16, 235, 81, 145 with neutral chroma
+    uint8_t buf[6] = { 16, 235, 81, 145, 128, 128 };
+    RefCompositor::Layer l;
+    l.mOv = makeOv(MDP_Y_CBCR_H2V2, 2, 2);
+    l.mBuf = buf;
+    uint32_t px[4];
+    RefCompositor::Image out = { px, 2, 2, 2 };
+    RefCompositor comp(1);
+    ASSERT_TRUE(comp.compose(&l, 1, out, 0));
+    EXPECT_EQ(rgba(0, 0, 0, 255), px[0]);
+    EXPECT_EQ(rgba(255, 255, 255, 255), px[1]);
+    EXPECT_EQ(rgba(76, 76, 76, 255), px[2]);
+    EXPECT_EQ(rgba(150, 150, 150, 255), px[3]);
+}
+
+TEST(RefCompositorTest, RejectsUnsupportedFormat) {
+    uint8_t buf[16] = { 0 };
+    RefCompositor::Layer l;
+    l.mOv = makeOv(MDP_YCRYCB_H2V1, 2, 2);
+    l.mBuf = buf;
+    uint32_t px[4];
+    RefCompositor::Image out = { px, 2, 2, 2 };
+    RefCompositor comp(1);
+    EXPECT_FALSE(comp.compose(&l, 1, out, rgba(1, 2, 3, 4)));
+    for(int i = 0; i < 4; i++)
+        EXPECT_EQ(rgba(1, 2, 3, 4), px[i]);
+}
+
+//Checksum of the scene below, from the scalar compositor this one replaced
+const uint32_t GOLDEN_SCENE_HASH = 312970513u;
+
+//A scaled, flipped and blended scene composed by the pool matches the
+//caller alone, and the golden checksum, on repeated frames
+TEST(RefCompositorTest, PoolMatchesGoldenScene) {
+    const uint32_t w = 360, h = 640;
+    uint32_t *rgbaBuf = new uint32_t[w * h];
+    uint8_t *nv12 = new uint8_t[w * h * 3 / 2];
+    sSeed = 11;
+    for(uint32_t i = 0; i < w * h; i++)
+        rgbaBuf[i] = nextRand();
+    for(uint32_t i = 0; i < w * h * 3 / 2; i++)
+        nv12[i] = nextRand() >> 24;
+
+    RefCompositor::Layer l[3];
+    l[0].mOv = makeOv(MDP_Y_CBCR_H2V2, w, h);
+    l[0].mOv.dst_rect.w = 300;
+    l[0].mOv.dst_rect.h = 500;
+    l[0].mBuf = nv12;
+    l[1].mOv = makeOv(MDP_RGBA_8888, w, h);
+    l[1].mOv.src_rect.x = 10;
+    l[1].mOv.src_rect.w = 200;
+    l[1].mOv.src_rect.h = 300;
+    l[1].mOv.dst_rect.x = 40;
+    l[1].mOv.dst_rect.y = 100;
+    l[1].mOv.dst_rect.w = 320;
+    l[1].mOv.dst_rect.h = 500;
+    l[1].mOv.z_order = 1;
+    l[1].mOv.flags = MDP_FLIP_LR | MDP_FLIP_UD;
+    l[1].mOv.blend_op = BLEND_OP_PREMULTIPLIED;
+    l[1].mOv.alpha = 200;
+    l[1].mBuf = reinterpret_cast<const uint8_t*>(rgbaBuf);
+    l[2].mOv = makeOv(MDP_RGBA_8888, w, h);
+    l[2].mOv.dst_rect.w = 90;
+    l[2].mOv.dst_rect.h = 160;
+    l[2].mOv.z_order = 2;
+    l[2].mOv.blend_op = BLEND_OP_COVERAGE;
+    l[2].mBuf = reinterpret_cast<const uint8_t*>(rgbaBuf);
+
+    uint32_t *single = new uint32_t[w * h];
+    uint32_t *pooled = new uint32_t[w * h];
+    RefCompositor::Image a = { single, w, h, w };
+    RefCompositor::Image b = { pooled, w, h, w };
+    RefCompositor one(1);
+    RefCompositor pool(RefCompositor::MAX_THREADS);
+    ASSERT_TRUE(one.compose(l, 3, a, rgba(0, 0, 0, 255)));
+    for(int frame = 0; frame < 3; frame++) {
+        memset(pooled, 0, w * h * 4);
+        ASSERT_TRUE(pool.compose(l, 3, b, rgba(0, 0, 0, 255)));
+        ASSERT_EQ(0, memcmp(single, pooled, w * h * 4)) << "frame " << frame;
+    }
+    EXPECT_EQ(GOLDEN_SCENE_HASH, fnv1a(single, w * h));
+
+    delete [] pooled;
+    delete [] single;
+    delete [] nv12;
+    delete [] rgbaBuf;
+}
+
+} // namespace
+
+//Time per frame of a compositor on the 1080p scene, over a few frames
+nsecs_t timeFrames(RefCompositor& comp, const RefCompositor::Layer l[],
+        int count, RefCompositor::Image& out) {
+    const int frames = 10;
+    comp.compose(l, count, out, 0);
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for(int i = 0; i < frames; i++)
+        comp.compose(l, count, out, 0);
+    return (systemTime(SYSTEM_TIME_MONOTONIC) - start) / frames;
+}
+
+//Replay speed at 1080p: full screen NV12 video, a full screen premultiplied
+//UI layer and an upscaled coverage blended layer. Near real time is a frame
+//within a 60 fps vsync; the result is printed as measured, against that
+//budget, on the caller alone and on the pool
+TEST(RefCompositorTest, Replays1080pFrames) {
+    const uint32_t w = 1080, h = 1920;
+    const nsecs_t budget = 1000000000LL / 60;
+    uint32_t *rgbaBuf = new uint32_t[w * h];
+    uint8_t *nv12 = new uint8_t[w * h * 3 / 2];
+    sSeed = 5;
+    for(uint32_t i = 0; i < w * h; i++)
+        rgbaBuf[i] = nextRand();
+    for(uint32_t i = 0; i < w * h * 3 / 2; i++)
+        nv12[i] = nextRand() >> 24;
+
+    RefCompositor::Layer l[3];
+    l[0].mOv = makeOv(MDP_Y_CBCR_H2V2, w, h);
+    l[0].mBuf = nv12;
+    l[1].mOv = makeOv(MDP_RGBA_8888, w, h);
+    l[1].mOv.z_order = 1;
+    l[1].mOv.blend_op = BLEND_OP_PREMULTIPLIED;
+    l[1].mBuf = reinterpret_cast<const uint8_t*>(rgbaBuf);
+    l[2].mOv = makeOv(MDP_RGBA_8888, w, h);
+    l[2].mOv.src_rect.w = w / 2;
+    l[2].mOv.src_rect.h = h / 2;
+    l[2].mOv.z_order = 2;
+    l[2].mOv.blend_op = BLEND_OP_COVERAGE;
+    l[2].mBuf = reinterpret_cast<const uint8_t*>(rgbaBuf);
+
+    uint32_t *single = new uint32_t[w * h];
+    uint32_t *pooled = new uint32_t[w * h];
+    RefCompositor::Image a = { single, w, h, w };
+    RefCompositor::Image b = { pooled, w, h, w };
+    RefCompositor one(1);
+    RefCompositor pool(RefCompositor::MAX_THREADS);
+    nsecs_t oneTime = timeFrames(one, l, 3, a);
+    nsecs_t poolTime = timeFrames(pool, l, 3, b);
+    EXPECT_EQ(0, memcmp(single, pooled, w * h * 4));
+
+    const char *names[2] = { "1 thread", "pool" };
+    const nsecs_t times[2] = { oneTime, poolTime };
+    for(int i = 0; i < 2; i++) {
+        printf("1080p 3 layers, %s: %.1f ms/frame, %.1f fps, %s the "
+                "%.1f ms budget by %.1f ms\n", names[i], times[i] / 1e6,
+                1e9 / times[i], times[i] <= budget ? "within" : "over",
+                budget / 1e6, (times[i] > budget ? times[i] - budget :
+                budget - times[i]) / 1e6);
+    }
+
+    delete [] pooled;
+    delete [] single;
+    delete [] nv12;
+    delete [] rgbaBuf;
+}
@@ -0,0 +1,156 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <utils/Timers.h>
+#include "overlayRotator.h"
+
+using namespace overlay;
+
+namespace {
+
+//Stands in for the rotator writing slots and for the display releasing them.
+//Release fences come off a sw_sync timeline the test advances.
+class RotMemTest : public ::testing::Test {
+protected:
+    RotMemTest() : mTimeline(-1), mValue(0) {}
+
+    virtual void SetUp() {
+        RotMgr::getInstance()->clear();
+        mTimeline = sw_sync_timeline_create();
+        if(mTimeline < 0)
+            printf("sw_sync not available, skipping\n");
+    }
+    virtual void TearDown() {
+        RotMgr::getInstance()->clear();
+        if(mTimeline >= 0)
+            close(mTimeline);
+    }
+
+    bool haveSync() const { return mTimeline >= 0; }
+
+    //A fence the display signals on its next release
+    int pendingFence() {
+        return sw_sync_fence_create(mTimeline, "rot_mem_test", mValue + 1);
+    }
+    void release() {
+        sw_sync_timeline_inc(mTimeline, 1);
+        mValue++;
+    }
+
+    static bool openMem(RotMem::Mem& mem, const uint32_t& numBufs) {
+        return RotMgr::getInstance()->getMem(mem.m, numBufs, BUF_SZ, false);
+    }
+
+    enum { BUF_SZ = 4096 };
+    int mTimeline;
+    unsigned mValue;
+};
+
+TEST_F(RotMemTest, CloseDoesNotWaitOnTheDisplay) {
+    if(!haveSync()) return;
+    RotMem::Mem mem;
+    ASSERT_TRUE(openMem(mem, 2));
+    mem.setReleaseFd(pendingFence());
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    EXPECT_TRUE(mem.close());
+    EXPECT_LT(systemTime(SYSTEM_TIME_MONOTONIC) - start, ms2ns(100));
+
+    //The pool took the fence along with the buffers
+    EXPECT_FALSE(mem.valid());
+    for(int i = 0; i < RotMem::Mem::ROT_MAX_BUFS; i++)
+        EXPECT_EQ(-1, mem.mRelFence[i]);
+}
+
+TEST_F(RotMemTest, PoolHoldsMemTheDisplayStillReads) {
+    if(!haveSync()) return;
+    RotMem::Mem mem;
+    ASSERT_TRUE(openMem(mem, 2));
+    const int busyFd = mem.m.getFD();
+    mem.setReleaseFd(pendingFence());
+    ASSERT_TRUE(mem.close());
+
+    //Same shape, but still on screen: a new session gets fresh buffers
+    RotMem::Mem other;
+    ASSERT_TRUE(openMem(other, 2));
+    EXPECT_NE(busyFd, other.m.getFD());
+
+    //Once released the pooled buffers are handed out again
+    release();
+    RotMem::Mem reused;
+    ASSERT_TRUE(openMem(reused, 2));
+    EXPECT_EQ(busyFd, reused.m.getFD());
+
+    EXPECT_TRUE(other.close());
+    EXPECT_TRUE(reused.close());
+}
+
+TEST_F(RotMemTest, NextSlotSkipsSlotsInFlight) {
+    if(!haveSync()) return;
+    RotMem::Mem mem;
+    ASSERT_TRUE(openMem(mem, 3));
+
+    //Frames 1 and 2 stay on screen, the ring moves past them
+    mem.setReleaseFd(pendingFence());
+    mem.nextSlot();
+    EXPECT_EQ(1u, mem.mCurrOffset);
+    mem.setReleaseFd(sw_sync_fence_create(mTimeline, "rot_mem_test",
+            mValue + 2));
+    mem.nextSlot();
+    EXPECT_EQ(2u, mem.mCurrOffset);
+    EXPECT_TRUE(mem.isBusy());
+
+    //The display lets go of frame 1, the ring wraps around to its slot
+    release();
+    mem.nextSlot();
+    EXPECT_EQ(0u, mem.mCurrOffset);
+    EXPECT_EQ(0u, mem.mStalls);
+    EXPECT_TRUE(mem.isBusy());
+
+    release();
+    EXPECT_FALSE(mem.isBusy());
+    EXPECT_TRUE(mem.close());
+}
+
+TEST_F(RotMemTest, NextSlotCyclesWithoutFences) {
+    RotMem::Mem mem;
+    ASSERT_TRUE(openMem(mem, 3));
+    for(uint32_t i = 1; i <= 6; i++) {
+        mem.nextSlot();
+        EXPECT_EQ(i % 3, mem.mCurrOffset);
+    }
+    EXPECT_EQ(0u, mem.mStalls);
+    EXPECT_FALSE(mem.isBusy());
+    EXPECT_TRUE(mem.close());
+}
+
+} // namespace
@@ -0,0 +1,147 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include "overlayRotator.h"
+#include "overlayMdpModel.h"
+
+using namespace overlay;
+
+namespace {
+
+//Drives RotMgr the way a composition cycle does, without committing the
+//sessions to the rotator. The model serves the nodes the sessions open.
+class RotSessionTest : public ::testing::Test {
+protected:
+    RotSessionTest() : mModel(MdpModel::getDefaultCaps()),
+        mMgr(RotMgr::getInstance()),
+        mVideoA(1280, 720, MDP_Y_CBCR_H2V2),
+        mVideoB(1920, 1080, MDP_Y_CBCR_H2V2),
+        mVideoC(1280, 720, MDP_Y_CRCB_H2V2) {}
+
+    virtual void SetUp() {
+        mdp_wrapper::setDriver(&mModel);
+        mMgr->clear();
+    }
+    virtual void TearDown() {
+        mMgr->clear();
+        mdp_wrapper::setDriver(NULL);
+    }
+
+    //Reads the bypass totals back from the dump
+    bool getBypassed(uint32_t& layers, unsigned long long& savedKb) {
+        char buf[4096] = {'\0'};
+        mMgr->getDump(buf, sizeof(buf));
+        const char *line = strstr(buf, "Rotator bypassed");
+        return line && sscanf(line, "Rotator bypassed layers=%u saved=%lluKB",
+                &layers, &savedKb) == 2;
+    }
+
+    MdpModel mModel;
+    RotMgr *mMgr;
+    utils::Whf mVideoA;
+    utils::Whf mVideoB;
+    utils::Whf mVideoC;
+};
+
+TEST_F(RotSessionTest, SameSourceGetsItsSession) {
+    mMgr->configBegin();
+    Rotator *a = mMgr->getNext(mVideoA);
+    Rotator *b = mMgr->getNext(mVideoB);
+    ASSERT_TRUE(a != NULL && b != NULL);
+    mMgr->configDone();
+
+    //The layers come back in the other order
+    mMgr->configBegin();
+    EXPECT_EQ(b, mMgr->getNext(mVideoB));
+    EXPECT_EQ(a, mMgr->getNext(mVideoA));
+    mMgr->configDone();
+}
+
+TEST_F(RotSessionTest, OtherSourceLeavesIdleSessionAlone) {
+    if(RotMgr::isPipeBacked()) return;
+    mMgr->configBegin();
+    Rotator *a = mMgr->getNext(mVideoA);
+    mMgr->configDone();
+
+    //Same size, other format: not a's session
+    mMgr->configBegin();
+    Rotator *c = mMgr->getNext(mVideoC);
+    EXPECT_NE(a, c);
+    mMgr->configDone();
+    EXPECT_EQ(1u, mMgr->getIdleSessCount());
+
+    mMgr->configBegin();
+    EXPECT_EQ(a, mMgr->getNext(mVideoA));
+    mMgr->configDone();
+}
+
+TEST_F(RotSessionTest, PipeBackedSessionsEndWithTheFrame) {
+    mMgr->configBegin();
+    ASSERT_TRUE(mMgr->getNext(mVideoA) != NULL);
+    mMgr->configDone();
+
+    mMgr->configBegin();
+    mMgr->configDone();
+    EXPECT_EQ(RotMgr::isPipeBacked() ? 0u : 1u, mMgr->getIdleSessCount());
+}
+
+TEST_F(RotSessionTest, DroppedSessionIsHandedOutAgain) {
+    mMgr->configBegin();
+    mMgr->getNext(mVideoA);
+    Rotator *b = mMgr->getNext(mVideoB);
+    //The display that took b fell back to GPU
+    mMgr->markUnusedTop(1);
+    EXPECT_EQ(b, mMgr->getNext(mVideoB));
+    mMgr->configDone();
+}
+
+TEST_F(RotSessionTest, RunsOutOfSessions) {
+    mMgr->configBegin();
+    for(int i = 0; i < RotMgr::MAX_ROT_SESS; i++)
+        EXPECT_TRUE(mMgr->getNext(mVideoA) != NULL);
+    EXPECT_TRUE(mMgr->getNext(mVideoA) == NULL);
+    mMgr->configDone();
+}
+
+TEST_F(RotSessionTest, DumpsBypassedTraffic) {
+    uint32_t layers = 0, layersAfter = 0;
+    unsigned long long savedKb = 0, savedKbAfter = 0;
+    ASSERT_TRUE(getBypassed(layers, savedKb));
+    //A 1MB frame fetched flipped spares the rotator writing it and the
+    //pipe reading it back
+    mMgr->addBypassed(1 << 20);
+    ASSERT_TRUE(getBypassed(layersAfter, savedKbAfter));
+    EXPECT_EQ(layers + 1, layersAfter);
+    EXPECT_EQ(savedKb + 2048, savedKbAfter);
+}
+
+} // namespace
@@ -0,0 +1,321 @@
+/*
+* Copyright (c) 2013, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*    * Redistributions of source code must retain the above copyright
+*      notice, this list of conditions and the following disclaimer.
+*    * Redistributions in binary form must reproduce the above
+*      copyright notice, this list of conditions and the following
+*      disclaimer in the documentation and/or other materials provided
+*      with the distribution.
+*    * Neither the name of The Linux Foundation nor the names of its
+*      contributors may be used to endorse or promote products derived
+*      from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <math.h>
+#include "software_converter.h"
+
+namespace {
+
+//Same sequence on every libc, for the golden checksums
+uint32_t sSeed;
+uint32_t nextRand() {
+    sSeed = sSeed * 1664525u + 1013904223u;
+    return sSeed;
+}
+
+uint32_t fnv1a(const unsigned char *b, size_t len) {
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < len; i++)
+        h = (h ^ b[i]) * 16777619u;
+    return h;
+}
+
+//A gralloc buffer as copybit sees it. private_handle_t keeps the base as
+//an int, so the memory is mapped rather than taken from the heap.
+struct Buffer {
+    Buffer(const int& format, const int& w, const int& h, const int& size) :
+        mHnd(-1, size, 0, 0, format, w, h), mLen(size) {
+        mMem = mmap(NULL, mLen, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        mHnd.base = (mMem == MAP_FAILED) ? 0 : (int)(intptr_t)mMem;
+        memset(&mImg, 0, sizeof(mImg));
+        mImg.w = w;
+        mImg.h = h;
+        mImg.format = format;
+        mImg.base = mMem;
+        mImg.handle = &mHnd;
+    }
+    ~Buffer() {
+        if(mMem != MAP_FAILED)
+            munmap(mMem, mLen);
+    }
+    bool valid() const { return mHnd.base != 0; }
+    unsigned char *data() { return (unsigned char *)mMem; }
+
+    private_handle_t mHnd;
+    copybit_image_t mImg;
+    void *mMem;
+    size_t mLen;
+};
+
+int yuvSize(const int& format, const int& w, const int& h) {
+    if(format == HAL_PIXEL_FORMAT_YV12)
+        return w * h + 2 * ALIGN(w / 2, 16) * (h / 2);
+    return w * h * 3 / 2;
+}
+
+//A frame of noise, so that a wrong sample shows in the checksum
+void fillNoise(Buffer& b) {
+    for(size_t i = 0; i < b.mLen; i++)
+        b.data()[i] = nextRand() >> 24;
+}
+
+//The samples of pixel (x, y) of a w wide frame, chroma taken from the 2x2
+//block the pixel is in
+void getYuv(Buffer& b, const int& format, const int& w, const int& h,
+        const int& x, const int& y, int& luma, int& cb, int& cr) {
+    const unsigned char *p = b.data();
+    luma = p[y * w + x];
+    p += w * h;
+    if(format == HAL_PIXEL_FORMAT_YV12) {
+        //Cr plane, then Cb plane
+        int cStride = ALIGN(w / 2, 16);
+        cr = p[(y / 2) * cStride + x / 2];
+        cb = p[cStride * (h / 2) + (y / 2) * cStride + x / 2];
+        return;
+    }
+    const unsigned char *c = p + (y / 2) * w + (x / 2) * 2;
+    cb = (format == HAL_PIXEL_FORMAT_YCbCr_420_SP) ? c[0] : c[1];
+    cr = (format == HAL_PIXEL_FORMAT_YCbCr_420_SP) ? c[1] : c[0];
+}
+
+//The BT.601 and BT.709 equations in float, from the luma weights of red
+//and blue. Limited range stretches luma from 16-235 and chroma from 16-240.
+void yuvToRgb(const float& kr, const float& kb, const bool& fullRange,
+        const int& luma, const int& cb, const int& cr, int rgb[3]) {
+    const float kg = 1.0f - kr - kb;
+    float ys = fullRange ? 1.0f : 255.0f / 219.0f;
+    float cs = fullRange ? 1.0f : 255.0f / 224.0f;
+    float y = ys * (luma - (fullRange ? 0 : 16));
+    float u = cs * (cb - 128);
+    float v = cs * (cr - 128);
+    float out[3] = { y + 2.0f * (1.0f - kr) * v,
+            y - (2.0f * (1.0f - kb) * kb * u + 2.0f * (1.0f - kr) * kr * v) /
+            kg,
+            y + 2.0f * (1.0f - kb) * u };
+    for(int i = 0; i < 3; i++) {
+        int c = (int)floorf(out[i] + 0.5f);
+        rgb[i] = c < 0 ? 0 : (c > 255 ? 255 : c);
+    }
+}
+
+copybit_rect_t rect(int l, int t, int r, int b) {
+    copybit_rect_t rc = {l, t, r, b};
+    return rc;
+}
+
+class SoftwareConverterTest : public ::testing::Test {
+protected:
+    virtual void SetUp() { sSeed = 1; }
+
+    //Converts a noise frame and returns the checksum of the whole dst
+    uint32_t convert(const int& srcFormat, const int& srcW, const int& srcH,
+            const int& dstFormat, const int& dstW, const int& dstH,
+            const copybit_rect_t& dstRect, const copybit_rect_t& srcRect,
+            const copybit_rect_t& clip, const int& transform,
+            const int& flags = 0) {
+        Buffer src(srcFormat, srcW, srcH, yuvSize(srcFormat, srcW, srcH));
+        int bpp = (dstFormat == HAL_PIXEL_FORMAT_RGB_565) ? 2 : 4;
+        Buffer dst(dstFormat, dstW, dstH, dstW * dstH * bpp);
+        EXPECT_TRUE(src.valid() && dst.valid());
+        if(!src.valid() || !dst.valid())
+            return 0;
+        src.mHnd.flags |= flags;
+        fillNoise(src);
+        EXPECT_EQ(0, convert_yuv_to_rgb(&dst.mImg, &src.mImg, &dstRect,
+                &srcRect, &clip, transform));
+        return fnv1a(dst.data(), dst.mLen);
+    }
+};
+
+TEST_F(SoftwareConverterTest, ConvertsReferenceColors) {
+    //Limited range BT.601: white, black and pure red
+    const unsigned char yuv[3][3] = {{235, 128, 128}, {16, 128, 128},
+                                     {81, 90, 240}};
+    const unsigned char rgb[3][3] = {{255, 255, 255}, {0, 0, 0},
+                                     {255, 0, 0}};
+    for(int c = 0; c < 3; c++) {
+        Buffer src(HAL_PIXEL_FORMAT_YCbCr_420_SP, 2, 2, 6);
+        Buffer dst(HAL_PIXEL_FORMAT_RGBA_8888, 2, 2, 16);
+        ASSERT_TRUE(src.valid() && dst.valid());
+        memset(src.data(), yuv[c][0], 4);
+        src.data()[4] = yuv[c][1];
+        src.data()[5] = yuv[c][2];
+        copybit_rect_t all = rect(0, 0, 2, 2);
+        ASSERT_EQ(0, convert_yuv_to_rgb(&dst.mImg, &src.mImg, &all, &all,
+                &all, 0));
+        for(int i = 0; i < 4; i++) {
+            EXPECT_NEAR(rgb[c][0], dst.data()[i * 4 + 0], 1);
+            EXPECT_NEAR(rgb[c][1], dst.data()[i * 4 + 1], 1);
+            EXPECT_NEAR(rgb[c][2], dst.data()[i * 4 + 2], 1);
+            EXPECT_EQ(0xFF, dst.data()[i * 4 + 3]);
+        }
+    }
+}
+
+TEST_F(SoftwareConverterTest, ConvertsNoiseLikeTheEquations) {
+    //Every source format and color space at 1:1, pixels spread over the
+    //frame checked against the float equations
+    const int w = 64, h = 32;
+    const int formats[] = { HAL_PIXEL_FORMAT_YCbCr_420_SP,
+            HAL_PIXEL_FORMAT_YCrCb_420_SP, HAL_PIXEL_FORMAT_YV12 };
+    struct Space {
+        const char *name;
+        int flags;
+        float kr;
+        float kb;
+        bool fullRange;
+    } spaces[] = {
+        {"bt601", 0, 0.299f, 0.114f, false},
+        {"bt601 full range", private_handle_t::PRIV_FLAGS_ITU_R_601_FR,
+         0.299f, 0.114f, true},
+        {"bt709", private_handle_t::PRIV_FLAGS_ITU_R_709, 0.2126f, 0.0722f,
+         false},
+    };
+    for(size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for(size_t s = 0; s < sizeof(spaces) / sizeof(spaces[0]); s++) {
+            Buffer src(formats[f], w, h, yuvSize(formats[f], w, h));
+            Buffer dst(HAL_PIXEL_FORMAT_RGBA_8888, w, h, w * h * 4);
+            ASSERT_TRUE(src.valid() && dst.valid());
+            src.mHnd.flags |= spaces[s].flags;
+            fillNoise(src);
+            copybit_rect_t all = rect(0, 0, w, h);
+            ASSERT_EQ(0, convert_yuv_to_rgb(&dst.mImg, &src.mImg, &all,
+                    &all, &all, 0));
+            for(int i = 0; i < w * h; i += 37) {
+                int x = i % w, y = i / w;
+                int luma, cb, cr, rgb[3];
+                getYuv(src, formats[f], w, h, x, y, luma, cb, cr);
+                yuvToRgb(spaces[s].kr, spaces[s].kb, spaces[s].fullRange,
+                        luma, cb, cr, rgb);
+                const unsigned char *px = dst.data() + i * 4;
+                for(int c = 0; c < 3; c++) {
+                    EXPECT_NEAR(rgb[c], px[c], 1) << spaces[s].name <<
+                            " format " << formats[f] << " pixel " << x <<
+                            "," << y << " yuv " << luma << "," << cb <<
+                            "," << cr;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(SoftwareConverterTest, RotatesAndFlips) {
+    //A 2x2 luma ramp, rotated by 90 clockwise: dst row 0 is src column 0
+    //read bottom up
+    Buffer src(HAL_PIXEL_FORMAT_YCbCr_420_SP, 2, 2, 6);
+    Buffer dst(HAL_PIXEL_FORMAT_RGBA_8888, 2, 2, 16);
+    ASSERT_TRUE(src.valid() && dst.valid());
+    const unsigned char luma[4] = {16, 80, 160, 235};
+    memcpy(src.data(), luma, 4);
+    src.data()[4] = src.data()[5] = 128;
+    copybit_rect_t all = rect(0, 0, 2, 2);
+    ASSERT_EQ(0, convert_yuv_to_rgb(&dst.mImg, &src.mImg, &all, &all, &all,
+            COPYBIT_TRANSFORM_ROT_90));
+    const int expect[4] = {2, 0, 3, 1};
+    for(int i = 0; i < 4; i++) {
+        unsigned char y = luma[expect[i]];
+        unsigned char g = dst.data()[i * 4 + 1];
+        EXPECT_NEAR((y - 16) * 255 / 219, g, 1) << "pixel " << i;
+    }
+}
+
+//Checksums of the conversion as it was first written, before its tables
+//and threads were kept across blits. They only guard against regressions,
+//ConvertsNoiseLikeTheEquations checks the values themselves.
+//The noise frames go through every source format, both chroma orders,
+//scaling, the transforms, clipping and the three color spaces.
+TEST_F(SoftwareConverterTest, MatchesGoldenOutput) {
+    const copybit_rect_t full = rect(0, 0, 640, 360);
+    const copybit_rect_t big = rect(0, 0, 1280, 720);
+    struct Case {
+        const char *name;
+        int srcFormat;
+        int dstFormat;
+        copybit_rect_t dstRect;
+        copybit_rect_t srcRect;
+        copybit_rect_t clip;
+        int transform;
+        int flags;
+        uint32_t golden;
+    } cases[] = {
+        {"nv12 1:1", HAL_PIXEL_FORMAT_YCbCr_420_SP,
+         HAL_PIXEL_FORMAT_RGBA_8888, full, full, full, 0, 0, 765568752u},
+        {"nv21 bgra", HAL_PIXEL_FORMAT_YCrCb_420_SP,
+         HAL_PIXEL_FORMAT_BGRA_8888, full, full, full, 0, 0, 2578664792u},
+        {"yv12 565", HAL_PIXEL_FORMAT_YV12, HAL_PIXEL_FORMAT_RGB_565,
+         full, full, full, 0, 0, 183076807u},
+        {"nv12 upscale", HAL_PIXEL_FORMAT_YCbCr_420_SP,
+         HAL_PIXEL_FORMAT_RGBX_8888, big, rect(40, 20, 600, 340), big, 0,
+         private_handle_t::PRIV_FLAGS_ITU_R_709, 3176322785u},
+        {"nv21 downscale rot90", HAL_PIXEL_FORMAT_YCrCb_420_SP,
+         HAL_PIXEL_FORMAT_RGBA_8888, rect(100, 50, 300, 405), full,
+         big, COPYBIT_TRANSFORM_ROT_90, 0, 2678042888u},
+        {"yv12 rot270 clipped", HAL_PIXEL_FORMAT_YV12,
+         HAL_PIXEL_FORMAT_RGBA_8888, rect(0, 0, 720, 1280), full,
+         rect(100, 200, 600, 1000), COPYBIT_TRANSFORM_ROT_270,
+         private_handle_t::PRIV_FLAGS_ITU_R_601_FR, 564153693u},
+        {"nv12 flips", HAL_PIXEL_FORMAT_YCbCr_420_SP,
+         HAL_PIXEL_FORMAT_RGB_565, big, full, rect(-10, 300, 2000, 710),
+         COPYBIT_TRANSFORM_ROT_180, 0, 1741796397u},
+    };
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const Case& c = cases[i];
+        int dstW = (c.transform & COPYBIT_TRANSFORM_ROT_90) ? 720 : 1280;
+        int dstH = (c.transform & COPYBIT_TRANSFORM_ROT_90) ? 1280 : 720;
+        EXPECT_EQ(c.golden, convert(c.srcFormat, 640, 360, c.dstFormat,
+                dstW, dstH, c.dstRect, c.srcRect, c.clip, c.transform,
+                c.flags)) << c.name;
+    }
+}
+
+TEST_F(SoftwareConverterTest, GeometryChangesBetweenBlits) {
+    //The same blit gives the same result around blits of other geometry
+    const copybit_rect_t full = rect(0, 0, 640, 360);
+    const copybit_rect_t big = rect(0, 0, 1280, 720);
+    uint32_t first = convert(HAL_PIXEL_FORMAT_YCbCr_420_SP, 640, 360,
+            HAL_PIXEL_FORMAT_RGBA_8888, 1280, 720, big, full, big, 0);
+    sSeed = 1;
+    convert(HAL_PIXEL_FORMAT_YCbCr_420_SP, 640, 360,
+            HAL_PIXEL_FORMAT_RGBA_8888, 720, 1280, rect(0, 0, 720, 1280),
+            rect(8, 8, 632, 352), rect(0, 0, 720, 1280),
+            COPYBIT_TRANSFORM_ROT_90);
+    sSeed = 1;
+    convert(HAL_PIXEL_FORMAT_YCbCr_420_SP, 640, 360,
+            HAL_PIXEL_FORMAT_RGBA_8888, 1280, 720, rect(0, 0, 64, 36),
+            full, big, COPYBIT_TRANSFORM_FLIP_H);
+    sSeed = 1;
+    EXPECT_EQ(first, convert(HAL_PIXEL_FORMAT_YCbCr_420_SP, 640, 360,
+            HAL_PIXEL_FORMAT_RGBA_8888, 1280, 720, big, full, big, 0));
+}
+
+} // namespace